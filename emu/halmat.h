@@ -20,6 +20,7 @@
 #define HALMAT_DATA_SIZE    (1 << 20)   /* 1 MB data segment */
 #define HALMAT_LIT_STR_POOL 16384       /* character literal string pool */
 #define HALMAT_MAX_UNITS    16
+#define HALMAT_MAX_UPDATE   16          /* nested UPDATE blocks */
 
 /* Operator word: [TAG:8][NUMOP:8][CLASS:4][OPCODE:8][COPT:3][0:1] */
 #define HALMAT_IS_OP(w)       (((w) & 1) == 0)
@@ -96,6 +97,12 @@
 #define POP_EDCL  0x031
 #define POP_RTRN  0x032
 #define POP_TDCL  0x033
+#define POP_WAIT  0x034
+#define POP_SGNL  0x035
+#define POP_CANC  0x036
+#define POP_TERM  0x037
+#define POP_PRIO  0x038
+#define POP_SCHD  0x039
 #define POP_SFST  0x045
 #define POP_SFND  0x046
 #define POP_SFAR  0x047
@@ -106,6 +113,8 @@
 #define POP_TASN  0x04F
 #define POP_IDEF  0x051
 #define POP_ICLS  0x052
+#define POP_NNEQ  0x055
+#define POP_NEQU  0x056
 #define POP_NASN  0x057
 
 /* Class 1: Bit */
@@ -226,6 +235,8 @@
 
 #define HALMAT_OK              0
 #define HALMAT_HALT            1
+#define HALMAT_SWITCH          2    /* process moved off this worker thread */
+#define HALMAT_TRAP            3    /* stopped at a debugger breakpoint */
 #define HALMAT_ERR_UNKNOWN    -1
 #define HALMAT_ERR_BAD_OP     -2
 #define HALMAT_ERR_BAD_QUAL   -3
@@ -234,6 +245,7 @@
 #define HALMAT_ERR_STACK      -6
 #define HALMAT_ERR_BOUNDS     -7
 #define HALMAT_ERR_DIV_ZERO   -8
+#define HALMAT_ERR_NULL_NAME  -9    /* NULL NAME dereferenced */
 
 #define VAC_SLOT(addr) ((addr) & (HALMAT_MAX_VAC - 1))
 
@@ -242,17 +254,18 @@ typedef struct {
     int      is_open;       /* 1 = we fopened it (need fclose) */
     char     path[512];     /* empty = not configured */
     char     mode[4];       /* mode used to open (for lazy reopen) */
+    int      ebcdic;        /* text in the file is EBCDIC CP 037 */
 } halmat_unit_t;
 
 typedef struct {
-    uint32_t    code[HALMAT_MAX_CODE];
+    uint32_t   *code;                   /* code_store, shared by worker clones */
     uint32_t    code_len;
     uint32_t    num_blocks;
 
     uint32_t    pc;
     int         halted;             /* 0=running, 1=normal, -1=error */
 
-    syt_entry_t syt[HALMAT_MAX_SYT];
+    syt_entry_t *syt;                   /* syt_store, shared by worker clones */
     uint32_t    syt_count;
 
     lit_entry_t lit[HALMAT_MAX_LIT];
@@ -264,7 +277,7 @@ typedef struct {
     uint16_t lit_str_off[HALMAT_MAX_LIT];   /* offset into pool, 0 = not loaded */
     uint16_t lit_str_len[HALMAT_MAX_LIT];
 
-    uint8_t     data[HALMAT_DATA_SIZE];
+    uint8_t    *data;                   /* data_store */
     uint32_t    data_used;
 
     halmat_val_t vac[HALMAT_MAX_VAC];       /* direct-mapped by code address */
@@ -276,11 +289,43 @@ typedef struct {
     loop_info_t  loops[HALMAT_MAX_LOOPS];
     uint32_t     loop_depth;
 
+    uint32_t     update_syt[HALMAT_MAX_UPDATE];  /* open UPDATE blocks */
+    uint32_t     update_depth;
+
+    struct halmat_sched *sched;             /* real-time state, NULL until used */
+    int32_t      task;                      /* running process */
+    uint64_t     sim_limit_us;              /* stop virtual clock here, 0 = none */
+    uint32_t     sched_threads;             /* >1: run processes on threads */
+    int          sched_replay;              /* threads follow sequential order */
+    struct halmat_worker *worker;           /* set in worker thread clones */
+
     uint32_t    flow[HALMAT_MAX_FLOW];      /* flow number → code offset */
+    struct halmat_fuse *fuse;               /* fused class 3/4 chains, NULL = off */
+    struct halmat_arrays *arrays;           /* subscript plans, array loop kernels */
+    struct halmat_structs *structs;         /* decoded EXTNs */
+    struct halmat_chars *chars;             /* in-place string appends, NULL = off */
+    struct halmat_prof *prof;               /* --profile counters, NULL = off */
+    struct halmat_trace *trace;             /* --trace-bin ring, NULL = off */
+    struct halmat_perf *perf;               /* --perf-counters, NULL = off */
+    struct halmat_cov *cov;                 /* --coverage map, NULL = off */
+    struct halmat_watch *watch;             /* debugger watchpoints, NULL = none */
+    struct halmat_replay *replay;           /* debugger snapshots, NULL = off */
+    struct halmat_cost *cost;               /* --cost target estimate, NULL = off */
+    uint32_t    adlp_pc;                    /* array loop: first body operator */
+    uint32_t    adlp_i;                     /* element being computed */
+    uint32_t    adlp_n;                     /* elements, 0 = not in a loop */
+    uint32_t    adlp_ndim;
+    uint16_t    adlp_ext[HALMAT_MAX_DIMS];
     io_list_t   io;
+    uint32_t    tint_syt;                   /* structure TINT is filling */
+    uint32_t    tint_next;                  /* its next terminal element */
 
-    halmat_unit_t units[HALMAT_MAX_UNITS];
+    halmat_unit_t *units;                   /* unit_store */
     int           translate_ebcdic;
+    int           sync_io;                  /* format WRITE on the caller */
+    int           hfp;                      /* builtins round like IBM HFP */
+    uint64_t      rand_state;               /* RANDOM/RANDOMG stream */
+    uint32_t      file_reclen;              /* FILE record bytes, 0 = default */
 
     uint64_t    cycle_count;
     uint64_t    stmt_count;
@@ -288,17 +333,40 @@ typedef struct {
 
     int         debug_mode;
     int         single_step;
-    breakpoint_t breakpoints[64];
+    breakpoint_t breakpoints[64];           /* patched into code[] as traps */
     uint32_t     bp_count;
+    uint32_t     bp_resume;                 /* pc + 1 of a trap to run once */
+
+    /* Backing stores for state that worker clones share by pointer;
+     * a clone is allocated only up to code_store */
+    uint32_t      code_store[HALMAT_MAX_CODE];
+    syt_entry_t   syt_store[HALMAT_MAX_SYT];
+    uint8_t       data_store[HALMAT_DATA_SIZE];
+    halmat_unit_t unit_store[HALMAT_MAX_UNITS];
 } halmat_t;
 
 double ibm_float_to_double(uint32_t w);
 double ibm_double_to_double(uint32_t w_hi, uint32_t w_lo);
+uint32_t double_to_ibm_float(double x);
+double halmat_hfp_chop(double x);           /* truncate to short HFP */
 
 int  halmat_load(halmat_t *H, const char *filename);
 int  halmat_load_litfile(halmat_t *H, const char *filename);
 int  halmat_load_strings(halmat_t *H, const char *source_file);
 void halmat_build_flow_table(halmat_t *H);
+uint32_t halmat_op_at(const halmat_t *H, uint32_t addr);  /* next operator */
+void halmat_transcode_literals(halmat_t *H);
+void halmat_fuse_build(halmat_t *H);
+void halmat_fuse_free(halmat_t *H);
+int  halmat_fuse_exec(halmat_t *H);         /* 1 if a chain ran at H->pc */
+int  halmat_load_declares(halmat_t *H, const char *source_file);
+const char *halmat_syt_name(const halmat_t *H, uint32_t syt); /* or NULL */
+void halmat_array_build(halmat_t *H, int kernels);
+void halmat_array_free(halmat_t *H);
+void halmat_struct_build(halmat_t *H);
+void halmat_struct_free(halmat_t *H);
+void halmat_char_build(halmat_t *H);
+void halmat_char_free(halmat_t *H);
 void halmat_init(halmat_t *H);
 
 const char *halmat_popcode_name(uint32_t popcode);
@@ -309,6 +377,29 @@ void halmat_disasm_word(halmat_t *H, uint32_t addr, FILE *out);
 
 halmat_val_t halmat_resolve_operand(halmat_t *H, uint32_t operand_word);
 void         halmat_store_vac(halmat_t *H, uint32_t addr, halmat_val_t val);
+void         halmat_watch_asn(halmat_t *H, uint32_t pc);   /* write barrier */
+void         halmat_watch_store(halmat_t *H, uint32_t syt, const halmat_val_t *v);
+halmat_val_t halmat_ref_load(halmat_t *H, const halmat_val_t *ref);
+void         halmat_ref_store(halmat_t *H, const halmat_val_t *ref,
+                              const halmat_val_t *src);
+void         halmat_ref_init(halmat_val_t *r, const halmat_array_t *a,
+                             uint8_t *elem);
+uint32_t     halmat_array_layout(halmat_array_t *a);
+uint32_t     halmat_data_alloc(halmat_t *H, uint32_t size);
+halmat_val_t halmat_array_get(halmat_t *H, uint32_t syt, uint32_t index);
+void         halmat_array_put(halmat_t *H, uint32_t syt, uint32_t index,
+                              const halmat_val_t *val);
+int          halmat_array_store(halmat_t *H, uint32_t dest_word,
+                                const halmat_val_t *src);
+int          halmat_struct_ref(halmat_t *H, uint32_t word, halmat_val_t *r);
+uint8_t     *halmat_struct_addr(halmat_t *H, uint32_t word, uint32_t *plain);
+int          halmat_struct_desc(halmat_t *H, uint32_t word, halmat_array_t *a);
+uint16_t     halmat_char_max(const halmat_t *H, uint32_t syt);
+int          halmat_char_compare(const halmat_val_t *a, const halmat_val_t *b);
+void         halmat_char_assign(halmat_t *H, uint32_t dest, const halmat_val_t *src);
+int          halmat_bit_max(const halmat_t *H, uint32_t syt);
+void         halmat_bit_assign(halmat_t *H, uint32_t dest, const halmat_val_t *src);
+int          halmat_char_exec(halmat_t *H, uint32_t pc);  /* 1 if it did the op */
 int          halmat_step(halmat_t *H);
 int          halmat_run(halmat_t *H);
 
@@ -321,6 +412,8 @@ int halmat_exec_class5(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
 int halmat_exec_class6(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag);
 int halmat_exec_class7(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag);
 int halmat_exec_class8(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag);
+int halmat_array_exec(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag);
+int halmat_struct_exec(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag);
 
 void halmat_decode_char_lit(halmat_t *H, uint32_t lit_idx, char *buf, int *len);
 
@@ -0,0 +1,1599 @@
+/* Arrays and subscripts: DSUB, TSUB, ADLP, IDLP, DLPE.
+ *
+ * HALMAT carries no symbol table, so array dimensions and element types
+ * come from the DECLARE statements in the HAL/S source (SYT numbers are
+ * handed out in order of declaration, labels included) or, failing that,
+ * are inferred from the subscripts the program uses.  At load time every
+ * arrayed variable gets a contiguous, row-major block in the data segment
+ * and its SYT entry a descriptor holding base, extents and strides.
+ *
+ * Each DSUB site is decoded once into a plan: constant subscripts are
+ * folded into a byte offset, the rest keep their stride and extent, so
+ * running a DSUB is a few multiply-adds.  The result is a reference
+ * (HTYPE_REF) in the DSUB's VAC: reading the VAC loads the element, an
+ * assignment whose destination is the VAC stores through it.
+ *
+ * ADLP/IDLP ... DLPE repeat the operators between them once per element,
+ * with arrayed operands standing for the current element.  Loops whose
+ * body is plain SCALAR/INTEGER arithmetic on whole arrays are compiled
+ * into kernels that run each operator over all elements at once; other
+ * loops are interpreted element by element.
+ *
+ * Subscript operand words, as this compiler emits them: QUAL_AST is '*';
+ * otherwise TAG1 bits 0-1 give the form (2 = TO, 3 = AT, each taking a
+ * second operand word, else a single index) and bit 2 marks an array
+ * subscript as opposed to a component subscript. */
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include "halmat.h"
+#include "halmat_builtin.h"
+#include "halmat_cov.h"
+
+#define SUB_MAX         5       /* array + component subscripts */
+#define KERNEL_MAX     32       /* operators in a compiled loop body */
+
+enum { SUB_INDEX, SUB_TO, SUB_AT, SUB_STAR };
+
+typedef struct {
+    uint32_t word, word2;   /* index operand (TO/AT: second), 0 = constant */
+    int32_t  lo;            /* constant index, 1-based */
+    uint32_t stride;        /* bytes; CHARACTER/BIT: 1 */
+    uint16_t extent;
+    uint8_t  kind;
+    uint8_t  array;         /* array subscript, else component */
+} sub_t;
+
+typedef struct {
+    uint32_t off;           /* constant part of the offset, bytes */
+    uint32_t word;          /* what is subscripted: SYT or XPT operand */
+    uint16_t syt;           /* 0 for a structure field */
+    uint8_t  nsub;
+    uint8_t  narr;          /* array subscripts given */
+    uint8_t  comp;          /* component subscripts given */
+    uint8_t  bad;           /* constant subscript out of range */
+    uint8_t  indirect;      /* address from halmat_struct_addr() */
+    halmat_array_t a;       /* dimensions subscripted */
+    sub_t    sub[SUB_MAX];
+} sub_plan_t;
+
+/* Compiled array loop */
+enum {
+    K_SADD, K_SSUB, K_SSPR, K_SSDV, K_SNEG, K_STOS,
+    K_IADD, K_ISUB, K_IIPR, K_INEG, K_ITOI, K_BFNC, K_STORE
+};
+
+enum { KO_ARR, KO_TEMP, KO_BCAST };
+
+typedef struct {
+    uint8_t  kind;
+    uint16_t index;         /* SYT (KO_ARR) or step (KO_TEMP) */
+    uint32_t word;          /* KO_BCAST operand word */
+} kopnd_t;
+
+typedef struct {
+    uint8_t  op;
+    uint8_t  isint;         /* result is INTEGER */
+    uint8_t  nsrc;
+    uint16_t dest;          /* K_STORE: destination SYT; K_BFNC: builtin */
+    kopnd_t  src[2];
+} kstep_t;
+
+typedef struct {
+    uint32_t end;           /* address of the DLPE */
+    uint32_t n;             /* elements, 0 = extents known only at run time */
+    uint32_t nops;          /* operators in the body */
+    uint16_t ext[HALMAT_MAX_DIMS];
+    uint8_t  ndim;
+    uint8_t  nsteps;        /* 0 = interpreted */
+    kstep_t *steps;
+    double  *buf;           /* nsteps + 2 vectors of n */
+} aloop_t;
+
+struct halmat_arrays {
+    uint32_t   *plan_at;    /* code address -> plan + 1 */
+    uint32_t   *loop_at;    /* code address -> loop + 1 */
+    sub_plan_t *plans;
+    aloop_t    *loops;
+    uint32_t    nplans, nloops;
+    char      (*names)[32]; /* symbol names from the DECLAREs, by SYT */
+    uint32_t    nnames;
+};
+
+static double num(const halmat_val_t *v)
+{
+    return (v->type == HTYPE_INTEGER) ? (double)v->v.integer : v->v.scalar;
+}
+
+static int32_t to_int(const halmat_val_t *v)
+{
+    switch (v->type) {
+    case HTYPE_INTEGER: return v->v.integer;
+    case HTYPE_SCALAR:  return (int32_t)v->v.scalar;
+    case HTYPE_BIT:     return (int32_t)v->v.bits;
+    default:            return 0;
+    }
+}
+
+static int is_arith(int t)
+{
+    return t == HTYPE_SCALAR || t == HTYPE_VECTOR || t == HTYPE_MATRIX;
+}
+
+/* First operator at or after a, skipping block headers and the unused
+ * tail of each block; code_len when there are no more */
+uint32_t halmat_op_at(const halmat_t *H, uint32_t a)
+{
+    while (a < H->code_len) {
+        uint32_t base = a - a % HALMAT_BLOCK_WORDS;
+        uint32_t end = base + ((H->code[base + 1] >> 16) & 0xFFFF);
+        if (a < base + 2)
+            a = base + 2;
+        if (a > end) {
+            a = base + HALMAT_BLOCK_WORDS;
+            continue;
+        }
+        if (HALMAT_IS_OP(H->code[a]))
+            return a;
+        a++;
+    }
+    return H->code_len;
+}
+
+#define NEXT_OP(H, a) halmat_op_at(H, (a) + HALMAT_NUMOP((H)->code[a]) + 1)
+
+/* ---- declarations ---- */
+
+typedef struct {
+    char  text[32];
+    char  kind;             /* 'a' identifier, '0' number, else punctuation */
+} tok_t;
+
+static int keyword(const char *s)
+{
+    static const char *const kw[] = {
+        "ARRAY", "MATRIX", "VECTOR", "SCALAR", "INTEGER", "BOOLEAN", "BIT",
+        "CHARACTER", "EVENT", "SINGLE", "DOUBLE", "INITIAL", "CONSTANT",
+        "STATIC", "AUTOMATIC", "DENSE", "ALIGNED", "LOCK", "REMOTE",
+        "RIGID", "LATCHED", "NAME", "ACCESS", "REENTRANT", "DEPENDENT",
+        NULL
+    };
+    for (int i = 0; kw[i]; i++)
+        if (strcmp(s, kw[i]) == 0)
+            return 1;
+    return 0;
+}
+
+/* Parenthesised numbers after tokens[*k], e.g. (3, 3); n = 0 for a
+ * missing or non-constant list.  *k is left after the ')'. */
+static int dims(const tok_t *t, int nt, int *k, int *d, int max)
+{
+    int n = 0;
+    if (*k >= nt || t[*k].kind != '(')
+        return 0;
+    int depth = 0, ok = 1;
+    for (; *k < nt; (*k)++) {
+        char c = t[*k].kind;
+        if (c == '(') depth++;
+        else if (c == ')' && --depth == 0) { (*k)++; break; }
+        else if (depth == 1 && c == '0' && n < max) d[n++] = atoi(t[*k].text);
+        else if (depth == 1 && c != ',') ok = 0;
+    }
+    return ok ? n : 0;
+}
+
+/* Attributes from t[k] up to the next top-level ',' or the end */
+static int attributes(halmat_t *H, const tok_t *t, int nt, int k,
+                      halmat_array_t *a, halmat_struct_t *st)
+{
+    while (k < nt && t[k].kind != ',') {
+        const char *s = t[k].text;
+        int d[HALMAT_MAX_DIMS] = {0}, n;
+        k++;
+        if (k + 1 < nt && t[k].kind == '-' &&
+            strcmp(t[k + 1].text, "STRUCTURE") == 0) {
+            k += 2;                     /* T-STRUCTURE, T-STRUCTURE(n) */
+            const struct halmat_arrays *A = H->arrays;
+            uint32_t i = A->nnames < HALMAT_MAX_SYT ? A->nnames : HALMAT_MAX_SYT - 1;
+            for (; i > 0; i--)
+                if (H->syt[i].st.kind == SK_TEMPLATE &&
+                    strcmp(A->names[i], s) == 0) {
+                    st->templ = (uint16_t)i;
+                    break;
+                }
+            a->etype = HTYPE_STRUCT;
+            n = dims(t, nt, &k, d, 1);
+            a->ndim = (uint8_t)(n == 1 && d[0] > 1);
+            a->extent[0] = (uint16_t)(n == 1 && d[0] > 1 ? d[0] : 0);
+        } else if (strcmp(s, "NAME") == 0) {
+            st->name = 1;
+        } else if (strcmp(s, "ARRAY") == 0) {
+            n = dims(t, nt, &k, d, HALMAT_MAX_DIMS);
+            for (int i = 0; i < n; i++)
+                a->extent[i] = (uint16_t)(d[i] > 0 ? d[i] : 1);
+            a->ndim = (uint8_t)n;
+        } else if (strcmp(s, "MATRIX") == 0) {
+            n = dims(t, nt, &k, d, 2);
+            a->etype = HTYPE_MATRIX;
+            a->erows = (uint8_t)(n == 2 ? d[0] : 3);
+            a->ecols = (uint8_t)(n == 2 ? d[1] : 3);
+        } else if (strcmp(s, "VECTOR") == 0) {
+            n = dims(t, nt, &k, d, 1);
+            a->etype = HTYPE_VECTOR;
+            a->erows = (uint8_t)(n == 1 ? d[0] : 3);
+            a->ecols = 1;
+        } else if (strcmp(s, "CHARACTER") == 0) {
+            n = dims(t, nt, &k, d, 1);
+            a->etype = HTYPE_CHAR;
+            a->elen = (uint16_t)(n == 1 && d[0] > 0 && d[0] < 256 ? d[0] : 255);
+        } else if (strcmp(s, "BIT") == 0) {
+            n = dims(t, nt, &k, d, 1);
+            a->etype = HTYPE_BIT;
+            a->elen = (uint16_t)(n == 1 && d[0] > 0 && d[0] <= 32 ? d[0] : 1);
+        } else if (strcmp(s, "SCALAR") == 0) {
+            a->etype = HTYPE_SCALAR;
+        } else if (strcmp(s, "INTEGER") == 0) {
+            a->etype = HTYPE_INTEGER;
+        } else if (strcmp(s, "BOOLEAN") == 0) {
+            a->etype = HTYPE_BOOLEAN;
+            a->elen = 1;
+        } else if (strcmp(s, "EVENT") == 0) {
+            a->etype = HTYPE_EVENT;
+            a->elen = 1;
+        } else {
+            dims(t, nt, &k, d, 0);      /* INITIAL(...) and the like */
+        }
+    }
+    return k;
+}
+
+static int tokenize(const char *src, tok_t *t, int max)
+{
+    int nt = 0;
+    const char *p = src;
+    int col = 0;
+
+    while (*p && nt < max) {
+        if (col == 0 && (*p == 'E' || *p == 'S' || *p == 'C')) {
+            while (*p && *p != '\n') p++;   /* exponent, subscript, comment */
+            continue;
+        }
+        if (*p == '\n') { col = 0; p++; continue; }
+        if (col == 0) { col = 1; p++; continue; }
+        if (p[0] == '/' && p[1] == '*') {
+            const char *e = strstr(p + 2, "*/");
+            p = e ? e + 2 : p + strlen(p);
+            continue;
+        }
+        if (*p == '\'') {
+            for (p++; *p && !(*p == '\'' && p[1] != '\''); p++)
+                if (*p == '\'') p++;
+            if (*p) p++;
+            continue;
+        }
+        if (isalpha((unsigned char)*p) || *p == '_' || isdigit((unsigned char)*p)) {
+            int n = 0;
+            char kind = isdigit((unsigned char)*p) ? '0' : 'a';
+            while (isalnum((unsigned char)*p) || *p == '_' || *p == '.') {
+                if (n < (int)sizeof(t[nt].text) - 1)
+                    t[nt].text[n++] = *p;
+                p++;
+            }
+            t[nt].text[n] = '\0';
+            t[nt].kind = kind;
+            nt++;
+            continue;
+        }
+        if (!isspace((unsigned char)*p)) {
+            t[nt].text[0] = *p;
+            t[nt].text[1] = '\0';
+            t[nt].kind = *p;
+            nt++;
+        }
+        p++;
+    }
+    return nt;
+}
+
+/* Symbol number for a newly declared name, 0 if the table is full */
+static uint32_t new_symbol(struct halmat_arrays *A, const char *name)
+{
+    if (++A->nnames >= HALMAT_MAX_SYT)
+        return 0;
+    snprintf(A->names[A->nnames], sizeof(A->names[0]), "%s", name);
+    return A->nnames;
+}
+
+/* Declared name of a symbol, NULL if the source did not give one */
+const char *halmat_syt_name(const halmat_t *H, uint32_t syt)
+{
+    const struct halmat_arrays *A = H->arrays;
+    if (!A || !A->names || syt == 0 || syt > A->nnames ||
+        syt >= HALMAT_MAX_SYT || !A->names[syt][0])
+        return NULL;
+    return A->names[syt];
+}
+
+/* STRUCTURE T: 1 A SCALAR, 1 B, 2 C INTEGER, ... ; the template and
+ * its fields are numbered in order.  k is at the template name. */
+static void structure(halmat_t *H, const tok_t *t, int end, int k)
+{
+    struct halmat_arrays *A = H->arrays;
+    uint32_t tp = new_symbol(A, t[k].text);
+    if (!tp)
+        return;
+    H->syt[tp].st.kind = SK_TEMPLATE;
+    H->syt[tp].arr.etype = HTYPE_STRUCT;
+    while (k < end && t[k].kind != ':')
+        k++;
+
+    uint32_t prev = 0;
+    for (k++; k < end; ) {
+        if (t[k].kind != '0' || k + 1 >= end || t[k + 1].kind != 'a') {
+            k++;
+            continue;
+        }
+        int level = atoi(t[k].text);
+        uint32_t f = new_symbol(A, t[k + 1].text);
+        if (!f)
+            return;
+        syt_entry_t *e = &H->syt[f];
+        k = attributes(H, t, end, k + 2, &e->arr, &e->st);
+        if (k < end) k++;
+        e->st.kind = SK_FIELD;
+        e->st.owner = (uint16_t)tp;
+        e->st.level = (uint8_t)level;
+        if (prev && H->syt[prev].st.level < level)
+            H->syt[prev].st.kind = SK_MINOR;
+        prev = f;
+    }
+    for (uint32_t f = tp + 1; f <= A->nnames && f < HALMAT_MAX_SYT; f++) {
+        syt_entry_t *e = &H->syt[f];
+        if (e->st.kind == SK_MINOR) {
+            memset(&e->arr, 0, sizeof(e->arr));
+            e->arr.etype = HTYPE_STRUCT;
+        } else if (!e->arr.etype) {
+            e->arr.etype = HTYPE_SCALAR;
+        }
+    }
+}
+
+/* Array and type attributes from the DECLARE and STRUCTURE statements
+ * of a HAL/S source file into the SYT descriptors.  Symbols are
+ * numbered from 1 in order of appearance: statement labels, procedure
+ * parameters, structure templates and their fields, and declared
+ * names.  Returns the number of symbols seen, -1 if the file cannot
+ * be read. */
+int halmat_load_declares(halmat_t *H, const char *source_file)
+{
+    FILE *fp = fopen(source_file, "r");
+    if (!fp) return -1;
+
+    struct halmat_arrays *A = H->arrays;
+    if (!A && !(A = H->arrays = calloc(1, sizeof(*A)))) {
+        fclose(fp);
+        return -1;
+    }
+    if (!A->names && !(A->names = calloc(HALMAT_MAX_SYT, sizeof(A->names[0])))) {
+        fclose(fp);
+        return -1;
+    }
+
+    char source[16384];
+    size_t slen = fread(source, 1, sizeof(source) - 1, fp);
+    source[slen] = '\0';
+    fclose(fp);
+
+    static tok_t t[4096];
+    int nt = tokenize(source, t, 4096);
+    uint32_t scope = 1;
+
+    A->nnames = 0;
+    for (int k = 0; k < nt; ) {
+        int end = k;
+        while (end < nt && t[end].kind != ';')
+            end++;
+
+        while (k + 1 < end && t[k].kind == 'a' && t[k + 1].kind == ':') {
+            new_symbol(A, t[k].text);
+            k += 2;
+        }
+
+        if (k < end && (strcmp(t[k].text, "PROCEDURE") == 0 ||
+                        strcmp(t[k].text, "FUNCTION") == 0)) {
+            scope = A->nnames + 1;
+            for (k++; k < end && t[k].kind != ')'; k++)
+                if (t[k].kind == 'a')
+                    new_symbol(A, t[k].text);
+        } else if (k + 1 < end && strcmp(t[k].text, "STRUCTURE") == 0) {
+            structure(H, t, end, k + 1);
+        } else if (k < end && strcmp(t[k].text, "DECLARE") == 0) {
+            halmat_array_t common;
+            halmat_struct_t cst;
+            memset(&common, 0, sizeof(common));
+            memset(&cst, 0, sizeof(cst));
+            k++;
+            if (k < end && (keyword(t[k].text) ||
+                            (k + 2 < end && t[k + 1].kind == '-' &&
+                             strcmp(t[k + 2].text, "STRUCTURE") == 0))) {
+                k = attributes(H, t, end, k, &common, &cst);    /* factored */
+                if (k < end) k++;
+            }
+            while (k < end) {
+                if (t[k].kind != 'a') { k++; continue; }
+                uint32_t s = 0;
+                for (uint32_t i = scope; i <= A->nnames && i < HALMAT_MAX_SYT; i++)
+                    if (!H->syt[i].st.kind && strcmp(A->names[i], t[k].text) == 0)
+                        s = i;
+                if (!s)
+                    s = new_symbol(A, t[k].text);
+                halmat_array_t a = common;
+                halmat_struct_t st = cst;
+                k = attributes(H, t, end, k + 1, &a, &st);
+                if (k < end) k++;
+                if (s) {
+                    if (!a.etype)
+                        a.etype = HTYPE_SCALAR;
+                    H->syt[s].arr = a;
+                    H->syt[s].st = st;
+                }
+            }
+        }
+        k = end + 1;
+    }
+    return (int)A->nnames;
+}
+
+/* ---- descriptors ---- */
+
+static uint32_t element_size(const halmat_array_t *a)
+{
+    switch (a->etype) {
+    case HTYPE_MATRIX:  return 8u * a->erows * a->ecols;
+    case HTYPE_VECTOR:  return 8u * a->erows;
+    case HTYPE_SCALAR:  return 8;
+    case HTYPE_CHAR:    return (2u + a->elen + 1u) & ~1u;
+    default:            return 4;
+    }
+}
+
+/* Storage class of an element type, as in the ref's store field */
+static int storage(int type)
+{
+    if (is_arith(type))
+        return HTYPE_SCALAR;
+    if (type == HTYPE_INTEGER || type == HTYPE_CHAR || type == HTYPE_STRUCT)
+        return type;
+    return HTYPE_BIT;
+}
+
+/* Element size (a structure's is set beforehand) and row-major
+ * strides; returns the bytes for all elements */
+uint32_t halmat_array_layout(halmat_array_t *a)
+{
+    if (a->etype != HTYPE_STRUCT)
+        a->esize = element_size(a);
+    uint32_t size = a->esize;
+    for (int d = a->ndim - 1; d >= 0; d--) {
+        a->stride[d] = size;
+        size *= a->extent[d];
+    }
+    a->count = a->esize ? size / a->esize : 0;
+    return size;
+}
+
+/* size bytes of the data segment, 8-aligned: the offset, or
+ * HALMAT_DATA_SIZE if it is full */
+uint32_t halmat_data_alloc(halmat_t *H, uint32_t size)
+{
+    uint32_t base = (H->data_used + 7u) & ~7u;
+    if (size > HALMAT_DATA_SIZE - base)
+        return HALMAT_DATA_SIZE;
+    H->data_used = base + size;
+    return base;
+}
+
+static void allocate(halmat_t *H, uint32_t s)
+{
+    halmat_array_t *a = &H->syt[s].arr;
+    uint32_t base = halmat_data_alloc(H, halmat_array_layout(a));
+    if (base == HALMAT_DATA_SIZE) {
+        fprintf(stderr, "halmat_array_build: data segment full at SYT(%u)\n", s);
+        a->ndim = 0;
+        a->count = 0;
+        return;
+    }
+    a->base = base;
+}
+
+/* The bound a DO FOR gives its control variable, for undeclared arrays */
+static int32_t loop_bound(halmat_t *H, uint32_t var)
+{
+    int32_t max = 0;
+    for (uint32_t a = halmat_op_at(H, 0); a < H->code_len; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        uint32_t n = HALMAT_NUMOP(w);
+        if (HALMAT_POPCODE(w) == POP_DFOR && n >= 4 &&
+            HALMAT_QUAL(H->code[a + 2]) == QUAL_SYT &&
+            HALMAT_DATA(H->code[a + 2]) == var) {
+            for (uint32_t k = 3; k <= 4; k++) {
+                uint32_t ow = H->code[a + k];
+                uint32_t q = HALMAT_QUAL(ow);
+                if (q == QUAL_LIT || q == QUAL_IMD) {
+                    halmat_val_t v = halmat_resolve_operand(H, ow);
+                    int32_t b = (int32_t)num(&v);
+                    if (b > max) max = b;
+                }
+            }
+        }
+    }
+    return max;
+}
+
+/* Dimensions for a variable that was subscripted but never declared:
+ * the largest constant subscript or DO FOR bound in each position */
+static void infer(halmat_t *H, uint32_t pc, uint32_t numop, uint32_t tag)
+{
+    uint32_t s = HALMAT_DATA(H->code[pc + 1]);
+    halmat_array_t *a = &H->syt[s].arr;
+    int32_t ext[SUB_MAX] = {0};
+    int narr = 0, ncomp = 0;
+
+    for (uint32_t k = 2; k <= numop; k++) {
+        uint32_t w = H->code[pc + k];
+        uint32_t t1 = HALMAT_TAG1(w);
+        int32_t hi = 0;
+        if (HALMAT_QUAL(w) == QUAL_SYT)
+            hi = loop_bound(H, HALMAT_DATA(w));
+        else if (HALMAT_QUAL(w) == QUAL_IMD || HALMAT_QUAL(w) == QUAL_LIT) {
+            halmat_val_t v = halmat_resolve_operand(H, w);
+            hi = (int32_t)num(&v);
+        }
+        if ((t1 & 3) >= 2 && k < numop) {   /* TO/AT: the upper end */
+            k++;
+            halmat_val_t v = halmat_resolve_operand(H, H->code[pc + k]);
+            if ((int32_t)num(&v) > hi) hi = (int32_t)num(&v);
+        }
+        int i = narr + ncomp;
+        if (i >= SUB_MAX) break;
+        if (hi > ext[i]) ext[i] = hi;
+        if ((t1 & 4) && ncomp == 0 && narr < HALMAT_MAX_DIMS) narr++;
+        else ncomp++;
+    }
+
+    if (!a->etype) {
+        int t = (int)(tag & 0x0F);
+        if (ncomp == 2) {
+            a->etype = HTYPE_MATRIX;
+            a->erows = (uint8_t)(ext[narr] > 3 && ext[narr] <= 8 ? ext[narr] : 3);
+            a->ecols = (uint8_t)(ext[narr + 1] > 3 && ext[narr + 1] <= 8 ? ext[narr + 1] : 3);
+        } else if (ncomp == 1 && (t == HTYPE_SCALAR || t == HTYPE_INTEGER)) {
+            a->etype = HTYPE_VECTOR;
+            a->erows = (uint8_t)(ext[narr] > 3 && ext[narr] <= 64 ? ext[narr] : 3);
+            a->ecols = 1;
+        } else if (t == HTYPE_CHAR) {
+            a->etype = HTYPE_CHAR;
+            a->elen = 255;
+        } else if (t == HTYPE_BIT) {
+            a->etype = HTYPE_BIT;
+            a->elen = 32;
+        } else {
+            a->etype = (uint8_t)(t ? t : HTYPE_SCALAR);
+        }
+    }
+    if (!a->ndim && narr) {
+        a->ndim = (uint8_t)narr;
+        for (int d = 0; d < narr; d++)
+            a->extent[d] = (uint16_t)(ext[d] > 0 ? ext[d] : 1);
+    }
+}
+
+/* ---- subscript plans ---- */
+
+static void make_plan(halmat_t *H, uint32_t pc, uint32_t numop, sub_plan_t *P)
+{
+    memset(P, 0, sizeof(*P));
+    P->word = H->code[pc + 1];
+    P->indirect = (uint8_t)halmat_struct_desc(H, P->word, &P->a);
+    if (HALMAT_QUAL(P->word) == QUAL_SYT)
+        P->syt = (uint16_t)HALMAT_DATA(P->word);
+    const halmat_array_t *a = &P->a;
+
+    /* component dimensions of one element */
+    uint16_t cext[2] = {0, 0};
+    uint32_t cstride[2] = {0, 0};
+    int ncomp = 0;
+    switch (a->etype) {
+    case HTYPE_MATRIX:
+        cext[0] = a->erows; cstride[0] = 8u * a->ecols;
+        cext[1] = a->ecols; cstride[1] = 8;
+        ncomp = 2;
+        break;
+    case HTYPE_VECTOR:
+        cext[0] = a->erows; cstride[0] = 8;
+        ncomp = 1;
+        break;
+    case HTYPE_CHAR:
+    case HTYPE_BIT:
+        cext[0] = a->elen; cstride[0] = 1;
+        ncomp = 1;
+        break;
+    }
+
+    int d = 0;
+    for (uint32_t k = 2; k <= numop && P->nsub < SUB_MAX; k++, d++) {
+        sub_t *s = &P->sub[P->nsub];
+        uint32_t w = H->code[pc + k];
+        uint32_t q = HALMAT_QUAL(w);
+        s->array = (uint8_t)(d < a->ndim);
+        if (s->array) {
+            P->narr++;
+            s->extent = a->extent[d];
+            s->stride = a->stride[d];
+        } else if (d - a->ndim < ncomp) {
+            P->comp++;
+            s->extent = cext[d - a->ndim];
+            s->stride = cstride[d - a->ndim];
+        } else {
+            P->bad = 1;                 /* more subscripts than dimensions */
+            break;
+        }
+
+        if (q == QUAL_AST) {
+            s->kind = SUB_STAR;
+        } else if (q == QUAL_CSZ || q == QUAL_ASZ) {
+            s->kind = SUB_STAR;         /* #, # + e, # - e */
+            if (HALMAT_DATA(w) && k < numop)
+                k++;
+        } else {
+            uint32_t form = HALMAT_TAG1(w) & 3;
+            s->kind = form == 2 ? SUB_TO : form == 3 ? SUB_AT : SUB_INDEX;
+            if (s->kind != SUB_INDEX && k < numop)
+                s->word2 = H->code[pc + ++k];
+            if (q == QUAL_IMD || q == QUAL_LIT) {
+                halmat_val_t v = halmat_resolve_operand(H, w);
+                s->lo = (int32_t)num(&v);
+            } else {
+                s->word = w;
+            }
+        }
+
+        /* a constant single index: fold it in now */
+        if (s->kind == SUB_INDEX && !s->word && s->stride != 1) {
+            if (s->lo < 1 || s->lo > s->extent)
+                P->bad = 1;
+            else
+                P->off += (uint32_t)(s->lo - 1) * s->stride;
+            continue;
+        }
+        P->nsub++;
+    }
+}
+
+static int32_t sub_value(halmat_t *H, uint32_t w, int32_t lo)
+{
+    if (!w)
+        return lo;
+    halmat_val_t v = halmat_resolve_operand(H, w);
+    return v.type == HTYPE_SCALAR ? (int32_t)v.v.scalar : to_int(&v);
+}
+
+/* Index in array loop dimension d for the current element */
+static int32_t loop_index(halmat_t *H, int d)
+{
+    uint32_t i = H->adlp_i;
+    for (int k = (int)H->adlp_ndim - 1; k > d; k--)
+        i /= H->adlp_ext[k];
+    return (int32_t)(i % H->adlp_ext[d]) + 1;
+}
+
+static int range(uint32_t pc, int32_t i, int32_t n, int32_t extent)
+{
+    if (i < 1 || n < 0 || i + n - 1 > extent) {
+        fprintf(stderr, "halmat_class0: subscript %d out of range 1-%d at PC=%u\n",
+                i, extent, pc);
+        return HALMAT_ERR_BOUNDS;
+    }
+    return 0;
+}
+
+/* Reference to the data a plan designates */
+static int subscript(halmat_t *H, uint32_t pc, const sub_plan_t *P,
+                     halmat_val_t *r)
+{
+    syt_entry_t *e = &H->syt[P->syt];
+    const halmat_array_t *a = &P->a;
+    uint32_t off = P->off;
+    int loopdim = 0;
+    int rdim = 0;
+    uint16_t shape[2] = {0, 0};
+    uint32_t rstride[2] = {0, 0};
+    int32_t first = 0, count = -1;
+
+    if (P->bad) {
+        fprintf(stderr, "halmat_class0: bad subscript of SYT(%u) at PC=%u\n",
+                P->syt, pc);
+        return HALMAT_ERR_BOUNDS;
+    }
+
+    for (int k = 0; k < P->nsub; k++) {
+        const sub_t *s = &P->sub[k];
+        int32_t i, n = 1;
+        switch (s->kind) {
+        case SUB_INDEX:
+            i = sub_value(H, s->word, s->lo);
+            break;
+        case SUB_TO:
+            i = sub_value(H, s->word, s->lo);
+            n = sub_value(H, s->word2, 0) - i + 1;
+            break;
+        case SUB_AT:
+            n = sub_value(H, s->word, s->lo);
+            i = sub_value(H, s->word2, 0);
+            break;
+        default:
+            i = 1;
+            n = s->extent;
+            break;
+        }
+        if (s->array) {
+            /* in an array loop a partition walks with the loop */
+            if (s->kind != SUB_INDEX && H->adlp_n && loopdim < (int)H->adlp_ndim)
+                i += loop_index(H, loopdim++) - 1;
+            if (range(pc, i, 1, s->extent) < 0)
+                return HALMAT_ERR_BOUNDS;
+            off += (uint32_t)(i - 1) * s->stride;
+        } else if (s->stride == 1) {    /* CHARACTER/BIT partition */
+            if (range(pc, i, n, s->extent) < 0)
+                return HALMAT_ERR_BOUNDS;
+            first = i - 1;
+            count = n;
+        } else {
+            if (range(pc, i, n, s->extent) < 0)
+                return HALMAT_ERR_BOUNDS;
+            off += (uint32_t)(i - 1) * s->stride;
+            if (s->kind != SUB_INDEX && rdim < 2) {
+                shape[rdim] = (uint16_t)n;
+                rstride[rdim++] = s->stride;
+            }
+        }
+    }
+
+    memset(r, 0, offsetof(halmat_val_t, v) + sizeof(r->v.ref));
+    r->type = HTYPE_REF;
+    if (P->indirect) {
+        uint32_t plain;
+        uint8_t *base = halmat_struct_addr(H, P->word, &plain);
+        if (!base)
+            return HALMAT_ERR_NULL_NAME;
+        r->v.ref.len = plain ? &H->syt[plain - 1].val.v.string.len
+                             : (uint16_t *)(base + off);
+        r->v.ref.p = base + off + (!plain && a->etype == HTYPE_CHAR ? 2 : 0);
+        r->v.ref.syt = (uint16_t)plain;
+    } else if (a->ndim) {
+        uint8_t *elem = H->data + a->base + off;
+        r->v.ref.len = (uint16_t *)elem;        /* CHARACTER: length first */
+        r->v.ref.p = a->etype == HTYPE_CHAR ? elem + 2 : elem;
+    } else {
+        r->v.ref.p = (uint8_t *)&e->val.v + off;
+        r->v.ref.len = &e->val.v.string.len;
+        r->v.ref.syt = (uint16_t)(P->syt + 1);
+    }
+    r->v.ref.store = (uint8_t)storage(a->etype);
+    r->v.ref.size = a->elen;
+
+    switch (a->etype) {
+    case HTYPE_SCALAR:
+    case HTYPE_VECTOR:
+    case HTYPE_MATRIX:
+        if (!P->comp && a->etype != HTYPE_SCALAR) {
+            shape[0] = a->erows;            /* the whole element */
+            shape[1] = a->etype == HTYPE_MATRIX ? a->ecols : 0;
+            rstride[0] = a->etype == HTYPE_MATRIX ? 8u * a->ecols : 8;
+            rdim = a->etype == HTYPE_MATRIX ? 2 : 1;
+        }
+        r->v.ref.type = (uint8_t)(rdim == 2 ? HTYPE_MATRIX :
+                                  rdim == 1 ? HTYPE_VECTOR : HTYPE_SCALAR);
+        r->rows = (uint8_t)shape[0];
+        r->cols = (uint8_t)(rdim == 2 ? shape[1] : rdim == 1 ? 1 : 0);
+        r->v.ref.stride = (uint16_t)(rstride[0] / 8);
+        break;
+    case HTYPE_CHAR:
+        r->v.ref.type = HTYPE_CHAR;
+        r->v.ref.first = (uint16_t)first;
+        r->v.ref.count = (uint16_t)(count < 0 ? 0xFFFF : count);
+        break;
+    case HTYPE_INTEGER:
+        r->v.ref.type = HTYPE_INTEGER;
+        break;
+    case HTYPE_STRUCT:                      /* a copy, or all of them */
+        r->v.ref.type = HTYPE_STRUCT;
+        r->v.ref.bytes = P->narr || !a->count ? a->esize : a->esize * a->count;
+        break;
+    default:
+        r->v.ref.type = a->etype;
+        r->v.ref.first = (uint16_t)first;
+        r->v.ref.count = (uint16_t)(count < 0 ? a->elen : count);
+        break;
+    }
+    return 0;
+}
+
+/* ---- element access ---- */
+
+static uint32_t bit_mask(int n)
+{
+    return n >= 32 ? 0xFFFFFFFFu : (1u << n) - 1;
+}
+
+halmat_val_t halmat_ref_load(halmat_t *H, const halmat_val_t *ref)
+{
+    const uint8_t *p = ref->v.ref.p;
+    halmat_val_t v;
+    memset(&v, 0, sizeof(v));
+    v.type = ref->v.ref.type;
+    (void)H;
+
+    switch (ref->v.ref.store) {
+    case HTYPE_SCALAR: {
+        const double *d = (const double *)p;
+        int st = ref->v.ref.stride;
+        if (v.type == HTYPE_SCALAR) {
+            v.v.scalar = d[0];
+        } else if (v.type == HTYPE_VECTOR) {
+            v.rows = ref->rows;
+            v.cols = 1;
+            for (int i = 0; i < v.rows && i < 64; i++)
+                v.v.vector[i] = d[i * st];
+        } else {
+            v.rows = ref->rows;
+            v.cols = ref->cols;
+            for (int i = 0; i < v.rows; i++)
+                for (int j = 0; j < v.cols && i * v.cols + j < 64; j++)
+                    v.v.matrix[i * v.cols + j] = d[i * st + j];
+        }
+        break;
+    }
+    case HTYPE_INTEGER:
+        v.v.integer = *(const int32_t *)p;
+        break;
+    case HTYPE_BIT: {
+        int size = ref->v.ref.size, n = ref->v.ref.count;
+        int shift = size - ref->v.ref.first - n;
+        v.v.bits = (*(const uint32_t *)p >> (shift > 0 ? shift : 0)) & bit_mask(n);
+        v.rows = n < 32 ? (uint8_t)n : 0;
+        break;
+    }
+    case HTYPE_CHAR: {
+        int len = *ref->v.ref.len, first = ref->v.ref.first;
+        int n = ref->v.ref.count;
+        if (n > len - first) n = len - first;
+        if (n < 0) n = 0;
+        memcpy(v.v.string.data, p + first, (size_t)n);
+        v.v.string.len = (uint16_t)n;
+        break;
+    }
+    }
+    return v;
+}
+
+/* Store src, converted to the element type, where ref points */
+void halmat_ref_store(halmat_t *H, const halmat_val_t *ref, const halmat_val_t *src)
+{
+    uint8_t *p = ref->v.ref.p;
+
+    switch (ref->v.ref.store) {
+    case HTYPE_SCALAR: {
+        double *d = (double *)p;
+        int st = ref->v.ref.stride;
+        if (ref->v.ref.type == HTYPE_SCALAR) {
+            d[0] = num(src);
+        } else if (ref->v.ref.type == HTYPE_VECTOR) {
+            int n = src->type == HTYPE_VECTOR && src->rows < ref->rows ?
+                    src->rows : ref->rows;
+            for (int i = 0; i < n && i < 64; i++)
+                d[i * st] = src->type == HTYPE_VECTOR ? src->v.vector[i] : num(src);
+        } else {
+            int sc = src->type == HTYPE_MATRIX ? src->cols : 0;
+            for (int i = 0; i < ref->rows; i++)
+                for (int j = 0; j < ref->cols && i * sc + j < 64; j++)
+                    d[i * st + j] = sc ? (i < src->rows && j < sc ?
+                                          src->v.matrix[i * sc + j] : 0.0)
+                                       : num(src);
+        }
+        break;
+    }
+    case HTYPE_INTEGER:
+        *(int32_t *)p = to_int(src);
+        break;
+    case HTYPE_BIT: {
+        int size = ref->v.ref.size, n = ref->v.ref.count;
+        int shift = size - ref->v.ref.first - n;
+        if (shift < 0) shift = 0;
+        uint32_t m = bit_mask(n) << shift;
+        uint32_t *w = (uint32_t *)p;
+        *w = (*w & ~m) | ((src->v.bits << shift) & m);
+        break;
+    }
+    case HTYPE_CHAR: {
+        int cap = ref->v.ref.syt ? (int)sizeof(src->v.string.data) : ref->v.ref.size;
+        int len = *ref->v.ref.len;
+        int first = ref->v.ref.first;
+        int n = src->type == HTYPE_CHAR ? src->v.string.len : 0;
+        if (ref->v.ref.count == 0xFFFF) {       /* the whole string */
+            if (n > cap) n = cap;
+            memcpy(p, src->v.string.data, (size_t)n);
+            if (!ref->v.ref.syt)                /* TEQU compares the bytes */
+                memset(p + n, 0, (size_t)(cap - n));
+            *ref->v.ref.len = (uint16_t)n;
+            break;
+        }
+        int want = ref->v.ref.count;            /* substring: pad with blanks */
+        for (int i = 0; i < want && first + i < cap; i++)
+            p[first + i] = (char)(i < n ? src->v.string.data[i] : ' ');
+        if (first + want > len)
+            *ref->v.ref.len = (uint16_t)(first + want < cap ? first + want : cap);
+        break;
+    }
+    }
+
+    if (ref->v.ref.syt) {
+        syt_entry_t *e = &H->syt[ref->v.ref.syt - 1];
+        if (e->val.type == HTYPE_NONE)
+            e->val.type = e->arr.etype;
+        e->allocated = 1;
+    }
+}
+
+/* Reference to the whole element of type a that starts at elem */
+void halmat_ref_init(halmat_val_t *r, const halmat_array_t *a, uint8_t *elem)
+{
+    memset(r, 0, offsetof(halmat_val_t, v) + sizeof(r->v.ref));
+    r->type = HTYPE_REF;
+    r->v.ref.type = a->etype;
+    r->v.ref.store = (uint8_t)storage(a->etype);
+    r->v.ref.len = (uint16_t *)elem;
+    r->v.ref.p = a->etype == HTYPE_CHAR ? elem + 2 : elem;
+    r->v.ref.size = a->elen;
+    r->v.ref.count = a->etype == HTYPE_CHAR ? 0xFFFF : a->elen;
+    r->v.ref.stride = a->etype == HTYPE_MATRIX ? a->ecols : 1;
+    r->v.ref.bytes = a->esize;
+    r->rows = a->erows;
+    r->cols = a->etype == HTYPE_MATRIX ? a->ecols : a->etype == HTYPE_VECTOR;
+}
+
+/* Reference to element index (0-based, row-major) of an arrayed variable */
+static void element(halmat_t *H, uint32_t s, uint32_t index, halmat_val_t *r)
+{
+    const halmat_array_t *a = &H->syt[s].arr;
+    halmat_ref_init(r, a, H->data + a->base + (index % a->count) * a->esize);
+}
+
+halmat_val_t halmat_array_get(halmat_t *H, uint32_t syt, uint32_t index)
+{
+    halmat_val_t r;
+    element(H, syt, index, &r);
+    return halmat_ref_load(H, &r);
+}
+
+void halmat_array_put(halmat_t *H, uint32_t syt, uint32_t index,
+                      const halmat_val_t *val)
+{
+    halmat_val_t r;
+    element(H, syt, index, &r);
+    halmat_ref_store(H, &r, val);
+}
+
+/* Assignment to dest_word when it designates an element: a DSUB result,
+ * a structure field, what a NAME variable points at, or an arrayed
+ * variable inside an array loop.  1 if stored here, 0 if the
+ * destination is an ordinary variable. */
+int halmat_array_store(halmat_t *H, uint32_t dest_word, const halmat_val_t *src)
+{
+    uint32_t d = HALMAT_DATA(dest_word);
+    halmat_val_t ref;
+
+    switch (HALMAT_QUAL(dest_word)) {
+    case QUAL_VAC: {
+        const halmat_val_t *r = &H->vac[VAC_SLOT(d)];
+        if (r->type == HTYPE_REF)
+            halmat_ref_store(H, r, src);
+        return 1;
+    }
+    case QUAL_XPT:
+        if (halmat_struct_ref(H, dest_word, &ref) == 0)
+            halmat_ref_store(H, &ref, src);
+        return 1;
+    case QUAL_SYT:
+        if (d >= HALMAT_MAX_SYT)
+            break;
+        if (H->syt[d].st.name) {
+            if (halmat_struct_ref(H, dest_word, &ref) == 0)
+                halmat_ref_store(H, &ref, src);
+            return 1;
+        }
+        if (H->adlp_n && H->syt[d].arr.count) {
+            halmat_array_put(H, d, H->adlp_i, src);
+            return 1;
+        }
+        break;
+    }
+    return 0;
+}
+
+/* ---- array loops ---- */
+
+static const double *fetch_d(halmat_t *H, const aloop_t *L, const kopnd_t *o,
+                             double *tmp)
+{
+    uint32_t n = L->n;
+    const int32_t *s;
+
+    switch (o->kind) {
+    case KO_ARR: {
+        const halmat_array_t *a = &H->syt[o->index].arr;
+        if (a->etype == HTYPE_SCALAR)
+            return (const double *)(H->data + a->base);
+        s = (const int32_t *)(H->data + a->base);
+        break;
+    }
+    case KO_TEMP:
+        if (!L->steps[o->index].isint)
+            return L->buf + (size_t)o->index * n;
+        s = (const int32_t *)(L->buf + (size_t)o->index * n);
+        break;
+    default: {
+        halmat_val_t v = halmat_resolve_operand(H, o->word);
+        double x = num(&v);
+        for (uint32_t i = 0; i < n; i++)
+            tmp[i] = x;
+        return tmp;
+    }
+    }
+    for (uint32_t i = 0; i < n; i++)
+        tmp[i] = (double)s[i];
+    return tmp;
+}
+
+static const int32_t *fetch_i(halmat_t *H, const aloop_t *L, const kopnd_t *o,
+                              double *tmp)
+{
+    uint32_t n = L->n;
+    int32_t *t = (int32_t *)tmp;
+    const double *s;
+
+    switch (o->kind) {
+    case KO_ARR: {
+        const halmat_array_t *a = &H->syt[o->index].arr;
+        if (a->etype == HTYPE_INTEGER)
+            return (const int32_t *)(H->data + a->base);
+        s = (const double *)(H->data + a->base);
+        break;
+    }
+    case KO_TEMP:
+        if (L->steps[o->index].isint)
+            return (const int32_t *)(L->buf + (size_t)o->index * n);
+        s = L->buf + (size_t)o->index * n;
+        break;
+    default: {
+        halmat_val_t v = halmat_resolve_operand(H, o->word);
+        int32_t x = to_int(&v);
+        for (uint32_t i = 0; i < n; i++)
+            t[i] = x;
+        return t;
+    }
+    }
+    for (uint32_t i = 0; i < n; i++)
+        t[i] = (int32_t)s[i];
+    return t;
+}
+
+/* Whole-array evaluation of a compiled loop.  0 leaves the loop to the
+ * interpreter: a zero divisor is reported there, at its element. */
+static int run_kernel(halmat_t *H, const aloop_t *L)
+{
+    uint32_t n = L->n;
+    double *x = L->buf + (size_t)L->nsteps * n;
+    double *y = x + n;
+
+    for (int k = 0; k < L->nsteps; k++) {
+        const kstep_t *s = &L->steps[k];
+        double  *restrict t  = L->buf + (size_t)k * n;
+        int32_t *restrict ti = (int32_t *)t;
+        const double  *a, *b;
+        const int32_t *ia, *ib;
+
+        switch (s->op) {
+        case K_SADD:
+            a = fetch_d(H, L, &s->src[0], x);
+            b = fetch_d(H, L, &s->src[1], y);
+            for (uint32_t i = 0; i < n; i++) t[i] = a[i] + b[i];
+            break;
+        case K_SSUB:
+            a = fetch_d(H, L, &s->src[0], x);
+            b = fetch_d(H, L, &s->src[1], y);
+            for (uint32_t i = 0; i < n; i++) t[i] = a[i] - b[i];
+            break;
+        case K_SSPR:
+            a = fetch_d(H, L, &s->src[0], x);
+            b = fetch_d(H, L, &s->src[1], y);
+            for (uint32_t i = 0; i < n; i++) t[i] = a[i] * b[i];
+            break;
+        case K_SSDV:
+            a = fetch_d(H, L, &s->src[0], x);
+            b = fetch_d(H, L, &s->src[1], y);
+            for (uint32_t i = 0; i < n; i++)
+                if (b[i] == 0.0)
+                    return 0;
+            for (uint32_t i = 0; i < n; i++) t[i] = a[i] / b[i];
+            break;
+        case K_SNEG:
+            a = fetch_d(H, L, &s->src[0], x);
+            for (uint32_t i = 0; i < n; i++) t[i] = -a[i];
+            break;
+        case K_STOS:
+            a = fetch_d(H, L, &s->src[0], x);
+            memcpy(t, a, n * sizeof(double));
+            break;
+        case K_IADD:
+            ia = fetch_i(H, L, &s->src[0], x);
+            ib = fetch_i(H, L, &s->src[1], y);
+            for (uint32_t i = 0; i < n; i++) ti[i] = ia[i] + ib[i];
+            break;
+        case K_ISUB:
+            ia = fetch_i(H, L, &s->src[0], x);
+            ib = fetch_i(H, L, &s->src[1], y);
+            for (uint32_t i = 0; i < n; i++) ti[i] = ia[i] - ib[i];
+            break;
+        case K_IIPR:
+            ia = fetch_i(H, L, &s->src[0], x);
+            ib = fetch_i(H, L, &s->src[1], y);
+            for (uint32_t i = 0; i < n; i++) ti[i] = ia[i] * ib[i];
+            break;
+        case K_INEG:
+            ia = fetch_i(H, L, &s->src[0], x);
+            for (uint32_t i = 0; i < n; i++) ti[i] = -ia[i];
+            break;
+        case K_ITOI:
+            ia = fetch_i(H, L, &s->src[0], x);
+            memcpy(ti, ia, n * sizeof(int32_t));
+            break;
+        case K_BFNC:
+            /* a domain error is left for the interpreter to report */
+            if (H->hfp)
+                return 0;
+            a = fetch_d(H, L, &s->src[0], x);
+            b = s->nsrc == 2 ? fetch_d(H, L, &s->src[1], y) : NULL;
+            halmat_builtin_batch(s->dest, t, a, b, n);
+            for (uint32_t i = 0; i < n; i++)
+                if (!isfinite(t[i]))
+                    return 0;
+            break;
+        case K_STORE: {
+            const halmat_array_t *d = &H->syt[s->dest].arr;
+            if (d->etype == HTYPE_SCALAR)
+                memmove(H->data + d->base, fetch_d(H, L, &s->src[0], x),
+                        n * sizeof(double));
+            else
+                memmove(H->data + d->base, fetch_i(H, L, &s->src[0], x),
+                        n * sizeof(int32_t));
+            H->syt[s->dest].allocated = 1;
+            break;
+        }
+        }
+    }
+    H->cycle_count += (uint64_t)n * (L->nops + 1);
+    return 1;
+}
+
+int halmat_array_exec(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag)
+{
+    struct halmat_arrays *A = H->arrays;
+    uint32_t pc = H->pc;
+    (void)tag;
+
+    switch (popcode) {
+
+    case POP_DSUB:
+    case POP_TSUB: {
+        halmat_val_t r;
+        uint32_t k = A && A->plan_at ? A->plan_at[pc] : 0;
+        if (!k) {
+            memset(&r, 0, sizeof(r));
+        } else {
+            int rc = subscript(H, pc, &A->plans[k - 1], &r);
+            if (rc < 0)
+                return rc;
+        }
+        halmat_store_vac(H, pc, r);
+        break;
+    }
+
+    case POP_ADLP:
+    case POP_IDLP: {
+        uint32_t k = A && A->loop_at ? A->loop_at[pc] : 0;
+        if (!k)
+            break;
+        const aloop_t *L = &A->loops[k - 1];
+        uint32_t done = L->end + HALMAT_NUMOP(H->code[L->end]) + 1;
+
+        if (L->nsteps && run_kernel(H, L)) {
+            if (H->cov)
+                halmat_cov_span(H, pc + numop + 1, done, L->n);
+            H->pc = done;
+            return HALMAT_OK;
+        }
+
+        /* extents: from the operands, else from the body's arrays */
+        uint32_t n = 1, nd = 0;
+        for (uint32_t i = 1; i <= numop; i++) {
+            uint32_t w = H->code[pc + i];
+            uint32_t d = HALMAT_DATA(w);
+            if (HALMAT_QUAL(w) == QUAL_SYT && d < HALMAT_MAX_SYT &&
+                H->syt[d].arr.count) {
+                for (int j = 0; j < H->syt[d].arr.ndim && nd < HALMAT_MAX_DIMS; j++)
+                    H->adlp_ext[nd++] = H->syt[d].arr.extent[j];
+            } else if (nd < HALMAT_MAX_DIMS) {
+                halmat_val_t v = halmat_resolve_operand(H, w);
+                int32_t e = to_int(&v);
+                H->adlp_ext[nd++] = (uint16_t)(e > 0 ? e : 0);
+            }
+        }
+        if (!numop)
+            for (nd = 0; nd < L->ndim; nd++)
+                H->adlp_ext[nd] = L->ext[nd];
+        for (uint32_t i = 0; i < nd; i++)
+            n *= H->adlp_ext[i];
+        if (!nd || !n) {
+            H->pc = done;
+            return HALMAT_OK;
+        }
+        H->adlp_ndim = nd;
+        H->adlp_n = n;
+        H->adlp_i = 0;
+        H->adlp_pc = pc + numop + 1;
+        break;
+    }
+
+    case POP_DLPE:
+        if (H->adlp_n && ++H->adlp_i < H->adlp_n) {
+            H->pc = H->adlp_pc;
+            return HALMAT_OK;
+        }
+        H->adlp_n = 0;
+        break;
+    }
+
+    H->pc = pc + numop + 1;
+    return HALMAT_OK;
+}
+
+/* ---- load-time pass ---- */
+
+static int kernel_op(uint32_t pop, uint32_t numop, int *isint)
+{
+    *isint = 0;
+    switch (pop) {
+    case POP_SADD: return numop == 2 ? K_SADD : -1;
+    case POP_SSUB: return numop == 2 ? K_SSUB : -1;
+    case POP_SSPR: return numop == 2 ? K_SSPR : -1;
+    case POP_SSDV: return numop == 2 ? K_SSDV : -1;
+    case POP_SNEG: return numop == 1 ? K_SNEG : -1;
+    case POP_ITOS:
+    case POP_STOS: return numop == 1 ? K_STOS : -1;
+    case POP_SASN:
+    case POP_IASN: return numop == 2 ? K_STORE : -1;
+    }
+    *isint = 1;
+    switch (pop) {
+    case POP_IADD: return numop == 2 ? K_IADD : -1;
+    case POP_ISUB: return numop == 2 ? K_ISUB : -1;
+    case POP_IIPR: return numop == 2 ? K_IIPR : -1;
+    case POP_INEG: return numop == 1 ? K_INEG : -1;
+    case POP_STOI:
+    case POP_ITOI: return numop == 1 ? K_ITOI : -1;
+    }
+    return -1;
+}
+
+/* A builtin halmat_builtin_batch evaluates, called with n arguments */
+static int batch_fn(uint32_t num, uint32_t n)
+{
+    double r, x = 0;
+    int unary = halmat_builtin_batch((int)num, &r, &x, NULL, 0) == 0;
+    if (n == 1)
+        return unary;
+    return n == 2 && !unary && halmat_builtin_batch((int)num, &r, &x, &x, 0) == 0;
+}
+
+static int scalar_operand(halmat_t *H, const kstep_t *steps, const kopnd_t *o)
+{
+    if (o->kind == KO_ARR)
+        return H->syt[o->index].arr.etype == HTYPE_SCALAR;
+    return o->kind == KO_TEMP && !steps[o->index].isint;
+}
+
+static int whole_array(halmat_t *H, uint32_t s, uint32_t n)
+{
+    const halmat_array_t *a = &H->syt[s].arr;
+    return a->count == n &&
+           (a->etype == HTYPE_SCALAR || a->etype == HTYPE_INTEGER);
+}
+
+/* Operand of a kernel step; -1 if the loop cannot be compiled */
+static int kernel_operand(halmat_t *H, const aloop_t *L, uint32_t start,
+                          const kstep_t *steps, const uint32_t *addr,
+                          int nsteps, uint32_t w, kopnd_t *o)
+{
+    uint32_t d = HALMAT_DATA(w);
+    memset(o, 0, sizeof(*o));
+    switch (HALMAT_QUAL(w)) {
+    case QUAL_SYT:
+        if (d >= HALMAT_MAX_SYT)
+            return -1;
+        if (H->syt[d].arr.count) {
+            if (!whole_array(H, d, L->n))
+                return -1;
+            o->kind = KO_ARR;
+            o->index = (uint16_t)d;
+            return 0;
+        }
+        o->kind = KO_BCAST;
+        o->word = w;
+        return 0;
+    case QUAL_VAC: {
+        /* VAC operands hold the producer's address truncated to 16 bits */
+        for (int k = 0; k < nsteps; k++)
+            if ((addr[k] & 0xFFFF) == d) {
+                if (steps[k].op == K_STORE)
+                    return -1;
+                o->kind = KO_TEMP;
+                o->index = (uint16_t)k;
+                return 0;
+            }
+        /* Computed before the loop: the nearest operator below start
+         * with that key, and no step of the body sharing its slot */
+        uint32_t p = (start & ~0xFFFFu) | d;
+        if (p >= start) {
+            if (start < 0x10000)
+                return -1;
+            p -= 0x10000;
+        }
+        if (!HALMAT_IS_OP(H->code[p]))
+            return -1;
+        for (uint32_t a = halmat_op_at(H, start); a < L->end; a = NEXT_OP(H, a))
+            if (VAC_SLOT(a) == VAC_SLOT(p))
+                return -1;
+        o->kind = KO_BCAST;
+        o->word = w;
+        return 0;
+    }
+    case QUAL_LIT:
+    case QUAL_IMD:
+        o->kind = KO_BCAST;
+        o->word = w;
+        return 0;
+    }
+    return -1;
+}
+
+static void compile(halmat_t *H, aloop_t *L, uint32_t start)
+{
+    kstep_t  steps[KERNEL_MAX];
+    uint32_t addr[KERNEL_MAX];
+    int nsteps = 0, stores = 0;
+
+    for (uint32_t a = halmat_op_at(H, start); a < L->end; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        if (nsteps == KERNEL_MAX)
+            return;
+        uint32_t pop = HALMAT_POPCODE(w), n = HALMAT_NUMOP(w);
+        int isint;
+        int op = pop == POP_BFNC ? (batch_fn(HALMAT_TAG(w), n) ? K_BFNC : -1)
+                                 : kernel_op(pop, n, &isint);
+        if (op < 0 || (stores && op != K_STORE))
+            return;
+
+        kstep_t *k = &steps[nsteps];
+        memset(k, 0, sizeof(*k));
+        k->op = (uint8_t)op;
+        k->isint = op == K_BFNC ? 0 : (uint8_t)isint;
+        k->nsrc = (uint8_t)n;
+        if (kernel_operand(H, L, start, steps, addr, nsteps, H->code[a + 1],
+                           &k->src[0]) < 0)
+            return;
+        if (op == K_BFNC) {
+            /* SCALAR arguments, so no INTEGER forms (ABS, MOD) arise */
+            k->dest = (uint16_t)HALMAT_TAG(w);
+            if (n == 2 && kernel_operand(H, L, start, steps, addr, nsteps,
+                                         H->code[a + 2], &k->src[1]) < 0)
+                return;
+            for (uint32_t j = 0; j < n; j++)
+                if (!scalar_operand(H, steps, &k->src[j]))
+                    return;
+        } else if (op == K_STORE) {
+            uint32_t dw = H->code[a + 2];
+            uint32_t d = HALMAT_DATA(dw);
+            if (HALMAT_QUAL(dw) != QUAL_SYT || d >= HALMAT_MAX_SYT ||
+                !whole_array(H, d, L->n))
+                return;
+            k->dest = (uint16_t)d;
+            stores++;
+        } else if (n == 2 &&
+                   kernel_operand(H, L, start, steps, addr, nsteps,
+                                  H->code[a + 2], &k->src[1]) < 0) {
+            return;
+        }
+        addr[nsteps++] = a;
+    }
+    if (!stores)
+        return;
+
+    L->steps = malloc((size_t)nsteps * sizeof(kstep_t));
+    L->buf = malloc(((size_t)nsteps + 2) * L->n * sizeof(double));
+    if (!L->steps || !L->buf) {
+        free(L->steps);
+        free(L->buf);
+        L->steps = NULL;
+        L->buf = NULL;
+        return;
+    }
+    memcpy(L->steps, steps, (size_t)nsteps * sizeof(kstep_t));
+    L->nsteps = (uint8_t)nsteps;
+}
+
+/* Loop starting at the ADLP/IDLP at pc: its DLPE and, where the
+ * extents are known now, its element count */
+static int find_loop(halmat_t *H, uint32_t pc, aloop_t *L)
+{
+    uint32_t numop = HALMAT_NUMOP(H->code[pc]);
+    uint32_t start = pc + numop + 1;
+
+    memset(L, 0, sizeof(*L));
+    for (uint32_t a = halmat_op_at(H, start); a < H->code_len; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        uint32_t pop = HALMAT_POPCODE(w);
+        if (pop == POP_ADLP || pop == POP_IDLP)
+            return -1;
+        if (pop == POP_DLPE) {
+            L->end = a;
+            break;
+        }
+        L->nops++;
+        if (!L->ndim)
+            for (uint32_t k = 1; k <= HALMAT_NUMOP(w); k++) {
+                uint32_t ow = H->code[a + k], d = HALMAT_DATA(ow);
+                if (HALMAT_QUAL(ow) == QUAL_SYT && d < HALMAT_MAX_SYT &&
+                    H->syt[d].arr.count) {
+                    L->ndim = H->syt[d].arr.ndim;
+                    memcpy(L->ext, H->syt[d].arr.extent, sizeof(L->ext));
+                    break;
+                }
+            }
+    }
+    if (!L->end)
+        return -1;
+
+    if (numop) {                            /* explicit extents */
+        L->ndim = 0;
+        for (uint32_t i = 1; i <= numop; i++) {
+            uint32_t w = H->code[pc + i], d = HALMAT_DATA(w);
+            if (HALMAT_QUAL(w) == QUAL_SYT && d < HALMAT_MAX_SYT &&
+                H->syt[d].arr.count) {
+                for (int j = 0; j < H->syt[d].arr.ndim && L->ndim < HALMAT_MAX_DIMS; j++)
+                    L->ext[L->ndim++] = H->syt[d].arr.extent[j];
+            } else if ((HALMAT_QUAL(w) == QUAL_IMD || HALMAT_QUAL(w) == QUAL_LIT) &&
+                       L->ndim < HALMAT_MAX_DIMS) {
+                halmat_val_t v = halmat_resolve_operand(H, w);
+                int32_t e = to_int(&v);
+                L->ext[L->ndim++] = (uint16_t)(e > 0 ? e : 0);
+            } else {
+                return 0;                   /* known only at run time */
+            }
+        }
+    }
+    L->n = L->ndim ? 1 : 0;
+    for (int d = 0; d < L->ndim; d++)
+        L->n *= L->ext[d];
+    return 0;
+}
+
+/* A DSUB/TSUB whose first operand is a variable or a structure field */
+static int subscripted(const halmat_t *H, uint32_t a, uint32_t numop)
+{
+    uint32_t w = H->code[a + 1];
+    if (numop < 1)
+        return 0;
+    if (HALMAT_QUAL(w) == QUAL_XPT)
+        return HALMAT_DATA(w) < H->code_len;
+    return HALMAT_QUAL(w) == QUAL_SYT && HALMAT_DATA(w) < HALMAT_MAX_SYT;
+}
+
+void halmat_array_build(halmat_t *H, int kernels)
+{
+    uint32_t nsub = 0, nloop = 0;
+
+    for (uint32_t a = halmat_op_at(H, 0); a < H->code_len; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        uint32_t pop = HALMAT_POPCODE(w), n = HALMAT_NUMOP(w);
+        if ((pop == POP_DSUB || pop == POP_TSUB) && subscripted(H, a, n)) {
+            nsub++;
+            if (HALMAT_QUAL(H->code[a + 1]) == QUAL_SYT &&
+                !H->syt[HALMAT_DATA(H->code[a + 1])].arr.etype)
+                infer(H, a, n, HALMAT_TAG(w));
+        }
+        if (pop == POP_ADLP || pop == POP_IDLP)
+            nloop++;
+    }
+
+    for (uint32_t s = 1; s < HALMAT_MAX_SYT; s++) {
+        syt_entry_t *e = &H->syt[s];
+        if (e->st.kind || e->st.name || e->arr.etype == HTYPE_STRUCT)
+            continue;                       /* laid out by halmat_struct_build */
+        if (e->arr.ndim) {
+            allocate(H, s);
+        } else if (!e->allocated && (e->arr.etype == HTYPE_MATRIX ||
+                                     e->arr.etype == HTYPE_VECTOR)) {
+            e->val.type = e->arr.etype;     /* shape for component subscripts */
+            e->val.rows = e->arr.erows;
+            e->val.cols = e->arr.ecols;
+        }
+    }
+
+    if (!nsub && !nloop)
+        return;
+
+    struct halmat_arrays *A = H->arrays;     /* may hold the names already */
+    if (!A && !(A = H->arrays = calloc(1, sizeof(*A))))
+        return;
+    A->plan_at = calloc(H->code_len, sizeof(uint32_t));
+    A->loop_at = calloc(H->code_len, sizeof(uint32_t));
+    A->plans = calloc(nsub ? nsub : 1, sizeof(sub_plan_t));
+    A->loops = calloc(nloop ? nloop : 1, sizeof(aloop_t));
+    if (!A->plan_at || !A->loop_at || !A->plans || !A->loops) {
+        free(A->plan_at);
+        free(A->loop_at);
+        free(A->plans);
+        free(A->loops);
+        A->plan_at = A->loop_at = NULL;
+        A->plans = NULL;
+        A->loops = NULL;
+        return;
+    }
+
+    for (uint32_t a = halmat_op_at(H, 0); a < H->code_len; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        uint32_t pop = HALMAT_POPCODE(w), n = HALMAT_NUMOP(w);
+        if ((pop == POP_DSUB || pop == POP_TSUB) && subscripted(H, a, n)) {
+            make_plan(H, a, n, &A->plans[A->nplans]);
+            A->plan_at[a] = ++A->nplans;
+        }
+        if (pop == POP_ADLP || pop == POP_IDLP) {
+            aloop_t *L = &A->loops[A->nloops];
+            if (find_loop(H, a, L) == 0) {
+                if (kernels && L->n)
+                    compile(H, L, a + n + 1);
+                A->loop_at[a] = ++A->nloops;
+            }
+        }
+    }
+}
+
+void halmat_array_free(halmat_t *H)
+{
+    struct halmat_arrays *A = H->arrays;
+    if (!A)
+        return;
+    for (uint32_t i = 0; i < A->nloops; i++) {
+        free(A->loops[i].steps);
+        free(A->loops[i].buf);
+    }
+    free(A->plan_at);
+    free(A->loop_at);
+    free(A->plans);
+    free(A->loops);
+    free(A->names);
+    free(A);
+    H->arrays = NULL;
+}
@@ -0,0 +1,623 @@
+/* halmat-bench: interpreter benchmarks.
+ *
+ * Microbenchmarks are written with halmat_gen, one per kind of work,
+ * each an outer DO FOR around a small body.  Macrobenchmarks are the
+ * compiled sample programs in data/out_*, run inside an outer DO FOR
+ * spliced in after the program's first statement, so their INITIALs
+ * run again every time round.  Synthetic benchmarks are halmat_synth
+ * programs of 1 to 256 blocks from a fixed seed, run once each, for
+ * how load, analysis and run time scale with program size.  Each run
+ * is a child process that sets up the interpreter as yaHALMAT does and
+ * times the loading and analyses, then halmat_run and the I/O
+ * shutdown; the best of --runs is kept, with the child's peak RSS.
+ *
+ * Results go to stdout as a table and to --json F.  With --baseline F
+ * each benchmark's ns/op is compared with that file's, and any more
+ * than --threshold percent slower is flagged and fails the run. */
+
+#define _DEFAULT_SOURCE             /* wait4() */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "halmat.h"
+#include "halmat_io.h"
+#include "halmat_sched.h"
+#include "halmat_prof.h"
+#include "halmat_synth.h"
+
+static halmat_t H;
+
+typedef struct {
+    uint64_t ops;                   /* operators dispatched */
+    uint64_t ns;
+    uint64_t setup_ns;              /* load and analyses */
+    long     rss_kb;
+    int      rc;
+} bench_result_t;
+
+typedef struct {
+    const char *name;
+    void      (*build)(halmat_gen_t *G, uint32_t n);    /* micro */
+    const char *sample;                                 /* macro */
+    uint32_t    n;                                      /* iterations */
+    uint32_t    blocks;                                 /* synthetic */
+} bench_t;
+
+/* ---- microbenchmarks ---- */
+
+/* Sixteen NOPs a time round: the cost of dispatch itself */
+static void b_dispatch(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t f = halmat_gen_for(G, i, 1, n);
+    for (int k = 0; k < 16; k++)
+        halmat_gen_op(G, POP_NOP, 0, 0);
+    halmat_gen_efor(G, f);
+}
+
+/* X = X * 0.5 + 1; Y = Y + X / 3 - Y / 4; */
+static void b_scalar(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t x = halmat_gen_declare(G, "X", "SCALAR");
+    uint32_t y = halmat_gen_declare(G, "Y", "SCALAR");
+    uint32_t half = halmat_gen_lit(G, 0.5), one = halmat_gen_lit(G, 1);
+    uint32_t three = halmat_gen_lit(G, 3), four = halmat_gen_lit(G, 4);
+    uint32_t f = halmat_gen_for(G, i, 1, n);
+    uint32_t a = halmat_gen_op(G, POP_SSPR, 0, 2, HALMAT_SYT(x), HALMAT_LIT(half));
+    a = halmat_gen_op(G, POP_SADD, 0, 2, HALMAT_VAC(a), HALMAT_LIT(one));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(x));
+    halmat_gen_smrk(G);
+    a = halmat_gen_op(G, POP_SSDV, 0, 2, HALMAT_SYT(x), HALMAT_LIT(three));
+    a = halmat_gen_op(G, POP_SADD, 0, 2, HALMAT_SYT(y), HALMAT_VAC(a));
+    uint32_t b = halmat_gen_op(G, POP_SSDV, 0, 2, HALMAT_SYT(y), HALMAT_LIT(four));
+    a = halmat_gen_op(G, POP_SSUB, 0, 2, HALMAT_VAC(a), HALMAT_VAC(b));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(y));
+    halmat_gen_smrk(G);
+    halmat_gen_efor(G, f);
+}
+
+/* J = I * 2; K = K + J; K = K - I - I; */
+static void b_integer(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t j = halmat_gen_declare(G, "J", "INTEGER");
+    uint32_t k = halmat_gen_declare(G, "K", "INTEGER");
+    uint32_t f = halmat_gen_for(G, i, 1, n);
+    uint32_t a = halmat_gen_op(G, POP_IIPR, 0, 2, HALMAT_SYT(i), HALMAT_IMD(2));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(j));
+    halmat_gen_smrk(G);
+    a = halmat_gen_op(G, POP_IADD, 0, 2, HALMAT_SYT(k), HALMAT_SYT(j));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(k));
+    halmat_gen_smrk(G);
+    a = halmat_gen_op(G, POP_ISUB, 0, 2, HALMAT_SYT(k), HALMAT_SYT(i));
+    a = halmat_gen_op(G, POP_ISUB, 0, 2, HALMAT_VAC(a), HALMAT_SYT(i));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(k));
+    halmat_gen_smrk(G);
+    halmat_gen_efor(G, f);
+}
+
+/* IF I > n/2 THEN K = K + 1; ELSE K = K + 2; */
+static void b_branch(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t k = halmat_gen_declare(G, "K", "INTEGER");
+    uint32_t mid = halmat_gen_lit(G, n / 2);
+    uint32_t f = halmat_gen_for(G, i, 1, n);
+    uint32_t els = halmat_gen_flow(G), out = halmat_gen_flow(G);
+    halmat_gen_op(G, POP_IFHD, 0, 0);
+    uint32_t c = halmat_gen_op(G, POP_IGT, 0, 2, HALMAT_SYT(i), HALMAT_LIT(mid));
+    halmat_gen_op(G, POP_FBRA, 0, 2, HALMAT_INL(els), HALMAT_VAC(c));
+    halmat_gen_smrk(G);
+    uint32_t a = halmat_gen_op(G, POP_IADD, 0, 2, HALMAT_SYT(k), HALMAT_IMD(1));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(k));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_BRA, 1, 1, HALMAT_INL(out));
+    halmat_gen_op(G, POP_LBL, 0, 1, HALMAT_INL(els));
+    a = halmat_gen_op(G, POP_IADD, 0, 2, HALMAT_SYT(k), HALMAT_IMD(2));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(k));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_LBL, 1, 1, HALMAT_INL(out));
+    halmat_gen_efor(G, f);
+}
+
+/* Y = ADD_ONE(I), ADD_ONE: FUNCTION(N) INTEGER; RETURN N + 1; */
+static void b_call(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t y = halmat_gen_declare(G, "Y", "INTEGER");
+    uint32_t fn = halmat_gen_label(G, "ADD_ONE");
+    halmat_gen_source(G, "    FUNCTION(N) INTEGER;\n");
+    uint32_t np = ++G->nsyt;
+    halmat_gen_source(G, "    DECLARE INTEGER, N;\n    CLOSE ADD_ONE;\n");
+
+    halmat_gen_op(G, POP_FDEF, 0, 1, HALMAT_SYT(fn));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_EDCL, 1, 0);
+    uint32_t a = halmat_gen_op(G, POP_IADD, 0, 2, HALMAT_SYT(np), HALMAT_IMD(1));
+    halmat_gen_op(G, POP_RTRN, 0, 1, HALMAT_OPERAND(QUAL_VAC, a, 6));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_CLOS, 0, 1, HALMAT_SYT(fn));
+    halmat_gen_smrk(G);
+
+    uint32_t f = halmat_gen_for(G, i, 1, n);
+    halmat_gen_op(G, POP_XXST, 1, 1, HALMAT_SYT(fn));
+    halmat_gen_op(G, POP_XXAR, 1, 1, HALMAT_OPERAND(QUAL_SYT, i, 6));
+    uint32_t c = halmat_gen_op(G, POP_FCAL, 1, 1, HALMAT_SYT(fn));
+    halmat_gen_op(G, POP_XXND, 1, 0);
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(c), HALMAT_SYT(y));
+    halmat_gen_smrk(G);
+    halmat_gen_efor(G, f);
+}
+
+/* DO FOR S = 1 TO 4; DO CASE S; R = 10; R = 20; R = 30; R = 40; END; */
+static void b_case(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t s = halmat_gen_declare(G, "S", "INTEGER");
+    uint32_t r = halmat_gen_declare(G, "R", "INTEGER");
+    uint32_t f = halmat_gen_for(G, i, 1, n / 4);
+    uint32_t g = halmat_gen_for(G, s, 1, 4);
+    uint32_t c = halmat_gen_flow(G);
+    halmat_gen_op(G, POP_DCAS, 0, 2, HALMAT_INL(c), HALMAT_SYT(s));
+    halmat_gen_smrk(G);
+    for (int k = 1; k <= 4; k++) {
+        halmat_gen_op(G, POP_CLBL, 0, 2, HALMAT_INL(c), HALMAT_INL(halmat_gen_flow(G)));
+        halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_IMD(10 * k), HALMAT_SYT(r));
+        halmat_gen_smrk(G);
+    }
+    halmat_gen_op(G, POP_CLBL, 1, 2, HALMAT_INL(c), HALMAT_INL(halmat_gen_flow(G)));
+    halmat_gen_op(G, POP_ECAS, 0, 1, HALMAT_INL(c));
+    halmat_gen_smrk(G);
+    halmat_gen_efor(G, g);
+    halmat_gen_efor(G, f);
+}
+
+/* DO FOR J = 3, 7, 11, 42; R = R + J; END; */
+static void b_discrete(halmat_gen_t *G, uint32_t n)
+{
+    static const double v[4] = { 3, 7, 11, 42 };
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t j = halmat_gen_declare(G, "J", "INTEGER");
+    uint32_t r = halmat_gen_declare(G, "R", "INTEGER");
+    uint32_t lit[4];
+    for (int k = 0; k < 4; k++)
+        lit[k] = halmat_gen_lit(G, v[k]);
+    uint32_t f = halmat_gen_for(G, i, 1, n / 4);
+    uint32_t g = halmat_gen_flow(G);
+    halmat_gen_op(G, POP_DFOR, 0, 2, HALMAT_INL(g), HALMAT_SYT(j));
+    for (int k = 0; k < 4; k++)
+        halmat_gen_op(G, POP_AFOR, k == 3, 1, HALMAT_LIT(lit[k]));
+    halmat_gen_smrk(G);
+    uint32_t a = halmat_gen_op(G, POP_IADD, 0, 2, HALMAT_SYT(r), HALMAT_SYT(j));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(r));
+    halmat_gen_smrk(G);
+    halmat_gen_efor(G, g);
+    halmat_gen_efor(G, f);
+}
+
+/* C = A B, 3 x 3 */
+static void b_matrix(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t a = halmat_gen_declare(G, "A", "MATRIX(3, 3)");
+    uint32_t b = halmat_gen_declare(G, "B", "MATRIX(3, 3)");
+    uint32_t c = halmat_gen_declare(G, "C", "MATRIX(3, 3)");
+    uint32_t f = halmat_gen_for(G, i, 1, n);
+    uint32_t m = halmat_gen_op(G, POP_MMPR, 0, 2, HALMAT_SYT(a), HALMAT_SYT(b));
+    halmat_gen_op(G, POP_MASN, 0, 2, HALMAT_VAC(m), HALMAT_SYT(c));
+    halmat_gen_smrk(G);
+    halmat_gen_efor(G, f);
+}
+
+/* WRITE(6) I; */
+static void b_write(halmat_gen_t *G, uint32_t n)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t f = halmat_gen_for(G, i, 1, n);
+    halmat_gen_op(G, POP_XXST, 0, 1, HALMAT_IMD(1));
+    halmat_gen_op(G, POP_XXAR, 0, 1, HALMAT_OPERAND(QUAL_SYT, i, 6));
+    halmat_gen_op(G, POP_WRIT, 0, 1, HALMAT_IMD(6));
+    halmat_gen_op(G, POP_XXND, 0, 0);
+    halmat_gen_smrk(G);
+    halmat_gen_efor(G, f);
+}
+
+static const bench_t benches[] = {
+    { "dispatch",        b_dispatch, NULL, 500000, 0 },
+    { "scalar",          b_scalar,   NULL, 500000, 0 },
+    { "integer",         b_integer,  NULL, 500000, 0 },
+    { "compare_branch",  b_branch,   NULL, 500000, 0 },
+    { "call_return",     b_call,     NULL, 250000, 0 },
+    { "case",            b_case,     NULL, 500000, 0 },
+    { "discrete_for",    b_discrete, NULL, 500000, 0 },
+    { "matrix_multiply", b_matrix,   NULL, 250000, 0 },
+    { "write",           b_write,    NULL, 100000, 0 },
+    { "simple_do",       NULL, "out_simple_do",    50000, 0 },
+    { "ifelse",          NULL, "out_ifelse",       50000, 0 },
+    { "while",           NULL, "out_while",        50000, 0 },
+    { "discrete",        NULL, "out_discrete_for", 50000, 0 },
+    { "case_sample",     NULL, "out_case",         50000, 0 },
+    { "nested",          NULL, "out_nested",        5000, 0 },
+    { "proc",            NULL, "out_proc",         50000, 0 },
+    { "array",           NULL, "out_array",        50000, 0 },
+    { "matrix",          NULL, "out_matrix",       50000, 0 },
+    { "synth_1",         NULL, NULL,                   0,   1 },
+    { "synth_16",        NULL, NULL,                   0,  16 },
+    { "synth_64",        NULL, NULL,                   0,  64 },
+    { "synth_256",       NULL, NULL,                   0, 256 },
+};
+#define NBENCH (sizeof(benches) / sizeof(benches[0]))
+
+static const char *kind(const bench_t *B)
+{
+    return B->build ? "micro" : B->blocks ? "synth" : "macro";
+}
+
+/* ---- macrobenchmark scaling ---- */
+
+/* Wrap the program in DO FOR over n: the DFOR goes after the MDEF's
+ * statement marker, ahead of the INITIALs, and the EFOR before the
+ * program's CLOSE.  VAC operands past each insertion move with the
+ * code.  Single-block programs only. */
+static int scale_program(halmat_t *P, uint32_t n)
+{
+    uint32_t end = (P->code[1] >> 16) & 0xFFFF;
+    if (P->num_blocks != 1 || end + 7 >= HALMAT_BLOCK_WORDS ||
+        P->lit_count + 2 > HALMAT_MAX_LIT)
+        return -1;
+
+    uint32_t at1 = 0, at2 = 0;
+    for (uint32_t a = 2, smrks = 0; a <= end; a += HALMAT_NUMOP(P->code[a]) + 1) {
+        uint32_t w = P->code[a];
+        if (!HALMAT_IS_OP(w))
+            return -1;
+        if (HALMAT_POPCODE(w) == POP_SMRK && !smrks++)
+            at1 = a + HALMAT_NUMOP(w) + 1;
+        if (HALMAT_POPCODE(w) == POP_CLOS && HALMAT_DATA(P->code[a + 1]) == 1)
+            at2 = a;
+    }
+    if (!at1 || at2 < at1)
+        return -1;
+
+    uint32_t syt = HALMAT_MAX_SYT - 1, flow = HALMAT_MAX_FLOW - 1;
+    uint32_t lo = P->lit_count, hi = lo + 1;
+    P->lit[lo].lit1 = P->lit[hi].lit1 = 1;
+    P->lit[lo].type = P->lit[hi].type = 1;
+    P->lit[lo].lit2 = (int32_t)double_to_ibm_float(1);
+    P->lit[hi].lit2 = (int32_t)double_to_ibm_float(n);
+    P->lit_count += 2;
+
+    for (uint32_t a = 2; a <= end; a++) {
+        uint32_t w = P->code[a];
+        if (HALMAT_IS_OPERAND(w) && HALMAT_QUAL(w) == QUAL_VAC) {
+            uint32_t d = HALMAT_DATA(w);
+            d += (d >= at1 ? 5 : 0) + (d >= at2 ? 2 : 0);
+            P->code[a] = (w & 0xFFFF) | d << 16;
+        }
+    }
+    memmove(&P->code[at2 + 7], &P->code[at2], (end + 1 - at2) * sizeof(uint32_t));
+    memmove(&P->code[at1 + 5], &P->code[at1], (at2 - at1) * sizeof(uint32_t));
+    P->code[at1] = HALMAT_OPERATOR(POP_DFOR, 4, 1);
+    P->code[at1 + 1] = HALMAT_INL(flow);
+    P->code[at1 + 2] = HALMAT_SYT(syt);
+    P->code[at1 + 3] = HALMAT_LIT(lo);
+    P->code[at1 + 4] = HALMAT_LIT(hi);
+    P->code[at2 + 5] = HALMAT_OPERATOR(POP_EFOR, 1, 0);
+    P->code[at2 + 6] = HALMAT_INL(flow);
+    P->code[1] = (end + 7) << 16;
+    return 0;
+}
+
+/* ---- running ---- */
+
+/* In the child: load and prepare as yaHALMAT does, then time the run */
+static int child_run(const char *dir, uint32_t scale, bench_result_t *r)
+{
+    char path[1100];
+    uint64_t t0 = halmat_prof_now();
+    halmat_init(&H);
+    snprintf(path, sizeof(path), "%s/halmat.bin", dir);
+    if (halmat_load(&H, path) != 0)
+        return -1;
+    snprintf(path, sizeof(path), "%s/litfile.bin", dir);
+    halmat_load_litfile(&H, path);
+    snprintf(path, sizeof(path), "%s/SOURCECO.txt", dir);
+    if (halmat_load_strings(&H, path) == 0)
+        halmat_load_declares(&H, path);
+    if (scale && scale_program(&H, scale) != 0) {
+        fprintf(stderr, "halmat-bench: cannot scale %s\n", dir);
+        return -1;
+    }
+
+    halmat_build_flow_table(&H);
+    halmat_struct_build(&H);
+    halmat_array_build(&H, 1);
+    halmat_fuse_build(&H);
+    halmat_char_build(&H);
+
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    halmat_io_init(&H);
+
+    uint64_t t1 = halmat_prof_now();
+    r->setup_ns = t1 - t0;
+    halmat_run(&H);
+    halmat_io_shutdown(&H);
+    r->ns = halmat_prof_now() - t1;
+    r->ops = H.cycle_count;
+    r->rc = H.halted < 0 ? -1 : 0;
+    return 0;
+}
+
+static int run_once(const char *dir, uint32_t scale, bench_result_t *r)
+{
+    int fd[2];
+    if (pipe(fd) != 0)
+        return -1;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fd[0]);
+        close(fd[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        bench_result_t c;
+        memset(&c, 0, sizeof(c));
+        close(fd[0]);
+        if (child_run(dir, scale, &c) != 0)
+            c.rc = -1;
+        if (write(fd[1], &c, sizeof(c)) != (ssize_t)sizeof(c))
+            _exit(2);
+        _exit(0);
+    }
+    close(fd[1]);
+    ssize_t got = read(fd[0], r, sizeof(*r));
+    close(fd[0]);
+
+    int status;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    if (wait4(pid, &status, 0, &ru) < 0 || got != (ssize_t)sizeof(*r) ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    r->rss_kb = ru.ru_maxrss;
+    return r->rc;
+}
+
+/* ---- baseline ---- */
+
+typedef struct {
+    char   name[32];
+    double ns_per_op;
+} baseline_t;
+
+/* The name and ns_per_op of each entry in a file this program wrote */
+static int read_baseline(const char *path, baseline_t *b, int max)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "halmat-bench: cannot read %s\n", path);
+        return -1;
+    }
+    char line[512];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), fp)) {
+        char *p = strstr(line, "\"name\": \"");
+        char *q = strstr(line, "\"ns_per_op\": ");
+        if (!p || !q)
+            continue;
+        p += 9;
+        size_t len = strcspn(p, "\"");
+        if (len >= sizeof(b[n].name))
+            continue;
+        memcpy(b[n].name, p, len);
+        b[n].name[len] = '\0';
+        b[n].ns_per_op = strtod(q + 13, NULL);
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "halmat-bench - HALMAT interpreter benchmarks\n"
+        "Usage: %s [options]\n"
+        "\n"
+        "Options:\n"
+        "  --json F       Write the results to F as JSON\n"
+        "  --baseline F   Compare ns/op with an earlier --json file\n"
+        "  --threshold P  Percent slower that counts as a regression (default 10)\n"
+        "  --runs N       Best of N runs (default 3)\n"
+        "  --scale X      Multiply every iteration count by X (default 1;\n"
+        "                 synthetic programs are not scaled)\n"
+        "  --data DIR     Sample programs (default ../data)\n"
+        "  --only NAME    Run one benchmark\n"
+        "  --keep DIR     Leave the generated programs in DIR/<name>\n"
+        "  --list         List the benchmarks\n"
+        "\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *json = NULL;
+    const char *baseline = NULL;
+    const char *data = "../data";
+    const char *only = NULL;
+    const char *keep = NULL;
+    double threshold = 10.0;
+    double scale = 1.0;
+    int runs = 3;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+            if (runs < 1)
+                runs = 1;
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = strtod(argv[++i], NULL);
+            if (scale <= 0)
+                scale = 1.0;
+        } else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            data = argv[++i];
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) {
+            keep = argv[++i];
+        } else if (strcmp(argv[i], "--list") == 0) {
+            for (size_t b = 0; b < NBENCH; b++)
+                printf("%-16s %s\n", benches[b].name, kind(&benches[b]));
+            return 0;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    baseline_t base[64];
+    int nbase = 0;
+    if (baseline && (nbase = read_baseline(baseline, base, 64)) < 0)
+        return 1;
+
+    char tmp[] = "/tmp/halmat-bench-XXXXXX";
+    if (!mkdtemp(tmp)) {
+        fprintf(stderr, "halmat-bench: cannot make a work directory\n");
+        return 1;
+    }
+
+    FILE *out = json ? fopen(json, "w") : NULL;
+    if (json && !out) {
+        fprintf(stderr, "halmat-bench: cannot write %s\n", json);
+        return 1;
+    }
+    if (out)
+        fprintf(out, "{\n  \"version\": 1,\n  \"runs\": %d,\n  \"scale\": %g,\n"
+                "  \"benchmarks\": [", runs, scale);
+
+    printf("  %-16s %5s %12s %10s %14s %9s %9s", "benchmark", "kind", "ops", "ns/op",
+           "ops/sec", "setup ms", "RSS KB");
+    if (nbase)
+        printf(" %9s", "vs base");
+    printf("\n");
+
+    int regressions = 0, failures = 0, first = 1;
+    for (size_t b = 0; b < NBENCH; b++) {
+        const bench_t *B = &benches[b];
+        if (only && strcmp(only, B->name) != 0)
+            continue;
+        uint32_t n = (uint32_t)(B->n * scale);
+        if (n < 4)
+            n = 4;
+
+        char dir[1024];
+        if (!B->sample) {
+            halmat_gen_t G;
+            snprintf(dir, sizeof(dir), "%s/%s", keep ? keep : tmp, B->name);
+            if ((mkdir(dir, 0700) != 0 && !keep) || halmat_gen_init(&G, "BENCH") != 0) {
+                failures++;
+                continue;
+            }
+            int rc = 0;
+            if (B->build) {
+                B->build(&G, n);
+            } else {
+                halmat_synth_opts_t o;
+                halmat_synth_stats_t st;
+                halmat_synth_defaults(&o);
+                o.blocks = B->blocks;
+                rc = halmat_synth(&G, &o, &st);
+            }
+            if (rc == 0)
+                rc = halmat_gen_write(&G, dir);
+            halmat_gen_free(&G);
+            if (rc != 0) {
+                failures++;
+                continue;
+            }
+        } else {
+            snprintf(dir, sizeof(dir), "%s/%s", data, B->sample);
+        }
+
+        bench_result_t best;
+        memset(&best, 0, sizeof(best));
+        uint64_t setup = 0;
+        int ok = 1;
+        for (int r = 0; r < runs; r++) {
+            bench_result_t res;
+            memset(&res, 0, sizeof(res));
+            if (run_once(dir, B->sample ? n : 0, &res) != 0 || !res.ops) {
+                ok = 0;
+                break;
+            }
+            if (!setup || res.setup_ns < setup)
+                setup = res.setup_ns;
+            if (!best.ns || res.ns < best.ns)
+                best = res;
+            if (res.rss_kb > best.rss_kb)
+                best.rss_kb = res.rss_kb;
+        }
+        if (!ok) {
+            printf("  %-16s failed\n", B->name);
+            failures++;
+            continue;
+        }
+
+        best.setup_ns = setup;
+        double nsop = (double)best.ns / (double)best.ops;
+        double opss = (double)best.ops * 1e9 / (double)best.ns;
+        printf("  %-16s %5s %12llu %10.2f %14.0f %9.3f %9ld", B->name, kind(B),
+               (unsigned long long)best.ops, nsop, opss,
+               (double)best.setup_ns / 1e6, best.rss_kb);
+        for (int k = 0; k < nbase; k++) {
+            if (strcmp(base[k].name, B->name) != 0 || base[k].ns_per_op <= 0)
+                continue;
+            double d = (nsop / base[k].ns_per_op - 1.0) * 100.0;
+            printf(" %+8.1f%%%s", d, d > threshold ? "  REGRESSION" : "");
+            regressions += d > threshold;
+        }
+        printf("\n");
+
+        if (out) {
+            fprintf(out, "%s\n    { \"name\": \"%s\", \"kind\": \"%s\", \"ops\": %llu, "
+                    "\"ns\": %llu, \"ns_per_op\": %.4f, \"ops_per_sec\": %.0f, "
+                    "\"setup_ns\": %llu, \"rss_kb\": %ld }", first ? "" : ",", B->name,
+                    kind(B), (unsigned long long)best.ops,
+                    (unsigned long long)best.ns, nsop, opss,
+                    (unsigned long long)best.setup_ns, best.rss_kb);
+            first = 0;
+        }
+        if (!B->sample && !keep) {
+            static const char *const files[] = { "halmat.bin", "litfile.bin", "SOURCECO.txt" };
+            for (int f = 0; f < 3; f++) {
+                char path[1100];
+                snprintf(path, sizeof(path), "%s/%s", dir, files[f]);
+                remove(path);
+            }
+            rmdir(dir);
+        }
+    }
+    rmdir(tmp);
+
+    if (out) {
+        fprintf(out, "\n  ]\n}\n");
+        fclose(out);
+    }
+    if (regressions)
+        printf("\n%d benchmark(s) more than %.0f%% slower than %s\n",
+               regressions, threshold, baseline);
+    return regressions || failures ? 1 : 0;
+}
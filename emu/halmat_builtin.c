@@ -0,0 +1,577 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <time.h>
+#include "halmat_builtin.h"
+#include "halmat_matrix.h"
+#include "halmat_sched.h"
+#include "halmat_replay.h"
+
+typedef int (*bi_fn)(halmat_t *H, int num, const halmat_val_t *a,
+                     const uint32_t *w, int n, halmat_val_t *r);
+
+typedef struct {
+    const char *name;
+    uint8_t     min_args, max_args;
+    bi_fn       fn;
+} bi_entry_t;
+
+static double num_val(const halmat_val_t *v)
+{
+    return (v->type == HTYPE_INTEGER) ? (double)v->v.integer : v->v.scalar;
+}
+
+static int all_int(const halmat_val_t *a, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (a[i].type != HTYPE_INTEGER)
+            return 0;
+    return 1;
+}
+
+static void set_scalar(halmat_val_t *r, double x)
+{
+    r->type = HTYPE_SCALAR;
+    r->v.scalar = x;
+}
+
+/* Out of range saturates, as READ does; NaN gives 0 */
+static void set_int(halmat_val_t *r, double x)
+{
+    r->type = HTYPE_INTEGER;
+    r->v.integer = x >= 2147483647.0 ? INT32_MAX
+                 : x <= -2147483648.0 ? INT32_MIN
+                 : x == x ? (int32_t)x : 0;
+}
+
+static int domain(halmat_t *H, int num)
+{
+    fprintf(stderr, "halmat_builtin: %s argument out of range at PC=%u\n",
+            halmat_builtin_name(num), H->pc);
+    return HALMAT_ERR_BOUNDS;
+}
+
+static int elems(const halmat_val_t *v)
+{
+    int n = v->type == HTYPE_MATRIX ? v->rows * v->cols : v->rows;
+    return n > 64 ? 64 : n;
+}
+
+/* ---- scalar functions ---- */
+
+static double mod_floor(double a, double b)
+{
+    return a - b * floor(a / b);
+}
+
+/* One-argument SCALAR functions, shared with the batch entry */
+static double (*const unary_fn[BI_COUNT])(double) = {
+    [BI_COS] = cos,     [BI_EXP] = exp,     [BI_LOG] = log,
+    [BI_SIN] = sin,     [BI_TAN] = tan,     [BI_COSH] = cosh,
+    [BI_SINH] = sinh,   [BI_SQRT] = sqrt,   [BI_TANH] = tanh,
+    [BI_ARCCOS] = acos, [BI_ARCSIN] = asin, [BI_ARCTAN] = atan,
+    [BI_ARCCOSH] = acosh, [BI_ARCSINH] = asinh, [BI_ARCTANH] = atanh,
+    [BI_ABS] = fabs,
+};
+
+static double (*const binary_fn[BI_COUNT])(double, double) = {
+    [BI_ARCTAN2] = atan2, [BI_MOD] = mod_floor, [BI_REMAINDER] = fmod,
+};
+
+static int bi_unary(halmat_t *H, int num, const halmat_val_t *a,
+                    const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)w; (void)n;
+    double x = num_val(a);
+
+    switch (num) {
+    case BI_LOG:     if (x <= 0.0) return domain(H, num); break;
+    case BI_SQRT:    if (x < 0.0) return domain(H, num); break;
+    case BI_ARCCOS:
+    case BI_ARCSIN:  if (fabs(x) > 1.0) return domain(H, num); break;
+    case BI_ARCCOSH: if (x < 1.0) return domain(H, num); break;
+    case BI_ARCTANH: if (fabs(x) >= 1.0) return domain(H, num); break;
+    case BI_ABS:
+        if (a->type == HTYPE_INTEGER) {
+            set_int(r, a->v.integer < 0 ? -(double)a->v.integer : a->v.integer);
+            return 0;
+        }
+        break;
+    }
+    set_scalar(r, unary_fn[num](x));
+    return 0;
+}
+
+/* MOD, REMAINDER, DIV: INTEGER if both arguments are */
+static int bi_divide(halmat_t *H, int num, const halmat_val_t *a,
+                     const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)w; (void)n;
+    double x = num_val(&a[0]), y = num_val(&a[1]);
+    if (y == 0.0) {
+        fprintf(stderr, "halmat_builtin: %s by zero at PC=%u\n",
+                halmat_builtin_name(num), H->pc);
+        return HALMAT_ERR_DIV_ZERO;
+    }
+    if (num == BI_DIV) {
+        set_int(r, trunc(round(x) / round(y)));
+        return 0;
+    }
+    if (all_int(a, 2)) {
+        /* INT32_MIN % -1 traps on x86 */
+        int32_t i = a[0].v.integer, j = a[1].v.integer;
+        int32_t m = j == -1 ? 0 : i % j;
+        if (num == BI_MOD && m != 0 && (m < 0) != (j < 0))
+            m += j;
+        set_int(r, m);
+        return 0;
+    }
+    set_scalar(r, binary_fn[num](x, y));
+    return 0;
+}
+
+static int bi_arctan2(halmat_t *H, int num, const halmat_val_t *a,
+                      const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)num; (void)w; (void)n;
+    set_scalar(r, atan2(num_val(&a[0]), num_val(&a[1])));
+    return 0;
+}
+
+static int bi_integer(halmat_t *H, int num, const halmat_val_t *a,
+                      const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)w; (void)n;
+    double x = num_val(a);
+    switch (num) {
+    case BI_FLOOR:    x = floor(x); break;
+    case BI_CEILING:  x = ceil(x);  break;
+    case BI_ROUND:    x = round(x); break;
+    case BI_TRUNCATE: x = trunc(x); break;
+    case BI_SIGN:     x = x >= 0.0 ? 1 : -1; break;
+    case BI_SIGNUM:   x = (x > 0.0) - (x < 0.0); break;
+    }
+    set_int(r, x);
+    return 0;
+}
+
+static int bi_odd(halmat_t *H, int num, const halmat_val_t *a,
+                  const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)num; (void)w; (void)n;
+    int32_t i = a->type == HTYPE_INTEGER ? a->v.integer : (int32_t)a->v.scalar;
+    r->type = HTYPE_BOOLEAN;
+    r->v.bits = (uint32_t)i & 1;
+    return 0;
+}
+
+static int bi_xor(halmat_t *H, int num, const halmat_val_t *a,
+                  const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)num; (void)w; (void)n;
+    r->type = HTYPE_BIT;
+    r->rows = a[0].rows > a[1].rows ? a[0].rows : a[1].rows;
+    r->v.bits = a[0].v.bits ^ a[1].v.bits;
+    return 0;
+}
+
+/* MAX, MIN: over the arguments, or over the elements of one array */
+static int bi_extreme(halmat_t *H, int num, const halmat_val_t *a,
+                      const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)w;
+    int is_max = num == BI_MAX;
+    if (n == 1 && (a->type == HTYPE_VECTOR || a->type == HTYPE_MATRIX)) {
+        int ne = elems(a);
+        double m = ne ? a->v.vector[0] : 0.0;
+        for (int i = 1; i < ne; i++)
+            if (is_max ? a->v.vector[i] > m : a->v.vector[i] < m)
+                m = a->v.vector[i];
+        set_scalar(r, m);
+        return 0;
+    }
+    double m = num_val(&a[0]);
+    for (int i = 1; i < n; i++) {
+        double x = num_val(&a[i]);
+        if (is_max ? x > m : x < m)
+            m = x;
+    }
+    if (all_int(a, n))
+        set_int(r, m);
+    else
+        set_scalar(r, m);
+    return 0;
+}
+
+static int bi_midval(halmat_t *H, int num, const halmat_val_t *a,
+                     const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)num; (void)w; (void)n;
+    double x = num_val(&a[0]), y = num_val(&a[1]), z = num_val(&a[2]);
+    double m = fmax(fmin(x, y), fmin(fmax(x, y), z));
+    if (all_int(a, 3))
+        set_int(r, m);
+    else
+        set_scalar(r, m);
+    return 0;
+}
+
+/* ---- vector and matrix functions ---- */
+
+static int bi_reduce(halmat_t *H, int num, const halmat_val_t *a,
+                     const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)w; (void)n;
+    int ne = elems(a);
+    double s = num == BI_SUM ? 0.0 : 1.0;
+    for (int i = 0; i < ne; i++)
+        s = num == BI_SUM ? s + a->v.vector[i] : s * a->v.vector[i];
+    set_scalar(r, s);
+    return 0;
+}
+
+static int bi_abval(halmat_t *H, int num, const halmat_val_t *a,
+                    const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)w; (void)n;
+    if (a->type != HTYPE_VECTOR) {
+        set_scalar(r, fabs(num_val(a)));
+        return 0;
+    }
+    int len = a->rows > 64 ? 64 : a->rows;
+    double mag = sqrt(halmat_vec_dot(a->v.vector, a->v.vector, len));
+    if (num == BI_ABVAL) {
+        set_scalar(r, mag);
+        return 0;
+    }
+    if (mag == 0.0) {
+        fprintf(stderr, "halmat_builtin: UNIT of a zero vector at PC=%u\n", H->pc);
+        return HALMAT_ERR_DIV_ZERO;
+    }
+    r->type = HTYPE_VECTOR;
+    r->rows = (uint8_t)len;
+    for (int i = 0; i < len; i++)
+        r->v.vector[i] = a->v.vector[i] / mag;
+    return 0;
+}
+
+static int mat_dim(int d)
+{
+    return d > HALMAT_MAT_MAX ? HALMAT_MAT_MAX : d;
+}
+
+static int bi_matrix(halmat_t *H, int num, const halmat_val_t *a,
+                     const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)w; (void)n;
+    int rows = mat_dim(a->rows), cols = mat_dim(a->cols);
+
+    switch (num) {
+    case BI_DET:
+        set_scalar(r, halmat_mat_det(a->v.matrix, rows));
+        return 0;
+    case BI_TRACE: {
+        double s = 0.0;
+        for (int i = 0; i < rows && i < cols; i++)
+            s += a->v.matrix[i * a->cols + i];
+        set_scalar(r, s);
+        return 0;
+    }
+    case BI_TRANSPOSE:
+        r->type = HTYPE_MATRIX;
+        r->rows = (uint8_t)cols;
+        r->cols = (uint8_t)rows;
+        halmat_mat_transpose(r->v.matrix, a->v.matrix, rows, cols);
+        return 0;
+    default:        /* BI_INVERSE */
+        r->type = HTYPE_MATRIX;
+        r->rows = r->cols = (uint8_t)rows;
+        if (halmat_mat_inverse(r->v.matrix, a->v.matrix, rows) != 0) {
+            fprintf(stderr, "halmat_builtin: INVERSE of a singular matrix at PC=%u\n",
+                    H->pc);
+            return HALMAT_ERR_DIV_ZERO;
+        }
+        return 0;
+    }
+}
+
+static int bi_size(halmat_t *H, int num, const halmat_val_t *a,
+                   const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)w; (void)n;
+    if (a->type == HTYPE_CHAR)
+        set_int(r, a->v.string.len);
+    else if (num == BI_SIZE && a->type == HTYPE_MATRIX)
+        set_int(r, a->rows * a->cols);
+    else
+        set_int(r, a->rows);
+    return 0;
+}
+
+/* ---- character functions ---- */
+
+static int bi_index(halmat_t *H, int num, const halmat_val_t *a,
+                    const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)num; (void)w; (void)n;
+    int len = a[0].v.string.len, sub = a[1].v.string.len, pos = 0;
+    for (int i = 0; sub > 0 && i + sub <= len; i++)
+        if (memcmp(a[0].v.string.data + i, a[1].v.string.data, (size_t)sub) == 0) {
+            pos = i + 1;
+            break;
+        }
+    set_int(r, pos);
+    return 0;
+}
+
+static int bi_trim(halmat_t *H, int num, const halmat_val_t *a,
+                   const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)num; (void)w; (void)n;
+    const char *s = a->v.string.data;
+    int lo = 0, hi = a->v.string.len;
+    while (lo < hi && s[lo] == ' ') lo++;
+    while (hi > lo && s[hi - 1] == ' ') hi--;
+    r->type = HTYPE_CHAR;
+    r->v.string.len = (uint16_t)(hi - lo);
+    memcpy(r->v.string.data, s + lo, (size_t)(hi - lo));
+    return 0;
+}
+
+/* LJUST/RJUST(s, n): pad with blanks to n characters, or cut to n */
+static int bi_justify(halmat_t *H, int num, const halmat_val_t *a,
+                      const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)H; (void)w; (void)n;
+    int width = (int)num_val(&a[1]), len = a[0].v.string.len;
+    if (width < 0) width = 0;
+    if (width > (int)sizeof(r->v.string.data)) width = sizeof(r->v.string.data);
+    int keep = len < width ? len : width;
+    int pad = width - keep;
+    r->type = HTYPE_CHAR;
+    r->v.string.len = (uint16_t)width;
+    if (num == BI_LJUST) {
+        memcpy(r->v.string.data, a[0].v.string.data, (size_t)keep);
+        memset(r->v.string.data + keep, ' ', (size_t)pad);
+    } else {
+        memset(r->v.string.data, ' ', (size_t)pad);
+        memcpy(r->v.string.data + pad, a[0].v.string.data + len - keep, (size_t)keep);
+    }
+    return 0;
+}
+
+/* ---- clock, process and error state ---- */
+
+static int bi_clock(halmat_t *H, int num, const halmat_val_t *a,
+                    const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)a;
+    time_t now;
+    struct tm tm;
+
+    switch (num) {
+    case BI_DATE:       /* YYDDD */
+    case BI_CLOCKTIME:
+        if (H->replay && halmat_replay_fetch(H, r, 1))
+            break;
+        now = time(NULL);
+        localtime_r(&now, &tm);
+        if (num == BI_DATE)
+            set_int(r, (tm.tm_year % 100) * 1000 + tm.tm_yday + 1);
+        else
+            set_scalar(r, tm.tm_hour * 3600.0 + tm.tm_min * 60.0 + tm.tm_sec);
+        if (H->replay)
+            halmat_replay_keep(H, r, 1);
+        break;
+    case BI_RUNTIME:
+        set_scalar(r, halmat_sched_clock(H));
+        break;
+    case BI_PRIO:
+        set_int(r, H->sched && H->task >= 0 ? H->sched->tasks[H->task].prio : 0);
+        break;
+    case BI_NEXTIME: {
+        double t = halmat_sched_clock(H);
+        if (n >= 1 && H->sched && HALMAT_QUAL(w[0]) == QUAL_SYT &&
+            HALMAT_DATA(w[0]) < HALMAT_MAX_SYT) {
+            int id = H->sched->task_of[HALMAT_DATA(w[0])];
+            if (id >= 0 && H->sched->tasks[id].state == TASK_WAIT_TIME)
+                t = H->sched->tasks[id].deadline_us / 1e6;
+        }
+        set_scalar(r, t);
+        break;
+    }
+    default:            /* ERRGRP, ERRNUM: no error has been recovered */
+        set_int(r, 0);
+        break;
+    }
+    return 0;
+}
+
+/* xorshift64*.  Each process draws from its own stream, kept in its
+ * task slot and seeded from the slot number and generation, so what it
+ * gets does not depend on the other processes or on which worker thread
+ * runs it.  The main program goes on with the stream it used before the
+ * scheduler started. */
+static double next_uniform(halmat_t *H)
+{
+    uint64_t *s = &H->rand_state;
+    if (H->sched && H->task >= 0) {
+        halmat_task_t *t = &H->sched->tasks[H->task];
+        s = &t->rand_state;
+        if (!*s && H->task > 0) {
+            uint64_t k = ((uint64_t)t->gen << 8 | (uint64_t)H->task) * 0x9E3779B97F4A7C15ull;
+            k = (k ^ (k >> 30)) * 0xBF58476D1CE4E5B9ull;    /* splitmix64 */
+            k = (k ^ (k >> 27)) * 0x94D049BB133111EBull;
+            *s = (k ^ (k >> 31)) | 1;
+        }
+    }
+    if (!*s)
+        *s = 0x9E3779B97F4A7C15ull;
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return (double)((x * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int bi_random(halmat_t *H, int num, const halmat_val_t *a,
+                     const uint32_t *w, int n, halmat_val_t *r)
+{
+    (void)a; (void)w; (void)n;
+    double u = next_uniform(H);
+    if (num == BI_RANDOMG) {
+        double v = next_uniform(H);
+        u = sqrt(-2.0 * log(1.0 - u)) * cos(6.283185307179586 * v);
+    }
+    set_scalar(r, u);
+    return 0;
+}
+
+/* ---- dispatch ---- */
+
+static const bi_entry_t bi_table[BI_COUNT] = {
+    [BI_ABS]       = { "ABS",       1, 1, bi_unary },
+    [BI_COS]       = { "COS",       1, 1, bi_unary },
+    [BI_DET]       = { "DET",       1, 1, bi_matrix },
+    [BI_DIV]       = { "DIV",       2, 2, bi_divide },
+    [BI_EXP]       = { "EXP",       1, 1, bi_unary },
+    [BI_LOG]       = { "LOG",       1, 1, bi_unary },
+    [BI_MAX]       = { "MAX",       1, BI_MAX_ARGS, bi_extreme },
+    [BI_MIN]       = { "MIN",       1, BI_MAX_ARGS, bi_extreme },
+    [BI_MOD]       = { "MOD",       2, 2, bi_divide },
+    [BI_ODD]       = { "ODD",       1, 1, bi_odd },
+    [BI_SIN]       = { "SIN",       1, 1, bi_unary },
+    [BI_SUM]       = { "SUM",       1, 1, bi_reduce },
+    [BI_TAN]       = { "TAN",       1, 1, bi_unary },
+    [BI_XOR]       = { "XOR",       2, 2, bi_xor },
+    [BI_COSH]      = { "COSH",      1, 1, bi_unary },
+    [BI_DATE]      = { "DATE",      0, 0, bi_clock },
+    [BI_PRIO]      = { "PRIO",      0, 0, bi_clock },
+    [BI_PROD]      = { "PROD",      1, 1, bi_reduce },
+    [BI_SIGN]      = { "SIGN",      1, 1, bi_integer },
+    [BI_SINH]      = { "SINH",      1, 1, bi_unary },
+    [BI_SIZE]      = { "SIZE",      1, 1, bi_size },
+    [BI_SQRT]      = { "SQRT",      1, 1, bi_unary },
+    [BI_TANH]      = { "TANH",      1, 1, bi_unary },
+    [BI_TRIM]      = { "TRIM",      1, 1, bi_trim },
+    [BI_UNIT]      = { "UNIT",      1, 1, bi_abval },
+    [BI_ABVAL]     = { "ABVAL",     1, 1, bi_abval },
+    [BI_FLOOR]     = { "FLOOR",     1, 1, bi_integer },
+    [BI_INDEX]     = { "INDEX",     2, 2, bi_index },
+    [BI_LJUST]     = { "LJUST",     2, 2, bi_justify },
+    [BI_RJUST]     = { "RJUST",     2, 2, bi_justify },
+    [BI_ROUND]     = { "ROUND",     1, 1, bi_integer },
+    [BI_TRACE]     = { "TRACE",     1, 1, bi_matrix },
+    [BI_ARCCOS]    = { "ARCCOS",    1, 1, bi_unary },
+    [BI_ARCSIN]    = { "ARCSIN",    1, 1, bi_unary },
+    [BI_ARCTAN]    = { "ARCTAN",    1, 1, bi_unary },
+    [BI_ERRGRP]    = { "ERRGRP",    0, 0, bi_clock },
+    [BI_ERRNUM]    = { "ERRNUM",    0, 0, bi_clock },
+    [BI_LENGTH]    = { "LENGTH",    1, 1, bi_size },
+    [BI_MIDVAL]    = { "MIDVAL",    3, 3, bi_midval },
+    [BI_RANDOM]    = { "RANDOM",    0, 0, bi_random },
+    [BI_SIGNUM]    = { "SIGNUM",    1, 1, bi_integer },
+    [BI_ARCCOSH]   = { "ARCCOSH",   1, 1, bi_unary },
+    [BI_ARCSINH]   = { "ARCSINH",   1, 1, bi_unary },
+    [BI_ARCTANH]   = { "ARCTANH",   1, 1, bi_unary },
+    [BI_ARCTAN2]   = { "ARCTAN2",   2, 2, bi_arctan2 },
+    [BI_CEILING]   = { "CEILING",   1, 1, bi_integer },
+    [BI_INVERSE]   = { "INVERSE",   1, 1, bi_matrix },
+    [BI_NEXTIME]   = { "NEXTIME",   1, 1, bi_clock },
+    [BI_RANDOMG]   = { "RANDOMG",   0, 0, bi_random },
+    [BI_RUNTIME]   = { "RUNTIME",   0, 0, bi_clock },
+    [BI_TRUNCATE]  = { "TRUNCATE",  1, 1, bi_integer },
+    [BI_CLOCKTIME] = { "CLOCKTIME", 0, 0, bi_clock },
+    [BI_REMAINDER] = { "REMAINDER", 2, 2, bi_divide },
+    [BI_TRANSPOSE] = { "TRANSPOSE", 1, 1, bi_matrix },
+};
+
+const char *halmat_builtin_name(int num)
+{
+    return (num > 0 && num < BI_COUNT) ? bi_table[num].name : NULL;
+}
+
+static void chop_result(halmat_val_t *r)
+{
+    switch (r->type) {
+    case HTYPE_SCALAR:
+        r->v.scalar = halmat_hfp_chop(r->v.scalar);
+        break;
+    case HTYPE_VECTOR:
+    case HTYPE_MATRIX:
+        for (int i = 0, n = elems(r); i < n; i++)
+            r->v.vector[i] = halmat_hfp_chop(r->v.vector[i]);
+        break;
+    }
+}
+
+int halmat_builtin_call(halmat_t *H, int num, const halmat_val_t *args,
+                        const uint32_t *words, int nargs, halmat_val_t *r)
+{
+    if (num <= 0 || num >= BI_COUNT) {
+        fprintf(stderr, "halmat_builtin: unknown builtin %d at PC=%u\n", num, H->pc);
+        return HALMAT_ERR_BAD_OP;
+    }
+    const bi_entry_t *e = &bi_table[num];
+    if (nargs < e->min_args || nargs > e->max_args) {
+        fprintf(stderr, "halmat_builtin: %s takes %d argument(s), got %d at PC=%u\n",
+                e->name, e->min_args, nargs, H->pc);
+        return HALMAT_ERR_BAD_OP;
+    }
+    memset(r, 0, sizeof(*r));
+    int rc = e->fn(H, num, args, words, nargs, r);
+    if (rc == 0 && H->hfp)
+        chop_result(r);
+    return rc;
+}
+
+int halmat_builtin_batch(int num, double *r, const double *x,
+                         const double *y, size_t n)
+{
+    if (num <= 0 || num >= BI_COUNT)
+        return -1;
+
+    /* Straight loops the compiler can vectorise */
+    switch (num) {
+    case BI_ABS:
+        for (size_t i = 0; i < n; i++) r[i] = fabs(x[i]);
+        return 0;
+    case BI_SQRT:
+        for (size_t i = 0; i < n; i++) r[i] = sqrt(x[i]);
+        return 0;
+    }
+
+    double (*f1)(double) = unary_fn[num];
+    double (*f2)(double, double) = binary_fn[num];
+    if (f1) {
+        for (size_t i = 0; i < n; i++)
+            r[i] = f1(x[i]);
+        return 0;
+    }
+    if (f2 && y) {
+        for (size_t i = 0; i < n; i++)
+            r[i] = f2(x[i], y[i]);
+        return 0;
+    }
+    return -1;
+}
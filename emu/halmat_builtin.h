@@ -0,0 +1,44 @@
+/* HAL/S builtin functions, called through BFNC/LFNC.
+ *
+ * The operator TAG is the builtin number, the operands are the
+ * arguments and the result goes to the operator's VAC. */
+
+#ifndef HALMAT_BUILTIN_H
+#define HALMAT_BUILTIN_H
+
+#include <stddef.h>
+#include "halmat.h"
+
+enum {
+    BI_ABS = 1, BI_COS, BI_DET, BI_DIV, BI_EXP, BI_LOG, BI_MAX, BI_MIN,
+    BI_MOD, BI_ODD, BI_SIN, BI_SUM, BI_TAN, BI_XOR, BI_COSH, BI_DATE,
+    BI_PRIO, BI_PROD, BI_SIGN, BI_SINH, BI_SIZE, BI_SQRT, BI_TANH,
+    BI_TRIM, BI_UNIT, BI_ABVAL, BI_FLOOR, BI_INDEX, BI_LJUST, BI_RJUST,
+    BI_ROUND, BI_TRACE, BI_ARCCOS, BI_ARCSIN, BI_ARCTAN, BI_ERRGRP,
+    BI_ERRNUM, BI_LENGTH, BI_MIDVAL, BI_RANDOM, BI_SIGNUM, BI_ARCCOSH,
+    BI_ARCSINH, BI_ARCTANH, BI_ARCTAN2, BI_CEILING, BI_INVERSE,
+    BI_NEXTIME, BI_RANDOMG, BI_RUNTIME, BI_TRUNCATE, BI_CLOCKTIME,
+    BI_REMAINDER, BI_TRANSPOSE,
+    BI_COUNT
+};
+
+#define BI_MAX_ARGS 16
+
+/* r = builtin num(args); words are the operand words (NEXTIME needs
+ * the process name).  0, or HALMAT_ERR_* for a bad call or a
+ * domain error (divide by zero, singular INVERSE, zero UNIT) */
+int halmat_builtin_call(halmat_t *H, int num, const halmat_val_t *args,
+                        const uint32_t *words, int nargs, halmat_val_t *r);
+
+/* Name for listings, NULL if num is not a builtin */
+const char *halmat_builtin_name(int num);
+
+/* Scalar builtins over arrays: r[i] = f(x[i]) or f(x[i], y[i]), for
+ * evaluating many cases at once (compiled array loops call it for a
+ * BFNC in the body).  y is ignored by one-argument functions.  There is
+ * no domain check: such an element comes out NaN or infinite.  -1 if
+ * num is not a scalar-valued SCALAR function. */
+int halmat_builtin_batch(int num, double *r, const double *x,
+                         const double *y, size_t n);
+
+#endif /* HALMAT_BUILTIN_H */
@@ -0,0 +1,217 @@
+/* CHARACTER support: declared maximum lengths, comparison, and string
+ * appends done in place.
+ *
+ * HAL/S limits a CHARACTER variable to 255 characters, and to its
+ * declared CHARACTER(n) length below that, so a value always fits in
+ * the halmat_val_t buffer and there is nothing to gain from a heap.
+ * What does cost is copying: S = S || A || B compiles to two CCATs and
+ * a CASN, and run one operator at a time every step copies S through a
+ * VAC.  At load time we look for such chains, where the first CCAT
+ * takes S itself, each later one takes the one before, the CASN stores
+ * back into S, and nothing else in the statement mentions S.  Those
+ * CCATs then append straight onto S's buffer and the CASN does
+ * nothing.  Truncation is at the declared length either way, so the
+ * result is the same.
+ *
+ * Comparisons look only at the current lengths: memcmp over the common
+ * prefix, and the shorter string is the lesser if that ties. */
+
+#include <stddef.h>
+#include "halmat.h"
+
+#define NEXT_OP(H, a) halmat_op_at(H, (a) + HALMAT_NUMOP((H)->code[a]) + 1)
+
+struct halmat_chars {
+    uint16_t *append_at;    /* CCAT/CASN address -> SYT appended to, 0 = none */
+};
+
+uint16_t halmat_char_max(const halmat_t *H, uint32_t syt)
+{
+    const halmat_array_t *a = &H->syt[syt].arr;
+    if (a->etype == HTYPE_CHAR && a->elen && a->elen < 255)
+        return a->elen;
+    return 255;
+}
+
+int halmat_char_compare(const halmat_val_t *a, const halmat_val_t *b)
+{
+    size_t la = a->v.string.len, lb = b->v.string.len;
+    if (la > sizeof(a->v.string.data)) la = sizeof(a->v.string.data);
+    if (lb > sizeof(b->v.string.data)) lb = sizeof(b->v.string.data);
+    int c = memcmp(a->v.string.data, b->v.string.data, la < lb ? la : lb);
+    if (c)
+        return c;
+    return (la > lb) - (la < lb);
+}
+
+void halmat_char_assign(halmat_t *H, uint32_t dest, const halmat_val_t *src)
+{
+    halmat_val_t *d = &H->syt[dest].val;
+    uint16_t n = src->v.string.len;
+    uint16_t max = halmat_char_max(H, dest);
+    if (n > max)
+        n = max;
+    d->type = HTYPE_CHAR;
+    if (d != src)
+        memmove(d->v.string.data, src->v.string.data, n);
+    d->v.string.len = n;
+    H->syt[dest].allocated = 1;
+}
+
+/* ---- in-place appends ---- */
+
+static int plain_char(const halmat_t *H, uint32_t s)
+{
+    const syt_entry_t *e = &H->syt[s];
+    return s && s < HALMAT_MAX_SYT && !e->arr.count && !e->st.name &&
+           e->st.kind == SK_NONE &&
+           (e->arr.etype == HTYPE_CHAR || e->arr.etype == 0);
+}
+
+static int mentions(const halmat_t *H, uint32_t a, uint32_t s)
+{
+    uint32_t numop = HALMAT_NUMOP(H->code[a]);
+    for (uint32_t k = 1; k <= numop && a + k < H->code_len; k++) {
+        uint32_t w = H->code[a + k];
+        if (HALMAT_QUAL(w) == QUAL_SYT && HALMAT_DATA(w) == s)
+            return 1;
+    }
+    return 0;
+}
+
+/* Operators that may sit between the CCATs of a chain: expression
+ * operators, which cannot change S other than through an operand
+ * naming it */
+static int harmless(uint32_t w)
+{
+    uint32_t pop = HALMAT_POPCODE(w);
+    uint32_t cls = HALMAT_CLASS(w);
+    if (cls >= 1 && cls <= 7)
+        return HALMAT_OPCODE(w) != 0x01;        /* not an assignment */
+    return pop == POP_DSUB || pop == POP_TSUB || pop == POP_EXTN ||
+           pop == POP_BFNC || pop == POP_LFNC;
+}
+
+static void find_chain(halmat_t *H, struct halmat_chars *C, uint32_t first)
+{
+    uint32_t s = HALMAT_DATA(H->code[first + 1]);
+    uint32_t cur = first;
+    uint32_t links[64];
+    uint32_t n = 0;
+
+    if (HALMAT_QUAL(H->code[first + 2]) == QUAL_SYT &&
+        HALMAT_DATA(H->code[first + 2]) == s)
+        return;                                 /* S = S || S */
+    links[n++] = first;
+
+    for (uint32_t a = NEXT_OP(H, first); a < H->code_len; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        uint32_t pop = HALMAT_POPCODE(w);
+        uint32_t numop = HALMAT_NUMOP(w);
+        int feeds = numop >= 1 && HALMAT_QUAL(H->code[a + 1]) == QUAL_VAC &&
+                    HALMAT_DATA(H->code[a + 1]) == cur;
+
+        if (pop == POP_CASN && numop == 2 && feeds) {
+            uint32_t d = H->code[a + 2];
+            if (HALMAT_QUAL(d) != QUAL_SYT || HALMAT_DATA(d) != s ||
+                HALMAT_TAG1(d) != 0)
+                return;
+            for (uint32_t i = 0; i < n; i++)
+                C->append_at[links[i]] = (uint16_t)s;
+            C->append_at[a] = (uint16_t)s;
+            return;
+        }
+        if (pop == POP_CCAT && numop == 2 && feeds) {
+            if (mentions(H, a, s) || n == 64)
+                return;
+            links[n++] = cur = a;
+            continue;
+        }
+        if (!harmless(w) || mentions(H, a, s))
+            return;
+        for (uint32_t k = 1; k <= numop && a + k < H->code_len; k++) {
+            uint32_t o = H->code[a + k];
+            if (HALMAT_QUAL(o) == QUAL_VAC && HALMAT_DATA(o) == cur)
+                return;                         /* chain value used elsewhere */
+        }
+    }
+}
+
+void halmat_char_build(halmat_t *H)
+{
+    struct halmat_chars *C = calloc(1, sizeof(*C));
+    if (!C)
+        return;
+    C->append_at = calloc(H->code_len + 1, sizeof(uint16_t));
+    if (!C->append_at) {
+        free(C);
+        return;
+    }
+    uint32_t found = 0;
+    for (uint32_t a = halmat_op_at(H, 0); a < H->code_len; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        if (HALMAT_POPCODE(w) != POP_CCAT || HALMAT_NUMOP(w) != 2 ||
+            a + 2 >= H->code_len || C->append_at[a])
+            continue;
+        uint32_t o = H->code[a + 1];
+        if (HALMAT_QUAL(o) != QUAL_SYT || HALMAT_TAG1(o) != 0 ||
+            !plain_char(H, HALMAT_DATA(o)))
+            continue;
+        find_chain(H, C, a);
+        found += C->append_at[a] != 0;
+    }
+    if (!found) {
+        free(C->append_at);
+        free(C);
+        return;
+    }
+    H->chars = C;
+}
+
+void halmat_char_free(halmat_t *H)
+{
+    struct halmat_chars *C = H->chars;
+    if (!C)
+        return;
+    free(C->append_at);
+    free(C);
+    H->chars = NULL;
+}
+
+/* The CCAT or CASN at pc is part of an in-place append: do it and
+ * return 1 */
+int halmat_char_exec(halmat_t *H, uint32_t pc)
+{
+    if (!H->chars || !H->chars->append_at[pc])
+        return 0;
+    if (HALMAT_POPCODE(H->code[pc]) == POP_CASN)
+        return 1;
+
+    uint32_t s = H->chars->append_at[pc];
+    halmat_val_t *d = &H->syt[s].val;
+    halmat_val_t tmp;
+    const halmat_val_t *b;
+    uint32_t w = H->code[pc + 2];
+    if (HALMAT_QUAL(w) == QUAL_SYT && HALMAT_DATA(w) < HALMAT_MAX_SYT &&
+        !H->syt[HALMAT_DATA(w)].arr.count && !H->syt[HALMAT_DATA(w)].st.name)
+        b = &H->syt[HALMAT_DATA(w)].val;
+    else if (HALMAT_QUAL(w) == QUAL_VAC && H->vac[VAC_SLOT(HALMAT_DATA(w))].type != HTYPE_REF)
+        b = &H->vac[VAC_SLOT(HALMAT_DATA(w))];
+    else {
+        tmp = halmat_resolve_operand(H, w);
+        b = &tmp;
+    }
+
+    uint16_t len = d->type == HTYPE_CHAR ? d->v.string.len : 0;
+    uint16_t max = halmat_char_max(H, s);
+    uint16_t n = b->v.string.len;
+    if (len > max)
+        len = max;
+    if (n > max - len)
+        n = max - len;
+    memcpy(d->v.string.data + len, b->v.string.data, n);
+    d->type = HTYPE_CHAR;
+    d->v.string.len = len + n;
+    H->syt[s].allocated = 1;
+    return 1;
+}
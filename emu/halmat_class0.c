@@ -1,5 +1,8 @@
 #include "halmat.h"
 #include "halmat_io.h"
+#include "halmat_sched.h"
+#include "halmat_builtin.h"
+#include "halmat_replay.h"
 
 /* Advance PC past current operator + operands */
 #define ADVANCE() do { H->pc += numop + 1; } while (0)
@@ -28,6 +31,29 @@ static uint32_t scan_forward(halmat_t *H, uint32_t start,
     return H->code_len; /* not found */
 }
 
+/* Address of the CLOS ending the block whose header operator is at addr.
+ * Nested PROCEDURE/FUNCTION/TASK/UPDATE blocks all close with CLOS. */
+static uint32_t block_end(halmat_t *H, uint32_t addr)
+{
+    int depth = 0;
+    uint32_t scan = addr;
+    while (scan < H->code_len) {
+        uint32_t w = H->code[scan];
+        if (!HALMAT_IS_OP(w)) { scan++; continue; }
+        switch (HALMAT_POPCODE(w)) {
+        case POP_PDEF: case POP_FDEF: case POP_TDEF: case POP_UDEF:
+            depth++;
+            break;
+        case POP_CLOS:
+            if (--depth == 0)
+                return scan;
+            break;
+        }
+        scan += HALMAT_NUMOP(w) + 1;
+    }
+    return H->code_len;
+}
+
 int halmat_exec_class0(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag)
 {
     switch (popcode) {
@@ -70,22 +96,50 @@ int halmat_exec_class0(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
     }
 
     case POP_MDEF:
-    case POP_TDEF:
-    case POP_UDEF:
     case POP_CDEF:
         ADVANCE();
         return HALMAT_OK;
 
+    case POP_TDEF: {
+        /* Task bodies only run when SCHEDULEd */
+        uint32_t exit = block_end(H, H->pc);
+        if (exit < H->code_len)
+            H->pc = exit + HALMAT_NUMOP(H->code[exit]) + 1;
+        else
+            ADVANCE();
+        return HALMAT_OK;
+    }
+
+    case POP_UDEF:
+        /* UPDATE blocks execute in line; remember which CLOS ends them */
+        if (H->update_depth >= HALMAT_MAX_UPDATE) {
+            fprintf(stderr, "halmat: UPDATE nesting too deep at PC=%u\n", H->pc);
+            return HALMAT_ERR_STACK;
+        }
+        H->update_syt[H->update_depth++] =
+            numop >= 1 ? HALMAT_DATA(H->code[H->pc + 1]) : 0;
+        ADVANCE();
+        return HALMAT_OK;
+
     case POP_EDCL:
         ADVANCE();
         return HALMAT_OK;
 
     case POP_CLOS:
+        if (H->update_depth > 0 &&
+            (numop < 1 || HALMAT_DATA(H->code[H->pc + 1]) ==
+                          H->update_syt[H->update_depth - 1])) {
+            H->update_depth--;
+            ADVANCE();
+            return HALMAT_OK;
+        }
         if (H->frame_depth > 0) {
             call_frame_t *f = &H->frames[--H->frame_depth];
             H->pc = f->return_pc;
             return HALMAT_OK;
         }
+        if (H->sched)
+            return halmat_sched_close(H);
         H->halted = 1;
         ADVANCE();
         return HALMAT_HALT;
@@ -497,6 +551,21 @@ int halmat_exec_class0(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
     case POP_XXAR: {
         if (numop >= 1 && H->io.active && H->io.nargs < HALMAT_MAX_IO_ARGS) {
             uint32_t ow = H->code[H->pc + 1];
+            uint32_t d = HALMAT_DATA(ow);
+            if (HALMAT_QUAL(ow) == QUAL_SYT && d < HALMAT_MAX_SYT &&
+                H->syt[d].arr.count && !H->adlp_n) {
+                /* a whole array: its elements in order */
+                for (uint32_t i = 0; i < H->syt[d].arr.count &&
+                                     H->io.nargs < HALMAT_MAX_IO_ARGS; i++) {
+                    H->io.args[H->io.nargs] = halmat_array_get(H, d, i);
+                    H->io.arg_types[H->io.nargs] = H->syt[d].arr.etype;
+                    H->io.arg_words[H->io.nargs] = ow;
+                    H->io.arg_elem[H->io.nargs] = (uint16_t)i;
+                    H->io.nargs++;
+                }
+                ADVANCE();
+                return HALMAT_OK;
+            }
             halmat_val_t val = halmat_resolve_operand(H, ow);
             uint8_t arg_type = (uint8_t)HALMAT_TAG1(ow);
 
@@ -507,6 +576,8 @@ int halmat_exec_class0(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
 
             H->io.args[H->io.nargs] = val;
             H->io.arg_types[H->io.nargs] = arg_type;
+            H->io.arg_words[H->io.nargs] = ow;
+            H->io.arg_elem[H->io.nargs] = 0;
             H->io.nargs++;
         }
         ADVANCE();
@@ -517,20 +588,84 @@ int halmat_exec_class0(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         int channel = 6;
         if (numop >= 1)
             channel = (int)HALMAT_DATA(H->code[H->pc + 1]);
-        halmat_io_write(H, channel, H->io.args, H->io.arg_types, H->io.nargs);
+        if (!halmat_replay_muted(H) &&
+            halmat_io_write(H, channel, H->io.args, H->io.arg_types, H->io.nargs) < 0)
+            return HALMAT_ERR_IO;
         ADVANCE();
         return HALMAT_OK;
     }
 
-    case POP_READ: {
+    case POP_READ:
+    case POP_RDAL: {
+        int channel = 5;
+        if (numop >= 1)
+            channel = (int)HALMAT_DATA(H->code[H->pc + 1]);
+        if (!(H->replay && halmat_replay_fetch(H, H->io.args, H->io.nargs))) {
+            int rc = popcode == POP_READ
+                ? halmat_io_read(H, channel, H->io.args, H->io.arg_types, H->io.nargs)
+                : halmat_io_read_all(H, channel, H->io.args, H->io.arg_types, H->io.nargs);
+            if (rc < 0)
+                return HALMAT_ERR_IO;
+        }
+        if (H->replay)
+            halmat_replay_keep(H, H->io.args, H->io.nargs);
+        /* Store back to variables; unread items still hold their value */
+        for (int i = 0; i < H->io.nargs; i++) {
+            uint32_t ow = H->io.arg_words[i];
+            uint32_t d = HALMAT_DATA(ow);
+            if (H->io.args[i].type == HTYPE_NONE)
+                continue;
+            if (HALMAT_QUAL(ow) == QUAL_SYT && d < HALMAT_MAX_SYT &&
+                H->syt[d].arr.count && !H->adlp_n) {
+                halmat_array_put(H, d, H->io.arg_elem[i], &H->io.args[i]);
+                H->syt[d].allocated = 1;
+            } else if (!halmat_array_store(H, ow, &H->io.args[i]) &&
+                       HALMAT_QUAL(ow) == QUAL_SYT && d < HALMAT_MAX_SYT) {
+                H->syt[d].val = H->io.args[i];
+                H->syt[d].allocated = 1;
+            }
+            if (H->watch && HALMAT_QUAL(ow) == QUAL_SYT)
+                halmat_watch_store(H, d, &H->io.args[i]);
+        }
         ADVANCE();
         return HALMAT_OK;
     }
 
-    case POP_RDAL:
-    case POP_FILE:
+    case POP_FILE: {
+        /* FILE(unit, rec) = expr:  op1 record, op2 value (TAG2=1)
+         * var = FILE(unit, rec):   op1 variable, op2 record */
+        if (numop < 2) { ADVANCE(); return HALMAT_OK; }
+        uint32_t w1 = H->code[H->pc + 1];
+        uint32_t w2 = H->code[H->pc + 2];
+        int is_write = (HALMAT_TAG2(w2) == 1);
+        halmat_val_t r = halmat_resolve_operand(H, is_write ? w1 : w2);
+        int32_t rec = (r.type == HTYPE_SCALAR) ? (int32_t)r.v.scalar : r.v.integer;
+        if (rec < 0) {
+            fprintf(stderr, "halmat_class0: FILE(%u,%d): negative record\n", tag, rec);
+            return HALMAT_ERR_BOUNDS;
+        }
+        halmat_val_t v = {0};
+        if (is_write) {
+            v = halmat_resolve_operand(H, w2);
+            if (!halmat_replay_muted(H) &&
+                halmat_io_file(H, (int)tag, (uint32_t)rec, HALMAT_FILE_WRITE, &v) < 0)
+                return HALMAT_ERR_IO;
+        } else {
+            if (!(H->replay && halmat_replay_fetch(H, &v, 1)) &&
+                halmat_io_file(H, (int)tag, (uint32_t)rec, HALMAT_FILE_READ, &v) < 0)
+                return HALMAT_ERR_IO;
+            if (H->replay)
+                halmat_replay_keep(H, &v, 1);
+            uint32_t d = HALMAT_DATA(w1);
+            if (!halmat_array_store(H, w1, &v) &&
+                HALMAT_QUAL(w1) == QUAL_SYT && d < HALMAT_MAX_SYT) {
+                H->syt[d].val = v;
+                H->syt[d].allocated = 1;
+            }
+        }
         ADVANCE();
         return HALMAT_OK;
+    }
 
     case POP_XXND:
         H->io.active = 0;
@@ -620,32 +755,51 @@ int halmat_exec_class0(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         ADVANCE();
         return HALMAT_OK;
 
+    case POP_BFNC:
+    case POP_LFNC: {
+        /* TAG is the builtin number, the operands its arguments */
+        halmat_val_t args[BI_MAX_ARGS], r;
+        int nargs = numop <= BI_MAX_ARGS ? (int)numop : BI_MAX_ARGS + 1;
+        for (int i = 0; i < nargs && i < BI_MAX_ARGS; i++)
+            args[i] = halmat_resolve_operand(H, H->code[H->pc + 1 + i]);
+        int rc = halmat_builtin_call(H, (int)tag, args, &H->code[H->pc + 1],
+                                     nargs, &r);
+        if (rc < 0)
+            return rc;
+        halmat_store_vac(H, H->pc, r);
+        ADVANCE();
+        return HALMAT_OK;
+    }
+
     case POP_DSUB:
     case POP_TSUB:
     case POP_ADLP:
     case POP_DLPE:
     case POP_IDLP:
-        ADVANCE();
-        return HALMAT_OK;
+        return halmat_array_exec(H, popcode, numop, tag);
 
     case POP_SFST:
     case POP_SFND:
     case POP_SFAR:
-    case POP_BFNC:
-    case POP_LFNC:
+        ADVANCE();
+        return HALMAT_OK;
+
     case POP_TNEQ:
     case POP_TEQU:
     case POP_TASN:
+    case POP_NNEQ:
+    case POP_NEQU:
     case POP_NASN:
-        ADVANCE();
-        return HALMAT_OK;
+        return halmat_struct_exec(H, popcode, numop, tag);
+
+    case POP_WAIT:
+    case POP_SGNL:
+    case POP_CANC:
+    case POP_TERM:
+    case POP_PRIO:
+    case POP_SCHD:
+        return halmat_sched_exec(H, popcode, numop, tag);
 
-    case 0x034: /* WAIT */
-    case 0x035: /* SGNL */
-    case 0x036: /* CANC */
-    case 0x037: /* TERM */
-    case 0x038: /* PRIO */
-    case 0x039: /* SCHD */
     case 0x03C: /* ERON */
     case 0x03D: /* ERSE */
     case 0x040: /* MSHP */
@@ -655,8 +809,6 @@ int halmat_exec_class0(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
     case 0x059: /* PMHD */
     case 0x05A: /* PMAR */
     case 0x05B: /* PMIN */
-    case 0x055: /* NNEQ */
-    case 0x056: /* NEQU */
         ADVANCE();
         return HALMAT_OK;
 
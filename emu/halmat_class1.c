@@ -1,5 +1,37 @@
 #include "halmat.h"
 
+/* A BIT value is right-justified in v.bits with its length in rows,
+ * 0 meaning 32 (or not known).  HAL/S limits BIT(n) to 32 bits, so
+ * each operator is a single word operation: shorter operands are
+ * padded on the left with zeros, and longer results lose their
+ * leftmost bits. */
+static int bit_len(const halmat_val_t *v)
+{
+    return v->rows && v->rows < 32 ? v->rows : 32;
+}
+
+static uint32_t bit_mask(int n)
+{
+    return n >= 32 ? 0xFFFFFFFFu : (1u << n) - 1;
+}
+
+/* Declared length of a BIT variable, 0 if not known */
+int halmat_bit_max(const halmat_t *H, uint32_t syt)
+{
+    const halmat_array_t *a = &H->syt[syt].arr;
+    return a->etype == HTYPE_BIT ? a->elen : 0;
+}
+
+void halmat_bit_assign(halmat_t *H, uint32_t dest, const halmat_val_t *src)
+{
+    halmat_val_t *d = &H->syt[dest].val;
+    int n = halmat_bit_max(H, dest);
+    d->type = HTYPE_BIT;
+    d->rows = n ? (n < 32 ? (uint8_t)n : 0) : src->rows;
+    d->v.bits = src->v.bits & bit_mask(bit_len(d));
+    H->syt[dest].allocated = 1;
+}
+
 int halmat_exec_class1(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag)
 {
     uint32_t pc = H->pc;
@@ -10,53 +42,52 @@ int halmat_exec_class1(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t src = halmat_resolve_operand(H, H->code[pc + 1]);
         uint32_t dest = HALMAT_DATA(H->code[pc + 2]);
-        if (dest < HALMAT_MAX_SYT) {
-            H->syt[dest].val.type = HTYPE_BIT;
-            H->syt[dest].val.v.bits = src.v.bits;
-            H->syt[dest].allocated = 1;
-        }
-        break;
-    }
-
-    case POP_BAND: {
-        if (numop < 2) break;
-        uint32_t a = halmat_resolve_operand(H, H->code[pc + 1]).v.bits;
-        uint32_t b = halmat_resolve_operand(H, H->code[pc + 2]).v.bits;
-        halmat_val_t r = {0};
-        r.type = HTYPE_BIT;
-        r.v.bits = a & b;
-        halmat_store_vac(H, pc, r);
+        if (!halmat_array_store(H, H->code[pc + 2], &src) && dest < HALMAT_MAX_SYT)
+            halmat_bit_assign(H, dest, &src);
+        if (H->watch)
+            halmat_watch_asn(H, pc);
         break;
     }
 
+    case POP_BAND:
     case POP_BOR: {
         if (numop < 2) break;
-        uint32_t a = halmat_resolve_operand(H, H->code[pc + 1]).v.bits;
-        uint32_t b = halmat_resolve_operand(H, H->code[pc + 2]).v.bits;
+        halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
+        halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
+        uint32_t x = a.v.bits & bit_mask(bit_len(&a));
+        uint32_t y = b.v.bits & bit_mask(bit_len(&b));
         halmat_val_t r = {0};
         r.type = HTYPE_BIT;
-        r.v.bits = a | b;
+        r.rows = a.rows && b.rows ? (a.rows > b.rows ? a.rows : b.rows) : 0;
+        r.v.bits = popcode == POP_BAND ? x & y : x | y;
         halmat_store_vac(H, pc, r);
         break;
     }
 
     case POP_BNOT: {
         if (numop < 1) break;
-        uint32_t a = halmat_resolve_operand(H, H->code[pc + 1]).v.bits;
+        halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t r = {0};
         r.type = HTYPE_BIT;
-        r.v.bits = ~a;
+        r.rows = a.rows;
+        r.v.bits = ~a.v.bits & bit_mask(bit_len(&a));
         halmat_store_vac(H, pc, r);
         break;
     }
 
     case POP_BCAT: {
+        /* Shift the left operand over the right one; past 32 bits the
+         * leftmost are lost, as in an assignment */
         if (numop < 2) break;
-        uint32_t a = halmat_resolve_operand(H, H->code[pc + 1]).v.bits;
-        uint32_t b = halmat_resolve_operand(H, H->code[pc + 2]).v.bits;
+        halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
+        halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
+        int la = bit_len(&a), lb = bit_len(&b);
+        uint64_t v = ((uint64_t)(a.v.bits & bit_mask(la)) << lb) |
+                     (b.v.bits & bit_mask(lb));
         halmat_val_t r = {0};
         r.type = HTYPE_BIT;
-        r.v.bits = (a << 16) | (b & 0xFFFF);
+        r.rows = la + lb < 32 ? (uint8_t)(la + lb) : 0;
+        r.v.bits = (uint32_t)v;
         halmat_store_vac(H, pc, r);
         break;
     }
@@ -8,21 +8,18 @@ int halmat_exec_class2(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
     switch (popcode) {
 
     case POP_CASN: {
-        if (numop < 2) break;
+        if (numop < 2 || halmat_char_exec(H, pc)) break;
         halmat_val_t src = halmat_resolve_operand(H, H->code[pc + 1]);
         uint32_t dest = HALMAT_DATA(H->code[pc + 2]);
-        if (dest < HALMAT_MAX_SYT) {
-            H->syt[dest].val.type = HTYPE_CHAR;
-            memcpy(H->syt[dest].val.v.string.data, src.v.string.data,
-                   src.v.string.len);
-            H->syt[dest].val.v.string.len = src.v.string.len;
-            H->syt[dest].allocated = 1;
-        }
+        if (!halmat_array_store(H, H->code[pc + 2], &src) && dest < HALMAT_MAX_SYT)
+            halmat_char_assign(H, dest, &src);
+        if (H->watch)
+            halmat_watch_asn(H, pc);
         break;
     }
 
     case POP_CCAT: {
-        if (numop < 2) break;
+        if (numop < 2 || halmat_char_exec(H, pc)) break;
         halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
         halmat_val_t r = {0};
@@ -1,4 +1,5 @@
 #include "halmat.h"
+#include "halmat_matrix.h"
 #include <math.h>
 
 static double val_scalar(halmat_val_t v)
@@ -6,8 +7,16 @@ static double val_scalar(halmat_val_t v)
     return (v.type == HTYPE_INTEGER) ? (double)v.v.integer : v.v.scalar;
 }
 
+static int dim(int d)
+{
+    return d > HALMAT_MAT_MAX ? HALMAT_MAT_MAX : d;
+}
+
 int halmat_exec_class3(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag)
 {
+    if (H->fuse && halmat_fuse_exec(H))
+        return HALMAT_OK;
+
     uint32_t pc = H->pc;
 
     switch (popcode) {
@@ -16,11 +25,13 @@ int halmat_exec_class3(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t src = halmat_resolve_operand(H, H->code[pc + 1]);
         uint32_t dest = HALMAT_DATA(H->code[pc + 2]);
-        if (dest < HALMAT_MAX_SYT) {
+        if (!halmat_array_store(H, H->code[pc + 2], &src) && dest < HALMAT_MAX_SYT) {
             H->syt[dest].val = src;
             H->syt[dest].val.type = HTYPE_MATRIX;
             H->syt[dest].allocated = 1;
         }
+        if (H->watch)
+            halmat_watch_asn(H, pc);
         break;
     }
 
@@ -93,27 +104,102 @@ int halmat_exec_class3(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
         halmat_val_t r = {0};
         r.type = HTYPE_MATRIX;
-        r.rows = a.rows;
-        r.cols = b.cols;
-        for (int i = 0; i < a.rows && i < 8; i++)
-            for (int j = 0; j < b.cols && j < 8; j++) {
-                double sum = 0;
-                for (int k = 0; k < a.cols && k < 8; k++)
-                    sum += a.v.matrix[i * a.cols + k] * b.v.matrix[k * b.cols + j];
-                r.v.matrix[i * r.cols + j] = sum;
-            }
+        r.rows = (uint8_t)dim(a.rows);
+        r.cols = (uint8_t)dim(b.cols);
+        halmat_mat_mul(r.v.matrix, a.v.matrix, b.v.matrix,
+                       r.rows, dim(a.cols), r.cols);
+        halmat_store_vac(H, pc, r);
+        break;
+    }
+
+    case POP_MSDV: {
+        if (numop < 2) break;
+        halmat_val_t m = halmat_resolve_operand(H, H->code[pc + 1]);
+        halmat_val_t s = halmat_resolve_operand(H, H->code[pc + 2]);
+        double sv = val_scalar(s);
+        if (sv == 0.0) {
+            H->pc = pc + numop + 1;
+            return HALMAT_ERR_DIV_ZERO;
+        }
+        halmat_val_t r = m;
+        r.type = HTYPE_MATRIX;
+        int n = r.rows * r.cols;
+        if (n > 64) n = 64;
+        for (int i = 0; i < n; i++)
+            r.v.matrix[i] /= sv;
+        halmat_store_vac(H, pc, r);
+        break;
+    }
+
+    case POP_MDET: {
+        if (numop < 1) break;
+        halmat_val_t m = halmat_resolve_operand(H, H->code[pc + 1]);
+        halmat_val_t r = {0};
+        r.type = HTYPE_SCALAR;
+        r.v.scalar = halmat_mat_det(m.v.matrix, dim(m.rows));
+        halmat_store_vac(H, pc, r);
+        break;
+    }
+
+    case POP_MIDN: {
+        /* Size from a matrix operand or an integer; 3 if absent */
+        int n = 3;
+        if (numop >= 1) {
+            halmat_val_t s = halmat_resolve_operand(H, H->code[pc + 1]);
+            if (s.type == HTYPE_MATRIX)
+                n = s.rows;
+            else if (s.type == HTYPE_INTEGER || s.type == HTYPE_SCALAR)
+                n = (int)val_scalar(s);
+        }
+        if (n < 1) n = 1;
+        halmat_val_t r = {0};
+        r.type = HTYPE_MATRIX;
+        r.rows = r.cols = (uint8_t)dim(n);
+        halmat_mat_identity(r.v.matrix, r.rows);
+        halmat_store_vac(H, pc, r);
+        break;
+    }
+
+    case POP_MINV: {
+        /* M**k: op2 is the integer power, -1 for a plain inverse */
+        if (numop < 1) break;
+        halmat_val_t m = halmat_resolve_operand(H, H->code[pc + 1]);
+        int k = -1;
+        if (numop >= 2)
+            k = (int)val_scalar(halmat_resolve_operand(H, H->code[pc + 2]));
+        halmat_val_t r = {0};
+        r.type = HTYPE_MATRIX;
+        r.rows = r.cols = (uint8_t)dim(m.rows);
+        if (halmat_mat_power(r.v.matrix, m.v.matrix, r.rows, k) != 0) {
+            fprintf(stderr, "halmat_class3: singular matrix at PC=%u\n", pc);
+            H->pc = pc + numop + 1;
+            return HALMAT_ERR_DIV_ZERO;
+        }
         halmat_store_vac(H, pc, r);
         break;
     }
 
-    case POP_MSDV:
-    case POP_MDET:
-    case POP_MIDN:
-    case POP_MINV:
-    case POP_MTOM:
-    case POP_VVPR:
-        /* TODO */
+    case POP_MTOM: {
+        /* Precision conversion: values are held as doubles already */
+        if (numop < 1) break;
+        halmat_val_t r = halmat_resolve_operand(H, H->code[pc + 1]);
+        r.type = HTYPE_MATRIX;
+        halmat_store_vac(H, pc, r);
         break;
+    }
+
+    case POP_VVPR: {
+        if (numop < 2) break;
+        halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
+        halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
+        halmat_val_t r = {0};
+        r.type = HTYPE_MATRIX;
+        r.rows = (uint8_t)dim(a.rows);
+        r.cols = (uint8_t)dim(b.rows);
+        halmat_vec_outer(r.v.matrix, a.v.vector, b.v.vector, r.rows, r.cols);
+        halmat_store_vac(H, pc, r);
+        break;
+    }
 
     default:
         fprintf(stderr, "halmat_class3: unknown popcode 0x%03X at PC=%u\n",
@@ -128,6 +214,9 @@ int halmat_exec_class3(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
 
 int halmat_exec_class4(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag)
 {
+    if (H->fuse && halmat_fuse_exec(H))
+        return HALMAT_OK;
+
     uint32_t pc = H->pc;
 
     switch (popcode) {
@@ -136,11 +225,13 @@ int halmat_exec_class4(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t src = halmat_resolve_operand(H, H->code[pc + 1]);
         uint32_t dest = HALMAT_DATA(H->code[pc + 2]);
-        if (dest < HALMAT_MAX_SYT) {
+        if (!halmat_array_store(H, H->code[pc + 2], &src) && dest < HALMAT_MAX_SYT) {
             H->syt[dest].val = src;
             H->syt[dest].val.type = HTYPE_VECTOR;
             H->syt[dest].allocated = 1;
         }
+        if (H->watch)
+            halmat_watch_asn(H, pc);
         break;
     }
 
@@ -219,11 +310,37 @@ int halmat_exec_class4(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         break;
     }
 
-    case POP_VMPR:
-    case POP_MVPR:
-    case POP_VTOV:
-        /* TODO */
+    case POP_VMPR: {
+        if (numop < 2) break;
+        halmat_val_t v = halmat_resolve_operand(H, H->code[pc + 1]);
+        halmat_val_t m = halmat_resolve_operand(H, H->code[pc + 2]);
+        halmat_val_t r = {0};
+        r.type = HTYPE_VECTOR;
+        r.rows = (uint8_t)dim(m.cols);
+        halmat_vec_mat(r.v.vector, v.v.vector, m.v.matrix, dim(m.rows), r.rows);
+        halmat_store_vac(H, pc, r);
+        break;
+    }
+
+    case POP_MVPR: {
+        if (numop < 2) break;
+        halmat_val_t m = halmat_resolve_operand(H, H->code[pc + 1]);
+        halmat_val_t v = halmat_resolve_operand(H, H->code[pc + 2]);
+        halmat_val_t r = {0};
+        r.type = HTYPE_VECTOR;
+        r.rows = (uint8_t)dim(m.rows);
+        halmat_mat_vec(r.v.vector, m.v.matrix, v.v.vector, r.rows, dim(m.cols));
+        halmat_store_vac(H, pc, r);
         break;
+    }
+
+    case POP_VTOV: {
+        if (numop < 1) break;
+        halmat_val_t r = halmat_resolve_operand(H, H->code[pc + 1]);
+        r.type = HTYPE_VECTOR;
+        halmat_store_vac(H, pc, r);
+        break;
+    }
 
     default:
         fprintf(stderr, "halmat_class4: unknown popcode 0x%03X at PC=%u\n",
@@ -12,11 +12,13 @@ int halmat_exec_class5(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         halmat_val_t src = halmat_resolve_operand(H, H->code[pc + 1]);
         uint32_t dest = HALMAT_DATA(H->code[pc + 2]);
         double val = (src.type == HTYPE_INTEGER) ? (double)src.v.integer : src.v.scalar;
-        if (dest < HALMAT_MAX_SYT) {
+        if (!halmat_array_store(H, H->code[pc + 2], &src) && dest < HALMAT_MAX_SYT) {
             H->syt[dest].val.type = HTYPE_SCALAR;
             H->syt[dest].val.v.scalar = val;
             H->syt[dest].allocated = 1;
         }
+        if (H->watch)
+            halmat_watch_asn(H, pc);
         break;
     }
 
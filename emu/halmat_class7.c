@@ -154,10 +154,8 @@ int halmat_exec_class7(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
-        int cmp = strncmp(a.v.string.data, b.v.string.data,
-                          a.v.string.len < b.v.string.len ?
-                          a.v.string.len : b.v.string.len);
-        result.v.integer = (cmp == 0 && a.v.string.len == b.v.string.len) ? 1 : 0;
+        int cmp = halmat_char_compare(&a, &b);
+        result.v.integer = (cmp == 0) ? 1 : 0;
         break;
     }
 
@@ -165,10 +163,8 @@ int halmat_exec_class7(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
-        int cmp = strncmp(a.v.string.data, b.v.string.data,
-                          a.v.string.len < b.v.string.len ?
-                          a.v.string.len : b.v.string.len);
-        result.v.integer = (cmp != 0 || a.v.string.len != b.v.string.len) ? 1 : 0;
+        int cmp = halmat_char_compare(&a, &b);
+        result.v.integer = (cmp != 0) ? 1 : 0;
         break;
     }
 
@@ -176,7 +172,7 @@ int halmat_exec_class7(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
-        int cmp = strncmp(a.v.string.data, b.v.string.data, 256);
+        int cmp = halmat_char_compare(&a, &b);
         result.v.integer = (cmp > 0) ? 1 : 0;
         break;
     }
@@ -185,7 +181,7 @@ int halmat_exec_class7(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
-        int cmp = strncmp(a.v.string.data, b.v.string.data, 256);
+        int cmp = halmat_char_compare(&a, &b);
         result.v.integer = (cmp < 0) ? 1 : 0;
         break;
     }
@@ -194,7 +190,7 @@ int halmat_exec_class7(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
-        int cmp = strncmp(a.v.string.data, b.v.string.data, 256);
+        int cmp = halmat_char_compare(&a, &b);
         result.v.integer = (cmp <= 0) ? 1 : 0;
         break;
     }
@@ -203,7 +199,7 @@ int halmat_exec_class7(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         halmat_val_t a = halmat_resolve_operand(H, H->code[pc + 1]);
         halmat_val_t b = halmat_resolve_operand(H, H->code[pc + 2]);
-        int cmp = strncmp(a.v.string.data, b.v.string.data, 256);
+        int cmp = halmat_char_compare(&a, &b);
         result.v.integer = (cmp >= 0) ? 1 : 0;
         break;
     }
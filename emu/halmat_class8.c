@@ -41,13 +41,8 @@ int halmat_exec_class8(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         uint32_t dest = HALMAT_DATA(H->code[pc + 1]);
         halmat_val_t src = halmat_resolve_operand(H, H->code[pc + 2]);
-        if (dest < HALMAT_MAX_SYT) {
-            H->syt[dest].val.type = HTYPE_CHAR;
-            memcpy(H->syt[dest].val.v.string.data, src.v.string.data,
-                   src.v.string.len);
-            H->syt[dest].val.v.string.len = src.v.string.len;
-            H->syt[dest].allocated = 1;
-        }
+        if (dest < HALMAT_MAX_SYT)
+            halmat_char_assign(H, dest, &src);
         break;
     }
 
@@ -55,11 +50,8 @@ int halmat_exec_class8(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
         if (numop < 2) break;
         uint32_t dest = HALMAT_DATA(H->code[pc + 1]);
         halmat_val_t src = halmat_resolve_operand(H, H->code[pc + 2]);
-        if (dest < HALMAT_MAX_SYT) {
-            H->syt[dest].val.type = HTYPE_BIT;
-            H->syt[dest].val.v.bits = src.v.bits;
-            H->syt[dest].allocated = 1;
-        }
+        if (dest < HALMAT_MAX_SYT)
+            halmat_bit_assign(H, dest, &src);
         break;
     }
 
@@ -76,8 +68,7 @@ int halmat_exec_class8(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t t
     case POP_NINT:
     case POP_TINT:
     case POP_EINT:
-        /* TODO */
-        break;
+        return halmat_struct_exec(H, popcode, numop, tag);
 
     case POP_STRI:
     case POP_SLRI:
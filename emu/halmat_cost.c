@@ -0,0 +1,721 @@
+#include "halmat_cost.h"
+#include "halmat_prof.h"
+#include "halmat_sched.h"
+
+#define NO_STMT    0xFFFFFFFFu
+#define MAX_WARN   10                       /* frame overruns printed */
+#define PATH_MAX_LEN 16
+
+typedef struct {
+    uint16_t code;
+    float    instr, cycles, instr_n, cycles_n;
+    uint8_t  scale, operands;
+} cost_row_t;
+
+/* Built-in AP-101S estimates.  Operand fetches for scalar, integer, bit
+ * and comparison operators are added per operand (see opnd_default);
+ * aggregates pay per element instead.  Declarations, initialisation and
+ * statement marks generate no code.  Anything missing costs dflt_entry,
+ * or what the model file gives as `default`. */
+static const cost_row_t cost_table[] = {
+    /* Class 0: control, subscripts, calls, I/O, real time */
+    { 0x000, 0, 0, 0, 0, COST_FIXED, 0 },           /* NOP */
+    { 0x001, 0, 0, 0, 0, COST_FIXED, 0 },           /* EXTN */
+    { 0x002, 0, 0, 0, 0, COST_FIXED, 0 },           /* XREC */
+    { 0x003, 0, 0, 0, 0, COST_FIXED, 0 },           /* IMRK */
+    { 0x004, 0, 0, 0, 0, COST_FIXED, 0 },           /* SMRK */
+    { 0x005, 0, 0, 0, 0, COST_FIXED, 0 },           /* PXRC */
+    { 0x007, 0, 0, 0, 0, COST_FIXED, 0 },           /* IFHD */
+    { 0x008, 0, 0, 0, 0, COST_FIXED, 0 },           /* LBL */
+    { 0x009, 1, 3, 0, 0, COST_FIXED, 0 },           /* BRA */
+    { 0x00A, 1, 3, 0, 0, COST_FIXED, 0 },           /* FBRA */
+    { 0x00B, 4, 13, 0, 0, COST_FIXED, 0 },          /* DCAS: index a branch table */
+    { 0x00C, 1, 3, 0, 0, COST_FIXED, 0 },           /* ECAS */
+    { 0x00D, 1, 3, 0, 0, COST_FIXED, 0 },           /* CLBL */
+    { 0x00E, 0, 0, 0, 0, COST_FIXED, 0 },           /* DTST */
+    { 0x00F, 1, 3, 0, 0, COST_FIXED, 0 },           /* ETST */
+    { 0x010, 4, 12, 0, 0, COST_FIXED, 0 },          /* DFOR */
+    { 0x011, 3, 9, 0, 0, COST_FIXED, 0 },           /* EFOR: step, compare, branch */
+    { 0x012, 2, 6, 0, 0, COST_FIXED, 0 },           /* CFOR */
+    { 0x013, 0, 0, 0, 0, COST_FIXED, 0 },           /* DSMP */
+    { 0x014, 0, 0, 0, 0, COST_FIXED, 0 },           /* ESMP */
+    { 0x015, 3, 9, 0, 0, COST_FIXED, 0 },           /* AFOR */
+    { 0x016, 1, 3, 0, 0, COST_FIXED, 0 },           /* CTST */
+    { 0x017, 3, 9, 0, 0, COST_FIXED, 0 },           /* ADLP */
+    { 0x018, 3, 9, 0, 0, COST_FIXED, 0 },           /* DLPE */
+    { 0x019, 1, 3, 2, 8, COST_ARGS, 0 },            /* DSUB: per subscript */
+    { 0x01A, 3, 9, 0, 0, COST_FIXED, 0 },           /* IDLP */
+    { 0x01B, 1, 3, 2, 8, COST_ARGS, 0 },            /* TSUB */
+    { 0x01D, 8, 30, 2, 7, COST_ARGS, 0 },           /* PCAL: BAL, save, per argument */
+    { 0x01E, 8, 30, 2, 7, COST_ARGS, 0 },           /* FCAL */
+    { 0x01F, 20, 200, 10, 60, COST_ARGS, 0 },       /* READ: SVC to the OS */
+    { 0x020, 20, 200, 10, 60, COST_ARGS, 0 },       /* RDAL */
+    { 0x021, 20, 200, 10, 60, COST_ARGS, 0 },       /* WRIT */
+    { 0x022, 20, 200, 0, 0, COST_FIXED, 0 },        /* FILE */
+    { 0x025, 0, 0, 0, 0, COST_FIXED, 0 },           /* XXST */
+    { 0x026, 0, 0, 0, 0, COST_FIXED, 0 },           /* XXND */
+    { 0x027, 2, 6, 0, 0, COST_FIXED, 0 },           /* XXAR */
+    { 0x02A, 0, 0, 0, 0, COST_FIXED, 0 },           /* TDEF: bodies are out of line */
+    { 0x02B, 4, 14, 0, 0, COST_FIXED, 0 },          /* MDEF: program entry */
+    { 0x02C, 0, 0, 0, 0, COST_FIXED, 0 },           /* FDEF */
+    { 0x02D, 0, 0, 0, 0, COST_FIXED, 0 },           /* PDEF */
+    { 0x02E, 0, 0, 0, 0, COST_FIXED, 0 },           /* UDEF */
+    { 0x02F, 0, 0, 0, 0, COST_FIXED, 0 },           /* CDEF */
+    { 0x030, 3, 10, 0, 0, COST_FIXED, 0 },          /* CLOS: exit */
+    { 0x031, 0, 0, 0, 0, COST_FIXED, 0 },           /* EDCL */
+    { 0x032, 3, 10, 0, 0, COST_FIXED, 0 },          /* RTRN */
+    { 0x033, 0, 0, 0, 0, COST_FIXED, 0 },           /* TDCL */
+    { 0x034, 15, 150, 0, 0, COST_FIXED, 0 },        /* WAIT: SVC */
+    { 0x035, 15, 150, 0, 0, COST_FIXED, 0 },        /* SGNL */
+    { 0x036, 15, 150, 0, 0, COST_FIXED, 0 },        /* CANC */
+    { 0x037, 15, 150, 0, 0, COST_FIXED, 0 },        /* TERM */
+    { 0x038, 15, 150, 0, 0, COST_FIXED, 0 },        /* PRIO */
+    { 0x039, 20, 200, 0, 0, COST_FIXED, 0 },        /* SCHD */
+    { 0x045, 2, 6, 0, 0, COST_FIXED, 0 },           /* SFST */
+    { 0x046, 2, 8, 0, 0, COST_FIXED, 0 },           /* SFND */
+    { 0x047, 1, 3, 0, 0, COST_FIXED, 1 },           /* SFAR */
+    { 0x04A, 25, 110, 0, 0, COST_FIXED, 1 },        /* BFNC: library routine */
+    { 0x04B, 25, 110, 0, 0, COST_FIXED, 1 },        /* LFNC */
+    { 0x04D, 6, 20, 0, 0, COST_FIXED, 0 },          /* TNEQ */
+    { 0x04E, 6, 20, 0, 0, COST_FIXED, 0 },          /* TEQU */
+    { 0x04F, 6, 20, 0, 0, COST_FIXED, 0 },          /* TASN: MVC */
+    { 0x051, 0, 0, 0, 0, COST_FIXED, 0 },           /* IDEF */
+    { 0x052, 0, 0, 0, 0, COST_FIXED, 0 },           /* ICLS */
+    { 0x055, 2, 6, 0, 0, COST_FIXED, 0 },           /* NNEQ */
+    { 0x056, 2, 6, 0, 0, COST_FIXED, 0 },           /* NEQU */
+    { 0x057, 2, 6, 0, 0, COST_FIXED, 0 },           /* NASN */
+
+    /* Class 1: bit */
+    { 0x101, 1, 3, 0, 0, COST_FIXED, 1 },           /* BASN */
+    { 0x102, 1, 2, 0, 0, COST_FIXED, 1 },           /* BAND */
+    { 0x103, 1, 2, 0, 0, COST_FIXED, 1 },           /* BOR */
+    { 0x104, 1, 2, 0, 0, COST_FIXED, 1 },           /* BNOT */
+    { 0x105, 3, 8, 0, 0, COST_FIXED, 1 },           /* BCAT: shift and or */
+    { 0x121, 1, 2, 0, 0, COST_FIXED, 1 },           /* BTOB */
+    { 0x1C1, 1, 2, 0, 0, COST_FIXED, 1 },           /* ITOB */
+
+    /* Class 2: character, per character moved or compared */
+    { 0x201, 6, 20, 0.1f, 0.5f, COST_CHARS, 0 },    /* CASN */
+    { 0x202, 10, 35, 0.1f, 0.5f, COST_CHARS, 0 },   /* CCAT */
+    { 0x221, 25, 110, 0, 0, COST_FIXED, 0 },        /* BTOC */
+    { 0x241, 6, 20, 0.1f, 0.5f, COST_CHARS, 0 },    /* CTOC */
+    { 0x2A1, 30, 140, 0, 0, COST_FIXED, 0 },        /* STOC */
+    { 0x2C1, 25, 110, 0, 0, COST_FIXED, 0 },        /* ITOC */
+
+    /* Class 3: matrix, per element or multiply-add */
+    { 0x301, 2, 6, 2, 6, COST_ELEMS, 0 },           /* MASN */
+    { 0x362, 4, 12, 3, 12, COST_ELEMS, 0 },         /* MADD */
+    { 0x363, 4, 12, 3, 12, COST_ELEMS, 0 },         /* MSUB */
+    { 0x344, 4, 12, 2, 8, COST_ELEMS, 0 },          /* MNEG */
+    { 0x368, 6, 20, 2, 14, COST_MADDS, 0 },         /* MMPR */
+    { 0x3A5, 4, 12, 3, 14, COST_ELEMS, 0 },         /* MSPR */
+    { 0x3A6, 4, 30, 3, 14, COST_ELEMS, 0 },         /* MSDV */
+    { 0x329, 4, 12, 2, 6, COST_ELEMS, 0 },          /* MTRA */
+    { 0x371, 10, 40, 1, 7, COST_CUBE, 0 },          /* MDET: n^3/3 */
+    { 0x373, 3, 8, 1, 3, COST_ELEMS, 0 },           /* MIDN */
+    { 0x341, 2, 6, 2, 6, COST_ELEMS, 0 },           /* MTOM */
+    { 0x3CA, 20, 80, 3, 20, COST_CUBE, 0 },         /* MINV */
+    { 0x387, 4, 12, 3, 14, COST_MADDS, 0 },         /* VVPR: outer product */
+
+    /* Class 4: vector */
+    { 0x401, 2, 6, 2, 6, COST_ELEMS, 0 },           /* VASN */
+    { 0x482, 4, 12, 3, 12, COST_ELEMS, 0 },         /* VADD */
+    { 0x483, 4, 12, 3, 12, COST_ELEMS, 0 },         /* VSUB */
+    { 0x444, 4, 12, 2, 8, COST_ELEMS, 0 },          /* VNEG */
+    { 0x46D, 6, 20, 2, 14, COST_MADDS, 0 },         /* VMPR */
+    { 0x4A5, 4, 12, 3, 14, COST_ELEMS, 0 },         /* VSPR */
+    { 0x48B, 20, 90, 0, 0, COST_FIXED, 0 },         /* VCRS: 3-vectors */
+    { 0x441, 2, 6, 2, 6, COST_ELEMS, 0 },           /* VTOV */
+    { 0x46C, 6, 20, 2, 14, COST_MADDS, 0 },         /* MVPR */
+
+    /* Class 5: scalar */
+    { 0x58E, 4, 12, 2, 14, COST_ELEMS, 0 },         /* VDOT */
+    { 0x501, 1, 3, 0, 0, COST_FIXED, 1 },           /* SASN: STE */
+    { 0x521, 4, 14, 0, 0, COST_FIXED, 1 },          /* BTOS */
+    { 0x541, 30, 140, 0, 0, COST_FIXED, 1 },        /* CTOS */
+    { 0x571, 10, 60, 0, 0, COST_FIXED, 1 },         /* SIEX */
+    { 0x572, 8, 45, 0, 0, COST_FIXED, 1 },          /* SPEX */
+    { 0x5A1, 1, 2, 0, 0, COST_FIXED, 1 },           /* STOS */
+    { 0x5AB, 1, 4, 0, 0, COST_FIXED, 1 },           /* SADD: AER */
+    { 0x5AC, 1, 4, 0, 0, COST_FIXED, 1 },           /* SSUB */
+    { 0x5AD, 1, 9, 0, 0, COST_FIXED, 1 },           /* SSPR: MER */
+    { 0x5AE, 1, 24, 0, 0, COST_FIXED, 1 },          /* SSDV: DER */
+    { 0x5AF, 30, 200, 0, 0, COST_FIXED, 1 },        /* SEXP: library */
+    { 0x5B0, 1, 2, 0, 0, COST_FIXED, 1 },           /* SNEG */
+    { 0x5C1, 4, 14, 0, 0, COST_FIXED, 1 },          /* ITOS */
+
+    /* Class 6: integer */
+    { 0x601, 1, 2, 0, 0, COST_FIXED, 1 },           /* IASN: STH */
+    { 0x621, 1, 2, 0, 0, COST_FIXED, 1 },           /* BTOI */
+    { 0x641, 25, 110, 0, 0, COST_FIXED, 1 },        /* CTOI */
+    { 0x6A1, 4, 14, 0, 0, COST_FIXED, 1 },          /* STOI */
+    { 0x6C1, 1, 2, 0, 0, COST_FIXED, 1 },           /* ITOI */
+    { 0x6CB, 1, 2, 0, 0, COST_FIXED, 1 },           /* IADD: AR */
+    { 0x6CC, 1, 2, 0, 0, COST_FIXED, 1 },           /* ISUB */
+    { 0x6CD, 1, 7, 0, 0, COST_FIXED, 1 },           /* IIPR: MR */
+    { 0x6D0, 1, 2, 0, 0, COST_FIXED, 1 },           /* INEG */
+    { 0x6D2, 8, 40, 0, 0, COST_FIXED, 1 },          /* IPEX */
+
+    /* Class 7: conditions, compare and branch */
+    { 0x720, 2, 5, 0, 0, COST_FIXED, 1 },           /* BTRU */
+    { 0x725, 2, 5, 0, 0, COST_FIXED, 1 },           /* BNEQ */
+    { 0x726, 2, 5, 0, 0, COST_FIXED, 1 },           /* BEQU */
+    { 0x745, 6, 20, 0.2f, 0.6f, COST_CHARS, 0 },    /* CNEQ: CLC */
+    { 0x746, 6, 20, 0.2f, 0.6f, COST_CHARS, 0 },    /* CEQU */
+    { 0x747, 6, 20, 0.2f, 0.6f, COST_CHARS, 0 },    /* CNGT */
+    { 0x748, 6, 20, 0.2f, 0.6f, COST_CHARS, 0 },    /* CGT */
+    { 0x749, 6, 20, 0.2f, 0.6f, COST_CHARS, 0 },    /* CNLT */
+    { 0x74A, 6, 20, 0.2f, 0.6f, COST_CHARS, 0 },    /* CLT */
+    { 0x765, 4, 10, 2, 6, COST_ELEMS, 0 },          /* MNEQ */
+    { 0x766, 4, 10, 2, 6, COST_ELEMS, 0 },          /* MEQU */
+    { 0x785, 4, 10, 2, 6, COST_ELEMS, 0 },          /* VNEQ */
+    { 0x786, 4, 10, 2, 6, COST_ELEMS, 0 },          /* VEQU */
+    { 0x7A5, 2, 6, 0, 0, COST_FIXED, 1 },           /* SNEQ: CER, BC */
+    { 0x7A6, 2, 6, 0, 0, COST_FIXED, 1 },           /* SEQU */
+    { 0x7A7, 2, 6, 0, 0, COST_FIXED, 1 },           /* SNGT */
+    { 0x7A8, 2, 6, 0, 0, COST_FIXED, 1 },           /* SGT */
+    { 0x7A9, 2, 6, 0, 0, COST_FIXED, 1 },           /* SNLT */
+    { 0x7AA, 2, 6, 0, 0, COST_FIXED, 1 },           /* SLT */
+    { 0x7C5, 2, 5, 0, 0, COST_FIXED, 1 },           /* INEQ: CR, BC */
+    { 0x7C6, 2, 5, 0, 0, COST_FIXED, 1 },           /* IEQU */
+    { 0x7C7, 2, 5, 0, 0, COST_FIXED, 1 },           /* INGT */
+    { 0x7C8, 2, 5, 0, 0, COST_FIXED, 1 },           /* IGT */
+    { 0x7C9, 2, 5, 0, 0, COST_FIXED, 1 },           /* INLT */
+    { 0x7CA, 2, 5, 0, 0, COST_FIXED, 1 },           /* ILT */
+    { 0x7E2, 1, 3, 0, 0, COST_FIXED, 0 },           /* CAND */
+    { 0x7E3, 1, 3, 0, 0, COST_FIXED, 0 },           /* COR */
+    { 0x7E4, 1, 3, 0, 0, COST_FIXED, 0 },           /* CNOT */
+};
+
+/* Fetching one operand of a scalar operator, by qualifier: from
+ * storage or a literal it is an RX load; an accumulator is already in a
+ * register */
+static const float opnd_default[16][2] = {
+    [QUAL_SYT] = { 1, 3 },
+    [QUAL_LIT] = { 1, 3 },
+    [QUAL_IMD] = { 1, 1 },
+    [QUAL_XPT] = { 2, 6 },
+};
+
+static const halmat_cost_entry_t dflt_entry = { 2, 6, 0, 0, COST_FIXED, 0 };
+
+typedef struct {
+    double   stmt_t0, proc_t0;              /* task clock at the start */
+    double   heavy;                         /* costliest callee so far */
+    uint32_t stmt, proc, heavy_proc;
+} cost_level_t;
+
+typedef struct {
+    double        clock;                    /* cycles charged to the task */
+    double        act_t0;
+    uint64_t      act;                      /* activation being charged */
+    uint32_t      gen;
+    uint32_t      key;                      /* process SYT, 0 = program */
+    uint64_t      release_us, period_us;
+    uint32_t      depth;                    /* levels open above 0 */
+    int           open;
+    cost_level_t *lv;                       /* HALMAT_MAX_FRAMES + 1 */
+} cost_task_t;
+
+typedef struct {
+    uint64_t count;                         /* instances */
+    double   incl, excl, worst;             /* cycles */
+    uint32_t worst_child;                   /* procedure SYT + 1, 0 = none */
+    uint32_t over;                          /* activations over the period */
+    uint64_t worst_at_us;                   /* activation: release time */
+    uint64_t period_us;
+} cost_line_t;
+
+struct halmat_cost {
+    halmat_cost_entry_t e[HALMAT_POPCODES];
+    uint8_t      known[HALMAT_POPCODES];    /* in the table or the model */
+    float        opnd[16][2];
+    double       cycle_ns;
+    const char  *model;
+
+    double       instr_pop[HALMAT_POPCODES], cycles_pop[HALMAT_POPCODES];
+    uint64_t     count_pop[HALMAT_POPCODES];
+
+    uint32_t    *stmt_of;                   /* code address -> statement */
+    cost_line_t  stmt[HALMAT_STMT_MAX];
+    cost_line_t  proc[HALMAT_MAX_SYT];
+    cost_line_t  task[HALMAT_MAX_SYT];      /* by process SYT, 0 = program */
+    cost_task_t  t[HALMAT_MAX_TASKS];
+
+    double       frame_ns;                  /* budget, 0 = none */
+    uint64_t     frame, frames, over;
+    double       frame_sum, worst_frame;
+    uint64_t     worst_frame_at;
+};
+
+/* ---- model ---- */
+
+static uint32_t pop_by_name(const char *name)
+{
+    for (uint32_t pop = 0; pop < HALMAT_POPCODES; pop++) {
+        const char *n = halmat_popcode_name(pop);
+        if (n && strcmp(n, name) == 0)
+            return pop;
+    }
+    return HALMAT_POPCODES;
+}
+
+static int qual_by_name(const char *name)
+{
+    static const char *const names[] = { "SYT", "LIT", "VAC", "IMD", "XPT" };
+    static const int quals[] = { QUAL_SYT, QUAL_LIT, QUAL_VAC, QUAL_IMD, QUAL_XPT };
+    for (int i = 0; i < 5; i++)
+        if (strcmp(name, names[i]) == 0)
+            return quals[i];
+    return -1;
+}
+
+static int load_model(struct halmat_cost *C, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "halmat_cost: cannot open %s\n", path);
+        return -1;
+    }
+    char buf[256], word[32], arg[32];
+    unsigned line = 0;
+    int rc = 0;
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        char *hash = strchr(buf, '#');
+        if (hash)
+            *hash = '\0';
+        float a = 0, b = 0, c = 0, d = 0;
+        int n = sscanf(buf, "%31s", word);
+        if (n != 1)
+            continue;
+        if (strcmp(word, "cycle-ns") == 0 && sscanf(buf, "%*s %f", &a) == 1 && a > 0) {
+            C->cycle_ns = a;
+        } else if (strcmp(word, "operand") == 0 &&
+                   sscanf(buf, "%*s %31s %f %f", arg, &a, &b) == 3 &&
+                   qual_by_name(arg) >= 0) {
+            C->opnd[qual_by_name(arg)][0] = a;
+            C->opnd[qual_by_name(arg)][1] = b;
+        } else if (strcmp(word, "default") == 0 &&
+                   sscanf(buf, "%*s %f %f", &a, &b) == 2) {
+            for (uint32_t pop = 0; pop < HALMAT_POPCODES; pop++)
+                if (!C->known[pop]) {
+                    C->e[pop].instr = a;
+                    C->e[pop].cycles = b;
+                }
+        } else {
+            uint32_t pop = pop_by_name(word);
+            n = sscanf(buf, "%*s %f %f %f %f", &a, &b, &c, &d);
+            if (pop == HALMAT_POPCODES || (n != 2 && n != 4)) {
+                fprintf(stderr, "halmat_cost: %s:%u: cannot read '%s'\n", path, line, word);
+                rc = -1;
+                continue;
+            }
+            C->known[pop] = 1;
+            C->e[pop].instr = a;
+            C->e[pop].cycles = b;
+            if (n == 4) {
+                C->e[pop].instr_n = c;
+                C->e[pop].cycles_n = d;
+            }
+        }
+    }
+    fclose(f);
+    return rc;
+}
+
+int halmat_cost_init(halmat_t *H, const char *model, double frame_ms)
+{
+    struct halmat_cost *C = calloc(1, sizeof(*C));
+    if (!C)
+        return -1;
+    for (uint32_t pop = 0; pop < HALMAT_POPCODES; pop++)
+        C->e[pop] = dflt_entry;
+    for (size_t i = 0; i < sizeof(cost_table) / sizeof(cost_table[0]); i++) {
+        const cost_row_t *r = &cost_table[i];
+        halmat_cost_entry_t *e = &C->e[r->code];
+        e->instr = r->instr;
+        e->cycles = r->cycles;
+        e->instr_n = r->instr_n;
+        e->cycles_n = r->cycles_n;
+        e->scale = r->scale;
+        e->operands = r->operands;
+        C->known[r->code] = 1;
+    }
+    memcpy(C->opnd, opnd_default, sizeof(C->opnd));
+    C->cycle_ns = HALMAT_COST_CYCLE_NS;
+    C->model = model;
+    C->frame_ns = frame_ms * 1e6;
+    if ((model && load_model(C, model) != 0) || !(C->stmt_of = halmat_stmt_map(H))) {
+        free(C->stmt_of);
+        free(C);
+        return -1;
+    }
+    H->cost = C;
+    return 0;
+}
+
+void halmat_cost_free(halmat_t *H)
+{
+    struct halmat_cost *C = H->cost;
+    if (!C)
+        return;
+    for (uint32_t i = 0; i < HALMAT_MAX_TASKS; i++)
+        free(C->t[i].lv);
+    free(C->stmt_of);
+    free(C);
+    H->cost = NULL;
+}
+
+/* ---- charging ---- */
+
+static uint32_t elems(const halmat_val_t *v)
+{
+    if (v->type == HTYPE_MATRIX)
+        return (uint32_t)v->rows * v->cols;
+    if (v->type == HTYPE_VECTOR)
+        return v->rows;
+    return 1;
+}
+
+/* Units of the entry's scale for the operator at pc */
+static double units(halmat_t *H, const halmat_cost_entry_t *e, uint32_t pc, uint32_t numop)
+{
+    if (e->scale == COST_ARGS)
+        return numop;
+
+    halmat_val_t a, b;
+    uint32_t n = 0, most = 0;
+    a.type = b.type = HTYPE_NONE;
+    a.rows = a.cols = b.rows = b.cols = 0;
+    for (uint32_t j = 1; j <= numop && pc + j < H->code_len; j++) {
+        uint32_t ow = H->code[pc + j];
+        uint32_t q = HALMAT_QUAL(ow);
+        if (!HALMAT_IS_OPERAND(ow) || (q != QUAL_SYT && q != QUAL_VAC && q != QUAL_LIT))
+            continue;
+        halmat_val_t v = halmat_resolve_operand(H, ow);
+        uint32_t u = e->scale == COST_CHARS ?
+            (v.type == HTYPE_CHAR ? v.v.string.len : 0) : elems(&v);
+        if (u > most)
+            most = u;
+        if (n == 0)
+            a = v;
+        else if (n == 1)
+            b = v;
+        n++;
+    }
+    switch (e->scale) {
+    case COST_CUBE:
+        return n ? (double)a.rows * a.rows * a.rows : 0;
+    case COST_MADDS:
+        /* matrix product r x k x c; vector outer product; else the matrix */
+        if (n >= 2 && a.type == HTYPE_MATRIX && b.type == HTYPE_MATRIX)
+            return (double)a.rows * a.cols * b.cols;
+        if (n >= 2 && a.type == HTYPE_VECTOR && b.type == HTYPE_VECTOR)
+            return (double)a.rows * b.rows;
+        return most;
+    default:
+        return most;
+    }
+}
+
+static void close_stmt(struct halmat_cost *C, cost_task_t *T, cost_level_t *L)
+{
+    if (L->stmt == NO_STMT)
+        return;
+    cost_line_t *s = &C->stmt[L->stmt];
+    double c = T->clock - L->stmt_t0;
+    s->count++;
+    s->incl += c;
+    if (c > s->worst)
+        s->worst = c;
+    L->stmt = NO_STMT;
+}
+
+/* Leave call level k, charging the call to its procedure and to the
+ * caller's costliest callee */
+static void pop_level(struct halmat_cost *C, cost_task_t *T, uint32_t k)
+{
+    cost_level_t *L = &T->lv[k];
+    close_stmt(C, T, L);
+    cost_line_t *p = &C->proc[L->proc];
+    double c = T->clock - L->proc_t0;
+    int nested = 0;
+    for (uint32_t j = 1; j < k; j++)
+        nested |= T->lv[j].proc == L->proc;
+    p->count++;
+    if (!nested)
+        p->incl += c;
+    if (c > p->worst) {
+        p->worst = c;
+        p->worst_child = L->heavy_proc;
+    }
+    if (c > T->lv[k - 1].heavy) {
+        T->lv[k - 1].heavy = c;
+        T->lv[k - 1].heavy_proc = L->proc + 1;
+    }
+}
+
+static void open_level(cost_task_t *T, uint32_t k, uint32_t proc)
+{
+    cost_level_t *L = &T->lv[k];
+    L->stmt = NO_STMT;
+    L->proc = proc;
+    L->proc_t0 = T->clock;
+    L->heavy = 0;
+    L->heavy_proc = 0;
+}
+
+static void close_activation(struct halmat_cost *C, cost_task_t *T)
+{
+    while (T->depth > 0)
+        pop_level(C, T, T->depth--);
+    close_stmt(C, T, &T->lv[0]);
+    cost_line_t *l = &C->task[T->key];
+    double c = T->clock - T->act_t0;
+    l->count++;
+    l->incl += c;
+    l->period_us = T->period_us;
+    if (c > l->worst) {
+        l->worst = c;
+        l->worst_child = T->lv[0].heavy_proc;
+        l->worst_at_us = T->release_us;
+    }
+    if (T->period_us && c * C->cycle_ns > T->period_us * 1e3)
+        l->over++;
+    T->open = 0;
+}
+
+static void end_frame(struct halmat_cost *C)
+{
+    double ns = C->frame_sum * C->cycle_ns;
+    C->frames++;
+    if (C->frame_sum > C->worst_frame) {
+        C->worst_frame = C->frame_sum;
+        C->worst_frame_at = C->frame;
+    }
+    if (ns > C->frame_ns) {
+        if (C->over++ < MAX_WARN)
+            fprintf(stderr, "halmat_cost: frame %llu (t=%.3f s): %.3f ms estimated, "
+                    "budget %.3f ms\n", (unsigned long long)C->frame,
+                    C->frame * C->frame_ns / 1e9, ns / 1e6, C->frame_ns / 1e6);
+        else if (C->over == MAX_WARN + 1)
+            fprintf(stderr, "halmat_cost: further frame overruns counted, not shown\n");
+    }
+    C->frame_sum = 0;
+}
+
+void halmat_cost_op(halmat_t *H, uint32_t pc, uint32_t w)
+{
+    struct halmat_cost *C = H->cost;
+    uint32_t pop = HALMAT_POPCODE(w);
+    uint32_t numop = HALMAT_NUMOP(w);
+    const halmat_cost_entry_t *e = &C->e[pop];
+
+    double instr = e->instr, cycles = e->cycles;
+    if (e->scale != COST_FIXED) {
+        double u = units(H, e, pc, numop);
+        instr += e->instr_n * u;
+        cycles += e->cycles_n * u;
+    }
+    if (e->operands)
+        for (uint32_t j = 1; j <= numop && pc + j < H->code_len; j++) {
+            uint32_t ow = H->code[pc + j];
+            if (HALMAT_IS_OPERAND(ow)) {
+                instr += C->opnd[HALMAT_QUAL(ow)][0];
+                cycles += C->opnd[HALMAT_QUAL(ow)][1];
+            }
+        }
+    C->count_pop[pop]++;
+    C->instr_pop[pop] += instr;
+    C->cycles_pop[pop] += cycles;
+
+    /* the activation, call level and statement this runs in */
+    halmat_sched_t *S = H->sched;
+    int32_t id = S && H->task >= 0 ? H->task : 0;
+    cost_task_t *T = &C->t[id];
+    if (!T->lv && !(T->lv = calloc(HALMAT_MAX_FRAMES + 1, sizeof(cost_level_t))))
+        return;
+    uint64_t act = S ? S->tasks[id].activations : 1;
+    uint32_t gen = S ? S->tasks[id].gen : 0;
+    if (!T->open || act != T->act || gen != T->gen) {
+        if (T->open)
+            close_activation(C, T);
+        T->open = 1;
+        T->act = act;
+        T->gen = gen;
+        T->key = id && S->tasks[id].syt < HALMAT_MAX_SYT ? S->tasks[id].syt : 0;
+        T->release_us = S ? S->tasks[id].release_us : 0;
+        T->period_us = S && (S->tasks[id].sched_flags & SCHD_REPEAT_MASK) == SCHD_EVERY ?
+                       S->tasks[id].period_us : 0;
+        T->act_t0 = T->clock;
+        T->depth = 0;
+        open_level(T, 0, 0);
+    }
+    uint32_t depth = H->frame_depth < HALMAT_MAX_FRAMES ? H->frame_depth : HALMAT_MAX_FRAMES;
+    while (T->depth > depth)
+        pop_level(C, T, T->depth--);
+    while (T->depth < depth) {
+        T->depth++;
+        open_level(T, T->depth, halmat_callee(H, H->frames[T->depth - 1].call_addr));
+    }
+
+    cost_level_t *L = &T->lv[T->depth];
+    uint32_t st = C->stmt_of[pc];
+    if (st != L->stmt || pop == POP_SMRK) {     /* a SMRK starts each instance */
+        close_stmt(C, T, L);
+        L->stmt = st;
+        L->stmt_t0 = T->clock;
+    }
+    T->clock += cycles;
+    C->stmt[st].excl += cycles;
+    C->proc[L->proc].excl += cycles;
+
+    if (C->frame_ns > 0) {
+        uint64_t f = S ? (uint64_t)(S->now_us * 1e3 / C->frame_ns) : 0;
+        if (f != C->frame) {
+            if (C->frame_sum > 0)
+                end_frame(C);
+            C->frame = f;
+        }
+        C->frame_sum += cycles;
+    }
+}
+
+/* ---- report ---- */
+
+static double ms(const struct halmat_cost *C, double cycles)
+{
+    return cycles * C->cycle_ns / 1e6;
+}
+
+/* The costliest callee of each worst instance, in turn */
+static void print_path(const halmat_t *H, const struct halmat_cost *C, uint32_t child,
+                       FILE *out)
+{
+    uint32_t seen[PATH_MAX_LEN];
+    for (uint32_t n = 0; child && n < PATH_MAX_LEN; n++) {
+        uint32_t syt = child - 1;
+        for (uint32_t k = 0; k < n; k++)
+            if (seen[k] == syt)
+                return;
+        seen[n] = syt;
+        char buf[16];
+        fprintf(out, " > %s %.3f", halmat_proc_name(H, syt, buf, sizeof(buf)),
+                ms(C, C->proc[syt].worst));
+        child = C->proc[syt].worst_child;
+    }
+}
+
+static int stmt_costlier(const struct halmat_cost *C, uint32_t a, uint32_t b)
+{
+    return C->stmt[a].excl > C->stmt[b].excl;
+}
+
+void halmat_cost_report(halmat_t *H, FILE *out)
+{
+    struct halmat_cost *C = H->cost;
+    if (!C)
+        return;
+    for (uint32_t i = 0; i < HALMAT_MAX_TASKS; i++)
+        if (C->t[i].open)
+            close_activation(C, &C->t[i]);
+    if (C->frame_ns > 0 && C->frame_sum > 0)
+        end_frame(C);
+
+    double instr = 0, cycles = 0;
+    for (uint32_t pop = 0; pop < HALMAT_POPCODES; pop++) {
+        instr += C->instr_pop[pop];
+        cycles += C->cycles_pop[pop];
+    }
+    fprintf(out, "\n=== AP-101S ESTIMATE ===  (model: %s, %.0f ns cycle)\n\n",
+            C->model ? C->model : "built-in", C->cycle_ns);
+    fprintf(out, "  %.0f instructions, %.0f cycles, %.3f ms\n", instr, cycles, ms(C, cycles));
+
+    /* costliest popcodes */
+    uint32_t top[10];
+    int ntop = 0;
+    for (uint32_t pop = 0; pop < HALMAT_POPCODES; pop++) {
+        if (!C->cycles_pop[pop])
+            continue;
+        int j = ntop < 10 ? ntop++ : 10;
+        while (j > 0 && C->cycles_pop[pop] > C->cycles_pop[top[j - 1]]) {
+            if (j < 10)
+                top[j] = top[j - 1];
+            j--;
+        }
+        if (j < 10)
+            top[j] = pop;
+    }
+    fprintf(out, "\n  %-6s %12s %14s %12s %10s\n", "POP", "COUNT", "INSTRUCTIONS",
+            "CYCLES", "MS");
+    for (int i = 0; i < ntop; i++) {
+        const char *name = halmat_popcode_name(top[i]);
+        fprintf(out, "  %-6s %12llu %14.0f %12.0f %10.3f\n", name ? name : "???",
+                (unsigned long long)C->count_pop[top[i]], C->instr_pop[top[i]],
+                C->cycles_pop[top[i]], ms(C, C->cycles_pop[top[i]]));
+    }
+
+    fprintf(out, "\nPROCESSES\n\n  name                 %11s   total ms   worst ms  period ms  over\n",
+            "activations");
+    for (uint32_t i = 0; i < HALMAT_MAX_SYT; i++) {
+        const cost_line_t *l = &C->task[i];
+        if (!l->count)
+            continue;
+        char buf[16];
+        fprintf(out, "  %-20s %11llu %10.3f %10.3f %10.3f  %4u\n",
+                halmat_proc_name(H, i, buf, sizeof(buf)), (unsigned long long)l->count,
+                ms(C, l->incl), ms(C, l->worst), l->period_us / 1e3, l->over);
+    }
+
+    fprintf(out, "\nPROCEDURES\n\n  name                    calls    incl ms    excl ms   worst ms\n");
+    for (uint32_t i = 1; i < HALMAT_MAX_SYT; i++) {
+        const cost_line_t *l = &C->proc[i];
+        if (!l->count)
+            continue;
+        char buf[16];
+        fprintf(out, "  %-20s %8llu %10.3f %10.3f %10.3f\n",
+                halmat_proc_name(H, i, buf, sizeof(buf)), (unsigned long long)l->count,
+                ms(C, l->incl), ms(C, l->excl), ms(C, l->worst));
+    }
+
+    ntop = 0;
+    for (uint32_t st = 0; st < HALMAT_STMT_MAX; st++) {
+        if (!C->stmt[st].excl)
+            continue;
+        int j = ntop < 10 ? ntop++ : 10;
+        while (j > 0 && stmt_costlier(C, st, top[j - 1])) {
+            if (j < 10)
+                top[j] = top[j - 1];
+            j--;
+        }
+        if (j < 10)
+            top[j] = st;
+    }
+    fprintf(out, "\nSTATEMENTS\n\n  stmt      count    incl ms    excl ms   worst ms\n");
+    for (int i = 0; i < ntop; i++) {
+        const cost_line_t *l = &C->stmt[top[i]];
+        fprintf(out, "  %4u %10llu %10.3f %10.3f %10.3f\n", top[i],
+                (unsigned long long)l->count, ms(C, l->incl), ms(C, l->excl),
+                ms(C, l->worst));
+    }
+
+    fprintf(out, "\nWORST CASE (ms)\n\n");
+    for (uint32_t i = 0; i < HALMAT_MAX_SYT; i++) {
+        const cost_line_t *l = &C->task[i];
+        if (!l->count)
+            continue;
+        char buf[16];
+        fprintf(out, "  %s %.3f", halmat_proc_name(H, i, buf, sizeof(buf)), ms(C, l->worst));
+        if (l->period_us)
+            fprintf(out, " (released at %.3f s)", l->worst_at_us / 1e6);
+        print_path(H, C, l->worst_child, out);
+        fprintf(out, "\n");
+    }
+
+    if (C->frame_ns > 0)
+        fprintf(out, "\nFRAMES: %.3f ms budget, %llu of %llu over; worst frame %llu: %.3f ms\n",
+                C->frame_ns / 1e6, (unsigned long long)C->over,
+                (unsigned long long)C->frames, (unsigned long long)C->worst_frame_at,
+                ms(C, C->worst_frame));
+}
@@ -0,0 +1,49 @@
+/* Target timing estimate (--cost, --cost-model, --frame-budget).
+ *
+ * cycle_count counts HALMAT operators, which says little about the
+ * flight computer.  Here each operator is charged an estimated AP-101S
+ * instruction count and cycle count from a table: a fixed part, a part
+ * per unit of size (matrix or vector elements, multiply-adds, characters
+ * or arguments, according to the popcode) and, for scalar operators, a
+ * part per operand by where it comes from (storage, literal, register).
+ * The built-in figures are rough and meant to be calibrated: a model
+ * file replaces any of them.
+ *
+ * Costs accumulate per statement, procedure and process activation.
+ * Code is charged to the statement of the SMRK before it, the same map
+ * the statement profiler uses (halmat_stmt_map), and a statement,
+ * call or activation includes what it calls; each process keeps its own
+ * count, so preemption does not move work between them.  The worst
+ * instance of each is kept with the callee that weighed most in it, which
+ * gives the worst path observed.  With a frame budget the virtual clock
+ * is cut into frames of that length and a frame whose work would take
+ * longer than the budget on the target is reported.
+ *
+ * Model file: lines of `POPNAME instr cycles [instr cycles per unit]`,
+ * `operand SYT|LIT|VAC|IMD instr cycles`, `default instr cycles` and
+ * `cycle-ns N`; # starts a comment. */
+
+#ifndef HALMAT_COST_H
+#define HALMAT_COST_H
+
+#include "halmat.h"
+
+#define HALMAT_COST_CYCLE_NS 250            /* default cycle time */
+
+enum { COST_FIXED, COST_ELEMS, COST_MADDS, COST_CUBE, COST_CHARS, COST_ARGS };
+
+typedef struct {
+    float    instr, cycles;                 /* fixed */
+    float    instr_n, cycles_n;             /* per unit of `scale` */
+    uint8_t  scale;                         /* COST_* */
+    uint8_t  operands;                      /* add the operand costs */
+} halmat_cost_entry_t;
+
+struct halmat_cost;
+
+int  halmat_cost_init(halmat_t *H, const char *model, double frame_ms);
+void halmat_cost_op(halmat_t *H, uint32_t pc, uint32_t w);     /* before dispatch */
+void halmat_cost_report(halmat_t *H, FILE *out);
+void halmat_cost_free(halmat_t *H);
+
+#endif /* HALMAT_COST_H */
@@ -0,0 +1,254 @@
+#include "halmat_cov.h"
+#include "halmat_prof.h"
+
+static const char magic[8] = { 'H', 'A', 'L', 'C', 'O', 'V', 'E', 'R' };
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t code_sum(const halmat_t *H)
+{
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < H->code_len; i++)
+        for (int k = 0; k < 32; k += 8) {
+            h ^= (H->code[i] >> k) & 0xFF;
+            h *= 16777619u;
+        }
+    return h;
+}
+
+int halmat_cov_init(halmat_t *H, int counts)
+{
+    struct halmat_cov *C = calloc(1, sizeof(*C));
+    if (!C)
+        return -1;
+    if (counts && !(C->hits = calloc(H->code_len ? H->code_len : 1, sizeof(uint16_t)))) {
+        free(C);
+        return -1;
+    }
+    C->code_len = H->code_len;
+    C->sum = code_sum(H);
+    H->cov = C;
+    return 0;
+}
+
+void halmat_cov_free(halmat_t *H)
+{
+    struct halmat_cov *C = H->cov;
+    if (!C)
+        return;
+    free(C->hits);
+    free(C);
+    H->cov = NULL;
+}
+
+/* The operators from..to (exclusive) ran as part of the one at H->pc */
+void halmat_cov_span(halmat_t *H, uint32_t from, uint32_t to, uint32_t times)
+{
+    struct halmat_cov *C = H->cov;
+    for (uint32_t a = from; a < to && a < H->code_len; ) {
+        uint32_t w = H->code[a];
+        if (!HALMAT_IS_OP(w)) {
+            a++;
+            continue;
+        }
+        halmat_cov_hit(C, a);
+        if (C->hits && times > 1) {
+            uint32_t h = C->hits[a] + times - 1;
+            C->hits[a] = (uint16_t)(h < HALMAT_COV_MAX_HITS ? h : HALMAT_COV_MAX_HITS);
+        }
+        a += HALMAT_NUMOP(w) + 1;
+    }
+}
+
+/* OR the bits of a file for the same program into the map and add its
+ * counts, keeping counts from then on if the file has them */
+int halmat_cov_merge(halmat_t *H, const char *path)
+{
+    struct halmat_cov *C = H->cov;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "halmat_cov: cannot open %s\n", path);
+        return -1;
+    }
+    uint8_t hdr[24];
+    if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) || memcmp(hdr, magic, 8) != 0 ||
+        get_u32(hdr + 8) != 1) {
+        fprintf(stderr, "halmat_cov: %s is not a coverage file\n", path);
+        fclose(fp);
+        return -1;
+    }
+    uint32_t flags = get_u32(hdr + 12);
+    if (get_u32(hdr + 16) != C->code_len || get_u32(hdr + 20) != C->sum) {
+        fprintf(stderr, "halmat_cov: %s is for a different program\n", path);
+        fclose(fp);
+        return -1;
+    }
+    if ((flags & HALMAT_COV_COUNTS) && !C->hits &&
+        !(C->hits = calloc(C->code_len ? C->code_len : 1, sizeof(uint16_t)))) {
+        fclose(fp);
+        return -1;
+    }
+
+    int rc = 0;
+    uint8_t b[8];
+    for (uint32_t i = 0; i < (C->code_len + 63) / 64 && rc == 0; i++) {
+        if (fread(b, 1, 8, fp) != 8)
+            rc = -1;
+        else
+            C->bits[i] |= (uint64_t)get_u32(b) | (uint64_t)get_u32(b + 4) << 32;
+    }
+    if (flags & HALMAT_COV_COUNTS)
+        for (uint32_t i = 0; i < C->code_len && rc == 0; i++) {
+            if (fread(b, 1, 2, fp) != 2) {
+                rc = -1;
+                break;
+            }
+            uint32_t n = C->hits[i] + ((uint32_t)b[0] | (uint32_t)b[1] << 8);
+            C->hits[i] = (uint16_t)(n > HALMAT_COV_MAX_HITS ? HALMAT_COV_MAX_HITS : n);
+        }
+    fclose(fp);
+    if (rc != 0)
+        fprintf(stderr, "halmat_cov: %s is truncated\n", path);
+    return rc;
+}
+
+int halmat_cov_write(halmat_t *H, const char *path)
+{
+    struct halmat_cov *C = H->cov;
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "halmat_cov: cannot create %s\n", path);
+        return -1;
+    }
+    uint8_t hdr[24];
+    memcpy(hdr, magic, 8);
+    put_u32(hdr + 8, 1);
+    put_u32(hdr + 12, C->hits ? HALMAT_COV_COUNTS : 0);
+    put_u32(hdr + 16, C->code_len);
+    put_u32(hdr + 20, C->sum);
+    fwrite(hdr, 1, sizeof(hdr), fp);
+    uint8_t b[8];
+    for (uint32_t i = 0; i < (C->code_len + 63) / 64; i++) {
+        put_u32(b, (uint32_t)C->bits[i]);
+        put_u32(b + 4, (uint32_t)(C->bits[i] >> 32));
+        fwrite(b, 1, 8, fp);
+    }
+    if (C->hits)
+        for (uint32_t i = 0; i < C->code_len; i++) {
+            b[0] = (uint8_t)C->hits[i];
+            b[1] = (uint8_t)(C->hits[i] >> 8);
+            fwrite(b, 1, 2, fp);
+        }
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "halmat_cov: error writing %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Count a block's operators and those that ran, as halmat_disasm walks
+ * them; with tables, also by popcode */
+static void count_block(halmat_t *H, uint32_t blk, uint32_t *ops, uint32_t *ran,
+                        uint32_t *sites, uint32_t *run, uint64_t *hits)
+{
+    struct halmat_cov *C = H->cov;
+    uint32_t base = blk * HALMAT_BLOCK_WORDS;
+    uint32_t end = base + ((H->code[base + 1] >> 16) & 0xFFFF);
+    uint32_t i = base + 2;
+
+    *ops = *ran = 0;
+    while (i <= end && i < H->code_len) {
+        uint32_t w = H->code[i];
+        if (!HALMAT_IS_OP(w)) {
+            i++;
+            continue;
+        }
+        int r = halmat_cov_ran(C, i);
+        (*ops)++;
+        *ran += (uint32_t)r;
+        if (sites) {
+            uint32_t pop = HALMAT_POPCODE(w);
+            sites[pop]++;
+            run[pop] += (uint32_t)r;
+            if (C->hits)
+                hits[pop] += C->hits[i];
+        }
+        i += HALMAT_NUMOP(w) + 1;
+    }
+}
+
+static double pct(uint32_t n, uint32_t of)
+{
+    return of ? 100.0 * n / of : 0.0;
+}
+
+void halmat_cov_summary(halmat_t *H, FILE *out)
+{
+    uint32_t ops = 0, ran = 0;
+    for (uint32_t blk = 0; blk < H->num_blocks; blk++) {
+        uint32_t n, r;
+        count_block(H, blk, &n, &r, NULL, NULL, NULL);
+        ops += n;
+        ran += r;
+    }
+    fprintf(out, "halmat_cov: %u of %u operators executed (%.1f%%)\n",
+            ran, ops, pct(ran, ops));
+}
+
+/* Operators run in each block, then every popcode in the program with
+ * how many of its sites ran; ##### marks a handler never exercised */
+void halmat_cov_report(halmat_t *H, FILE *out)
+{
+    struct halmat_cov *C = H->cov;
+    uint32_t *sites = calloc(HALMAT_POPCODES, sizeof(uint32_t));
+    uint32_t *run = calloc(HALMAT_POPCODES, sizeof(uint32_t));
+    uint64_t *hits = calloc(HALMAT_POPCODES, sizeof(uint64_t));
+    if (!sites || !run || !hits) {
+        free(sites);
+        free(run);
+        free(hits);
+        return;
+    }
+
+    fprintf(out, "=== COVERAGE ===\n\n  %-5s  %9s  %9s  %6s\n",
+            "BLOCK", "OPERATORS", "EXECUTED", "%");
+    for (uint32_t blk = 0; blk < H->num_blocks; blk++) {
+        uint32_t ops, ran;
+        count_block(H, blk, &ops, &ran, sites, run, hits);
+        fprintf(out, "  %5u  %9u  %9u  %5.1f%%\n", blk, ops, ran, pct(ran, ops));
+    }
+
+    fprintf(out, "\n  %-5s  %-6s  %5s  %5s  %10s\n",
+            "POP", "NAME", "SITES", "RUN", C->hits ? "HITS" : "");
+    uint32_t pops = 0, pops_run = 0;
+    for (uint32_t pop = 0; pop < HALMAT_POPCODES; pop++) {
+        if (!sites[pop])
+            continue;
+        const char *name = halmat_popcode_name(pop);
+        char hit[24] = "";
+        if (C->hits)
+            snprintf(hit, sizeof(hit), "%10llu", (unsigned long long)hits[pop]);
+        fprintf(out, "  0x%03X  %-6s  %5u  %5u  %s%s\n",
+                pop, name ? name : "???", sites[pop], run[pop], hit,
+                run[pop] ? "" : "  #####");
+        pops++;
+        pops_run += run[pop] != 0;
+    }
+    fprintf(out, "\n%u of %u popcodes exercised\n", pops_run, pops);
+    halmat_cov_summary(H, out);
+    free(sites);
+    free(run);
+    free(hits);
+}
@@ -0,0 +1,56 @@
+/* Execution coverage (--coverage, --coverage-counts, --coverage-in).
+ *
+ * halmat_step sets one bit per code word for every operator it runs,
+ * and a fused chain or compiled array loop also sets the bits of the
+ * operators it runs in their place.  The bit is tested before it is
+ * set, so an operator that has run before costs one load and a
+ * predicted branch.  With counts, each word also has a 16-bit hit
+ * counter that stops at 65535; a fused chain or compiled array loop
+ * adds what running its operators one at a time would (once per
+ * element in a loop), so the counts match the profiler's, which runs
+ * unfused.  Bits are set atomically, so worker
+ * threads can share the map; counters are not, and need one thread.
+ *
+ * File: "HALCOVER", then u32 little-endian version, flags, code words
+ * and an FNV-1a checksum of the code, then the bitmap as u64 words
+ * and, with HALMAT_COV_COUNTS, a u16 per code word.  Files for the same
+ * program merge by OR-ing the bits and adding the counts. */
+
+#ifndef HALMAT_COV_H
+#define HALMAT_COV_H
+
+#include "halmat.h"
+
+#define HALMAT_COV_COUNTS   0x1             /* header flag */
+#define HALMAT_COV_MAX_HITS 0xFFFF
+
+struct halmat_cov {
+    uint64_t  bits[HALMAT_MAX_CODE / 64];
+    uint16_t *hits;                         /* per code word, NULL = bits only */
+    uint32_t  code_len;
+    uint32_t  sum;                          /* checksum of the code at init */
+};
+
+int  halmat_cov_init(halmat_t *H, int counts);
+int  halmat_cov_merge(halmat_t *H, const char *path);
+int  halmat_cov_write(halmat_t *H, const char *path);
+void halmat_cov_span(halmat_t *H, uint32_t from, uint32_t to, uint32_t times);
+void halmat_cov_summary(halmat_t *H, FILE *out);    /* one line */
+void halmat_cov_report(halmat_t *H, FILE *out);     /* by block and popcode */
+void halmat_cov_free(halmat_t *H);
+
+static inline void halmat_cov_hit(struct halmat_cov *C, uint32_t pc)
+{
+    uint64_t m = (uint64_t)1 << (pc & 63);
+    if (!(__atomic_load_n(&C->bits[pc >> 6], __ATOMIC_RELAXED) & m))
+        __atomic_fetch_or(&C->bits[pc >> 6], m, __ATOMIC_RELAXED);
+    if (C->hits && C->hits[pc] != HALMAT_COV_MAX_HITS)
+        C->hits[pc]++;
+}
+
+static inline int halmat_cov_ran(const struct halmat_cov *C, uint32_t addr)
+{
+    return addr < C->code_len && (C->bits[addr >> 6] >> (addr & 63)) & 1;
+}
+
+#endif /* HALMAT_COV_H */
@@ -1,5 +1,10 @@
 #include "halmat.h"
 #include "halmat_debug.h"
+#include "halmat_sched.h"
+#include "halmat_cov.h"
+#include "halmat_replay.h"
+
+#include <math.h>
 
 int halmat_debug_init(halmat_t *H)
 {
@@ -9,20 +14,383 @@ int halmat_debug_init(halmat_t *H)
     return 0;
 }
 
-int halmat_debug_check_breakpoint(halmat_t *H)
+static breakpoint_t *bp_at(halmat_t *H, uint32_t addr)
 {
-    for (uint32_t i = 0; i < H->bp_count; i++) {
-        if (!H->breakpoints[i].enabled)
-            continue;
-        if (H->breakpoints[i].addr == H->pc)
-            return 1;
-        if (H->breakpoints[i].stmt > 0 &&
-            H->breakpoints[i].stmt == H->current_stmt)
-            return 1;
+    for (uint32_t i = 0; i < H->bp_count; i++)
+        if (H->breakpoints[i].enabled && H->breakpoints[i].addr == addr)
+            return &H->breakpoints[i];
+    return NULL;
+}
+
+/* The word at addr as loaded, without a trap */
+static uint32_t code_word(halmat_t *H, uint32_t addr)
+{
+    breakpoint_t *b = bp_at(H, addr);
+    return b ? b->saved : H->code[addr];
+}
+
+static void bp_set(halmat_t *H, uint32_t addr, uint32_t stmt)
+{
+    uint32_t max = (uint32_t)(sizeof(H->breakpoints) / sizeof(H->breakpoints[0]));
+    if (addr >= H->code_len || !HALMAT_IS_OP(H->code[addr])) {
+        printf("No operator at address %u\n", addr);
+        return;
+    }
+    if (bp_at(H, addr)) {
+        printf("Breakpoint already at address %u\n", addr);
+        return;
+    }
+    if (H->bp_count == max) {
+        printf("Too many breakpoints (%u)\n", max);
+        return;
+    }
+    breakpoint_t *b = &H->breakpoints[H->bp_count];
+    b->addr = addr;
+    b->stmt = stmt;
+    b->enabled = 1;
+    b->saved = H->code[addr];
+    H->code[addr] = (b->saved & ~0xEu) | HALMAT_TRAP_COPT << 1;
+    if (stmt)
+        printf("Breakpoint %u at statement %u (address %u)\n", H->bp_count, stmt, addr);
+    else
+        printf("Breakpoint %u at address %u\n", H->bp_count, addr);
+    H->bp_count++;
+}
+
+static void bp_clear(halmat_t *H, breakpoint_t *b)
+{
+    if (!b->enabled)
+        return;
+    H->code[b->addr] = b->saved;
+    b->enabled = 0;
+}
+
+/* Called by halmat_step for an operator whose COPT is the trap value:
+ * stop unless it is the trap being stepped off, or a word that has
+ * that COPT of its own */
+int halmat_debug_trap(halmat_t *H)
+{
+    if (H->bp_resume == H->pc + 1) {
+        H->bp_resume = 0;
+        return 0;
+    }
+    return bp_at(H, H->pc) != NULL;
+}
+
+void halmat_debug_free(halmat_t *H)
+{
+    for (uint32_t i = 0; i < H->bp_count; i++)
+        bp_clear(H, &H->breakpoints[i]);
+    free(H->watch);
+    H->watch = NULL;
+}
+
+/* ---- watchpoints ---- */
+
+static const char *const cond_names[] = { "", "==", "!=", "<", ">", "<=", ">=" };
+
+static double watch_num(const halmat_val_t *v)
+{
+    switch (v->type) {
+    case HTYPE_INTEGER: return v->v.integer;
+    case HTYPE_SCALAR:  return v->v.scalar;
+    case HTYPE_BIT:
+    case HTYPE_BOOLEAN: return v->v.bits;
+    default:            return NAN;
+    }
+}
+
+static int watch_test(const watchpoint_t *w, const halmat_val_t *v)
+{
+    double x = watch_num(v);
+    switch (w->cond) {
+    case WATCH_EQ: return x == w->value;
+    case WATCH_NE: return x != w->value;
+    case WATCH_LT: return x < w->value;
+    case WATCH_GT: return x > w->value;
+    case WATCH_LE: return x <= w->value;
+    case WATCH_GE: return x >= w->value;
+    default:       return 1;
+    }
+}
+
+static int watched(const struct halmat_watch *W, uint32_t syt)
+{
+    return syt < HALMAT_MAX_SYT && (W->bits[syt >> 6] >> (syt & 63)) & 1;
+}
+
+/* syt was just written with v */
+void halmat_watch_store(halmat_t *H, uint32_t syt, const halmat_val_t *v)
+{
+    struct halmat_watch *W = H->watch;
+    if (!watched(W, syt) || W->hit)
+        return;
+    for (uint32_t i = 0; i < W->n; i++)
+        if (W->w[i].syt == syt && watch_test(&W->w[i], v)) {
+            W->w[i].now = *v;
+            W->hit = i + 1;
+            return;
+        }
+}
+
+/* The assignment at pc has stored into its second operand: a variable,
+ * or an element through the reference a DSUB/TSUB left in its VAC */
+void halmat_watch_asn(halmat_t *H, uint32_t pc)
+{
+    uint32_t w = H->code[pc + 2];
+    uint32_t d = HALMAT_DATA(w);
+    halmat_val_t v;
+
+    if (HALMAT_QUAL(w) == QUAL_SYT) {
+        if (!watched(H->watch, d))
+            return;
+        v = H->syt[d].val;
+    } else if (HALMAT_QUAL(w) == QUAL_VAC && d + 1 < H->code_len &&
+               HALMAT_QUAL(H->code[d + 1]) == QUAL_SYT &&
+               (HALMAT_POPCODE(H->code[d]) == POP_DSUB ||
+                HALMAT_POPCODE(H->code[d]) == POP_TSUB)) {
+        const halmat_val_t *r = &H->vac[VAC_SLOT(d)];
+        d = HALMAT_DATA(H->code[d + 1]);
+        if (!watched(H->watch, d) || r->type != HTYPE_REF)
+            return;
+        v = halmat_ref_load(H, r);
+    } else {
+        return;
+    }
+    halmat_watch_store(H, d, &v);
+}
+
+static void print_val(const halmat_val_t *v)
+{
+    switch (v->type) {
+    case HTYPE_INTEGER: printf("%d", v->v.integer); break;
+    case HTYPE_SCALAR:  printf("%g", v->v.scalar); break;
+    case HTYPE_CHAR:
+        printf("\"%.*s\"", (int)v->v.string.len, v->v.string.data);
+        break;
+    case HTYPE_BIT:     printf("0x%X", v->v.bits); break;
+    default:            printf("?"); break;
+    }
+}
+
+/* A SYT number, or a name from the DECLAREs */
+static uint32_t syt_arg(const halmat_t *H, const char *s)
+{
+    char *end;
+    unsigned long n = strtoul(s, &end, 0);
+    if (end != s && !*end)
+        return n < HALMAT_MAX_SYT ? (uint32_t)n : 0;
+    for (uint32_t i = 1; i < HALMAT_MAX_SYT; i++) {
+        const char *name = halmat_syt_name(H, i);
+        if (name && strcmp(name, s) == 0)
+            return i;
     }
     return 0;
 }
 
+/* w <syt> [op value] */
+static void watch_set(halmat_t *H, const char *arg)
+{
+    char name[64], op[4] = "";
+    double value = 0.0;
+    int k = sscanf(arg, "%63s %3s %lf", name, op, &value);
+    uint32_t syt = k >= 1 ? syt_arg(H, name) : 0;
+    int cond = WATCH_WRITE;
+    if (!syt) {
+        printf("Unknown variable %s\n", k >= 1 ? name : "");
+        return;
+    }
+    if (k >= 2) {
+        for (cond = WATCH_EQ; cond <= WATCH_GE; cond++)
+            if (strcmp(op, cond_names[cond]) == 0)
+                break;
+        if (cond > WATCH_GE || k < 3) {
+            printf("Usage: w <syt> [== != < > <= >= value]\n");
+            return;
+        }
+    }
+    if (!H->watch && !(H->watch = calloc(1, sizeof(*H->watch))))
+        return;
+    struct halmat_watch *W = H->watch;
+    if (W->n == HALMAT_MAX_WATCH) {
+        printf("Too many watchpoints (%d)\n", HALMAT_MAX_WATCH);
+        return;
+    }
+    watchpoint_t *w = &W->w[W->n];
+    w->syt = syt;
+    w->cond = cond;
+    w->value = value;
+    w->last = H->syt[syt].val;
+    W->bits[syt >> 6] |= (uint64_t)1 << (syt & 63);
+    printf("Watchpoint %u: SYT(%u)", W->n, syt);
+    if (halmat_syt_name(H, syt))
+        printf(" %s", halmat_syt_name(H, syt));
+    if (cond != WATCH_WRITE)
+        printf(" %s %g", cond_names[cond], value);
+    printf("\n");
+    W->n++;
+}
+
+static void watch_delete(halmat_t *H, uint32_t i)
+{
+    struct halmat_watch *W = H->watch;
+    if (!W || i >= W->n) {
+        printf("No watchpoint %u\n", i);
+        return;
+    }
+    uint32_t syt = W->w[i].syt;
+    memmove(&W->w[i], &W->w[i + 1], (W->n - i - 1) * sizeof(W->w[0]));
+    W->n--;
+    W->bits[syt >> 6] &= ~((uint64_t)1 << (syt & 63));
+    for (uint32_t j = 0; j < W->n; j++)
+        if (W->w[j].syt == syt)
+            W->bits[syt >> 6] |= (uint64_t)1 << (syt & 63);
+}
+
+static void report_stop(halmat_t *H, int rc)
+{
+    struct halmat_watch *W = H->watch;
+    if (rc == HALMAT_TRAP) {
+        breakpoint_t *b = bp_at(H, H->pc);
+        printf("Breakpoint %u, address %u\n", (uint32_t)(b - H->breakpoints), H->pc);
+    } else if (W && W->hit) {
+        watchpoint_t *w = &W->w[W->hit - 1];
+        printf("Watchpoint %u: SYT(%u)", W->hit - 1, w->syt);
+        if (halmat_syt_name(H, w->syt))
+            printf(" %s", halmat_syt_name(H, w->syt));
+        printf(" ");
+        print_val(&w->last);
+        printf(" -> ");
+        print_val(&w->now);
+        printf("\n");
+        w->last = w->now;
+        W->hit = 0;
+    }
+}
+
+/* ---- reverse execution ---- */
+
+typedef struct {
+    uint64_t     cycle;         /* UINT64_MAX = none */
+    int          watch;         /* watchpoint that fired, -1 = a trap */
+    halmat_val_t val;           /* the value it wrote */
+} stop_t;
+
+/* Run forward to cycle without stopping at traps or watchpoints.  With
+ * stop, note the last place before limit where the program would have
+ * stopped. */
+static void run_to(halmat_t *H, uint64_t cycle, uint64_t limit, stop_t *stop)
+{
+    struct halmat_watch *W = H->watch;
+    while (!H->halted && H->cycle_count < cycle) {
+        if (stop && H->cycle_count < limit && bp_at(H, H->pc)) {
+            stop->cycle = H->cycle_count;
+            stop->watch = -1;
+        }
+        H->bp_resume = H->pc + 1;
+        int rc = halmat_step(H);
+        halmat_replay_tick(H);
+        if (W && W->hit) {
+            watchpoint_t *w = &W->w[W->hit - 1];
+            if (stop && H->cycle_count < limit) {
+                stop->cycle = H->cycle_count;
+                stop->watch = (int)W->hit - 1;
+                stop->val = w->now;
+            }
+            w->last = w->now;
+            W->hit = 0;
+        }
+        if (rc < 0)
+            break;
+    }
+}
+
+static void goto_cycle(halmat_t *H, uint64_t cycle)
+{
+    struct halmat_replay *R = H->replay;
+    uint32_t i = R->nsnap;
+    while (i > 1 && R->snap[i - 1].cycle > cycle)
+        i--;
+    /* restore when going back, or when a copy is nearer than here */
+    if (cycle < H->cycle_count || R->snap[i - 1].cycle > H->cycle_count)
+        halmat_replay_restore(H, cycle);
+    run_to(H, cycle, 0, NULL);
+    if (H->cycle_count < cycle)
+        printf("Program ended at cycle %llu\n", (unsigned long long)H->cycle_count);
+}
+
+/* Back to the last stop before here: search each stretch between
+ * copies, latest first */
+static void reverse_continue(halmat_t *H)
+{
+    uint64_t end = H->cycle_count, limit = end;
+    stop_t stop;
+    stop.cycle = UINT64_MAX;
+    while (end > 0) {
+        uint64_t at = halmat_replay_restore(H, end - 1);
+        run_to(H, end, limit, &stop);
+        if (stop.cycle != UINT64_MAX || at == 0)
+            break;
+        end = at;
+        limit = at + 1;
+    }
+    if (stop.cycle == UINT64_MAX) {
+        goto_cycle(H, 0);
+        printf("No earlier stop; at the start\n");
+        return;
+    }
+    goto_cycle(H, stop.cycle);
+    if (stop.watch < 0) {
+        breakpoint_t *b = bp_at(H, H->pc);
+        printf("Breakpoint %u, address %u\n", (uint32_t)(b - H->breakpoints), H->pc);
+    } else {
+        uint32_t syt = H->watch->w[stop.watch].syt;
+        printf("Watchpoint %d: SYT(%u)", stop.watch, syt);
+        if (halmat_syt_name(H, syt))
+            printf(" %s", halmat_syt_name(H, syt));
+        printf(" = ");
+        print_val(&stop.val);
+        printf("\n");
+    }
+}
+
+static int recording(halmat_t *H)
+{
+    if (!H->replay)
+        printf("Not recording (--snapshot-interval 0)\n");
+    return H->replay != NULL;
+}
+
+/* Prompt; then run one operator, or until a trap, a watchpoint or the
+ * end of the program, and prompt again.  With snapshots the end of the
+ * program still prompts, as there is somewhere to go back to. */
+void halmat_debug_run(halmat_t *H)
+{
+    for (;;) {
+        if (H->halted) {
+            if (!H->replay)
+                break;
+            printf("Program ended\n");
+        }
+        if (halmat_debug_prompt(H))
+            break;
+        if (H->halted)
+            continue;
+        H->bp_resume = H->pc + 1;       /* do not stop where we are */
+        int rc = halmat_step(H);
+        if (H->replay)
+            halmat_replay_tick(H);
+        if (!H->single_step)
+            while (rc == HALMAT_OK && !(H->watch && H->watch->hit)) {
+                rc = halmat_step(H);
+                if (H->replay)
+                    halmat_replay_tick(H);
+            }
+        H->single_step = 1;
+        report_stop(H, rc);
+    }
+}
+
 void halmat_debug_print_state(halmat_t *H, FILE *out)
 {
     fprintf(out, "PC=%u  STMT=%u  CYCLES=%llu  FRAMES=%u  LOOPS=%u  COND=%d\n",
@@ -31,7 +399,7 @@ void halmat_debug_print_state(halmat_t *H, FILE *out)
             H->frame_depth, H->loop_depth, H->cond_true);
 
     if (H->pc < H->code_len) {
-        uint32_t w = H->code[H->pc];
+        uint32_t w = code_word(H, H->pc);
         if (HALMAT_IS_OP(w)) {
             const char *name = halmat_popcode_name(HALMAT_POPCODE(w));
             fprintf(out, "  -> %08X  %s  (numop=%u tag=%u)\n",
@@ -41,7 +409,7 @@ void halmat_debug_print_state(halmat_t *H, FILE *out)
     }
 }
 
-void halmat_debug_prompt(halmat_t *H)
+int halmat_debug_prompt(halmat_t *H)
 {
     char line[256];
 
@@ -51,8 +419,9 @@ void halmat_debug_prompt(halmat_t *H)
         fflush(stdout);
 
         if (!fgets(line, sizeof(line), stdin)) {
-            H->halted = 1;
-            return;
+            if (!H->halted)
+                H->halted = 1;
+            return 1;
         }
 
         size_t len = strlen(line);
@@ -60,41 +429,80 @@ void halmat_debug_prompt(halmat_t *H)
             line[--len] = '\0';
 
         if (len == 0 || strcmp(line, "s") == 0 || strcmp(line, "step") == 0)
-            return;
+            return 0;
 
         if (strcmp(line, "c") == 0 || strcmp(line, "continue") == 0) {
             H->single_step = 0;
-            return;
+            return 0;
         }
 
         if (strcmp(line, "q") == 0 || strcmp(line, "quit") == 0) {
-            H->halted = 1;
-            return;
+            if (!H->halted)
+                H->halted = 1;
+            return 1;
+        }
+
+        if (strcmp(line, "rs") == 0 || strcmp(line, "reverse-step") == 0) {
+            if (recording(H)) {
+                if (H->cycle_count == 0)
+                    printf("At the start\n");
+                else
+                    goto_cycle(H, H->cycle_count - 1);
+            }
+            continue;
+        }
+
+        if (strcmp(line, "rc") == 0 || strcmp(line, "reverse-continue") == 0) {
+            if (recording(H))
+                reverse_continue(H);
+            continue;
+        }
+
+        if (strncmp(line, "goto ", 5) == 0 || strncmp(line, "goto-cycle ", 11) == 0) {
+            if (recording(H))
+                goto_cycle(H, strtoull(strchr(line, ' ') + 1, NULL, 0));
+            continue;
         }
 
         if (strncmp(line, "b ", 2) == 0 || strncmp(line, "break ", 6) == 0) {
             char *arg = strchr(line, ' ') + 1;
-            if (H->bp_count < 64) {
-                uint32_t addr = (uint32_t)strtoul(arg, NULL, 0);
-                H->breakpoints[H->bp_count].addr = addr;
-                H->breakpoints[H->bp_count].stmt = 0;
-                H->breakpoints[H->bp_count].enabled = 1;
-                printf("Breakpoint %u at address %u\n", H->bp_count, addr);
-                H->bp_count++;
-            }
+            bp_set(H, (uint32_t)strtoul(arg, NULL, 0), 0);
             continue;
         }
 
         if (strncmp(line, "bs ", 3) == 0) {
-            char *arg = line + 3;
-            if (H->bp_count < 64) {
-                uint32_t stmt = (uint32_t)strtoul(arg, NULL, 0);
-                H->breakpoints[H->bp_count].addr = 0;
-                H->breakpoints[H->bp_count].stmt = stmt;
-                H->breakpoints[H->bp_count].enabled = 1;
-                printf("Breakpoint %u at statement %u\n", H->bp_count, stmt);
-                H->bp_count++;
+            /* a trap on the statement's SMRK */
+            uint32_t stmt = (uint32_t)strtoul(line + 3, NULL, 0);
+            int found = 0;
+            for (uint32_t a = 0; a + 1 < H->code_len; a++) {
+                uint32_t w = H->code[a];
+                if (HALMAT_IS_OP(w) && HALMAT_POPCODE(w) == POP_SMRK &&
+                    HALMAT_NUMOP(w) >= 1 && HALMAT_DATA(H->code[a + 1]) == stmt) {
+                    bp_set(H, a, stmt);
+                    found = 1;
+                }
             }
+            if (!found)
+                printf("No statement %u\n", stmt);
+            continue;
+        }
+
+        if (strncmp(line, "del ", 4) == 0) {
+            uint32_t i = (uint32_t)strtoul(line + 4, NULL, 0);
+            if (i < H->bp_count)
+                bp_clear(H, &H->breakpoints[i]);
+            else
+                printf("No breakpoint %u\n", i);
+            continue;
+        }
+
+        if (strncmp(line, "w ", 2) == 0 || strncmp(line, "watch ", 6) == 0) {
+            watch_set(H, strchr(line, ' ') + 1);
+            continue;
+        }
+
+        if (strncmp(line, "dw ", 3) == 0) {
+            watch_delete(H, (uint32_t)strtoul(line + 3, NULL, 0));
             continue;
         }
 
@@ -104,7 +512,16 @@ void halmat_debug_prompt(halmat_t *H)
                 printf("  #%u: addr=%u stmt=%u %s\n",
                        i, H->breakpoints[i].addr,
                        H->breakpoints[i].stmt,
-                       H->breakpoints[i].enabled ? "enabled" : "disabled");
+                       H->breakpoints[i].enabled ? "enabled" : "deleted");
+            }
+            printf("Watchpoints:\n");
+            for (uint32_t i = 0; H->watch && i < H->watch->n; i++) {
+                const watchpoint_t *w = &H->watch->w[i];
+                printf("  #%u: SYT(%u) %s", i, w->syt,
+                       halmat_syt_name(H, w->syt) ? halmat_syt_name(H, w->syt) : "");
+                if (w->cond != WATCH_WRITE)
+                    printf(" %s %g", cond_names[w->cond], w->value);
+                printf("\n");
             }
             continue;
         }
@@ -135,15 +552,22 @@ void halmat_debug_prompt(halmat_t *H)
             continue;
         }
 
-        printf("Commands: s(tep) c(ontinue) q(uit) b <addr> bs <stmt> "
-               "i(nfo) x <syt> d(isasm)\n");
+        if (strcmp(line, "tasks") == 0 || strcmp(line, "t") == 0) {
+            halmat_sched_print(H, stdout);
+            continue;
+        }
+
+        printf("Commands: s(tep) c(ontinue) q(uit) b <addr> bs <stmt> del <n>\n"
+               "          w <syt|name> [== != < > <= >= value] dw <n>\n"
+               "          rs (reverse-step) rc (reverse-continue) goto <cycle>\n"
+               "          i(nfo) x <syt> d(isasm) t(asks)\n");
     }
 }
 
 void halmat_disasm_word(halmat_t *H, uint32_t addr, FILE *out)
 {
     if (addr >= H->code_len) return;
-    uint32_t w = H->code[addr];
+    uint32_t w = code_word(H, addr);
     if (!HALMAT_IS_OP(w)) {
         fprintf(out, "  %4u: %08X  (operand)\n", addr, w);
         return;
@@ -152,8 +576,14 @@ void halmat_disasm_word(halmat_t *H, uint32_t addr, FILE *out)
     uint32_t numop = HALMAT_NUMOP(w);
     uint32_t cls = HALMAT_CLASS(w);
     const char *name = halmat_popcode_name(pop);
-    fprintf(out, "  %4u: %08X  %s/%s  (%u ops)\n",
-            addr, w, halmat_class_name(cls), name ? name : "???", numop);
+    char cov[32] = "";
+    if (H->cov && !halmat_cov_ran(H->cov, addr))
+        snprintf(cov, sizeof(cov), "  [not run]");
+    else if (H->cov && H->cov->hits)
+        snprintf(cov, sizeof(cov), "  [%u%s hits]", H->cov->hits[addr],
+                 H->cov->hits[addr] == HALMAT_COV_MAX_HITS ? "+" : "");
+    fprintf(out, "  %4u: %08X  %s/%s  (%u ops)%s\n",
+            addr, w, halmat_class_name(cls), name ? name : "???", numop, cov);
     for (uint32_t j = 1; j <= numop && (addr + j) < H->code_len; j++) {
         uint32_t ow = H->code[addr + j];
         if (HALMAT_IS_OPERAND(ow)) {
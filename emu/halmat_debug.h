@@ -1,11 +1,50 @@
+/* Debugger (--debug).
+ *
+ * A breakpoint is a trap patched into the code: the operator's COPT
+ * field, which only the disassembler reads, is set to HALMAT_TRAP_COPT
+ * and the original word kept in the breakpoint.  halmat_step looks at
+ * the field of the word it has already loaded, so code without traps
+ * runs as fast as it does outside the debugger, and the scans for
+ * matching operators (CTST, ECAS, CLOS...) still see the right popcode.
+ * The breakpoint list is only searched when a trap is hit.
+ *
+ * A watchpoint stops after a write to a variable, or after a write that
+ * leaves it satisfying a comparison.  The assignment handlers (and
+ * READ) test a write-barrier bitmap with one bit per SYT entry, and only
+ * when a watchpoint is set.
+ *
+ * rs, rc and goto move backwards with the snapshots of halmat_replay.c. */
+
 #ifndef HALMAT_DEBUG_H
 #define HALMAT_DEBUG_H
 
 #include "halmat.h"
 
+#define HALMAT_TRAP_COPT  7
+#define HALMAT_MAX_WATCH  16
+
+enum { WATCH_WRITE, WATCH_EQ, WATCH_NE, WATCH_LT, WATCH_GT, WATCH_LE, WATCH_GE };
+
+typedef struct {
+    uint32_t     syt;
+    int          cond;          /* WATCH_* */
+    double       value;         /* compared with, unless WATCH_WRITE */
+    halmat_val_t last;          /* value at the last stop */
+    halmat_val_t now;           /* value written when it fired */
+} watchpoint_t;
+
+struct halmat_watch {
+    uint64_t     bits[HALMAT_MAX_SYT / 64];     /* write barrier */
+    watchpoint_t w[HALMAT_MAX_WATCH];
+    uint32_t     n;
+    uint32_t     hit;           /* watchpoint that fired + 1, 0 = none */
+};
+
 int  halmat_debug_init(halmat_t *H);
-void halmat_debug_prompt(halmat_t *H);
-int  halmat_debug_check_breakpoint(halmat_t *H);
+void halmat_debug_run(halmat_t *H);             /* prompt, run to a stop, repeat */
+int  halmat_debug_prompt(halmat_t *H);          /* 1: quit */
+int  halmat_debug_trap(halmat_t *H);            /* 1: stop at the trap at H->pc */
 void halmat_debug_print_state(halmat_t *H, FILE *out);
+void halmat_debug_free(halmat_t *H);
 
 #endif /* HALMAT_DEBUG_H */
@@ -1,4 +1,5 @@
 #include "halmat.h"
+#include "halmat_cov.h"
 
 typedef struct { uint32_t code; const char *name; } opcode_entry_t;
 
@@ -146,8 +147,31 @@ static void lit_annotation(halmat_t *H, uint32_t idx, char *buf, int bufsize)
     }
 }
 
+/* With a coverage map, a column in front: the operator's hit count, or
+ * * if it ran and was not counted, or ##### if it never ran */
+#define COV_W 7
+
+static const char *cov_column(const halmat_t *H, uint32_t addr, char *buf, int bufsize)
+{
+    const struct halmat_cov *C = H->cov;
+    if (!C)
+        return "";
+    if (!halmat_cov_ran(C, addr))
+        snprintf(buf, bufsize, "%*s", COV_W, "#####");
+    else if (!C->hits || !C->hits[addr])
+        snprintf(buf, bufsize, "%*s", COV_W, "*");
+    else if (C->hits[addr] == HALMAT_COV_MAX_HITS)
+        snprintf(buf, bufsize, "%*u+", COV_W - 1, HALMAT_COV_MAX_HITS);
+    else
+        snprintf(buf, bufsize, "%*u", COV_W, C->hits[addr]);
+    return buf;
+}
+
 void halmat_disasm(halmat_t *H, FILE *out)
 {
+    const char *pad = H->cov ? "       " : "";
+    char hits[16];
+
     for (uint32_t blk = 0; blk < H->num_blocks; blk++) {
         uint32_t base = blk * HALMAT_BLOCK_WORDS;
         uint32_t w1 = H->code[base + 1];
@@ -155,9 +179,9 @@ void halmat_disasm(halmat_t *H, FILE *out)
 
         fprintf(out, "=== BLOCK %u === (%u atoms, words 2..%u)\n\n",
                 blk, atom_fault, atom_fault);
-        fprintf(out, "  %-5s  %-10s  %-6s  %-5s  %-6s  %s\n",
-                "ADDR", "RAW", "TYPE", "TAG", "COPT", "DECODED");
-        fprintf(out, "  ");
+        fprintf(out, "%s  %-5s  %-10s  %-6s  %-5s  %-6s  %s\n",
+                H->cov ? "   HITS" : "", "ADDR", "RAW", "TYPE", "TAG", "COPT", "DECODED");
+        fprintf(out, "%s  ", pad);
         for (int k = 0; k < 70; k++) fputc('-', out);
         fputc('\n', out);
 
@@ -187,8 +211,8 @@ void halmat_disasm(halmat_t *H, FILE *out)
                 if (tag > 0) snprintf(tag_str, sizeof(tag_str), "T=%u", tag);
                 if (copt > 0) snprintf(copt_str, sizeof(copt_str), "C=%u", copt);
 
-                fprintf(out, "  %4u:  %08X  %-6s  %-5s  %-6s  %s  (%s/%s, %u ops)\n",
-                        i, w, clsname, tag_str, copt_str,
+                fprintf(out, "%s  %4u:  %08X  %-6s  %-5s  %-6s  %s  (%s/%s, %u ops)\n",
+                        cov_column(H, i, hits, sizeof(hits)), i, w, clsname, tag_str, copt_str,
                         name, clsname, name, numop);
 
                 for (uint32_t j = 1; j <= numop && (i + j) <= end; j++) {
@@ -210,11 +234,11 @@ void halmat_disasm(halmat_t *H, FILE *out)
                             snprintf(taginfo, sizeof(taginfo),
                                      " [T1=%u T2=%u]", tag1, tag2);
 
-                        fprintf(out, "         %08X    op%-2u               %s(%u)%s%s\n",
-                                ow, j, qname, data, annot, taginfo);
+                        fprintf(out, "%s         %08X    op%-2u               %s(%u)%s%s\n",
+                                pad, ow, j, qname, data, annot, taginfo);
                     } else {
-                        fprintf(out, "         %08X    op%-2u               <unexpected operator>\n",
-                                ow, j);
+                        fprintf(out, "%s         %08X    op%-2u               <unexpected operator>\n",
+                                pad, ow, j);
                     }
                 }
 
@@ -225,11 +249,13 @@ void halmat_disasm(halmat_t *H, FILE *out)
                 uint32_t tag1 = HALMAT_TAG1(w);
                 uint32_t qual = HALMAT_QUAL(w);
                 uint32_t tag2 = HALMAT_TAG2(w);
-                fprintf(out, "  %4u:  %08X  STRAY               %s(%u) [T1=%u T2=%u]\n",
-                        i, w, halmat_qual_name(qual), data, tag1, tag2);
+                fprintf(out, "%s  %4u:  %08X  STRAY               %s(%u) [T1=%u T2=%u]\n",
+                        pad, i, w, halmat_qual_name(qual), data, tag1, tag2);
                 i++;
             }
         }
         fprintf(out, "\n");
     }
+    if (H->cov)
+        halmat_cov_report(H, out);
 }
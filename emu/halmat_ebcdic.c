@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdint.h>
+#include "halmat_ebcdic.h"
+
+/* EBCDIC Code Page 037 -> ASCII.
+ * IBM S/360 encoding used by the HAL/S-FC compiler. */
+static const uint8_t ebcdic_to_ascii_tab[256] = {
+    0x00,0x01,0x02,0x03,0x9C,0x09,0x86,0x7F,
+    0x97,0x8D,0x8E,0x0B,0x0C,0x0D,0x0E,0x0F,
+    0x10,0x11,0x12,0x13,0x9D,0x85,0x08,0x87,
+    0x18,0x19,0x92,0x8F,0x1C,0x1D,0x1E,0x1F,
+    0x80,0x81,0x82,0x83,0x84,0x0A,0x17,0x1B,
+    0x88,0x89,0x8A,0x8B,0x8C,0x05,0x06,0x07,
+    0x90,0x91,0x16,0x93,0x94,0x95,0x96,0x04,
+    0x98,0x99,0x9A,0x9B,0x14,0x15,0x9E,0x1A,
+    0x20,0xA0,0xE2,0xE4,0xE0,0xE1,0xE3,0xE5, /* 40: SP */
+    0xE7,0xF1,0xA2,0x2E,0x3C,0x28,0x2B,0x7C, /* 4B: . < ( + | */
+    0x26,0xE9,0xEA,0xEB,0xE8,0xED,0xEE,0xEF, /* 50: & */
+    0xEC,0xDF,0x21,0x24,0x2A,0x29,0x3B,0xAC, /* 5A: ! $ * ) ; */
+    0x2D,0x2F,0xC2,0xC4,0xC0,0xC1,0xC3,0xC5, /* 60: - / */
+    0xC7,0xD1,0xA6,0x2C,0x25,0x5F,0x3E,0x3F, /* 6B: , % _ > ? */
+    0xF8,0xC9,0xCA,0xCB,0xC8,0xCD,0xCE,0xCF, /* 70: 0xF8 = ø */
+    0xCC,0x60,0x3A,0x23,0x40,0x27,0x3D,0x22, /* 79: ` : # @ ' = " */
+    0xD8,0x61,0x62,0x63,0x64,0x65,0x66,0x67, /* 80: 0xD8 = Ø  81-89: a-i */
+    0x68,0x69,0xAB,0xBB,0xF0,0xFD,0xFE,0xB1,
+    0xB0,0x6A,0x6B,0x6C,0x6D,0x6E,0x6F,0x70, /* 91-99: j-r */
+    0x71,0x72,0xAA,0xBA,0xE6,0xB8,0xC6,0xA4,
+    0xB5,0x7E,0x73,0x74,0x75,0x76,0x77,0x78, /* A1: ~  A2-A9: s-z */
+    0x79,0x7A,0xA1,0xBF,0xD0,0x5B,0xDE,0xAE, /* AD: [ */
+    0x5E,0xA3,0xA5,0xB7,0xA9,0xA7,0xB6,0xBC, /* B0: ^ */
+    0xBD,0xBE,0xDD,0xA8,0xAF,0x5D,0xB4,0xD7, /* BD: ] */
+    0x7B,0x41,0x42,0x43,0x44,0x45,0x46,0x47, /* C0: {  C1-C9: A-I */
+    0x48,0x49,0xAD,0xF4,0xF6,0xF2,0xF3,0xF5,
+    0x7D,0x4A,0x4B,0x4C,0x4D,0x4E,0x4F,0x50, /* D0: }  D1-D9: J-R */
+    0x51,0x52,0xB9,0xFB,0xFC,0xF9,0xFA,0xFF,
+    0x5C,0xF7,0x53,0x54,0x55,0x56,0x57,0x58, /* E0: \  E2-E9: S-Z */
+    0x59,0x5A,0xB2,0xD4,0xD6,0xD2,0xD3,0xD5,
+    0x30,0x31,0x32,0x33,0x34,0x35,0x36,0x37, /* F0-F9: 0-9 */
+    0x38,0x39,0xB3,0xDB,0xDC,0xD9,0xDA,0x9F
+};
+
+static uint8_t ascii_to_ebcdic_tab[256];    /* inverse, built on first use */
+
+typedef void (*xlat_fn)(uint8_t *dst, const uint8_t *src, size_t n,
+                        const uint8_t *table);
+
+static void xlat_scalar(uint8_t *dst, const uint8_t *src, size_t n,
+                        const uint8_t *table)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = table[src[i]];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* A 256-entry table is sixteen 16-byte rows.  PSHUFB looks every byte's
+ * low nibble up in one row at a time; the result is kept where the high
+ * nibble matches that row. */
+__attribute__((target("ssse3")))
+static void xlat_ssse3(uint8_t *dst, const uint8_t *src, size_t n,
+                       const uint8_t *table)
+{
+    const __m128i nib = _mm_set1_epi8(0x0F);
+    __m128i row[16];
+    size_t i = 0;
+
+    for (int h = 0; h < 16; h++)
+        row[h] = _mm_loadu_si128((const __m128i *)(table + 16 * h));
+    for (; i + 16 <= n; i += 16) {
+        __m128i x  = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_and_si128(x, nib);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), nib);
+        __m128i r  = _mm_setzero_si128();
+        for (int h = 0; h < 16; h++) {
+            __m128i sel = _mm_cmpeq_epi8(hi, _mm_set1_epi8((char)h));
+            r = _mm_or_si128(r, _mm_and_si128(sel, _mm_shuffle_epi8(row[h], lo)));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), r);
+    }
+    xlat_scalar(dst + i, src + i, n - i, table);
+}
+
+__attribute__((target("avx2")))
+static void xlat_avx2(uint8_t *dst, const uint8_t *src, size_t n,
+                      const uint8_t *table)
+{
+    const __m256i nib = _mm256_set1_epi8(0x0F);
+    __m256i row[16];
+    size_t i = 0;
+
+    /* VPSHUFB indexes within each 128-bit lane, so both lanes get the row */
+    for (int h = 0; h < 16; h++)
+        row[h] = _mm256_broadcastsi128_si256(
+                     _mm_loadu_si128((const __m128i *)(table + 16 * h)));
+    for (; i + 32 <= n; i += 32) {
+        __m256i x  = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lo = _mm256_and_si256(x, nib);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nib);
+        __m256i r  = _mm256_setzero_si256();
+        for (int h = 0; h < 16; h++) {
+            __m256i sel = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8((char)h));
+            r = _mm256_or_si256(r, _mm256_and_si256(sel,
+                                   _mm256_shuffle_epi8(row[h], lo)));
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), r);
+    }
+    xlat_scalar(dst + i, src + i, n - i, table);
+}
+#endif
+
+static xlat_fn xlat = xlat_scalar;
+static pthread_once_t xlat_once = PTHREAD_ONCE_INIT;
+
+static void xlat_init(void)
+{
+    for (int i = 0; i < 256; i++)
+        ascii_to_ebcdic_tab[ebcdic_to_ascii_tab[i]] = (uint8_t)i;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        xlat = xlat_avx2;
+    else if (__builtin_cpu_supports("ssse3"))
+        xlat = xlat_ssse3;
+#endif
+}
+
+/* Short strings are not worth the table loads */
+#define XLAT_SIMD_MIN 32
+
+void halmat_ebcdic_to_ascii(char *dst, const char *src, size_t n)
+{
+    pthread_once(&xlat_once, xlat_init);
+    if (n < XLAT_SIMD_MIN)
+        xlat_scalar((uint8_t *)dst, (const uint8_t *)src, n, ebcdic_to_ascii_tab);
+    else
+        xlat((uint8_t *)dst, (const uint8_t *)src, n, ebcdic_to_ascii_tab);
+}
+
+void halmat_ascii_to_ebcdic(char *dst, const char *src, size_t n)
+{
+    pthread_once(&xlat_once, xlat_init);
+    if (n < XLAT_SIMD_MIN)
+        xlat_scalar((uint8_t *)dst, (const uint8_t *)src, n, ascii_to_ebcdic_tab);
+    else
+        xlat((uint8_t *)dst, (const uint8_t *)src, n, ascii_to_ebcdic_tab);
+}
@@ -0,0 +1,18 @@
+/* EBCDIC code page 037 <-> ASCII translation.
+ *
+ * The HAL/S-FC compiler ran on S/360 and its character literals are
+ * EBCDIC.  Literals are transcoded once at load time (--ebcdic); these
+ * routines cover dynamic data, i.e. unit files kept in EBCDIC.  On x86
+ * the translation uses a 16-way PSHUFB table walk (AVX2 or SSSE3,
+ * picked at run time); elsewhere it is a byte table lookup. */
+
+#ifndef HALMAT_EBCDIC_H
+#define HALMAT_EBCDIC_H
+
+#include <stddef.h>
+
+/* dst may equal src */
+void halmat_ebcdic_to_ascii(char *dst, const char *src, size_t n);
+void halmat_ascii_to_ebcdic(char *dst, const char *src, size_t n);
+
+#endif /* HALMAT_EBCDIC_H */
@@ -1,4 +1,10 @@
 #include "halmat.h"
+#include "halmat_prof.h"
+#include "halmat_trace.h"
+#include "halmat_perf.h"
+#include "halmat_cov.h"
+#include "halmat_cost.h"
+#include "halmat_debug.h"
 #include <math.h>
 
 halmat_val_t halmat_resolve_operand(halmat_t *H, uint32_t operand_word)
@@ -11,8 +17,19 @@ halmat_val_t halmat_resolve_operand(halmat_t *H, uint32_t operand_word)
 
     switch (qual) {
     case QUAL_SYT:
-        if (data < HALMAT_MAX_SYT)
+        if (data < HALMAT_MAX_SYT) {
+            if (H->adlp_n && H->syt[data].arr.count)    /* array loop */
+                return halmat_array_get(H, data, H->adlp_i);
+            if (H->syt[data].st.name && halmat_struct_ref(H, operand_word, &v) == 0)
+                return halmat_ref_load(H, &v);
             return H->syt[data].val;
+        }
+        break;
+
+    case QUAL_XPT:
+        if (halmat_struct_ref(H, operand_word, &v) == 0)
+            return halmat_ref_load(H, &v);
+        memset(&v, 0, sizeof(v));
         break;
 
     case QUAL_LIT:
@@ -30,6 +47,8 @@ halmat_val_t halmat_resolve_operand(halmat_t *H, uint32_t operand_word)
             case 2: /* BIT */
                 v.type = HTYPE_BIT;
                 v.v.bits = (uint32_t)H->lit[data].lit2;
+                if (H->lit[data].lit3 > 0 && H->lit[data].lit3 < 32)
+                    v.rows = (uint8_t)H->lit[data].lit3;    /* length */
                 break;
             case 5: /* DOUBLE */
                 v.type = HTYPE_SCALAR;
@@ -42,6 +61,8 @@ halmat_val_t halmat_resolve_operand(halmat_t *H, uint32_t operand_word)
         break;
 
     case QUAL_VAC:
+        if (H->vac[VAC_SLOT(data)].type == HTYPE_REF)
+            return halmat_ref_load(H, &H->vac[VAC_SLOT(data)]);
         return H->vac[VAC_SLOT(data)];
 
     case QUAL_IMD:
@@ -90,6 +111,18 @@ int halmat_step(halmat_t *H)
     uint32_t numop   = HALMAT_NUMOP(w);
     uint32_t tag     = HALMAT_TAG(w);
 
+    /* a debugger trap: COPT is not otherwise looked at */
+    if (HALMAT_COPT(w) == HALMAT_TRAP_COPT && H->debug_mode && halmat_debug_trap(H))
+        return HALMAT_TRAP;
+
+    uint32_t pc = H->pc;
+    if (H->cost)
+        halmat_cost_op(H, pc, w);
+    struct halmat_prof *P = H->prof;
+    uint64_t t0 = P ? halmat_prof_enter(P, popcode) : 0;
+    if (H->perf && H->perf->by_class && cls != H->perf->cls)
+        halmat_perf_class(H->perf, cls);
+
     int rc;
     switch (cls) {
     case 0: rc = halmat_exec_class0(H, popcode, numop, tag); break;
@@ -107,6 +140,17 @@ int halmat_step(halmat_t *H)
         break;
     }
 
+    if (H->cov)
+        halmat_cov_hit(H->cov, pc);
+    if (H->trace)
+        halmat_trace_put(H, pc, popcode);
+    if (P) {
+        if (t0)
+            halmat_prof_leave(P, popcode, t0);
+        if (P->st && (H->stmt_count != P->last_stmts ||
+                      H->frame_depth != P->last_depth))
+            halmat_prof_stmt(H);
+    }
     H->cycle_count++;
 
     if (rc < 0) {
@@ -16,6 +16,41 @@ double ibm_float_to_double(uint32_t w)
     return sign * mantissa * pow(16.0, (double)(exp - 64));
 }
 
+/* Nearest short (6 hex digit) value toward zero, which is what IBM
+ * arithmetic and the single precision library return.  Hex
+ * normalisation keeps 21 to 24 significant bits depending on the
+ * leading digit. */
+double halmat_hfp_chop(double x)
+{
+    if (x == 0.0 || !isfinite(x))
+        return x;
+    int e2;
+    frexp(x, &e2);                          /* |x| = m * 2^e2, m in [0.5,1) */
+    int e16 = e2 > 0 ? (e2 + 3) / 4 : -(-e2 / 4);      /* ceil(e2 / 4) */
+    int shift = 24 - 4 * e16;               /* fraction bits kept */
+    return ldexp(trunc(ldexp(x, shift)), -shift);
+}
+
+/* Nearest short hex float toward zero, for writing literal tables */
+uint32_t double_to_ibm_float(double x)
+{
+    if (x == 0.0 || !isfinite(x))
+        return 0;
+    uint32_t sign = x < 0 ? 0x80000000u : 0;
+    int exp = 64;
+    x = fabs(x);
+    while (x >= 1.0 && exp < 127) {
+        x /= 16.0;
+        exp++;
+    }
+    while (x < 1.0 / 16.0 && exp > 0) {
+        x *= 16.0;
+        exp--;
+    }
+    uint32_t frac = (uint32_t)(x * 16777216.0);
+    return sign | (uint32_t)exp << 24 | (frac & 0x00FFFFFFu);
+}
+
 double ibm_double_to_double(uint32_t w_hi, uint32_t w_lo)
 {
     double sign = (w_hi & 0x80000000u) ? -1.0 : 1.0;
@@ -0,0 +1,535 @@
+/* Fused evaluation of class 3/4 expression chains.
+ *
+ * A statement like A = B C + D compiles to MMPR, MADD, MASN, and run
+ * one operator at a time each step copies a whole halmat_val_t into the
+ * VAC table and back out.  At load time we find runs of contiguous
+ * matrix/vector operators that end in MASN/VASN and whose intermediate
+ * VACs are referenced exactly once, inside the run.  Such a chain is
+ * executed as one step: intermediates live in local buffers, elementwise
+ * operators work in place on their input, a transpose feeding a product
+ * is folded into the product kernel, and the last result is written
+ * straight into the destination SYT.  Arithmetic is done in the same
+ * order as the single operators, so results are bit-identical.
+ *
+ * Dimensions are only known at run time.  Each execution checks them
+ * first and falls back to the ordinary handlers if an operand is not
+ * conformable, so error behaviour is unchanged too. */
+
+#include <stddef.h>
+#include "halmat.h"
+#include "halmat_matrix.h"
+#include "halmat_cov.h"
+
+#define FUSE_MAX_STEPS 16
+
+enum {
+    FK_ADD, FK_SUB, FK_NEG, FK_SCALE, FK_COPY, FK_TRA,
+    FK_MUL, FK_MUL_TA, FK_MUL_TB, FK_MV, FK_VM, FK_OUTER, FK_CROSS
+};
+
+/* Operand: result of an earlier step, or an operand word to resolve */
+typedef struct {
+    int16_t  step;
+    uint32_t word;
+} fuse_ref_t;
+
+typedef struct {
+    uint8_t    kind;
+    uint8_t    vec;         /* result is a vector */
+    uint8_t    buf;         /* 0 = chain result, 1.. = temporaries */
+    uint8_t    nin;
+    fuse_ref_t in[2];
+} fuse_step_t;
+
+typedef struct {
+    uint32_t end;           /* address after the assignment */
+    uint16_t dest;          /* destination SYT */
+    uint16_t first;         /* into steps[] */
+    uint8_t  nsteps;
+    uint8_t  nops;          /* operators the chain replaces */
+    uint8_t  direct;        /* result buffer is the SYT itself */
+} fuse_chain_t;
+
+struct halmat_fuse {
+    uint16_t     *chain_at;     /* code address -> chain + 1, 0 = none */
+    fuse_chain_t *chains;
+    fuse_step_t  *steps;
+    uint32_t      nchains, nsteps;
+    uint32_t      chain_cap, step_cap;
+};
+
+/* ---- load-time pass ---- */
+
+static int fusable(uint32_t pop)
+{
+    switch (pop) {
+    case POP_MADD: case POP_MSUB: case POP_MNEG: case POP_MSPR:
+    case POP_MTRA: case POP_MMPR: case POP_MTOM: case POP_VVPR:
+    case POP_VADD: case POP_VSUB: case POP_VNEG: case POP_VSPR:
+    case POP_VCRS: case POP_VMPR: case POP_MVPR: case POP_VTOV:
+        return 1;
+    }
+    return 0;
+}
+
+static int step_kind(uint32_t pop)
+{
+    switch (pop) {
+    case POP_MADD: case POP_VADD: return FK_ADD;
+    case POP_MSUB: case POP_VSUB: return FK_SUB;
+    case POP_MNEG: case POP_VNEG: return FK_NEG;
+    case POP_MSPR: case POP_VSPR: return FK_SCALE;
+    case POP_MTOM: case POP_VTOV: return FK_COPY;
+    case POP_MTRA:                return FK_TRA;
+    case POP_MMPR:                return FK_MUL;
+    case POP_MVPR:                return FK_MV;
+    case POP_VMPR:                return FK_VM;
+    case POP_VVPR:                return FK_OUTER;
+    default:                      return FK_CROSS;
+    }
+}
+
+static int arity(uint32_t pop)
+{
+    switch (pop) {
+    case POP_MNEG: case POP_MTRA: case POP_MTOM:
+    case POP_VNEG: case POP_VTOV:
+        return 1;
+    }
+    return 2;
+}
+
+static int elementwise(int kind)
+{
+    return kind <= FK_COPY;
+}
+
+/* One candidate run of operators, collected while scanning */
+typedef struct {
+    uint32_t addr[FUSE_MAX_STEPS];
+    uint32_t pop[FUSE_MAX_STEPS];
+    int      n;
+} run_t;
+
+static int find_step(const run_t *run, uint32_t w, const uint8_t *refs)
+{
+    if (HALMAT_QUAL(w) != QUAL_VAC || refs[HALMAT_DATA(w)] != 1)
+        return -1;
+    for (int i = run->n - 1; i >= 0; i--)
+        if (run->addr[i] == HALMAT_DATA(w))
+            return i;
+    return -1;
+}
+
+static void add_chain(halmat_t *H, struct halmat_fuse *F, const run_t *run,
+                      uint32_t asn, const uint8_t *refs)
+{
+    int root = find_step(run, H->code[asn + 1], refs);
+    if (root != run->n - 1)
+        return;
+
+    /* Steps feeding the assignment; the chain is the longest suffix of
+     * the run made only of those */
+    uint8_t used[FUSE_MAX_STEPS] = {0};
+    used[root] = 1;
+    for (int i = root; i >= 0; i--) {
+        if (!used[i])
+            continue;
+        uint32_t numop = HALMAT_NUMOP(H->code[run->addr[i]]);
+        for (uint32_t k = 1; k <= numop; k++) {
+            int j = find_step(run, H->code[run->addr[i] + k], refs);
+            if (j >= 0 && j < i)
+                used[j] = 1;
+        }
+    }
+    int start = root;
+    while (start > 0 && used[start - 1])
+        start--;
+
+    if (F->nchains >= 0xFFFF)
+        return;
+    if (F->nsteps + FUSE_MAX_STEPS > F->step_cap) {
+        uint32_t cap = F->step_cap ? F->step_cap * 2 : 256;
+        fuse_step_t *p = realloc(F->steps, cap * sizeof(*p));
+        if (!p) return;
+        F->steps = p;
+        F->step_cap = cap;
+    }
+    if (F->nchains >= F->chain_cap) {
+        uint32_t cap = F->chain_cap ? F->chain_cap * 2 : 64;
+        fuse_chain_t *p = realloc(F->chains, cap * sizeof(*p));
+        if (!p) return;
+        F->chains = p;
+        F->chain_cap = cap;
+    }
+
+    uint32_t dest = HALMAT_DATA(H->code[asn + 2]);
+    fuse_step_t *st = &F->steps[F->nsteps];
+    int n = root - start + 1;
+    int8_t map[FUSE_MAX_STEPS];     /* run index -> step */
+
+    for (int i = start; i <= root; i++) {
+        fuse_step_t *s = &st[i - start];
+        uint32_t a = run->addr[i];
+        uint32_t numop = HALMAT_NUMOP(H->code[a]);
+        s->kind = (uint8_t)step_kind(run->pop[i]);
+        s->vec = (run->pop[i] >> 8) == 4;
+        s->nin = (uint8_t)numop;
+        for (int k = 0; k < s->nin; k++) {
+            uint32_t w = H->code[a + 1 + k];
+            int j = find_step(run, w, refs);
+            s->in[k].step = (int16_t)(j >= start && j < i ? map[j] : -1);
+            s->in[k].word = w;
+        }
+        map[i] = (int8_t)(i - start);
+
+        /* Fold a transpose into the product that consumes it */
+        if (s->kind == FK_MUL)
+            for (int k = 0; k < 2; k++) {
+                int j = s->in[k].step;
+                if (j >= 0 && st[j].kind == FK_TRA && st[j].nin == 1) {
+                    s->kind = k == 0 ? FK_MUL_TA : FK_MUL_TB;
+                    s->in[k] = st[j].in[0];
+                    st[j].nin = 0;          /* dead */
+                    break;
+                }
+            }
+    }
+
+    /* Buffers: elementwise steps reuse an input temporary, everything
+     * else gets a fresh one.  The root's buffer is the result. */
+    uint8_t nbuf = 1;
+    for (int i = 0; i < n; i++) {
+        fuse_step_t *s = &st[i];
+        s->buf = 0xFF;
+        if (elementwise(s->kind))
+            for (int k = 0; k < s->nin && k < (s->kind <= FK_SUB ? 2 : 1); k++)
+                if (s->in[k].step >= 0) {
+                    s->buf = st[s->in[k].step].buf;
+                    break;
+                }
+        if (s->buf == 0xFF)
+            s->buf = nbuf++;
+    }
+    uint8_t result = st[n - 1].buf;
+    for (int i = 0; i < n; i++)
+        if (st[i].buf == result)
+            st[i].buf = 0;
+
+    /* Write the SYT directly unless something read after the result
+     * buffer is first written is the destination itself */
+    int direct = 1, written = 0;
+    for (int i = 0; i < n && direct; i++) {
+        if (st[i].nin == 0 && st[i].kind == FK_TRA)
+            continue;
+        written |= st[i].buf == 0;
+        for (int k = 0; k < st[i].nin; k++)
+            if (written && st[i].in[k].step < 0 &&
+                HALMAT_QUAL(st[i].in[k].word) == QUAL_SYT &&
+                HALMAT_DATA(st[i].in[k].word) == dest)
+                direct = 0;
+    }
+
+    fuse_chain_t *c = &F->chains[F->nchains++];
+    c->end = asn + HALMAT_NUMOP(H->code[asn]) + 1;
+    c->dest = (uint16_t)dest;
+    c->first = (uint16_t)F->nsteps;
+    c->nsteps = (uint8_t)n;
+    c->nops = (uint8_t)(n + 1);
+    c->direct = (uint8_t)direct;
+    F->chain_at[run->addr[start]] = (uint16_t)F->nchains;
+    F->nsteps += (uint32_t)n;
+}
+
+void halmat_fuse_build(halmat_t *H)
+{
+    struct halmat_fuse *F = calloc(1, sizeof(*F));
+    uint8_t *refs = calloc(65536, 1);
+    if (F)
+        F->chain_at = calloc(H->code_len + 1, sizeof(uint16_t));
+    if (!F || !refs || !F->chain_at) {
+        free(refs);
+        if (F) free(F->chain_at);
+        free(F);
+        return;
+    }
+
+    /* VAC reference counts over the whole program */
+    for (uint32_t blk = 0; blk < H->num_blocks; blk++) {
+        uint32_t base = blk * HALMAT_BLOCK_WORDS;
+        uint32_t end = base + ((H->code[base + 1] >> 16) & 0xFFFF);
+        for (uint32_t i = base + 2; i <= end; i++) {
+            uint32_t w = H->code[i];
+            if (HALMAT_IS_OPERAND(w) && HALMAT_QUAL(w) == QUAL_VAC &&
+                refs[HALMAT_DATA(w)] < 255)
+                refs[HALMAT_DATA(w)]++;
+        }
+    }
+
+    for (uint32_t blk = 0; blk < H->num_blocks; blk++) {
+        uint32_t base = blk * HALMAT_BLOCK_WORDS;
+        uint32_t end = base + ((H->code[base + 1] >> 16) & 0xFFFF);
+        uint32_t i = base + 2;
+        run_t run;
+        run.n = 0;
+
+        while (i <= end) {
+            uint32_t w = H->code[i];
+            if (!HALMAT_IS_OP(w)) {
+                i++;
+                continue;
+            }
+            uint32_t pop = HALMAT_POPCODE(w);
+            uint32_t numop = HALMAT_NUMOP(w);
+
+            if (fusable(pop) && numop == (uint32_t)arity(pop)) {
+                if (run.n == FUSE_MAX_STEPS) {
+                    memmove(run.addr, run.addr + 1, (FUSE_MAX_STEPS - 1) * sizeof(uint32_t));
+                    memmove(run.pop, run.pop + 1, (FUSE_MAX_STEPS - 1) * sizeof(uint32_t));
+                    run.n--;
+                }
+                run.addr[run.n] = i;
+                run.pop[run.n++] = pop;
+            } else {
+                if ((pop == POP_MASN || pop == POP_VASN) && numop == 2 &&
+                    run.n > 0 && HALMAT_QUAL(H->code[i + 2]) == QUAL_SYT &&
+                    HALMAT_DATA(H->code[i + 2]) < HALMAT_MAX_SYT &&
+                    !H->syt[HALMAT_DATA(H->code[i + 2])].st.name)
+                    add_chain(H, F, &run, i, refs);
+                run.n = 0;
+            }
+            i += numop + 1;
+        }
+    }
+
+    free(refs);
+    H->fuse = F;
+}
+
+void halmat_fuse_free(halmat_t *H)
+{
+    struct halmat_fuse *F = H->fuse;
+    if (!F)
+        return;
+    free(F->chain_at);
+    free(F->chains);
+    free(F->steps);
+    free(F);
+    H->fuse = NULL;
+}
+
+/* ---- execution ---- */
+
+static double val_scalar(const halmat_val_t *v)
+{
+    return (v->type == HTYPE_INTEGER) ? (double)v->v.integer : v->v.scalar;
+}
+
+static const halmat_val_t *operand(halmat_t *H, uint32_t w, halmat_val_t *lit)
+{
+    uint32_t d = HALMAT_DATA(w);
+    if (HALMAT_QUAL(w) == QUAL_SYT && d < HALMAT_MAX_SYT && !H->syt[d].st.name)
+        return &H->syt[d].val;
+    if (HALMAT_QUAL(w) == QUAL_VAC && H->vac[VAC_SLOT(d)].type != HTYPE_REF)
+        return &H->vac[VAC_SLOT(d)];
+    *lit = halmat_resolve_operand(H, w);
+    return lit;
+}
+
+/* Result shape into r[0] x k[0], as the single operator would set it.
+ * 0 if the operands are not conformable or exceed the kernels' limit;
+ * the ordinary handlers then deal with them. */
+static int shape(const fuse_step_t *s, int *r, int *k)
+{
+    int m = HALMAT_MAT_MAX;
+
+    switch (s->kind) {
+    case FK_ADD:
+    case FK_SUB:
+        if (r[0] != r[1] || (!s->vec && k[0] != k[1]))
+            return 0;
+        if (s->vec)
+            k[0] = 0;
+        return 1;
+    case FK_NEG:
+    case FK_SCALE:
+    case FK_COPY:
+        return 1;
+    case FK_TRA: {
+        if (r[0] > m || k[0] > m)
+            return 0;
+        int t = r[0];
+        r[0] = k[0];
+        k[0] = t;
+        return 1;
+    }
+    case FK_MUL:            /* a(r0 x k0) b(r1 x k1) */
+        if (k[0] != r[1] || r[0] > m || k[0] > m || k[1] > m)
+            return 0;
+        k[0] = k[1];
+        return 1;
+    case FK_MUL_TA:         /* a' b, a(r0 x k0) */
+        if (r[0] != r[1] || r[0] > m || k[0] > m || k[1] > m)
+            return 0;
+        r[0] = k[0];
+        k[0] = k[1];
+        return 1;
+    case FK_MUL_TB:         /* a b', b(r1 x k1) */
+        if (k[0] != k[1] || r[0] > m || k[0] > m || r[1] > m)
+            return 0;
+        k[0] = r[1];
+        return 1;
+    case FK_MV:             /* a(r0 x k0) v(r1) */
+        if (k[0] != r[1] || r[0] > m || k[0] > m)
+            return 0;
+        k[0] = 0;
+        return 1;
+    case FK_VM:             /* v(r0) a(r1 x k1) */
+        if (r[0] != r[1] || r[1] > m || k[1] > m)
+            return 0;
+        r[0] = k[1];
+        k[0] = 0;
+        return 1;
+    case FK_OUTER:
+        if (r[0] > m || r[1] > m)
+            return 0;
+        k[0] = r[1];
+        return 1;
+    default:                /* FK_CROSS */
+        r[0] = 3;
+        k[0] = 0;
+        return 1;
+    }
+}
+
+static int elems(int vec, int rows, int cols)
+{
+    int n = vec ? rows : rows * cols;
+    return n > 64 ? 64 : n;
+}
+
+int halmat_fuse_exec(halmat_t *H)
+{
+    struct halmat_fuse *F = H->fuse;
+    uint32_t c = F->chain_at[H->pc];
+    if (!c || H->adlp_n)        /* operands are array elements */
+        return 0;
+    const fuse_chain_t *ch = &F->chains[c - 1];
+    const fuse_step_t *st = &F->steps[ch->first];
+    int n = ch->nsteps;
+
+    halmat_val_t tmp[FUSE_MAX_STEPS + 1];   /* only rows x cols is touched */
+    halmat_val_t lit[FUSE_MAX_STEPS][2];
+    halmat_val_t *buf[FUSE_MAX_STEPS + 1];
+    const halmat_val_t *in[FUSE_MAX_STEPS][2];
+    uint8_t rows[FUSE_MAX_STEPS], cols[FUSE_MAX_STEPS];
+
+    halmat_val_t *dest = &H->syt[ch->dest].val;
+    for (int i = 0; i <= n; i++)
+        buf[i] = &tmp[i];
+    if (ch->direct)
+        buf[0] = dest;
+
+    /* Operands and result shapes, checked before anything is written */
+    for (int i = 0; i < n; i++) {
+        const fuse_step_t *s = &st[i];
+        if (s->kind == FK_TRA && s->nin == 0)
+            continue;
+        int r[2] = {0, 0}, k[2] = {0, 0};
+        for (int j = 0; j < s->nin; j++) {
+            int p = s->in[j].step;
+            if (p >= 0) {
+                in[i][j] = buf[st[p].buf];
+                r[j] = rows[p];
+                k[j] = cols[p];
+            } else {
+                in[i][j] = operand(H, s->in[j].word, &lit[i][j]);
+                r[j] = in[i][j]->rows;
+                k[j] = in[i][j]->cols;
+            }
+        }
+        if (!shape(s, r, k))
+            return 0;
+        rows[i] = (uint8_t)r[0];
+        cols[i] = (uint8_t)k[0];
+    }
+
+    for (int i = 0; i < n; i++) {
+        const fuse_step_t *s = &st[i];
+        if (s->kind == FK_TRA && s->nin == 0)
+            continue;
+        halmat_val_t *out = buf[s->buf];
+        const double *a = in[i][0]->v.matrix;
+        const double *b = s->nin > 1 ? in[i][1]->v.matrix : NULL;
+        double *o = out->v.matrix;
+        int ne = elems(s->vec, rows[i], cols[i]);
+
+        switch (s->kind) {
+        case FK_ADD:
+            for (int e = 0; e < ne; e++) o[e] = a[e] + b[e];
+            break;
+        case FK_SUB:
+            for (int e = 0; e < ne; e++) o[e] = a[e] - b[e];
+            break;
+        case FK_NEG:
+            for (int e = 0; e < ne; e++) o[e] = -a[e];
+            break;
+        case FK_SCALE: {
+            double sv = val_scalar(in[i][1]);
+            for (int e = 0; e < ne; e++) o[e] = a[e] * sv;
+            break;
+        }
+        case FK_COPY:
+            if (o != a)
+                memcpy(o, a, (size_t)ne * sizeof(double));
+            break;
+        case FK_TRA: {
+            int ar = cols[i], ac = rows[i];
+            for (int x = 0; x < ar; x++)
+                for (int y = 0; y < ac; y++)
+                    o[y * ar + x] = a[x * ac + y];
+            break;
+        }
+        case FK_MUL:
+            halmat_mat_mul(o, a, b, rows[i], in[i][0]->cols, cols[i]);
+            break;
+        case FK_MUL_TA:
+            halmat_mat_mul_tn(o, a, b, rows[i], in[i][0]->rows, cols[i]);
+            break;
+        case FK_MUL_TB:
+            halmat_mat_mul_nt(o, a, b, rows[i], in[i][0]->cols, cols[i]);
+            break;
+        case FK_MV:
+            halmat_mat_vec(o, a, b, rows[i], in[i][0]->cols);
+            break;
+        case FK_VM:
+            halmat_vec_mat(o, a, b, in[i][1]->rows, rows[i]);
+            break;
+        case FK_OUTER:
+            halmat_vec_outer(o, a, b, rows[i], cols[i]);
+            break;
+        case FK_CROSS:
+            o[0] = a[1]*b[2] - a[2]*b[1];
+            o[1] = a[2]*b[0] - a[0]*b[2];
+            o[2] = a[0]*b[1] - a[1]*b[0];
+            break;
+        }
+        out->type = s->vec ? HTYPE_VECTOR : HTYPE_MATRIX;
+        out->rows = rows[i];
+        out->cols = cols[i];
+    }
+
+    /* The assignment: what is left of the value is zero, as in a VAC */
+    int ne = elems(st[n - 1].vec, rows[n - 1], cols[n - 1]);
+    if (!ch->direct)
+        memcpy(dest, buf[0], offsetof(halmat_val_t, v) + (size_t)ne * sizeof(double));
+    memset(dest->v.matrix + ne, 0, (size_t)(64 - ne) * sizeof(double));
+    dest->type = st[n - 1].vec ? HTYPE_VECTOR : HTYPE_MATRIX;
+    H->syt[ch->dest].allocated = 1;
+
+    H->cycle_count += ch->nops - 1u;
+    if (H->cov)
+        halmat_cov_span(H, H->pc + HALMAT_NUMOP(H->code[H->pc]) + 1, ch->end, 1);
+    H->pc = ch->end;
+    return 1;
+}
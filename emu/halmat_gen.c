@@ -0,0 +1,269 @@
+#include "halmat_gen.h"
+
+#define LIT_PAGE_SIZE 130
+
+int halmat_gen_init(halmat_gen_t *G, const char *name)
+{
+    memset(G, 0, sizeof(*G));
+    G->code = calloc(HALMAT_BLOCK_WORDS, sizeof(uint32_t));
+    if (!G->code)
+        return -1;
+    G->nblocks = 1;
+    G->at = 2;
+    G->nlit = 1;                            /* LIT(0) is never referenced */
+    snprintf(G->name, sizeof(G->name), "%s", name);
+    halmat_gen_label(G, G->name);
+    halmat_gen_source(G, " PROGRAM;\n");
+    halmat_gen_op(G, POP_MDEF, 0, 1, HALMAT_SYT(1));
+    halmat_gen_smrk(G);
+    return G->err ? -1 : 0;
+}
+
+void halmat_gen_free(halmat_gen_t *G)
+{
+    free(G->code);
+    free(G->lit);
+    free(G->src);
+    memset(G, 0, sizeof(*G));
+}
+
+void halmat_gen_source(halmat_gen_t *G, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if (G->srclen + (size_t)n + 1 > G->srccap) {
+        size_t cap = G->srccap ? G->srccap * 2 : 1024;
+        while (cap < G->srclen + (size_t)n + 1)
+            cap *= 2;
+        char *p = realloc(G->src, cap);
+        if (!p) {
+            G->err = 1;
+            return;
+        }
+        G->src = p;
+        G->srccap = cap;
+    }
+    va_start(ap, fmt);
+    vsnprintf(G->src + G->srclen, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    G->srclen += (size_t)n;
+}
+
+/* The loader numbers labels and declared names in order of appearance */
+uint32_t halmat_gen_label(halmat_gen_t *G, const char *name)
+{
+    halmat_gen_source(G, " %s:\n", name);
+    if (++G->nsyt >= HALMAT_MAX_SYT)
+        G->err = 1;
+    return G->nsyt;
+}
+
+uint32_t halmat_gen_declare(halmat_gen_t *G, const char *name, const char *attrs)
+{
+    halmat_gen_source(G, "    DECLARE %s %s;\n", name, attrs);
+    if (++G->nsyt >= HALMAT_MAX_SYT)
+        G->err = 1;
+    return G->nsyt;
+}
+
+uint32_t halmat_gen_flow(halmat_gen_t *G)
+{
+    if (++G->flow >= HALMAT_MAX_FLOW)
+        G->err = 1;
+    return G->flow;
+}
+
+uint32_t halmat_gen_lit(halmat_gen_t *G, double v)
+{
+    if (G->nlit >= HALMAT_MAX_LIT) {
+        G->err = 1;
+        return 0;
+    }
+    if (G->nlit >= G->litcap) {
+        uint32_t cap = G->litcap ? G->litcap * 2 : LIT_PAGE_SIZE;
+        int32_t *p = realloc(G->lit, cap * 3 * sizeof(int32_t));
+        if (!p) {
+            G->err = 1;
+            return 0;
+        }
+        G->lit = p;
+        G->litcap = cap;
+    }
+    int32_t *l = &G->lit[G->nlit * 3];
+    l[0] = 1;                               /* ARITH */
+    l[1] = (int32_t)double_to_ibm_float(v);
+    l[2] = 0;
+    return G->nlit++;
+}
+
+/* A CHARACTER literal short enough to live in lit2 alone: the length
+ * less one in the top byte, the characters after it; lit1 = 0 */
+uint32_t halmat_gen_char(halmat_gen_t *G, const char *s)
+{
+    uint32_t i = halmat_gen_lit(G, 0);
+    size_t n = strlen(s);
+    if (!i || n < 1 || n > 3) {
+        G->err = 1;
+        return i;
+    }
+    uint32_t w = (uint32_t)(n - 1) << 24;
+    for (size_t k = 0; k < n; k++)
+        w |= (uint32_t)(uint8_t)s[k] << (16 - 8 * k);
+    G->lit[i * 3] = 0;
+    G->lit[i * 3 + 1] = (int32_t)w;
+    return i;
+}
+
+/* Close the current block with a non-final XREC and start the next.
+ * At the block limit the error is set and the block left as it is. */
+int halmat_gen_block(halmat_gen_t *G)
+{
+    uint32_t base = (G->nblocks - 1) * HALMAT_BLOCK_WORDS;
+    if (G->nblocks == HALMAT_MAX_BLOCKS) {
+        G->err = 1;
+        return -1;
+    }
+    uint32_t *p = realloc(G->code, (size_t)(G->nblocks + 1) * HALMAT_BLOCK_WORDS *
+                                   sizeof(uint32_t));
+    if (!p) {
+        G->err = 1;
+        return -1;
+    }
+    G->code = p;
+    G->code[G->at] = HALMAT_OPERATOR(POP_XREC, 0, 0);
+    G->code[base + 1] = (G->at - base) << 16;
+    memset(G->code + G->nblocks * HALMAT_BLOCK_WORDS, 0,
+           HALMAT_BLOCK_WORDS * sizeof(uint32_t));
+    G->at = G->nblocks * HALMAT_BLOCK_WORDS + 2;
+    G->nblocks++;
+    return 0;
+}
+
+/* Append an operator and its operands; returns its code address.  An
+ * operator that finds no room, even in a new block, is dropped. */
+uint32_t halmat_gen_op(halmat_gen_t *G, uint32_t pop, uint32_t tag, int numop, ...)
+{
+    if (G->at + (uint32_t)numop + 2 > G->nblocks * HALMAT_BLOCK_WORDS &&
+        halmat_gen_block(G) != 0)           /* room for an XREC after */
+        return G->at;
+
+    uint32_t a = G->at;
+    va_list ap;
+    va_start(ap, numop);
+    G->code[G->at++] = HALMAT_OPERATOR(pop, numop, tag);
+    for (int k = 0; k < numop; k++)
+        G->code[G->at++] = va_arg(ap, uint32_t);
+    va_end(ap);
+    G->nops++;
+    return a;
+}
+
+halmat_gen_mark_t halmat_gen_mark(const halmat_gen_t *G)
+{
+    halmat_gen_mark_t m = { G->at, G->nblocks, G->nops, G->stmt, G->flow,
+                            G->nlit, G->err };
+    return m;
+}
+
+/* Forget everything emitted since the mark: code, statement numbers,
+ * flow numbers and literals.  Blocks begun since are dropped. */
+void halmat_gen_rewind(halmat_gen_t *G, halmat_gen_mark_t m)
+{
+    G->at = m.at;
+    G->nblocks = m.nblocks;
+    G->nops = m.nops;
+    G->stmt = m.stmt;
+    G->flow = m.flow;
+    G->nlit = m.nlit;
+    G->err = m.err;
+}
+
+void halmat_gen_smrk(halmat_gen_t *G)
+{
+    halmat_gen_op(G, POP_SMRK, 0, 1, HALMAT_OPERAND(QUAL_NONE, ++G->stmt, 0));
+}
+
+/* DO FOR syt = from TO to; returns the flow number for the END */
+uint32_t halmat_gen_for(halmat_gen_t *G, uint32_t syt, double from, double to)
+{
+    uint32_t f = halmat_gen_flow(G);
+    uint32_t a = halmat_gen_lit(G, from);
+    uint32_t b = halmat_gen_lit(G, to);
+    halmat_gen_op(G, POP_DFOR, 1, 4, HALMAT_INL(f), HALMAT_SYT(syt),
+                  HALMAT_LIT(a), HALMAT_LIT(b));
+    halmat_gen_smrk(G);
+    return f;
+}
+
+void halmat_gen_efor(halmat_gen_t *G, uint32_t flow)
+{
+    halmat_gen_op(G, POP_EFOR, 0, 1, HALMAT_INL(flow));
+    halmat_gen_smrk(G);
+}
+
+static int write_be32(FILE *fp, const uint32_t *w, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint8_t b[4] = { (uint8_t)(w[i] >> 24), (uint8_t)(w[i] >> 16),
+                         (uint8_t)(w[i] >> 8), (uint8_t)w[i] };
+        if (fwrite(b, 1, 4, fp) != 4)
+            return -1;
+    }
+    return 0;
+}
+
+static FILE *open_in(const char *dir, const char *file)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        fprintf(stderr, "halmat_gen: cannot write %s\n", path);
+    return fp;
+}
+
+/* End the program (CLOSE and a final XREC) and write its three files
+ * into dir */
+int halmat_gen_write(halmat_gen_t *G, const char *dir)
+{
+    halmat_gen_op(G, POP_CLOS, 0, 1, HALMAT_SYT(1));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_XREC, 1, 0);
+    uint32_t base = (G->nblocks - 1) * HALMAT_BLOCK_WORDS;
+    G->code[base + 1] = (G->at - 1 - base) << 16;
+    halmat_gen_source(G, " CLOSE %s;\n", G->name);
+    if (G->err) {
+        fprintf(stderr, "halmat_gen: program exceeds the loader's limits\n");
+        return -1;
+    }
+
+    FILE *fp = open_in(dir, "halmat.bin");
+    if (!fp)
+        return -1;
+    int rc = write_be32(fp, G->code, (size_t)G->nblocks * HALMAT_BLOCK_WORDS);
+    fclose(fp);
+
+    /* 130 literals a page, as three arrays: lit1, lit2, lit3 */
+    if (!(fp = open_in(dir, "litfile.bin")))
+        return -1;
+    uint32_t pages = (G->nlit + LIT_PAGE_SIZE - 1) / LIT_PAGE_SIZE;
+    for (uint32_t pg = 0; pg < pages && rc == 0; pg++)
+        for (int part = 0; part < 3 && rc == 0; part++)
+            for (uint32_t i = 0; i < LIT_PAGE_SIZE && rc == 0; i++) {
+                uint32_t idx = pg * LIT_PAGE_SIZE + i;
+                uint32_t w = idx && idx < G->nlit ? (uint32_t)G->lit[idx * 3 + part] : 0;
+                rc = write_be32(fp, &w, 1);
+            }
+    fclose(fp);
+
+    if (!(fp = open_in(dir, "SOURCECO.txt")))
+        return -1;
+    if (fwrite(G->src, 1, G->srclen, fp) != G->srclen)
+        rc = -1;
+    fclose(fp);
+    return rc;
+}
@@ -0,0 +1,71 @@
+/* HALMAT writer: builds a program in memory and writes it out as the
+ * compiler would, halmat.bin and litfile.bin, with a SOURCECO.txt that
+ * holds only the DECLAREs so the loader can number and type symbols.
+ * Used by the benchmarks, which have no compiler to hand.
+ *
+ * Operators go into 1800-word blocks; a block that cannot take the
+ * next operator is closed with a non-final XREC and a new one begun.
+ * The interpreter's forward scans (DO, CASE, procedure bodies) do not
+ * step over block boundaries, so a caller that must keep a construct
+ * in one block marks the writer first, and if the construct crossed,
+ * rewinds and starts it again after halmat_gen_block.
+ * VAC operands hold the producing operator's code address, truncated
+ * to 16 bits, which is what the interpreter's VAC slots key on. */
+
+#ifndef HALMAT_GEN_H
+#define HALMAT_GEN_H
+
+#include <stdarg.h>
+#include "halmat.h"
+
+#define HALMAT_OPERATOR(pop, numop, tag) \
+    ((uint32_t)(tag) << 24 | (uint32_t)(numop) << 16 | (uint32_t)(pop) << 4)
+#define HALMAT_OPERAND(qual, data, tag1) \
+    ((uint32_t)((data) & 0xFFFF) << 16 | (uint32_t)(tag1) << 8 | \
+     (uint32_t)(qual) << 4 | 1)
+
+#define HALMAT_SYT(s)   HALMAT_OPERAND(QUAL_SYT, (s), 0)
+#define HALMAT_INL(f)   HALMAT_OPERAND(QUAL_INL, (f), 0)
+#define HALMAT_VAC(a)   HALMAT_OPERAND(QUAL_VAC, (a), 0)
+#define HALMAT_LIT(l)   HALMAT_OPERAND(QUAL_LIT, (l), 0)
+#define HALMAT_IMD(v)   HALMAT_OPERAND(QUAL_IMD, (v), 0)
+
+typedef struct {
+    uint32_t *code;                 /* nblocks whole blocks */
+    uint32_t  nblocks;
+    uint32_t  at;                   /* next word */
+    uint32_t  nops;                 /* operators written */
+    int32_t  *lit;                  /* lit1, lit2, lit3 per literal */
+    uint32_t  nlit, litcap;
+    uint32_t  stmt;                 /* last SMRK number */
+    uint32_t  flow;                 /* last INL flow number */
+    uint32_t  nsyt;                 /* symbols numbered so far */
+    char     *src;                  /* SOURCECO.txt */
+    size_t    srclen, srccap;
+    char      name[32];             /* program label */
+    int       err;                  /* out of memory or over the limits */
+} halmat_gen_t;
+
+typedef struct {
+    uint32_t at, nblocks, nops, stmt, flow, nlit;
+    int      err;
+} halmat_gen_mark_t;
+
+int      halmat_gen_init(halmat_gen_t *G, const char *name);    /* SYT 1 */
+void     halmat_gen_free(halmat_gen_t *G);
+uint32_t halmat_gen_declare(halmat_gen_t *G, const char *name, const char *attrs);
+uint32_t halmat_gen_label(halmat_gen_t *G, const char *name);   /* "NAME:" */
+void     halmat_gen_source(halmat_gen_t *G, const char *fmt, ...);
+uint32_t halmat_gen_flow(halmat_gen_t *G);
+uint32_t halmat_gen_lit(halmat_gen_t *G, double v);             /* ARITH */
+uint32_t halmat_gen_char(halmat_gen_t *G, const char *s);       /* 1-3 chars */
+uint32_t halmat_gen_op(halmat_gen_t *G, uint32_t pop, uint32_t tag, int numop, ...);
+int      halmat_gen_block(halmat_gen_t *G);                     /* start a block */
+halmat_gen_mark_t halmat_gen_mark(const halmat_gen_t *G);
+void     halmat_gen_rewind(halmat_gen_t *G, halmat_gen_mark_t m);
+void     halmat_gen_smrk(halmat_gen_t *G);
+uint32_t halmat_gen_for(halmat_gen_t *G, uint32_t syt, double from, double to);
+void     halmat_gen_efor(halmat_gen_t *G, uint32_t flow);
+int      halmat_gen_write(halmat_gen_t *G, const char *dir);    /* ends the program */
+
+#endif /* HALMAT_GEN_H */
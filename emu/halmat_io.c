@@ -1,47 +1,621 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "halmat.h"
 #include "halmat_io.h"
+#include "halmat_ebcdic.h"
 
-/* EBCDIC Code Page 037 -> ASCII.
- * IBM S/360 encoding used by the HAL/S-FC compiler. */
-static const uint8_t ebcdic_to_ascii[256] = {
-    0x00,0x01,0x02,0x03,0x9C,0x09,0x86,0x7F,
-    0x97,0x8D,0x8E,0x0B,0x0C,0x0D,0x0E,0x0F,
-    0x10,0x11,0x12,0x13,0x9D,0x85,0x08,0x87,
-    0x18,0x19,0x92,0x8F,0x1C,0x1D,0x1E,0x1F,
-    0x80,0x81,0x82,0x83,0x84,0x0A,0x17,0x1B,
-    0x88,0x89,0x8A,0x8B,0x8C,0x05,0x06,0x07,
-    0x90,0x91,0x16,0x93,0x94,0x95,0x96,0x04,
-    0x98,0x99,0x9A,0x9B,0x14,0x15,0x9E,0x1A,
-    0x20,0xA0,0xE2,0xE4,0xE0,0xE1,0xE3,0xE5, /* 40: SP */
-    0xE7,0xF1,0xA2,0x2E,0x3C,0x28,0x2B,0x7C, /* 4B: . < ( + | */
-    0x26,0xE9,0xEA,0xEB,0xE8,0xED,0xEE,0xEF, /* 50: & */
-    0xEC,0xDF,0x21,0x24,0x2A,0x29,0x3B,0xAC, /* 5A: ! $ * ) ; */
-    0x2D,0x2F,0xC2,0xC4,0xC0,0xC1,0xC3,0xC5, /* 60: - / */
-    0xC7,0xD1,0xA6,0x2C,0x25,0x5F,0x3E,0x3F, /* 6B: , % _ > ? */
-    0xF8,0xC9,0xCA,0xCB,0xC8,0xCD,0xCE,0xCF, /* 70: 0xF8 = ø */
-    0xCC,0x60,0x3A,0x23,0x40,0x27,0x3D,0x22, /* 79: ` : # @ ' = " */
-    0xD8,0x61,0x62,0x63,0x64,0x65,0x66,0x67, /* 80: 0xD8 = Ø  81-89: a-i */
-    0x68,0x69,0xAB,0xBB,0xF0,0xFD,0xFE,0xB1,
-    0xB0,0x6A,0x6B,0x6C,0x6D,0x6E,0x6F,0x70, /* 91-99: j-r */
-    0x71,0x72,0xAA,0xBA,0xE6,0xB8,0xC6,0xA4,
-    0xB5,0x7E,0x73,0x74,0x75,0x76,0x77,0x78, /* A1: ~  A2-A9: s-z */
-    0x79,0x7A,0xA1,0xBF,0xD0,0x5B,0xDE,0xAE, /* AD: [ */
-    0x5E,0xA3,0xA5,0xB7,0xA9,0xA7,0xB6,0xBC, /* B0: ^ */
-    0xBD,0xBE,0xDD,0xA8,0xAF,0x5D,0xB4,0xD7, /* BD: ] */
-    0x7B,0x41,0x42,0x43,0x44,0x45,0x46,0x47, /* C0: {  C1-C9: A-I */
-    0x48,0x49,0xAD,0xF4,0xF6,0xF2,0xF3,0xF5,
-    0x7D,0x4A,0x4B,0x4C,0x4D,0x4E,0x4F,0x50, /* D0: }  D1-D9: J-R */
-    0x51,0x52,0xB9,0xFB,0xFC,0xF9,0xFA,0xFF,
-    0x5C,0xF7,0x53,0x54,0x55,0x56,0x57,0x58, /* E0: \  E2-E9: S-Z */
-    0x59,0x5A,0xB2,0xD4,0xD6,0xD2,0xD3,0xD5,
-    0x30,0x31,0x32,0x33,0x34,0x35,0x36,0x37, /* F0-F9: 0-9 */
-    0x38,0x39,0xB3,0xDB,0xDC,0xD9,0xDA,0x9F
+/* ---- Asynchronous WRITE pipeline ----
+ *
+ * WRITE serialises its values into a per-unit staging buffer; a writer
+ * thread formats full buffers and fwrite()s them.  Staging memory is a
+ * fixed pool, so a program that outruns the disk blocks in WRITE rather
+ * than growing without bound.  The writer also picks up partly filled
+ * buffers after IO_IDLE_MS so output from slow programs still appears.
+ * Anything that reads or reopens a unit drains the pipeline first.  With
+ * H->sync_io (debugger, trace) a WRITE is formatted before it returns. */
+
+#define IO_BUF_BYTES  65536
+#define IO_NBUFS      16            /* 1 MB of staging */
+#define IO_IDLE_MS    20
+#define IO_NSTAGE     (HALMAT_MAX_UNITS + 1)  /* last: writes to bad units */
+
+/* Staged record kinds */
+#define REC_CHAR    'C'             /* len:2, bytes */
+#define REC_SCALAR  'S'             /* double */
+#define REC_INT     'I'             /* int32 */
+#define REC_EOL     '\n'
+
+typedef struct io_buf {
+    struct io_buf *next;
+    FILE     *fp;
+    int       ebcdic;               /* unit file is EBCDIC text */
+    uint32_t  len;
+    uint8_t   data[IO_BUF_BYTES];
+} io_buf_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  work;           /* writer: buffers queued / stop */
+    pthread_cond_t  space;          /* WRITE: a buffer was freed */
+    pthread_cond_t  idle;           /* flush: queue drained */
+    pthread_t       thread;
+    int             threaded, stop, busy;
+    io_buf_t       *pool;
+    io_buf_t       *free_list;
+    io_buf_t       *head, *tail;    /* queued for the writer */
+    io_buf_t       *stage[IO_NSTAGE];
+    char            text[IO_BUF_BYTES * 2];
+} aw;
+
+static const double pow10_exact[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
 };
 
-static void translate_buf(char *buf, int len, const uint8_t *table)
+/* "%11d" */
+static int fmt_int(char *out, int32_t v)
+{
+    char tmp[12];
+    uint32_t u = (v < 0) ? 0u - (uint32_t)v : (uint32_t)v;
+    int n = 0, len = 0;
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0)
+        tmp[n++] = '-';
+    while (len + n < 11)
+        out[len++] = ' ';
+    while (n)
+        out[len++] = tmp[--n];
+    return len;
+}
+
+
+/* |v| * 10^k with one rounding, or -1 when 10^k is not exact */
+static double scale10(double a, int k)
+{
+    if (k >= 0 && k <= 22) return a * pow10_exact[k];
+    if (k < 0 && k >= -22) return a / pow10_exact[-k];
+    return -1.0;
+}
+
+/* "% .7E" (zero is written " 0.0" by the caller).  The eight significant
+ * digits come from a single correctly rounded scaling, which is off by
+ * at most half an ulp; values that land too close to a rounding tie to
+ * decide, or outside 1e-15..1e30, go to snprintf so the text always
+ * matches the C library exactly. */
+static int fmt_e(char *out, double v)
+{
+    double a = fabs(v);
+    if (!(a >= 1e-15 && a < 1e30))
+        return snprintf(out, 32, "% .7E", v);
+
+    int e = (int)floor(log10(a));
+    double m = scale10(a, 7 - e);
+    if (m < 1e7) m = scale10(a, 7 - --e);
+    else if (m >= 1e8) m = scale10(a, 7 - ++e);
+    if (m < 1e7 || m >= 1e8)
+        return snprintf(out, 32, "% .7E", v);
+
+    double r = floor(m);
+    double frac = m - r;
+    if (fabs(frac - 0.5) < 1e-6)
+        return snprintf(out, 32, "% .7E", v);
+    uint32_t d = (uint32_t)r + (frac > 0.5);
+    if (d >= 100000000u) {
+        d /= 10;
+        e++;
+    }
+
+    char *p = out;
+    *p++ = (v < 0) ? '-' : ' ';
+    *p++ = (char)('0' + d / 10000000u);
+    *p++ = '.';
+    for (int i = 6; i >= 0; i--) {
+        p[i] = (char)('0' + d % 10);
+        d /= 10;
+    }
+    p += 7;
+    *p++ = 'E';
+    *p++ = (e < 0) ? '-' : '+';
+    if (e < 0) e = -e;
+    *p++ = (char)('0' + e / 10);
+    *p++ = (char)('0' + e % 10);
+    return (int)(p - out);
+}
+
+static void put_text(io_buf_t *b, char *text, size_t n)
+{
+    if (b->ebcdic)
+        halmat_ascii_to_ebcdic(text, text, n);
+    fwrite(text, 1, n, b->fp);
+}
+
+static void format_buf(io_buf_t *b)
+{
+    char *text = aw.text;
+    size_t n = 0;
+    uint32_t i = 0;
+
+    while (i < b->len) {
+        uint8_t kind = b->data[i++];
+        if (n > sizeof(aw.text) - 300) {
+            put_text(b, text, n);
+            n = 0;
+        }
+        switch (kind) {
+        case REC_CHAR: {
+            uint16_t len;
+            memcpy(&len, b->data + i, 2);
+            i += 2;
+            if (n + len > sizeof(aw.text)) {
+                put_text(b, text, n);
+                n = 0;
+            }
+            memcpy(text + n, b->data + i, len);
+            n += len;
+            i += len;
+            break;
+        }
+        case REC_SCALAR: {
+            double v;
+            memcpy(&v, b->data + i, 8);
+            i += 8;
+            if (v == 0.0) {
+                memcpy(text + n, " 0.0", 4);
+                n += 4;
+            } else {
+                n += (size_t)fmt_e(text + n, v);
+            }
+            break;
+        }
+        case REC_INT: {
+            int32_t v;
+            memcpy(&v, b->data + i, 4);
+            i += 4;
+            n += (size_t)fmt_int(text + n, v);
+            break;
+        }
+        case REC_EOL:
+            text[n++] = '\n';
+            break;
+        }
+    }
+    put_text(b, text, n);
+    fflush(b->fp);
+    b->len = 0;
+}
+
+/* Hand a staged buffer to the writer (lock held) */
+static void submit(io_buf_t *b)
+{
+    if (!aw.threaded) {
+        format_buf(b);
+        b->next = aw.free_list;
+        aw.free_list = b;
+        return;
+    }
+    b->next = NULL;
+    if (aw.tail) aw.tail->next = b;
+    else         aw.head = b;
+    aw.tail = b;
+    pthread_cond_signal(&aw.work);
+}
+
+static void submit_stages(void)
+{
+    for (int s = 0; s < IO_NSTAGE; s++) {
+        if (aw.stage[s] && aw.stage[s]->len) {
+            submit(aw.stage[s]);
+            aw.stage[s] = NULL;
+        }
+    }
+}
+
+static void *writer_main(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&aw.lock);
+    for (;;) {
+        while (!aw.head && !aw.stop) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += IO_IDLE_MS * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            if (pthread_cond_timedwait(&aw.work, &aw.lock, &ts) != 0)
+                submit_stages();
+        }
+        if (!aw.head)
+            break;                          /* stop requested, queue empty */
+        io_buf_t *b = aw.head;
+        aw.head = b->next;
+        if (!aw.head)
+            aw.tail = NULL;
+        aw.busy = 1;
+        pthread_mutex_unlock(&aw.lock);
+
+        format_buf(b);
+
+        pthread_mutex_lock(&aw.lock);
+        aw.busy = 0;
+        b->next = aw.free_list;
+        aw.free_list = b;
+        pthread_cond_signal(&aw.space);
+        if (!aw.head)
+            pthread_cond_broadcast(&aw.idle);
+    }
+    pthread_mutex_unlock(&aw.lock);
+    return NULL;
+}
+
+/* Write out everything staged so far and wait until it has reached the
+ * stdio stream */
+static void io_flush(void)
+{
+    if (!aw.pool)
+        return;
+    pthread_mutex_lock(&aw.lock);
+    submit_stages();
+    while (aw.head || aw.busy)
+        pthread_cond_wait(&aw.idle, &aw.lock);
+    pthread_mutex_unlock(&aw.lock);
+}
+
+/* ---- Streaming READ input ----
+ *
+ * Input units are read straight from their file descriptor: regular
+ * files are mapped whole, terminals and pipes go through a 1 MB read()
+ * buffer.  Fields are separated by blanks, commas or line ends; a comma
+ * after a separator is a null field that leaves its variable unchanged,
+ * and ';' ends the data for the rest of the statement.  Each READ and
+ * READALL starts at the beginning of a record. */
+
+#define IN_BUF_BYTES  (1 << 20)
+#define IN_TOKEN_MAX  256
+
+enum { FIELD_END = -1, FIELD_NULL = 0, FIELD_TOKEN = 1 };
+
+typedef struct {
+    FILE          *fp;              /* stream this state was built for */
+    int            fd;
+    const uint8_t *p;               /* mapping or rbuf */
+    size_t         pos, len;
+    uint8_t       *rbuf;
+    void          *map;
+    size_t         map_len;
+    int            eof;             /* nothing beyond p[len] */
+    int            ebcdic;          /* translate to ASCII as data arrives */
+    int            bol;             /* at the start of a record */
+    int            sep;             /* next ',' separates, not a null field */
+    int            warned;
+} in_unit_t;
+
+static in_unit_t in_units[IO_NSTAGE];
+
+static void in_release(in_unit_t *u)
+{
+    if (u->map)
+        munmap(u->map, u->map_len);
+    free(u->rbuf);
+    memset(u, 0, sizeof(*u));
+}
+
+static in_unit_t *in_attach(int s, FILE *fp, int ebcdic)
+{
+    in_unit_t *u = &in_units[s];
+    if (u->fp == fp)
+        return u;
+    in_release(u);
+    u->fp = fp;
+    u->fd = fileno(fp);
+    u->bol = 1;
+    u->ebcdic = ebcdic;
+
+    struct stat st;
+    off_t off = lseek(u->fd, 0, SEEK_CUR);
+    if (fstat(u->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        off >= 0 && off <= st.st_size) {
+        /* EBCDIC files are translated in place, chunk by chunk as the
+         * reader reaches them, in a private copy-on-write mapping */
+        int prot = ebcdic ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *m = mmap(NULL, (size_t)st.st_size, prot, MAP_PRIVATE, u->fd, 0);
+        if (m != MAP_FAILED) {
+            u->map = m;
+            u->map_len = (size_t)st.st_size;
+            u->p = m;
+            u->pos = (size_t)off;
+            u->len = ebcdic ? (size_t)off : (size_t)st.st_size;
+            u->eof = 1;
+            return u;
+        }
+    }
+    u->rbuf = malloc(IN_BUF_BYTES);
+    u->p = u->rbuf;
+    if (!u->rbuf)
+        u->eof = 1;
+    return u;
+}
+
+static int in_fill(in_unit_t *u)
+{
+    if (u->map && u->len < u->map_len) {
+        size_t n = u->map_len - u->len;
+        if (n > IN_BUF_BYTES)
+            n = IN_BUF_BYTES;
+        halmat_ebcdic_to_ascii((char *)u->map + u->len,
+                               (char *)u->map + u->len, n);
+        u->len += n;
+        return 1;
+    }
+    if (u->eof)
+        return 0;
+    ssize_t n = read(u->fd, u->rbuf, IN_BUF_BYTES);
+    if (n <= 0) {
+        u->eof = 1;
+        return 0;
+    }
+    if (u->ebcdic)
+        halmat_ebcdic_to_ascii((char *)u->rbuf, (char *)u->rbuf, (size_t)n);
+    u->pos = 0;
+    u->len = (size_t)n;
+    return 1;
+}
+
+static inline int in_peek(in_unit_t *u)
+{
+    if (u->pos < u->len || in_fill(u))
+        return u->p[u->pos];
+    return -1;
+}
+
+static void in_next_record(in_unit_t *u)
+{
+    int c;
+    if (!u->bol) {
+        while ((c = in_peek(u)) >= 0) {
+            u->pos++;
+            if (c == '\n')
+                break;
+        }
+    }
+    u->bol = 1;
+    u->sep = 0;
+}
+
+static int is_blank(int c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Next field into tok (NUL-terminated, truncated at max) */
+static int in_field(in_unit_t *u, char *tok, int max, int *len, int *quoted)
+{
+    int c, n = 0;
+    for (;;) {
+        while (is_blank(c = in_peek(u))) {
+            u->pos++;
+            u->bol = (c == '\n');
+        }
+        if (c < 0)
+            return FIELD_END;
+        u->pos++;
+        u->bol = 0;
+        if (c == ';')
+            return FIELD_END;
+        if (c != ',')
+            break;
+        if (!u->sep)
+            return FIELD_NULL;
+        u->sep = 0;
+    }
+
+    *quoted = (c == '\'');
+    if (*quoted) {
+        /* 'text', '' for an embedded quote; ends at the record end */
+        while ((c = in_peek(u)) >= 0 && c != '\n') {
+            u->pos++;
+            if (c == '\'') {
+                if (in_peek(u) != '\'')
+                    break;
+                u->pos++;
+            }
+            if (n < max) tok[n++] = (char)c;
+        }
+    } else {
+        tok[n++] = (char)c;
+        while ((c = in_peek(u)) >= 0 && !is_blank(c) && c != ',' && c != ';') {
+            u->pos++;
+            if (n < max) tok[n++] = (char)c;
+        }
+    }
+    tok[n] = '\0';
+    *len = n;
+    u->sep = 1;
+    return FIELD_TOKEN;
+}
+
+/* Decimal with optional fraction and E exponent.  Up to 19 significant
+ * digits with |exponent| <= 22 convert exactly; the rest use strtod.
+ * Returns 0 if the token is not a number. */
+static int parse_number(const char *s, double *d, int32_t *iv, int *is_int)
+{
+    const char *t = s;
+    int neg = 0, digits = 0, sig = 0, exp10 = 0, inexact = 0, frac = 0;
+    uint64_t mant = 0;
+
+    if (*t == '+' || *t == '-')
+        neg = (*t++ == '-');
+    for (;; t++) {
+        if (*t >= '0' && *t <= '9') {
+            digits++;
+            if (mant == 0 && *t == '0') {
+                if (frac) exp10--;
+            } else if (sig < 19) {
+                mant = mant * 10 + (uint64_t)(*t - '0');
+                sig++;
+                if (frac) exp10--;
+            } else {
+                inexact = 1;
+                if (!frac) exp10++;
+            }
+        } else if (*t == '.' && !frac) {
+            frac = 1;
+        } else {
+            break;
+        }
+    }
+    if (!digits)
+        return 0;
+    int has_exp = 0;
+    if (*t == 'E' || *t == 'e') {
+        int eneg = 0, e = 0, edig = 0;
+        t++;
+        if (*t == '+' || *t == '-')
+            eneg = (*t++ == '-');
+        for (; *t >= '0' && *t <= '9'; t++, edig++)
+            if (e < 10000) e = e * 10 + (*t - '0');
+        if (!edig)
+            return 0;
+        exp10 += eneg ? -e : e;
+        has_exp = 1;
+    }
+    if (*t)
+        return 0;
+
+    *is_int = !frac && !has_exp && !inexact && mant <= (neg ? 2147483648u : 2147483647u);
+    if (*is_int)
+        *iv = neg ? (int32_t)(0u - (uint32_t)mant) : (int32_t)mant;
+
+    if (!inexact && mant < (1ull << 53) && exp10 >= -22 && exp10 <= 22) {
+        double v = (double)mant;
+        v = (exp10 >= 0) ? v * pow10_exact[exp10] : v / pow10_exact[-exp10];
+        *d = neg ? -v : v;
+    } else {
+        *d = strtod(s, NULL);
+    }
+    return 1;
+}
+
+static int digit_val(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return 99;
+}
+
+/* BIN'...', OCT'...', HEX'...', TRUE/FALSE, ON/OFF, or bare binary */
+static int parse_bits(const char *s, uint32_t *bits)
+{
+    int radix = 2;
+    if (!strcmp(s, "TRUE") || !strcmp(s, "ON"))   { *bits = 1; return 1; }
+    if (!strcmp(s, "FALSE") || !strcmp(s, "OFF")) { *bits = 0; return 1; }
+    if (!strncmp(s, "BIN'", 4))      { radix = 2;  s += 4; }
+    else if (!strncmp(s, "OCT'", 4)) { radix = 8;  s += 4; }
+    else if (!strncmp(s, "HEX'", 4)) { radix = 16; s += 4; }
+
+    uint32_t v = 0;
+    int n = 0;
+    for (; *s && *s != '\''; s++, n++) {
+        int d = digit_val(*s);
+        if (d >= radix)
+            return 0;
+        v = v * (uint32_t)radix + (uint32_t)d;
+    }
+    if (!n)
+        return 0;
+    *bits = v;
+    return 1;
+}
+
+/* HAL/S converts to INTEGER by rounding; out of range saturates */
+static int32_t to_integer(double d)
 {
-    for (int i = 0; i < len; i++)
-        buf[i] = (char)table[(uint8_t)buf[i]];
+    if (d >= 2147483647.0)
+        return INT32_MAX;
+    if (d <= -2147483648.0)
+        return INT32_MIN;
+    return (int32_t)lround(d);
+}
+
+/* Convert one field to the destination's type; type 0 takes the type
+ * the text looks like */
+static void store_field(halmat_val_t *dest, int type, const char *tok,
+                        int len, int quoted)
+{
+    double d;
+    int32_t iv = 0;
+    int is_int = 0;
+
+    if (!type)
+        type = quoted ? HTYPE_CHAR
+             : parse_number(tok, &d, &iv, &is_int) ? (is_int ? HTYPE_INTEGER
+                                                             : HTYPE_SCALAR)
+             : HTYPE_CHAR;
+
+    switch (type) {
+    case HTYPE_INTEGER:
+        if (!quoted && parse_number(tok, &d, &iv, &is_int)) {
+            dest->type = HTYPE_INTEGER;
+            dest->v.integer = is_int ? iv : to_integer(d);
+        }
+        break;
+    case HTYPE_SCALAR:
+        if (!quoted && parse_number(tok, &d, &iv, &is_int)) {
+            dest->type = HTYPE_SCALAR;
+            dest->v.scalar = d;
+        }
+        break;
+    case HTYPE_BIT:
+    case HTYPE_BOOLEAN: {
+        uint32_t bits;
+        if (parse_bits(tok, &bits)) {
+            dest->type = (uint8_t)type;
+            dest->v.bits = bits;
+        }
+        break;
+    }
+    default:
+        dest->type = HTYPE_CHAR;
+        dest->v.string.len = (uint16_t)len;
+        memcpy(dest->v.string.data, tok, (size_t)len);
+        break;
+    }
+}
+
+/* READ list target type: XXAR TAG1, else the variable's current type */
+static int read_type(const halmat_val_t *a, uint8_t arg_type)
+{
+    switch (arg_type) {
+    case 2: return HTYPE_CHAR;
+    case 5: return HTYPE_SCALAR;
+    case 6: return HTYPE_INTEGER;
+    default:
+        switch (a->type) {
+        case HTYPE_CHAR: case HTYPE_SCALAR: case HTYPE_INTEGER:
+        case HTYPE_BIT:  case HTYPE_BOOLEAN:
+            return a->type;
+        }
+        return 0;
+    }
+}
+
+static void in_eof(in_unit_t *u, int channel)
+{
+    if (!u->warned) {
+        fprintf(stderr, "halmat_io: end of input on unit %d\n", channel);
+        u->warned = 1;
+    }
 }
 
 static FILE *unit_fp(halmat_t *H, int unit, const char *mode)
@@ -52,6 +626,8 @@ static FILE *unit_fp(halmat_t *H, int unit, const char *mode)
     if (u->fp) {
         /* Reopen if mode changed (e.g. "r" -> "w") */
         if (u->is_open && u->mode[0] && u->mode[0] != mode[0]) {
+            io_flush();
+            in_release(&in_units[unit]);
             fclose(u->fp);
             u->fp = fopen(u->path, mode);
             if (u->fp)
@@ -76,14 +652,179 @@ static FILE *unit_fp(halmat_t *H, int unit, const char *mode)
     return NULL;
 }
 
+/* ---- Random-access FILE records ----
+ *
+ * FILE(unit, n) transfers one value to or from record n of the unit's
+ * file as raw binary.  The file starts with an 8-byte header (magic and
+ * record length) and record n lives at 8 + n * reclen, so a transfer is
+ * a memcpy into the mapping.  The mapping grows in FILE_CHUNK steps; at
+ * shutdown it is msync'd and, if it grew, the file trimmed to the last
+ * record. */
+
+#define FILE_MAGIC   0x464D4C48u    /* "HLMF" */
+#define FILE_HDR     8
+#define FILE_CHUNK   (1u << 20)
+#define REC_HDR      8              /* type, rows, cols, 0, payload bytes */
+
+typedef struct {
+    int       inuse;                /* fd is open */
+    int       fd;
+    uint8_t  *map;
+    size_t    map_len;
+    size_t    used;                 /* header + records up to the last one */
+    uint32_t  reclen;
+    int       grown;                /* extended past its end, trim at close */
+} file_unit_t;
+
+static file_unit_t file_units[HALMAT_MAX_UNITS];
+
+/* Map the file, growing it in FILE_CHUNK steps if need is past its end */
+static int file_map(file_unit_t *f, size_t need)
+{
+    if (f->map) {
+        munmap(f->map, f->map_len);
+        f->map = NULL;
+    }
+    struct stat st;
+    if (fstat(f->fd, &st) != 0)
+        return HALMAT_ERR_IO;
+    size_t len = (size_t)st.st_size;
+    if (need > len) {
+        len = (need + FILE_CHUNK - 1) / FILE_CHUNK * FILE_CHUNK;
+        if (ftruncate(f->fd, (off_t)len) != 0)
+            return HALMAT_ERR_IO;
+        f->grown = 1;
+    }
+    void *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0);
+    if (m == MAP_FAILED)
+        return HALMAT_ERR_IO;
+    f->map = m;
+    f->map_len = len;
+    return 0;
+}
+
+/* An empty file gets the header; any other file must already have it,
+ * so a unit pointed at the wrong file is refused, not overwritten. */
+static file_unit_t *file_open(halmat_t *H, int unit)
+{
+    file_unit_t *f = &file_units[unit];
+    if (f->inuse)
+        return f;
+
+    const char *path = H->units[unit].path;
+    if (!path[0]) {
+        fprintf(stderr, "halmat_io: FILE unit %d has no file (use --unit)\n", unit);
+        return NULL;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "halmat_io: cannot open %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    uint32_t hdr[2];
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "halmat_io: cannot open %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size != 0 &&
+        (pread(fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+         hdr[0] != FILE_MAGIC)) {
+        fprintf(stderr, "halmat_io: %s is not a FILE unit file\n", path);
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size != 0 &&
+        (hdr[1] < HALMAT_FILE_RECLEN_MIN || hdr[1] > HALMAT_FILE_RECLEN_MAX)) {
+        fprintf(stderr, "halmat_io: %s has a bad record length (%u)\n",
+                path, hdr[1]);
+        close(fd);
+        return NULL;
+    }
+
+    f->inuse = 1;
+    f->fd = fd;
+    f->reclen = H->file_reclen ? H->file_reclen : HALMAT_FILE_RECLEN;
+    if (file_map(f, FILE_HDR) != 0) {
+        fprintf(stderr, "halmat_io: cannot map %s\n", path);
+        if (f->grown && ftruncate(fd, st.st_size) != 0)
+            fprintf(stderr, "halmat_io: cannot trim %s\n", path);
+        close(fd);
+        memset(f, 0, sizeof(*f));
+        return NULL;
+    }
+
+    if (st.st_size != 0) {
+        if (H->file_reclen && hdr[1] != H->file_reclen)
+            fprintf(stderr, "halmat_io: %s has %u-byte records, not %u\n",
+                    path, hdr[1], H->file_reclen);
+        f->reclen = hdr[1];
+        f->used = (size_t)st.st_size;
+    } else {
+        hdr[0] = FILE_MAGIC;
+        hdr[1] = f->reclen;
+        memcpy(f->map, hdr, sizeof(hdr));
+        f->used = FILE_HDR;
+    }
+    return f;
+}
+
+/* Only a file that was grown for writing is trimmed back */
+static void file_close(file_unit_t *f)
+{
+    if (!f->inuse)
+        return;
+    if (f->map) {
+        msync(f->map, f->map_len, MS_SYNC);
+        munmap(f->map, f->map_len);
+    }
+    if (f->grown && ftruncate(f->fd, (off_t)f->used) != 0)
+        fprintf(stderr, "halmat_io: cannot trim FILE unit\n");
+    close(f->fd);
+    memset(f, 0, sizeof(*f));
+}
+
 int halmat_io_init(halmat_t *H)
 {
-    (void)H;
+    aw.pool = malloc(IO_NBUFS * sizeof(io_buf_t));
+    if (!aw.pool) {
+        fprintf(stderr, "halmat_io: out of memory for output buffers\n");
+        return HALMAT_ERR_IO;
+    }
+    for (int i = 0; i < IO_NBUFS; i++) {
+        aw.pool[i].next = aw.free_list;
+        aw.free_list = &aw.pool[i];
+    }
+    pthread_mutex_init(&aw.lock, NULL);
+    pthread_cond_init(&aw.work, NULL);
+    pthread_cond_init(&aw.space, NULL);
+    pthread_cond_init(&aw.idle, NULL);
+    if (!H->sync_io)
+        aw.threaded = (pthread_create(&aw.thread, NULL, writer_main, NULL) == 0);
     return 0;
 }
 
 void halmat_io_shutdown(halmat_t *H)
 {
+    if (aw.pool) {
+        io_flush();
+        if (aw.threaded) {
+            pthread_mutex_lock(&aw.lock);
+            aw.stop = 1;
+            pthread_cond_signal(&aw.work);
+            pthread_mutex_unlock(&aw.lock);
+            pthread_join(aw.thread, NULL);
+            aw.threaded = 0;
+        }
+        free(aw.pool);
+        aw.pool = NULL;
+        aw.free_list = NULL;
+    }
+    for (int s = 0; s < IO_NSTAGE; s++)
+        in_release(&in_units[s]);
+    for (int i = 0; i < HALMAT_MAX_UNITS; i++)
+        file_close(&file_units[i]);
     for (int i = 0; i < HALMAT_MAX_UNITS; i++) {
         if (H->units[i].is_open && H->units[i].fp) {
             fclose(H->units[i].fp);
@@ -93,80 +834,258 @@ void halmat_io_shutdown(halmat_t *H)
     }
 }
 
-static void write_char(halmat_t *H, FILE *fp, const char *data, int len)
+/* Bytes a WRITE argument takes in the staging buffer */
+static uint32_t staged_size(const halmat_val_t *a, int type)
 {
-    if (H->translate_ebcdic) {
-        char buf[256];
-        while (len > 0) {
-            int chunk = (len > 256) ? 256 : len;
-            memcpy(buf, data, chunk);
-            translate_buf(buf, chunk, ebcdic_to_ascii);
-            fprintf(fp, "%.*s", chunk, buf);
-            data += chunk;
-            len -= chunk;
-        }
-    } else {
-        fprintf(fp, "%.*s", len, data);
+    switch (type) {
+    case 2: return (a->type == HTYPE_CHAR) ? 3u + a->v.string.len : 0;
+    case 5: return 9;
+    case 6: return 5;
+    default:
+        if (a->type == HTYPE_INTEGER) return 5;
+        if (a->type == HTYPE_SCALAR)  return 9;
+        if (a->type == HTYPE_CHAR)    return 3u + a->v.string.len;
+        return 0;
     }
 }
 
+static void stage_char(io_buf_t *b, const char *s, uint16_t len)
+{
+    uint8_t *p = b->data + b->len;
+    *p++ = REC_CHAR;
+    memcpy(p, &len, 2);
+    memcpy(p + 2, s, len);
+    b->len += 3u + len;
+}
+
+static void stage_scalar(io_buf_t *b, double v)
+{
+    b->data[b->len] = REC_SCALAR;
+    memcpy(b->data + b->len + 1, &v, 8);
+    b->len += 9;
+}
+
+static void stage_int(io_buf_t *b, int32_t v)
+{
+    b->data[b->len] = REC_INT;
+    memcpy(b->data + b->len + 1, &v, 4);
+    b->len += 5;
+}
+
 int halmat_io_write(halmat_t *H, int channel, halmat_val_t *args,
                     uint8_t *arg_types, int nargs)
 {
     FILE *fp = unit_fp(H, channel, "w");
     if (!fp) fp = stdout;
+    int s = (channel >= 0 && channel < HALMAT_MAX_UNITS) ? channel
+                                                          : HALMAT_MAX_UNITS;
+
+    uint32_t need = 1;
+    for (int i = 0; i < nargs; i++)
+        need += staged_size(&args[i], arg_types[i]);
+
+    pthread_mutex_lock(&aw.lock);
+    /* Units sharing a stream: what they staged goes out first, in order */
+    for (int t = 0; t < IO_NSTAGE; t++) {
+        if (t != s && aw.stage[t] && aw.stage[t]->fp == fp) {
+            submit(aw.stage[t]);
+            aw.stage[t] = NULL;
+        }
+    }
+    io_buf_t *b = aw.stage[s];
+    if (b && (b->fp != fp || b->len + need > IO_BUF_BYTES)) {
+        submit(b);
+        b = NULL;
+    }
+    if (!b) {
+        while (!aw.free_list)
+            pthread_cond_wait(&aw.space, &aw.lock);
+        b = aw.free_list;
+        aw.free_list = b->next;
+        b->fp = fp;
+        b->ebcdic = (s < HALMAT_MAX_UNITS && H->units[s].ebcdic);
+        b->len = 0;
+        aw.stage[s] = b;
+    }
 
     for (int i = 0; i < nargs; i++) {
+        halmat_val_t *a = &args[i];
         switch (arg_types[i]) {
         case 2:
-            if (args[i].type == HTYPE_CHAR)
-                write_char(H, fp, args[i].v.string.data, (int)args[i].v.string.len);
+            if (a->type == HTYPE_CHAR)
+                stage_char(b, a->v.string.data, a->v.string.len);
             break;
-        case 5: {
-            double v = (args[i].type == HTYPE_INTEGER)
-                       ? (double)args[i].v.integer : args[i].v.scalar;
-            if (v == 0.0)
-                fprintf(fp, " 0.0");
-            else
-                fprintf(fp, "% .7E", v);
+        case 5:
+            stage_scalar(b, (a->type == HTYPE_INTEGER) ? (double)a->v.integer
+                                                       : a->v.scalar);
             break;
-        }
-        case 6: {
-            int32_t v = (args[i].type == HTYPE_INTEGER)
-                        ? args[i].v.integer : (int32_t)args[i].v.scalar;
-            fprintf(fp, "%11d", v);
+        case 6:
+            stage_int(b, (a->type == HTYPE_INTEGER) ? a->v.integer
+                                                    : (int32_t)a->v.scalar);
             break;
-        }
         default:
-            if (args[i].type == HTYPE_INTEGER)
-                fprintf(fp, "%11d", args[i].v.integer);
-            else if (args[i].type == HTYPE_SCALAR) {
-                if (args[i].v.scalar == 0.0)
-                    fprintf(fp, " 0.0");
-                else
-                    fprintf(fp, "% .7E", args[i].v.scalar);
-            } else if (args[i].type == HTYPE_CHAR)
-                write_char(H, fp, args[i].v.string.data, (int)args[i].v.string.len);
+            if (a->type == HTYPE_INTEGER)
+                stage_int(b, a->v.integer);
+            else if (a->type == HTYPE_SCALAR)
+                stage_scalar(b, a->v.scalar);
+            else if (a->type == HTYPE_CHAR)
+                stage_char(b, a->v.string.data, a->v.string.len);
             break;
         }
     }
-    fprintf(fp, "\n");
+    b->data[b->len++] = REC_EOL;
+
+    if (!aw.threaded) {
+        submit(b);
+        aw.stage[s] = NULL;
+    }
+    pthread_mutex_unlock(&aw.lock);
     return 0;
 }
 
-int halmat_io_read(halmat_t *H, int channel, halmat_val_t *dest)
+/* READ: one field per list item, converted to the item's type.  Items
+ * whose field is null or missing keep their value.  Returns the number
+ * of items read. */
+int halmat_io_read(halmat_t *H, int channel, halmat_val_t *args,
+                   uint8_t *arg_types, int nargs)
 {
+    io_flush();
     FILE *fp = unit_fp(H, channel, "r");
     if (!fp) fp = stdin;
+    int s = (channel >= 0 && channel < HALMAT_MAX_UNITS) ? channel
+                                                          : HALMAT_MAX_UNITS;
+    in_unit_t *u = in_attach(s, fp, s < HALMAT_MAX_UNITS && H->units[s].ebcdic);
+    char tok[IN_TOKEN_MAX + 1];
+    int nread = 0;
 
-    dest->type = HTYPE_INTEGER;
-    if (fscanf(fp, "%d", &dest->v.integer) != 1)
-        dest->v.integer = 0;
-    return 0;
+    in_next_record(u);
+    for (int i = 0; i < nargs; i++) {
+        int len, quoted;
+        int f = in_field(u, tok, IN_TOKEN_MAX, &len, &quoted);
+        if (f == FIELD_END) {
+            if (in_peek(u) < 0)
+                in_eof(u, channel);
+            break;
+        }
+        if (f == FIELD_TOKEN) {
+            store_field(&args[i], read_type(&args[i], arg_types[i]),
+                        tok, len, quoted);
+            nread++;
+        }
+    }
+    return nread;
+}
+
+/* READALL: each CHARACTER item takes one whole record as it stands */
+int halmat_io_read_all(halmat_t *H, int channel, halmat_val_t *args,
+                       uint8_t *arg_types, int nargs)
+{
+    io_flush();
+    FILE *fp = unit_fp(H, channel, "r");
+    if (!fp) fp = stdin;
+    int s = (channel >= 0 && channel < HALMAT_MAX_UNITS) ? channel
+                                                          : HALMAT_MAX_UNITS;
+    in_unit_t *u = in_attach(s, fp, s < HALMAT_MAX_UNITS && H->units[s].ebcdic);
+    int nread = 0;
+
+    in_next_record(u);
+    for (int i = 0; i < nargs; i++) {
+        int c = in_peek(u);
+        if (c < 0) {
+            in_eof(u, channel);
+            break;
+        }
+        halmat_val_t *a = &args[i];
+        int take = (read_type(a, arg_types[i]) == HTYPE_CHAR ||
+                    read_type(a, arg_types[i]) == 0);
+        uint16_t n = 0;
+        while ((c = in_peek(u)) >= 0) {
+            u->pos++;
+            if (c == '\n')
+                break;
+            if (take && n < sizeof(a->v.string.data))
+                a->v.string.data[n++] = (char)c;
+        }
+        if (n && a->v.string.data[n - 1] == '\r')
+            n--;
+        if (take) {
+            a->type = HTYPE_CHAR;
+            a->v.string.len = n;
+            nread++;
+        }
+        u->bol = 1;
+    }
+    return nread;
 }
 
-int halmat_io_file(halmat_t *H, int unit, int op, void *buf, int len)
+static uint32_t payload_size(const halmat_val_t *v)
 {
-    (void)H; (void)unit; (void)op; (void)buf; (void)len;
+    switch (v->type) {
+    case HTYPE_CHAR:
+        return v->v.string.len;
+    case HTYPE_SCALAR:
+        return 8;
+    case HTYPE_VECTOR:
+    case HTYPE_MATRIX: {
+        uint32_t n = (uint32_t)v->rows * (v->cols ? v->cols : 1);
+        return 8 * (n > 64 ? 64 : n);
+    }
+    default:
+        return 4;
+    }
+}
+
+int halmat_io_file(halmat_t *H, int unit, uint32_t record, int op,
+                   halmat_val_t *val)
+{
+    if (unit < 0 || unit >= HALMAT_MAX_UNITS)
+        return HALMAT_ERR_IO;
+    file_unit_t *f = file_open(H, unit);
+    if (!f)
+        return HALMAT_ERR_IO;
+
+    size_t off = FILE_HDR + (size_t)record * f->reclen;
+    size_t end = off + f->reclen;
+    uint8_t *rec;
+
+    if (op == HALMAT_FILE_WRITE) {
+        uint32_t n = payload_size(val);
+        if (REC_HDR + n > f->reclen) {
+            fprintf(stderr, "halmat_io: FILE(%d,%u): %u-byte value exceeds "
+                    "%u-byte record\n", unit, record, n, f->reclen);
+            return HALMAT_ERR_IO;
+        }
+        if (end > f->map_len && file_map(f, end) != 0) {
+            fprintf(stderr, "halmat_io: cannot extend FILE unit %d\n", unit);
+            return HALMAT_ERR_IO;
+        }
+        rec = f->map + off;
+        rec[0] = val->type;
+        rec[1] = val->rows;
+        rec[2] = val->cols;
+        rec[3] = 0;
+        memcpy(rec + 4, &n, 4);
+        memcpy(rec + REC_HDR, &val->v, n);
+        if (end > f->used)
+            f->used = end;
+        return 0;
+    }
+
+    rec = f->map + off;
+    if (end > f->used || rec[0] == HTYPE_NONE) {
+        fprintf(stderr, "halmat_io: FILE(%d,%u): no such record\n", unit, record);
+        return HALMAT_ERR_IO;
+    }
+    uint32_t n;
+    memcpy(&n, rec + 4, 4);
+    if (n > sizeof(val->v) || REC_HDR + n > f->reclen)
+        return HALMAT_ERR_IO;
+    memset(val, 0, sizeof(*val));
+    val->type = rec[0];
+    val->rows = rec[1];
+    val->cols = rec[2];
+    memcpy(&val->v, rec + REC_HDR, n);
+    if (val->type == HTYPE_CHAR)
+        val->v.string.len = (uint16_t)n;
     return 0;
 }
@@ -9,7 +9,21 @@ int  halmat_io_init(halmat_t *H);
 void halmat_io_shutdown(halmat_t *H);
 int  halmat_io_write(halmat_t *H, int channel, halmat_val_t *args,
                      uint8_t *arg_types, int nargs);
-int  halmat_io_read(halmat_t *H, int channel, halmat_val_t *dest);
-int  halmat_io_file(halmat_t *H, int unit, int op, void *buf, int len);
+/* READ/READALL fill args in place (typed by arg_types / current value)
+ * and return how many items were read */
+int  halmat_io_read(halmat_t *H, int channel, halmat_val_t *args,
+                    uint8_t *arg_types, int nargs);
+int  halmat_io_read_all(halmat_t *H, int channel, halmat_val_t *args,
+                        uint8_t *arg_types, int nargs);
+
+/* FILE(unit, record): one value per fixed-length binary record */
+#define HALMAT_FILE_READ    0
+#define HALMAT_FILE_WRITE   1
+#define HALMAT_FILE_RECLEN  520     /* default: 8-byte header + 64 doubles */
+#define HALMAT_FILE_RECLEN_MIN  12  /* header + one INTEGER */
+#define HALMAT_FILE_RECLEN_MAX  (1u << 20)
+
+int  halmat_io_file(halmat_t *H, int unit, uint32_t record, int op,
+                    halmat_val_t *val);
 
 #endif /* HALMAT_IO_H */
@@ -11,14 +11,24 @@ int halmat_io_write(halmat_t *H, int channel, halmat_val_t *args,
     return 0;
 }
 
-int halmat_io_read(halmat_t *H, int channel, halmat_val_t *dest)
+int halmat_io_read(halmat_t *H, int channel, halmat_val_t *args,
+                   uint8_t *arg_types, int nargs)
 {
-    (void)H; (void)channel; (void)dest;
+    (void)H; (void)channel; (void)args; (void)arg_types; (void)nargs;
     return 0;
 }
 
-int halmat_io_file(halmat_t *H, int unit, int op, void *buf, int len)
+int halmat_io_read_all(halmat_t *H, int channel, halmat_val_t *args,
+                       uint8_t *arg_types, int nargs)
 {
-    (void)H; (void)unit; (void)op; (void)buf; (void)len;
+    (void)H; (void)channel; (void)args; (void)arg_types; (void)nargs;
     return 0;
 }
+
+/* Writes vanish; there is no record to read */
+int halmat_io_file(halmat_t *H, int unit, uint32_t record, int op,
+                   halmat_val_t *val)
+{
+    (void)H; (void)unit; (void)record; (void)val;
+    return op == HALMAT_FILE_WRITE ? 0 : HALMAT_ERR_IO;
+}
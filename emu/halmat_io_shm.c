@@ -0,0 +1,206 @@
+/* Shared-memory I/O for yaHALMAT-shm: link in place of halmat_io.o.
+ * WRITE values go to the unit's out ring as binary records, READ takes
+ * them from the in ring.  Segment name from $HALMAT_SHM, default
+ * HALMAT_SHM_DEFAULT; the host normally creates it first. */
+
+#define _POSIX_C_SOURCE 200809L
+#include "halmat.h"
+#include "halmat_io.h"
+#include "halmat_sched.h"
+#include "halmat_shm.h"
+
+static halmat_shm_t *shm;
+static const char   *shm_name;
+
+int halmat_io_init(halmat_t *H)
+{
+    (void)H;
+    shm_name = getenv("HALMAT_SHM");
+    if (!shm_name || !shm_name[0])
+        shm_name = HALMAT_SHM_DEFAULT;
+
+    shm = halmat_shm_open(shm_name, 0);
+    if (!shm)
+        shm = halmat_shm_open(shm_name, 1);
+    if (!shm)
+        return HALMAT_ERR_IO;
+    halmat_shm_set_state(&shm->emu, SHM_STATE_RUNNING);
+    return 0;
+}
+
+void halmat_io_shutdown(halmat_t *H)
+{
+    (void)H;
+    if (!shm)
+        return;
+    halmat_shm_set_state(&shm->emu, SHM_STATE_DONE);
+    halmat_shm_close(shm, shm_name, 0);     /* the host unlinks */
+    shm = NULL;
+}
+
+static uint64_t stamp(halmat_t *H)
+{
+    return (uint64_t)(halmat_sched_clock(H) * 1e6 + 0.5);
+}
+
+/* A wait that ended without its record: the host is done or has gone */
+static int host_lost(int rc)
+{
+    fprintf(stderr, "halmat_io_shm: host %s\n",
+            rc == 0 ? "stopped reading" : "exited without closing the channel");
+    return HALMAT_ERR_IO;
+}
+
+static int put(halmat_shm_ring_t *r, const halmat_shm_rec_t *rec)
+{
+    int rc = halmat_shm_put_wait(r, rec, &shm->host);
+    return rc == 1 ? 0 : host_lost(rc);
+}
+
+static int put_char(halmat_shm_ring_t *r, halmat_shm_rec_t *rec,
+                    const char *s, int len)
+{
+    rec->kind = SHM_REC_CHAR;
+    do {
+        int chunk = len > HALMAT_SHM_PAYLOAD ? HALMAT_SHM_PAYLOAD : len;
+        rec->len = (uint16_t)chunk;
+        rec->flags = (len > chunk) ? SHM_F_MORE : 0;
+        memcpy(rec->v.chars, s, (size_t)chunk);
+        if (put(r, rec) != 0)
+            return HALMAT_ERR_IO;
+        s += chunk;
+        len -= chunk;
+    } while (len > 0);
+    return 0;
+}
+
+int halmat_io_write(halmat_t *H, int channel, halmat_val_t *args,
+                    uint8_t *arg_types, int nargs)
+{
+    if (!shm || channel < 0 || channel >= HALMAT_SHM_UNITS)
+        return HALMAT_ERR_IO;
+    halmat_shm_ring_t *r = &shm->out[channel];
+    halmat_shm_rec_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.stamp_us = stamp(H);
+
+    for (int i = 0; i < nargs; i++) {
+        halmat_val_t *a = &args[i];
+        int type = arg_types[i] ? arg_types[i] : a->type;
+        rec.flags = 0;
+        rec.len = 0;
+        switch (type) {
+        case HTYPE_CHAR:
+            if (a->type == HTYPE_CHAR &&
+                put_char(r, &rec, a->v.string.data, (int)a->v.string.len) != 0)
+                return HALMAT_ERR_IO;
+            continue;
+        case HTYPE_SCALAR:
+            rec.kind = SHM_REC_SCALAR;
+            rec.v.scalar = (a->type == HTYPE_INTEGER) ? (double)a->v.integer
+                                                      : a->v.scalar;
+            break;
+        case HTYPE_INTEGER:
+            rec.kind = SHM_REC_INT;
+            rec.v.integer = (a->type == HTYPE_INTEGER) ? a->v.integer
+                                                       : (int32_t)a->v.scalar;
+            break;
+        case HTYPE_BIT:
+        case HTYPE_BOOLEAN:
+        case HTYPE_EVENT:
+            rec.kind = SHM_REC_BIT;
+            rec.v.bits = a->v.bits;
+            break;
+        default:
+            continue;
+        }
+        if (put(r, &rec) != 0)
+            return HALMAT_ERR_IO;
+    }
+
+    memset(&rec.v, 0, sizeof(rec.v));
+    rec.kind = SHM_REC_EOL;
+    rec.flags = 0;
+    rec.len = 0;
+    return put(r, &rec);
+}
+
+/* Next value record for the unit, converted to dest->type (or taken as
+ * sent when the destination type is not known).  End-of-line records
+ * separate host input records and are skipped.  0 once the host is done
+ * and the ring is empty, -1 if the host has gone. */
+static int read_value(halmat_shm_ring_t *r, halmat_val_t *dest)
+{
+    halmat_shm_rec_t rec;
+    int rc;
+
+    do {
+        if ((rc = halmat_shm_get_wait(r, &rec, &shm->host)) != 1)
+            return rc;
+    } while (rec.kind == SHM_REC_EOL);
+
+    int want = dest->type;
+    switch (rec.kind) {
+    case SHM_REC_INT:
+        if (want == HTYPE_SCALAR) dest->v.scalar = rec.v.integer;
+        else { dest->type = HTYPE_INTEGER; dest->v.integer = rec.v.integer; }
+        break;
+    case SHM_REC_SCALAR:
+        if (want == HTYPE_INTEGER) dest->v.integer = (int32_t)rec.v.scalar;
+        else { dest->type = HTYPE_SCALAR; dest->v.scalar = rec.v.scalar; }
+        break;
+    case SHM_REC_BIT:
+        dest->type = HTYPE_BIT;
+        dest->v.bits = rec.v.bits;
+        break;
+    case SHM_REC_CHAR: {
+        uint16_t len = 0;
+        for (;;) {
+            int n = rec.len;
+            if (len + n > (int)sizeof(dest->v.string.data))
+                n = (int)sizeof(dest->v.string.data) - len;
+            memcpy(dest->v.string.data + len, rec.v.chars, (size_t)n);
+            len = (uint16_t)(len + n);
+            if (!(rec.flags & SHM_F_MORE))
+                break;
+            if ((rc = halmat_shm_get_wait(r, &rec, &shm->host)) != 1) {
+                if (rc < 0)
+                    return rc;
+                break;
+            }
+        }
+        dest->type = HTYPE_CHAR;
+        dest->v.string.len = len;
+        break;
+    }
+    }
+    return 1;
+}
+
+int halmat_io_read(halmat_t *H, int channel, halmat_val_t *args,
+                   uint8_t *arg_types, int nargs)
+{
+    (void)H; (void)arg_types;
+    if (!shm || channel < 0 || channel >= HALMAT_SHM_UNITS)
+        return HALMAT_ERR_IO;
+    int i, rc = 1;
+    for (i = 0; i < nargs; i++)
+        if ((rc = read_value(&shm->in[channel], &args[i])) != 1)
+            break;
+    return rc < 0 ? host_lost(rc) : i;
+}
+
+/* Records arrive already split, so READALL is READ without conversion */
+int halmat_io_read_all(halmat_t *H, int channel, halmat_val_t *args,
+                       uint8_t *arg_types, int nargs)
+{
+    return halmat_io_read(H, channel, args, arg_types, nargs);
+}
+
+/* No record files over shared memory: writes are dropped, reads fail */
+int halmat_io_file(halmat_t *H, int unit, uint32_t record, int op,
+                   halmat_val_t *val)
+{
+    (void)H; (void)unit; (void)record; (void)val;
+    return op == HALMAT_FILE_WRITE ? 0 : HALMAT_ERR_IO;
+}
@@ -1,4 +1,5 @@
 #include "halmat.h"
+#include "halmat_ebcdic.h"
 
 static uint32_t read_be32(FILE *fp)
 {
@@ -12,6 +13,10 @@ static uint32_t read_be32(FILE *fp)
 void halmat_init(halmat_t *H)
 {
     memset(H, 0, sizeof(*H));
+    H->code = H->code_store;
+    H->syt = H->syt_store;
+    H->data = H->data_store;
+    H->units = H->unit_store;
 }
 
 int halmat_load(halmat_t *H, const char *filename)
@@ -204,6 +209,34 @@ int halmat_load_strings(halmat_t *H, const char *source_file)
     return 0;
 }
 
+/* --ebcdic: the string bytes packed in the literal table are EBCDIC.
+ * Decode each CHAR literal not already recovered from source into the
+ * string pool as ASCII, so nothing is translated at run time. */
+void halmat_transcode_literals(halmat_t *H)
+{
+    char buf[260];
+    int  len;
+
+    for (uint32_t i = 0; i < H->lit_count; i++) {
+        if (H->lit[i].lit1 != 0 || H->lit[i].lit2 == 0)
+            continue;
+        if (H->lit_str_off[i] > 0 && H->lit_str_len[i] > 0)
+            continue;                       /* source text is ASCII already */
+
+        halmat_decode_char_lit(H, i, buf, &len);
+        uint32_t off = H->lit_str_pool_used ? H->lit_str_pool_used : 1;
+        if (off + (uint32_t)len + 1 > HALMAT_LIT_STR_POOL) {
+            fprintf(stderr, "halmat_transcode_literals: string pool full\n");
+            return;
+        }
+        halmat_ebcdic_to_ascii(H->lit_str_pool + off, buf, (size_t)len);
+        H->lit_str_pool[off + len] = '\0';
+        H->lit_str_off[i] = (uint16_t)off;
+        H->lit_str_len[i] = (uint16_t)len;
+        H->lit_str_pool_used = off + (uint32_t)len + 1;
+    }
+}
+
 void halmat_decode_char_lit(halmat_t *H, uint32_t lit_idx, char *buf, int *len)
 {
     if (lit_idx >= H->lit_count) {
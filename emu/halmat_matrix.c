@@ -0,0 +1,410 @@
+#include <math.h>
+#include <string.h>
+#include "halmat_matrix.h"
+
+/* Two doubles per register: SSE2 on x86-64, NEON on AArch64; GCC lowers
+ * the type to scalar code anywhere else.  halmat_val_t only guarantees
+ * 8-byte alignment, so loads and stores go through memcpy. */
+typedef double v2d __attribute__((vector_size(16)));
+
+static inline v2d ld2(const double *p)
+{
+    v2d x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline void st2(double *p, v2d x)
+{
+    memcpy(p, &x, sizeof(x));
+}
+
+static inline v2d dup2(double s)
+{
+    v2d x = { s, s };
+    return x;
+}
+
+/* ---- Products ---- */
+
+static void mul3(double *r, const double *a, const double *b)
+{
+    for (int i = 0; i < 3; i++) {
+        double a0 = a[3 * i], a1 = a[3 * i + 1], a2 = a[3 * i + 2];
+        r[3 * i]     = a0 * b[0] + a1 * b[3] + a2 * b[6];
+        r[3 * i + 1] = a0 * b[1] + a1 * b[4] + a2 * b[7];
+        r[3 * i + 2] = a0 * b[2] + a1 * b[5] + a2 * b[8];
+    }
+}
+
+/* Row i of r is a linear combination of the rows of b */
+static void mul4(double *r, const double *a, const double *b)
+{
+    v2d b0l = ld2(b),      b0h = ld2(b + 2);
+    v2d b1l = ld2(b + 4),  b1h = ld2(b + 6);
+    v2d b2l = ld2(b + 8),  b2h = ld2(b + 10);
+    v2d b3l = ld2(b + 12), b3h = ld2(b + 14);
+
+    for (int i = 0; i < 4; i++) {
+        v2d x0 = dup2(a[4 * i]),     x1 = dup2(a[4 * i + 1]);
+        v2d x2 = dup2(a[4 * i + 2]), x3 = dup2(a[4 * i + 3]);
+        st2(r + 4 * i,     x0 * b0l + x1 * b1l + x2 * b2l + x3 * b3l);
+        st2(r + 4 * i + 2, x0 * b0h + x1 * b1h + x2 * b2h + x3 * b3h);
+    }
+}
+
+static void mul6(double *r, const double *a, const double *b)
+{
+    v2d bv[6][3];
+    for (int k = 0; k < 6; k++)
+        for (int j = 0; j < 3; j++)
+            bv[k][j] = ld2(b + 6 * k + 2 * j);
+
+    for (int i = 0; i < 6; i++) {
+        v2d s0 = dup2(0), s1 = dup2(0), s2 = dup2(0);
+        for (int k = 0; k < 6; k++) {
+            v2d x = dup2(a[6 * i + k]);
+            s0 += x * bv[k][0];
+            s1 += x * bv[k][1];
+            s2 += x * bv[k][2];
+        }
+        st2(r + 6 * i,     s0);
+        st2(r + 6 * i + 2, s1);
+        st2(r + 6 * i + 4, s2);
+    }
+}
+
+void halmat_mat_mul(double *r, const double *a, const double *b,
+                    int n, int m, int p)
+{
+    if (n == m && m == p) {
+        switch (n) {
+        case 3: mul3(r, a, b); return;
+        case 4: mul4(r, a, b); return;
+        case 6: mul6(r, a, b); return;
+        }
+    }
+    /* i-k-j order: the inner loop is a contiguous axpy */
+    for (int i = 0; i < n; i++) {
+        double *ri = r + i * p;
+        for (int j = 0; j < p; j++)
+            ri[j] = 0.0;
+        for (int k = 0; k < m; k++) {
+            double aik = a[i * m + k];
+            const double *bk = b + k * p;
+            for (int j = 0; j < p; j++)
+                ri[j] += aik * bk[j];
+        }
+    }
+}
+
+/* The transposed forms sum over k in the same order as halmat_mat_mul,
+ * so a fused transpose-multiply rounds exactly like MTRA then MMPR */
+void halmat_mat_mul_tn(double *r, const double *a, const double *b,
+                       int n, int m, int p)
+{
+    for (int i = 0; i < n * p; i++)
+        r[i] = 0.0;
+    for (int k = 0; k < m; k++) {
+        const double *ak = a + k * n;
+        const double *bk = b + k * p;
+        for (int i = 0; i < n; i++) {
+            double aki = ak[i];
+            double *ri = r + i * p;
+            for (int j = 0; j < p; j++)
+                ri[j] += aki * bk[j];
+        }
+    }
+}
+
+void halmat_mat_mul_nt(double *r, const double *a, const double *b,
+                       int n, int m, int p)
+{
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < p; j++) {
+            double s = 0.0;
+            for (int k = 0; k < m; k++)
+                s += a[i * m + k] * b[j * m + k];
+            r[i * p + j] = s;
+        }
+}
+
+void halmat_mat_vec(double *r, const double *a, const double *v, int n, int m)
+{
+    if (n == 3 && m == 3) {
+        r[0] = a[0] * v[0] + a[1] * v[1] + a[2] * v[2];
+        r[1] = a[3] * v[0] + a[4] * v[1] + a[5] * v[2];
+        r[2] = a[6] * v[0] + a[7] * v[1] + a[8] * v[2];
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        double s = 0.0;
+        for (int k = 0; k < m; k++)
+            s += a[i * m + k] * v[k];
+        r[i] = s;
+    }
+}
+
+void halmat_vec_mat(double *r, const double *v, const double *a, int n, int m)
+{
+    if (n == 3 && m == 3) {
+        r[0] = v[0] * a[0] + v[1] * a[3] + v[2] * a[6];
+        r[1] = v[0] * a[1] + v[1] * a[4] + v[2] * a[7];
+        r[2] = v[0] * a[2] + v[1] * a[5] + v[2] * a[8];
+        return;
+    }
+    for (int j = 0; j < m; j++)
+        r[j] = 0.0;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            r[j] += v[i] * a[i * m + j];
+}
+
+void halmat_vec_outer(double *r, const double *a, const double *b, int n, int m)
+{
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            r[i * m + j] = a[i] * b[j];
+}
+
+void halmat_mat_transpose(double *r, const double *a, int n, int m)
+{
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < m; j++)
+            r[j * n + i] = a[i * m + j];
+}
+
+/* Two partial sums, one per lane */
+double halmat_vec_dot(const double *a, const double *b, int n)
+{
+    v2d s = dup2(0);
+    int i = 0;
+    for (; i + 2 <= n; i += 2)
+        s += ld2(a + i) * ld2(b + i);
+    double d = s[0] + s[1];
+    for (; i < n; i++)
+        d += a[i] * b[i];
+    return d;
+}
+
+void halmat_mat_identity(double *r, int n)
+{
+    memset(r, 0, sizeof(double) * (size_t)(n * n));
+    for (int i = 0; i < n; i++)
+        r[i * n + i] = 1.0;
+}
+
+/* ---- Determinant and inverse ---- */
+
+static double det3(const double *a)
+{
+    return a[0] * (a[4] * a[8] - a[5] * a[7])
+         - a[1] * (a[3] * a[8] - a[5] * a[6])
+         + a[2] * (a[3] * a[7] - a[4] * a[6]);
+}
+
+/* 2x2 minors of the top (s) and bottom (c) row pairs, shared by the
+ * 4x4 determinant and inverse */
+typedef struct { double s[6], c[6]; } minors4_t;
+
+static double minors4(const double *a, minors4_t *m)
+{
+    m->s[0] = a[0] * a[5] - a[4] * a[1];
+    m->s[1] = a[0] * a[6] - a[4] * a[2];
+    m->s[2] = a[0] * a[7] - a[4] * a[3];
+    m->s[3] = a[1] * a[6] - a[5] * a[2];
+    m->s[4] = a[1] * a[7] - a[5] * a[3];
+    m->s[5] = a[2] * a[7] - a[6] * a[3];
+    m->c[5] = a[10] * a[15] - a[14] * a[11];
+    m->c[4] = a[9]  * a[15] - a[13] * a[11];
+    m->c[3] = a[9]  * a[14] - a[13] * a[10];
+    m->c[2] = a[8]  * a[15] - a[12] * a[11];
+    m->c[1] = a[8]  * a[14] - a[12] * a[10];
+    m->c[0] = a[8]  * a[13] - a[12] * a[9];
+    return m->s[0] * m->c[5] - m->s[1] * m->c[4] + m->s[2] * m->c[3]
+         + m->s[3] * m->c[2] - m->s[4] * m->c[1] + m->s[5] * m->c[0];
+}
+
+/* LU with partial pivoting on a copy */
+static double det_lu(const double *a, int n)
+{
+    double w[HALMAT_MAT_MAX * HALMAT_MAT_MAX];
+    double det = 1.0;
+    memcpy(w, a, sizeof(double) * (size_t)(n * n));
+
+    for (int k = 0; k < n; k++) {
+        int piv = k;
+        for (int i = k + 1; i < n; i++)
+            if (fabs(w[i * n + k]) > fabs(w[piv * n + k]))
+                piv = i;
+        if (w[piv * n + k] == 0.0)
+            return 0.0;
+        if (piv != k) {
+            for (int j = 0; j < n; j++) {
+                double t = w[k * n + j];
+                w[k * n + j] = w[piv * n + j];
+                w[piv * n + j] = t;
+            }
+            det = -det;
+        }
+        double p = w[k * n + k];
+        det *= p;
+        for (int i = k + 1; i < n; i++) {
+            double f = w[i * n + k] / p;
+            for (int j = k + 1; j < n; j++)
+                w[i * n + j] -= f * w[k * n + j];
+        }
+    }
+    return det;
+}
+
+double halmat_mat_det(const double *a, int n)
+{
+    minors4_t m;
+    switch (n) {
+    case 0:  return 1.0;
+    case 1:  return a[0];
+    case 2:  return a[0] * a[3] - a[1] * a[2];
+    case 3:  return det3(a);
+    case 4:  return minors4(a, &m);
+    default: return det_lu(a, n);
+    }
+}
+
+static int inv3(double *r, const double *a)
+{
+    double d = det3(a);
+    if (d == 0.0)
+        return -1;
+    double k = 1.0 / d;
+    r[0] = (a[4] * a[8] - a[5] * a[7]) * k;
+    r[1] = (a[2] * a[7] - a[1] * a[8]) * k;
+    r[2] = (a[1] * a[5] - a[2] * a[4]) * k;
+    r[3] = (a[5] * a[6] - a[3] * a[8]) * k;
+    r[4] = (a[0] * a[8] - a[2] * a[6]) * k;
+    r[5] = (a[2] * a[3] - a[0] * a[5]) * k;
+    r[6] = (a[3] * a[7] - a[4] * a[6]) * k;
+    r[7] = (a[1] * a[6] - a[0] * a[7]) * k;
+    r[8] = (a[0] * a[4] - a[1] * a[3]) * k;
+    return 0;
+}
+
+static int inv4(double *r, const double *a)
+{
+    minors4_t m;
+    double d = minors4(a, &m);
+    if (d == 0.0)
+        return -1;
+    double k = 1.0 / d;
+    const double *s = m.s, *c = m.c;
+    r[0]  = ( a[5]  * c[5] - a[6]  * c[4] + a[7]  * c[3]) * k;
+    r[1]  = (-a[1]  * c[5] + a[2]  * c[4] - a[3]  * c[3]) * k;
+    r[2]  = ( a[13] * s[5] - a[14] * s[4] + a[15] * s[3]) * k;
+    r[3]  = (-a[9]  * s[5] + a[10] * s[4] - a[11] * s[3]) * k;
+    r[4]  = (-a[4]  * c[5] + a[6]  * c[2] - a[7]  * c[1]) * k;
+    r[5]  = ( a[0]  * c[5] - a[2]  * c[2] + a[3]  * c[1]) * k;
+    r[6]  = (-a[12] * s[5] + a[14] * s[2] - a[15] * s[1]) * k;
+    r[7]  = ( a[8]  * s[5] - a[10] * s[2] + a[11] * s[1]) * k;
+    r[8]  = ( a[4]  * c[4] - a[5]  * c[2] + a[7]  * c[0]) * k;
+    r[9]  = (-a[0]  * c[4] + a[1]  * c[2] - a[3]  * c[0]) * k;
+    r[10] = ( a[12] * s[4] - a[13] * s[2] + a[15] * s[0]) * k;
+    r[11] = (-a[8]  * s[4] + a[9]  * s[2] - a[11] * s[0]) * k;
+    r[12] = (-a[4]  * c[3] + a[5]  * c[1] - a[6]  * c[0]) * k;
+    r[13] = ( a[0]  * c[3] - a[1]  * c[1] + a[2]  * c[0]) * k;
+    r[14] = (-a[12] * s[3] + a[13] * s[1] - a[14] * s[0]) * k;
+    r[15] = ( a[8]  * s[3] - a[9]  * s[1] + a[10] * s[0]) * k;
+    return 0;
+}
+
+/* Gauss-Jordan with partial pivoting: 6x6 covariance and other sizes */
+static int inv_gj(double *r, const double *a, int n)
+{
+    double w[HALMAT_MAT_MAX * HALMAT_MAT_MAX];
+    memcpy(w, a, sizeof(double) * (size_t)(n * n));
+    halmat_mat_identity(r, n);
+
+    for (int k = 0; k < n; k++) {
+        int piv = k;
+        for (int i = k + 1; i < n; i++)
+            if (fabs(w[i * n + k]) > fabs(w[piv * n + k]))
+                piv = i;
+        if (w[piv * n + k] == 0.0)
+            return -1;
+        if (piv != k) {
+            for (int j = 0; j < n; j++) {
+                double t = w[k * n + j]; w[k * n + j] = w[piv * n + j]; w[piv * n + j] = t;
+                t = r[k * n + j]; r[k * n + j] = r[piv * n + j]; r[piv * n + j] = t;
+            }
+        }
+        double inv = 1.0 / w[k * n + k];
+        for (int j = 0; j < n; j++) {
+            w[k * n + j] *= inv;
+            r[k * n + j] *= inv;
+        }
+        for (int i = 0; i < n; i++) {
+            double f = w[i * n + k];
+            if (i == k || f == 0.0)
+                continue;
+            for (int j = 0; j < n; j++) {
+                w[i * n + j] -= f * w[k * n + j];
+                r[i * n + j] -= f * r[k * n + j];
+            }
+        }
+    }
+    return 0;
+}
+
+int halmat_mat_inverse(double *r, const double *a, int n)
+{
+    switch (n) {
+    case 1:
+        if (a[0] == 0.0)
+            return -1;
+        r[0] = 1.0 / a[0];
+        return 0;
+    case 2: {
+        double d = a[0] * a[3] - a[1] * a[2];
+        if (d == 0.0)
+            return -1;
+        double k = 1.0 / d;
+        double a0 = a[0];
+        r[1] = -a[1] * k;
+        r[2] = -a[2] * k;
+        r[0] = a[3] * k;
+        r[3] = a0 * k;
+        return 0;
+    }
+    case 3:  return inv3(r, a);
+    case 4:  return inv4(r, a);
+    default: return inv_gj(r, a, n);
+    }
+}
+
+int halmat_mat_power(double *r, const double *a, int n, int k)
+{
+    double base[HALMAT_MAT_MAX * HALMAT_MAT_MAX];
+    double t[HALMAT_MAT_MAX * HALMAT_MAT_MAX];
+    size_t bytes = sizeof(double) * (size_t)(n * n);
+
+    if (k < 0) {
+        if (halmat_mat_inverse(base, a, n) != 0)
+            return -1;
+        k = -k;
+    } else {
+        memcpy(base, a, bytes);
+    }
+
+    halmat_mat_identity(r, n);
+    while (k) {
+        if (k & 1) {
+            halmat_mat_mul(t, r, base, n, n, n);
+            memcpy(r, t, bytes);
+        }
+        k >>= 1;
+        if (k) {
+            halmat_mat_mul(t, base, base, n, n, n);
+            memcpy(base, t, bytes);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+/* Small dense matrix/vector kernels for the class 3/4 operators.
+ *
+ * Matrices are row-major with no padding (stride = cols), at most
+ * HALMAT_MAT_MAX per side, as stored in halmat_val_t.  Callers clamp
+ * dimensions once; the kernels do no bounds checking.  3x3, 4x4, 6x6
+ * and 3-vectors have unrolled/SIMD paths, anything else up to 8x8 the
+ * generic loops. */
+
+#ifndef HALMAT_MATRIX_H
+#define HALMAT_MATRIX_H
+
+#define HALMAT_MAT_MAX 8
+
+/* r = a(n x m) * b(m x p); r must not alias a or b */
+void   halmat_mat_mul(double *r, const double *a, const double *b,
+                      int n, int m, int p);
+/* r = a' b with a stored m x n, and r = a b' with b stored p x m */
+void   halmat_mat_mul_tn(double *r, const double *a, const double *b,
+                         int n, int m, int p);
+void   halmat_mat_mul_nt(double *r, const double *a, const double *b,
+                         int n, int m, int p);
+/* r(n) = a(n x m) * v(m) */
+void   halmat_mat_vec(double *r, const double *a, const double *v, int n, int m);
+/* r(m) = v(n) * a(n x m) */
+void   halmat_vec_mat(double *r, const double *v, const double *a, int n, int m);
+/* r(n x m) = a(n) b(m)' */
+void   halmat_vec_outer(double *r, const double *a, const double *b, int n, int m);
+/* r(m x n) = a(n x m)'; r must not alias a */
+void   halmat_mat_transpose(double *r, const double *a, int n, int m);
+void   halmat_mat_identity(double *r, int n);
+double halmat_vec_dot(const double *a, const double *b, int n);
+double halmat_mat_det(const double *a, int n);
+/* r = a^-1 (r must not alias a); returns -1 if a is singular */
+int    halmat_mat_inverse(double *r, const double *a, int n);
+/* r = a^k for any integer k (negative powers invert first) */
+int    halmat_mat_power(double *r, const double *a, int n, int k);
+
+#endif /* HALMAT_MATRIX_H */
@@ -0,0 +1,206 @@
+#define _DEFAULT_SOURCE             /* syscall() */
+#include <errno.h>
+#include "halmat_perf.h"
+#include "halmat_prof.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *const phase_names[HALMAT_PERF_PHASES] = {
+    "load", "analysis", "execution", "I/O shutdown"
+};
+
+#ifdef __linux__
+static const uint64_t event_config[HALMAT_PERF_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int open_event(uint64_t config, int group)
+{
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = config;
+    a.disabled = group < 0;             /* the leader starts the group */
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                    PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, group, 0);
+}
+#endif
+
+/* Current counter values, in event order (missing events read 0),
+ * scaled up if the kernel had to multiplex the group */
+static void read_counters(const struct halmat_perf *Q, uint64_t *out)
+{
+    memset(out, 0, HALMAT_PERF_EVENTS * sizeof(uint64_t));
+#ifdef __linux__
+    uint64_t buf[3 + HALMAT_PERF_EVENTS];
+    if (Q->leader < 0 || read(Q->leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+        return;
+    uint64_t n = buf[0], enabled = buf[1], running = buf[2];
+    for (int k = 0, j = 0; k < HALMAT_PERF_EVENTS && (uint64_t)j < n; k++) {
+        if (Q->fd[k] < 0)
+            continue;
+        uint64_t v = buf[3 + j++];
+        if (running && running < enabled)
+            v = (uint64_t)((double)v * (double)enabled / (double)running);
+        out[k] = v;
+    }
+#else
+    (void)Q;
+#endif
+}
+
+static void charge(halmat_perf_sum_t *s, uint64_t dt, const uint64_t *now,
+                   const uint64_t *last)
+{
+    s->ns += dt;
+    for (int k = 0; k < HALMAT_PERF_EVENTS; k++)
+        s->ev[k] += now[k] - last[k];
+    s->readings++;
+}
+
+/* Read the counters and charge the interval to the phase and, while
+ * classes are followed, to the class that ran */
+static void reading(struct halmat_perf *Q)
+{
+    uint64_t now[HALMAT_PERF_EVENTS];
+    read_counters(Q, now);
+    uint64_t t = halmat_prof_now();
+    if (Q->phase >= 0)
+        charge(&Q->phases[Q->phase], t - Q->last_ns, now, Q->last);
+    if (Q->cls < HALMAT_PERF_CLASSES)
+        charge(&Q->classes[Q->cls], t - Q->last_ns, now, Q->last);
+    memcpy(Q->last, now, sizeof(now));
+    Q->last_ns = t;
+}
+
+int halmat_perf_open(halmat_t *H, int by_class)
+{
+    struct halmat_perf *Q = calloc(1, sizeof(*Q));
+    if (!Q)
+        return -1;
+    Q->leader = -1;
+    Q->phase = HALMAT_PERF_NONE;
+    Q->cls = HALMAT_PERF_CLASSES;
+    Q->by_class = by_class;
+    for (int k = 0; k < HALMAT_PERF_EVENTS; k++)
+        Q->fd[k] = -1;
+
+#ifdef __linux__
+    for (int k = 0; k < HALMAT_PERF_EVENTS; k++) {
+        Q->fd[k] = open_event(event_config[k], Q->leader);
+        if (Q->fd[k] < 0) {
+            if (Q->leader < 0)
+                Q->err = errno;
+            continue;
+        }
+        if (Q->leader < 0)
+            Q->leader = Q->fd[k];
+        Q->nev++;
+    }
+    if (Q->leader >= 0) {
+        ioctl(Q->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(Q->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    Q->err = ENOSYS;
+#endif
+    read_counters(Q, Q->last);
+    Q->last_ns = halmat_prof_now();
+    H->perf = Q;
+    return 0;
+}
+
+void halmat_perf_phase(halmat_t *H, int phase)
+{
+    struct halmat_perf *Q = H->perf;
+    if (!Q)
+        return;
+    reading(Q);
+    Q->phase = phase;
+    Q->cls = HALMAT_PERF_CLASSES;       /* classes only within execution */
+}
+
+void halmat_perf_class(struct halmat_perf *Q, uint32_t cls)
+{
+    if (Q->phase != HALMAT_PERF_EXEC)
+        return;
+    reading(Q);
+    Q->cls = cls < HALMAT_PERF_CLASSES ? cls : HALMAT_PERF_CLASSES;
+}
+
+static void print_sum(const struct halmat_perf *Q, const char *name,
+                      const halmat_perf_sum_t *s, FILE *out)
+{
+    fprintf(out, "  %-13s %10.3f", name, (double)s->ns / 1e6);
+    if (Q->leader < 0) {
+        fprintf(out, "\n");
+        return;
+    }
+    for (int k = 0; k < HALMAT_PERF_EVENTS; k++) {
+        if (Q->fd[k] < 0)
+            fprintf(out, " %13s", "-");
+        else
+            fprintf(out, " %13llu", (unsigned long long)s->ev[k]);
+    }
+    if (Q->fd[0] >= 0 && Q->fd[1] >= 0 && s->ev[0])
+        fprintf(out, " %5.2f\n", (double)s->ev[1] / (double)s->ev[0]);
+    else
+        fprintf(out, " %5s\n", "-");
+}
+
+void halmat_perf_report(halmat_t *H, FILE *out)
+{
+    struct halmat_perf *Q = H->perf;
+    if (!Q)
+        return;
+    if (Q->phase != HALMAT_PERF_NONE)
+        halmat_perf_phase(H, HALMAT_PERF_NONE);
+
+    if (Q->leader < 0)
+        fprintf(out, "\nPERF COUNTERS: not available (%s), timing only\n\n"
+                "  phase                 ms\n", strerror(Q->err));
+    else
+        fprintf(out, "\nPERF COUNTERS (user space, interpreter thread)\n\n"
+                "  phase                 ms        cycles  instructions"
+                "  cache misses branch misses   IPC\n");
+    for (int p = 0; p < HALMAT_PERF_PHASES; p++)
+        print_sum(Q, phase_names[p], &Q->phases[p], out);
+
+    if (!Q->by_class)
+        return;
+    fprintf(out, "\n  class\n");
+    for (uint32_t c = 0; c < HALMAT_PERF_CLASSES; c++) {
+        const halmat_perf_sum_t *s = &Q->classes[c];
+        if (!s->readings)
+            continue;
+        char name[16];
+        snprintf(name, sizeof(name), "%u", c);
+        print_sum(Q, name, s, out);
+    }
+}
+
+void halmat_perf_free(halmat_t *H)
+{
+    struct halmat_perf *Q = H->perf;
+    if (!Q)
+        return;
+#ifdef __linux__
+    for (int k = 0; k < HALMAT_PERF_EVENTS; k++)
+        if (Q->fd[k] >= 0)
+            close(Q->fd[k]);
+#endif
+    free(Q);
+    H->perf = NULL;
+}
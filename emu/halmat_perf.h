@@ -0,0 +1,56 @@
+/* Hardware performance counters (--perf-counters, --perf-class).
+ *
+ * Cycles, instructions, cache misses and branch misses are opened as
+ * one perf_event group through the raw syscall, counting user space in
+ * the interpreter thread.  main marks the run phases; each reading
+ * charges the difference since the last one, with the wall time, to
+ * the phase that ended.  With --perf-class the counters are also read
+ * whenever the operator class changes, which costs a system call per
+ * transition and slows the run accordingly.  Events the PMU does not
+ * offer are left out, and with none at all only times are reported. */
+
+#ifndef HALMAT_PERF_H
+#define HALMAT_PERF_H
+
+#include "halmat.h"
+
+enum {
+    HALMAT_PERF_NONE = -1,
+    HALMAT_PERF_LOAD,           /* halmat.bin, literals, source */
+    HALMAT_PERF_ANALYSIS,       /* flow table, plans, fusion, I/O setup */
+    HALMAT_PERF_EXEC,
+    HALMAT_PERF_SHUTDOWN,       /* I/O drained and closed */
+    HALMAT_PERF_PHASES
+};
+
+#define HALMAT_PERF_EVENTS  4   /* cycles, instructions, cache and branch misses */
+#define HALMAT_PERF_CLASSES 9
+
+typedef struct {
+    uint64_t ns;
+    uint64_t ev[HALMAT_PERF_EVENTS];
+    uint64_t readings;
+} halmat_perf_sum_t;
+
+struct halmat_perf {
+    int      fd[HALMAT_PERF_EVENTS];        /* -1 = not counted */
+    int      leader;                        /* group fd, -1 = timing only */
+    int      nev;                           /* events in the group */
+    int      err;                           /* errno of the failed leader */
+    int      phase;
+    uint64_t last_ns;
+    uint64_t last[HALMAT_PERF_EVENTS];
+
+    int      by_class;
+    uint32_t cls;                           /* class running, 9 = none yet */
+    halmat_perf_sum_t phases[HALMAT_PERF_PHASES];
+    halmat_perf_sum_t classes[HALMAT_PERF_CLASSES];
+};
+
+int  halmat_perf_open(halmat_t *H, int by_class);
+void halmat_perf_phase(halmat_t *H, int phase);     /* NONE: stop */
+void halmat_perf_class(struct halmat_perf *Q, uint32_t cls);
+void halmat_perf_report(halmat_t *H, FILE *out);
+void halmat_perf_free(halmat_t *H);
+
+#endif /* HALMAT_PERF_H */
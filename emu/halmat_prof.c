@@ -0,0 +1,692 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include "halmat_prof.h"
+
+#define STACK_SLOTS 8192                /* distinct call stacks kept */
+
+typedef struct {
+    uint64_t count;                     /* executions, or calls */
+    uint64_t incl, excl;                /* ns */
+    uint32_t seen;                      /* interval last charged inclusively */
+} prof_line_t;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t at, len;                   /* ids in the pool: procedures, then
+                                           the statement */
+    uint64_t ns;
+} prof_stack_t;
+
+typedef struct {
+    uint32_t stmt;
+    char     text[128];
+} listing_line_t;
+
+struct halmat_stmt_prof {
+    prof_line_t     stmt[HALMAT_STMT_MAX];
+    prof_line_t     proc[HALMAT_MAX_SYT];   /* by SYT, 0 = the program */
+    uint32_t       *stmt_of;                /* code address -> statement */
+    uint32_t        interval;
+    uint64_t        last_ns;
+    uint32_t        cur_stmt;
+
+    listing_line_t *lines;                  /* LISTING2, NULL if not found */
+    uint32_t        nlines;
+
+    const char     *stacks_file;            /* collapsed stacks, NULL = none */
+    prof_stack_t    stacks[STACK_SLOTS];
+    uint32_t        nstacks;
+    uint16_t       *pool;
+    uint32_t        pool_len, pool_cap;
+    uint64_t        dropped;                /* ns not charged to any stack */
+};
+
+static void stmt_free(struct halmat_stmt_prof *S);
+
+uint64_t halmat_prof_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int halmat_prof_init(halmat_t *H, uint32_t rate, const char *json)
+{
+    struct halmat_prof *P = calloc(1, sizeof(*P));
+    if (!P)
+        return -1;
+    P->rate = P->countdown = rate ? rate : 1;
+    P->json = json;
+    P->start_ns = halmat_prof_now();
+    H->prof = P;
+    return 0;
+}
+
+void halmat_prof_free(halmat_t *H)
+{
+    struct halmat_prof *P = H->prof;
+    if (!P)
+        return;
+    stmt_free(P->st);
+    free(P);
+    H->prof = NULL;
+}
+
+/* Estimated time spent in a popcode: its samples scaled to its count */
+static double est_ns(const struct halmat_prof *P, uint32_t pop)
+{
+    if (!P->samples[pop])
+        return 0.0;
+    return (double)P->ns[pop] * (double)P->count[pop] / (double)P->samples[pop];
+}
+
+static const char *pop_name(uint32_t pop, char *buf, size_t n)
+{
+    const char *name = halmat_popcode_name(pop);
+    if (name)
+        return name;
+    snprintf(buf, n, "?%03X", pop);
+    return buf;
+}
+
+static void write_json(const struct halmat_prof *P, const uint16_t *order,
+                       int n, const uint64_t *cls, uint64_t total,
+                       uint64_t elapsed)
+{
+    FILE *f = fopen(P->json, "w");
+    if (!f) {
+        fprintf(stderr, "halmat_prof: cannot write %s\n", P->json);
+        return;
+    }
+    fprintf(f, "{\n  \"operators\": %llu,\n  \"rate\": %u,\n"
+               "  \"elapsed_ns\": %llu,\n  \"classes\": [",
+            (unsigned long long)total, P->rate, (unsigned long long)elapsed);
+    for (uint32_t c = 0, first = 1; c < 16; c++) {
+        if (!cls[c])
+            continue;
+        fprintf(f, "%s\n    {\"class\": %u, \"name\": \"%s\", \"count\": %llu}",
+                first ? "" : ",", c, halmat_class_name(c),
+                (unsigned long long)cls[c]);
+        first = 0;
+    }
+    fprintf(f, "\n  ],\n  \"opcodes\": [");
+    for (int i = 0; i < n; i++) {
+        uint32_t pop = order[i];
+        char buf[8];
+        fprintf(f, "%s\n    {\"popcode\": \"0x%03X\", \"name\": \"%s\", "
+                   "\"class\": %u, \"count\": %llu, \"samples\": %llu, "
+                   "\"sampled_ns\": %llu, \"est_ns\": %.0f}",
+                i ? "," : "", pop, pop_name(pop, buf, sizeof(buf)), pop >> 8,
+                (unsigned long long)P->count[pop],
+                (unsigned long long)P->samples[pop],
+                (unsigned long long)P->ns[pop], est_ns(P, pop));
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+}
+
+/* ---- statements and procedures ---- */
+
+#define NEXT_OP(H, a) halmat_op_at(H, (a) + HALMAT_NUMOP((H)->code[a]) + 1)
+
+/* LISTING2: carriage control, statement number, "M|", the source
+ * line, "|", line number and block name */
+static void load_listing(struct halmat_stmt_prof *S, const char *path)
+{
+    FILE *f = path ? fopen(path, "r") : NULL;
+    if (!f)
+        return;
+    char buf[512];
+    uint32_t cap = 0;
+    while (fgets(buf, sizeof(buf), f)) {
+        unsigned st;
+        char *bar = strchr(buf, '|');
+        char *end = bar ? strrchr(bar + 1, '|') : NULL;
+        if (!end || sscanf(buf + 1, "%u", &st) != 1 || st >= HALMAT_STMT_MAX)
+            continue;
+        while (end > bar + 1 && end[-1] == ' ')
+            end--;
+        if (S->nlines == cap) {
+            cap = cap ? cap * 2 : 256;
+            listing_line_t *l = realloc(S->lines, cap * sizeof(*l));
+            if (!l)
+                break;
+            S->lines = l;
+        }
+        listing_line_t *l = &S->lines[S->nlines++];
+        l->stmt = st;
+        snprintf(l->text, sizeof(l->text), "%.*s", (int)(end - bar - 1), bar + 1);
+    }
+    fclose(f);
+}
+
+/* Code from a SMRK on belongs to its statement, up to the next SMRK */
+uint32_t *halmat_stmt_map(const halmat_t *H)
+{
+    uint32_t *stmt_of = calloc(H->code_len + 1, sizeof(uint32_t));
+    if (!stmt_of)
+        return NULL;
+    uint32_t stmt = 0;
+    for (uint32_t a = halmat_op_at(H, 0); a < H->code_len; ) {
+        uint32_t w = H->code[a];
+        if (HALMAT_POPCODE(w) == POP_SMRK && HALMAT_NUMOP(w) >= 1 &&
+            a + 1 < H->code_len)
+            stmt = HALMAT_DATA(H->code[a + 1]);
+        uint32_t next = NEXT_OP(H, a);
+        for (uint32_t x = a; x < next && x < H->code_len; x++)
+            stmt_of[x] = stmt;
+        a = next;
+    }
+    return stmt_of;
+}
+
+static struct halmat_stmt_prof *stmt_new(const halmat_t *H, const char *listing,
+                                         const char *stacks)
+{
+    struct halmat_stmt_prof *S = calloc(1, sizeof(*S));
+    if (!S)
+        return NULL;
+    S->stmt_of = halmat_stmt_map(H);
+    if (!S->stmt_of) {
+        free(S);
+        return NULL;
+    }
+    load_listing(S, listing);
+    S->stacks_file = stacks;
+    return S;
+}
+
+static void stmt_free(struct halmat_stmt_prof *S)
+{
+    if (!S)
+        return;
+    free(S->stmt_of);
+    free(S->lines);
+    free(S->pool);
+    free(S);
+}
+
+int halmat_prof_stmt_init(halmat_t *H, const char *listing, const char *stacks)
+{
+    struct halmat_prof *P = H->prof;
+    if (!P || !(P->st = stmt_new(H, listing, stacks)))
+        return -1;
+    P->st->proc[0].count = 1;
+    P->st->last_ns = halmat_prof_now();
+    return 0;
+}
+
+/* Procedure a call at code address `at` enters */
+uint32_t halmat_callee(const halmat_t *H, uint32_t at)
+{
+    uint32_t syt = at + 1 < H->code_len ? HALMAT_DATA(H->code[at + 1]) : 0;
+    return syt < HALMAT_MAX_SYT ? syt : 0;
+}
+
+const char *halmat_proc_name(const halmat_t *H, uint32_t syt, char *buf, size_t n)
+{
+    const char *name = halmat_syt_name(H, syt ? syt : 1);
+    if (name)
+        return name;
+    if (!syt)
+        return "PROGRAM";
+    snprintf(buf, n, "SYT(%u)", syt);
+    return buf;
+}
+
+static void add_stack(struct halmat_stmt_prof *S, const uint32_t *proc,
+                      uint32_t leaf, uint32_t n, uint64_t dt)
+{
+    uint32_t len = n + 1;
+    if (S->pool_len + len > S->pool_cap) {
+        uint32_t cap = S->pool_cap ? S->pool_cap * 2 : 4096;
+        while (cap < S->pool_len + len)
+            cap *= 2;
+        uint16_t *p = realloc(S->pool, cap * sizeof(uint16_t));
+        if (!p) {
+            S->dropped += dt;
+            return;
+        }
+        S->pool = p;
+        S->pool_cap = cap;
+    }
+    uint16_t *ids = S->pool + S->pool_len;
+    uint32_t h = 2166136261u;
+    for (uint32_t k = 0; k < len; k++) {
+        ids[k] = (uint16_t)(k < n ? proc[k] : leaf);
+        h = (h ^ ids[k]) * 16777619u;
+    }
+
+    for (uint32_t i = h & (STACK_SLOTS - 1), m = 0; m < STACK_SLOTS;
+         i = (i + 1) & (STACK_SLOTS - 1), m++) {
+        prof_stack_t *e = &S->stacks[i];
+        if (!e->len) {
+            if (S->nstacks == STACK_SLOTS * 3 / 4)
+                break;
+            e->hash = h;
+            e->at = S->pool_len;
+            e->len = len;
+            e->ns = dt;
+            S->pool_len += len;
+            S->nstacks++;
+            return;
+        }
+        if (e->hash == h && e->len == len &&
+            memcmp(S->pool + e->at, ids, len * sizeof(uint16_t)) == 0) {
+            e->ns += dt;
+            return;
+        }
+    }
+    S->dropped += dt;
+}
+
+/* Charge dt to a call stack of n levels, outermost first: the last
+ * statement and procedure exclusively, every level inclusively (once
+ * each, however deep the recursion) */
+static void charge(struct halmat_stmt_prof *S, const uint32_t *proc,
+                   const uint32_t *stmt, uint32_t n, uint64_t dt)
+{
+    uint32_t iv = ++S->interval;
+    S->stmt[stmt[n - 1]].excl += dt;
+    S->proc[proc[n - 1]].excl += dt;
+    for (uint32_t k = 0; k < n; k++) {
+        prof_line_t *l = &S->stmt[stmt[k]];
+        if (l->seen != iv) {
+            l->seen = iv;
+            l->incl += dt;
+        }
+        l = &S->proc[proc[k]];
+        if (l->seen != iv) {
+            l->seen = iv;
+            l->incl += dt;
+        }
+    }
+    if (S->stacks_file)
+        add_stack(S, proc, stmt[n - 1], n, dt);
+}
+
+void halmat_prof_stmt(halmat_t *H)
+{
+    static uint32_t proc[HALMAT_MAX_FRAMES + 1], stmt[HALMAT_MAX_FRAMES + 1];
+    struct halmat_prof *P = H->prof;
+    struct halmat_stmt_prof *S = P->st;
+    uint64_t now = halmat_prof_now();
+
+    /* The frames below the old depth are still in place after a
+     * return, so the stack that ran is rebuilt from H */
+    uint32_t depth = P->last_depth < HALMAT_MAX_FRAMES ? P->last_depth : HALMAT_MAX_FRAMES;
+    proc[0] = 0;
+    for (uint32_t k = 0; k < depth; k++) {
+        stmt[k] = S->stmt_of[H->frames[k].call_addr];
+        proc[k + 1] = halmat_callee(H, H->frames[k].call_addr);
+    }
+    stmt[depth] = S->cur_stmt;
+    charge(S, proc, stmt, depth + 1, now - S->last_ns);
+    S->last_ns = now;
+
+    if (H->frame_depth > P->last_depth && H->frame_depth <= HALMAT_MAX_FRAMES)
+        S->proc[halmat_callee(H, H->frames[H->frame_depth - 1].call_addr)].count++;
+    if (H->stmt_count != P->last_stmts)
+        S->stmt[H->current_stmt].count++;
+    /* after a RTRN current_stmt is still the callee's last statement */
+    S->cur_stmt = H->pc < H->code_len ? S->stmt_of[H->pc] : H->current_stmt;
+    P->last_stmts = H->stmt_count;
+    P->last_depth = H->frame_depth;
+}
+
+static void write_stacks(const halmat_t *H, const struct halmat_stmt_prof *S)
+{
+    FILE *f = fopen(S->stacks_file, "w");
+    if (!f) {
+        fprintf(stderr, "halmat_prof: cannot write %s\n", S->stacks_file);
+        return;
+    }
+    for (uint32_t i = 0; i < STACK_SLOTS; i++) {
+        const prof_stack_t *e = &S->stacks[i];
+        if (!e->len || !e->ns)
+            continue;
+        const uint16_t *ids = S->pool + e->at;
+        for (uint32_t k = 0; k + 1 < e->len; k++) {
+            char buf[16];
+            fprintf(f, "%s;", halmat_proc_name(H, ids[k], buf, sizeof(buf)));
+        }
+        fprintf(f, "stmt %u %llu\n", ids[e->len - 1], (unsigned long long)e->ns);
+    }
+    fclose(f);
+}
+
+static int stmt_hotter(const struct halmat_stmt_prof *S, uint32_t a, uint32_t b)
+{
+    return S->stmt[a].excl > S->stmt[b].excl;
+}
+
+/* Counts are calls and executions, or samples when sampled */
+static void stmt_report(const halmat_t *H, struct halmat_stmt_prof *S, int sampled,
+                        FILE *out)
+{
+    const char *count = sampled ? "samples" : "count";
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < HALMAT_MAX_SYT; i++)
+        total += S->proc[i].excl;
+    double pct = total ? 100.0 / (double)total : 0.0;
+
+    fprintf(out, "\nPROCEDURES\n\n  name                 %8s    incl ms    excl ms  excl %%\n",
+            sampled ? "samples" : "calls");
+    for (uint32_t i = 0; i < HALMAT_MAX_SYT; i++) {
+        const prof_line_t *l = &S->proc[i];
+        if (!l->incl)
+            continue;
+        char buf[16];
+        fprintf(out, "  %-20s %8llu %10.3f %10.3f  %5.1f%%\n",
+                halmat_proc_name(H, i, buf, sizeof(buf)), (unsigned long long)l->count,
+                (double)l->incl / 1e6, (double)l->excl / 1e6,
+                (double)l->excl * pct);
+    }
+
+    /* hottest statements by exclusive time */
+    uint32_t top[10];
+    int ntop = 0;
+    for (uint32_t st = 0; st < HALMAT_STMT_MAX; st++) {
+        if (!S->stmt[st].excl)
+            continue;
+        int j = ntop < 10 ? ntop++ : 10;
+        while (j > 0 && stmt_hotter(S, st, top[j - 1])) {
+            if (j < 10)
+                top[j] = top[j - 1];
+            j--;
+        }
+        if (j < 10)
+            top[j] = st;
+    }
+    fprintf(out, "\nSTATEMENTS\n\n  stmt %10s    incl ms    excl ms  excl %%\n", count);
+    for (int i = 0; i < ntop; i++) {
+        const prof_line_t *l = &S->stmt[top[i]];
+        fprintf(out, "  %4u %10llu %10.3f %10.3f  %5.1f%%\n", top[i],
+                (unsigned long long)l->count, (double)l->incl / 1e6,
+                (double)l->excl / 1e6, (double)l->excl * pct);
+    }
+
+    if (S->lines) {
+        fprintf(out, "\nLISTING\n\n  %10s    incl ms    excl ms | stmt\n", count);
+        uint32_t prev = HALMAT_STMT_MAX;
+        for (uint32_t i = 0; i < S->nlines; i++) {
+            const listing_line_t *ln = &S->lines[i];
+            const prof_line_t *l = &S->stmt[ln->stmt];
+            if (ln->stmt != prev && (l->count || l->incl))
+                fprintf(out, "  %10llu %10.3f %10.3f | %4u %s\n",
+                        (unsigned long long)l->count, (double)l->incl / 1e6,
+                        (double)l->excl / 1e6, ln->stmt, ln->text);
+            else
+                fprintf(out, "  %10s %10s %10s | %4u %s\n", "", "", "",
+                        ln->stmt, ln->text);
+            prev = ln->stmt;
+        }
+    }
+
+    if (S->stacks_file) {
+        write_stacks(H, S);
+        if (S->dropped)
+            fprintf(out, "halmat_prof: %.3f ms not in the stack file (too many stacks)\n",
+                    (double)S->dropped / 1e6);
+    }
+}
+
+/* ---- sampling (--profile-sample) ----
+ *
+ * A SIGPROF timer copies H->pc, current_stmt and the innermost call
+ * addresses into a preallocated ring; the handler takes no locks and
+ * allocates nothing.  A thread drains the ring and charges the samples
+ * through the same statement tables; at the end they are scaled by the
+ * CPU time used, since the kernel rounds the timer to its tick, so the
+ * report has the same form with samples in place of counts.  The interpreter runs
+ * uninstrumented.  The handler may catch a call or return half done;
+ * one sample in a great many is misattributed. */
+
+#define SAMPLE_RING  65536                  /* power of 2 */
+#define SAMPLE_DEPTH 16
+
+typedef struct {
+    uint32_t pc;
+    uint32_t stmt;
+    uint32_t depth;                         /* frames at the time */
+    uint32_t call[SAMPLE_DEPTH];            /* innermost, outermost first */
+} prof_sample_t;
+
+struct halmat_sampler {
+    prof_sample_t ring[SAMPLE_RING];
+    uint64_t      head, tail;
+    uint64_t      taken, dropped;
+    const halmat_t *H;
+    struct halmat_stmt_prof *st;
+    uint32_t      hz;
+    uint64_t      cpu0;                     /* process CPU ns at the start */
+    int           stop;
+    pthread_t     thread;
+};
+
+static struct halmat_sampler *sampling;     /* for the signal handler */
+
+static void on_sigprof(int sig)
+{
+    struct halmat_sampler *Z = sampling;
+    (void)sig;
+    if (!Z)
+        return;
+    uint64_t tail = Z->tail;
+    if (tail - __atomic_load_n(&Z->head, __ATOMIC_ACQUIRE) == SAMPLE_RING) {
+        Z->dropped++;
+        return;
+    }
+    prof_sample_t *s = &Z->ring[tail & (SAMPLE_RING - 1)];
+    const halmat_t *H = Z->H;
+    uint32_t depth = H->frame_depth < HALMAT_MAX_FRAMES ? H->frame_depth : HALMAT_MAX_FRAMES;
+    uint32_t n = depth < SAMPLE_DEPTH ? depth : SAMPLE_DEPTH;
+    s->pc = H->pc;
+    s->stmt = H->current_stmt;
+    s->depth = depth;
+    for (uint32_t i = 0; i < n; i++)
+        s->call[i] = H->frames[depth - n + i].call_addr;
+    __atomic_store_n(&Z->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void take(struct halmat_sampler *Z, const prof_sample_t *s)
+{
+    uint32_t proc[SAMPLE_DEPTH + 1], stmt[SAMPLE_DEPTH + 1];
+    struct halmat_stmt_prof *S = Z->st;
+    const halmat_t *H = Z->H;
+    uint32_t n = s->depth < SAMPLE_DEPTH ? s->depth : SAMPLE_DEPTH;
+
+    /* deeper stacks lose their outer frames: the program stands in */
+    proc[0] = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t at = s->call[k] < H->code_len ? s->call[k] : 0;
+        stmt[k] = S->stmt_of[at];
+        proc[k + 1] = halmat_callee(H, at);
+    }
+    stmt[n] = s->pc < H->code_len ? S->stmt_of[s->pc] : (s->stmt & (HALMAT_STMT_MAX - 1));
+    charge(S, proc, stmt, n + 1, 1);       /* scaled to ns at the end */
+    S->stmt[stmt[n]].count++;
+    S->proc[proc[n]].count++;
+    Z->taken++;
+}
+
+static uint64_t cpu_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Samples to ns */
+static void scale(struct halmat_stmt_prof *S, uint64_t ns)
+{
+    for (uint32_t i = 0; i < HALMAT_STMT_MAX; i++) {
+        S->stmt[i].incl *= ns;
+        S->stmt[i].excl *= ns;
+    }
+    for (uint32_t i = 0; i < HALMAT_MAX_SYT; i++) {
+        S->proc[i].incl *= ns;
+        S->proc[i].excl *= ns;
+    }
+    for (uint32_t i = 0; i < STACK_SLOTS; i++)
+        S->stacks[i].ns *= ns;
+    S->dropped *= ns;
+}
+
+static uint32_t drain_samples(struct halmat_sampler *Z)
+{
+    uint64_t head = Z->head;
+    uint64_t tail = __atomic_load_n(&Z->tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+        take(Z, &Z->ring[head & (SAMPLE_RING - 1)]);
+    uint32_t n = (uint32_t)(head - Z->head);
+    __atomic_store_n(&Z->head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+static void *sampler_main(void *arg)
+{
+    struct halmat_sampler *Z = arg;
+    struct timespec ts = { 0, 10000000 };   /* 10 ms */
+    while (!__atomic_load_n(&Z->stop, __ATOMIC_ACQUIRE))
+        if (!drain_samples(Z))
+            nanosleep(&ts, NULL);
+    return NULL;
+}
+
+int halmat_prof_sample_start(halmat_t *H, uint32_t hz, const char *listing,
+                             const char *stacks)
+{
+    struct halmat_sampler *Z = calloc(1, sizeof(*Z));
+    if (!Z || !(Z->st = stmt_new(H, listing, stacks))) {
+        free(Z);
+        return -1;
+    }
+    Z->H = H;
+    Z->hz = hz ? hz : 1000;
+
+    /* the drain thread is never the one sampled */
+    sigset_t prof, old;
+    sigemptyset(&prof);
+    sigaddset(&prof, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &prof, &old);
+    int rc = pthread_create(&Z->thread, NULL, sampler_main, Z);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        stmt_free(Z->st);
+        free(Z);
+        return -1;
+    }
+    sampling = Z;
+    Z->cpu0 = cpu_now();
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+
+    struct itimerval it;
+    it.it_interval.tv_sec = 0;
+    it.it_interval.tv_usec = Z->hz > 1 ? (suseconds_t)(1000000 / Z->hz) : 999999;
+    it.it_value = it.it_interval;
+    if (setitimer(ITIMER_PROF, &it, NULL) != 0) {
+        fprintf(stderr, "halmat_prof: no profiling timer\n");
+        halmat_prof_sample_stop(H, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+void halmat_prof_sample_stop(halmat_t *H, FILE *out)
+{
+    struct halmat_sampler *Z = sampling;
+    if (!Z || Z->H != H)
+        return;
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    signal(SIGPROF, SIG_IGN);
+    sampling = NULL;
+
+    __atomic_store_n(&Z->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(Z->thread, NULL);
+    drain_samples(Z);
+
+    if (out) {
+        uint64_t cpu = cpu_now() - Z->cpu0;
+        uint64_t per = Z->taken ? cpu / Z->taken : 1000000000u / Z->hz;
+        scale(Z->st, per);
+        fprintf(out, "\nSAMPLED PROFILE: %llu samples at %u Hz, %.3f ms CPU",
+                (unsigned long long)Z->taken, Z->hz, (double)cpu / 1e6);
+        if (Z->dropped)
+            fprintf(out, ", %llu dropped", (unsigned long long)Z->dropped);
+        fprintf(out, "\n");
+        stmt_report(H, Z->st, 1, out);
+    }
+    stmt_free(Z->st);
+    free(Z);
+}
+
+void halmat_prof_report(halmat_t *H, FILE *out)
+{
+    struct halmat_prof *P = H->prof;
+    if (!P)
+        return;
+    uint64_t elapsed = halmat_prof_now() - P->start_ns;
+
+    static uint16_t order[HALMAT_POPCODES];
+    uint64_t cls[16] = {0}, total = 0;
+    double timed = 0.0;
+    int n = 0;
+    for (uint32_t pop = 0; pop < HALMAT_POPCODES; pop++) {
+        if (!P->count[pop])
+            continue;
+        order[n++] = (uint16_t)pop;
+        cls[pop >> 8] += P->count[pop];
+        total += P->count[pop];
+        timed += est_ns(P, pop);
+    }
+    /* insertion sort by count, most frequent first: at most a few
+     * hundred distinct popcodes */
+    for (int i = 1; i < n; i++) {
+        uint16_t k = order[i];
+        int j = i;
+        while (j > 0 && P->count[order[j - 1]] < P->count[k]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = k;
+    }
+
+    fprintf(out, "\nPROFILE: %llu operators in %.3f ms, timing 1 in %u\n",
+            (unsigned long long)total, (double)elapsed / 1e6, P->rate);
+    fprintf(out, "\n  class        count       %%\n");
+    for (uint32_t c = 0; c < 16; c++)
+        if (cls[c])
+            fprintf(out, "  %-8s %12llu  %5.1f%%\n", halmat_class_name(c),
+                    (unsigned long long)cls[c], 100.0 * (double)cls[c] / (double)total);
+    fprintf(out, "\n  popcode  name         count       %%    ns/op   est. ms   time %%\n");
+    for (int i = 0; i < n; i++) {
+        uint32_t pop = order[i];
+        char buf[8];
+        double t = est_ns(P, pop);
+        fprintf(out, "  0x%03X    %-6s %12llu  %5.1f%%  %7.1f  %8.3f  %5.1f%%\n",
+                pop, pop_name(pop, buf, sizeof(buf)),
+                (unsigned long long)P->count[pop],
+                100.0 * (double)P->count[pop] / (double)total,
+                P->count[pop] ? t / (double)P->count[pop] : 0.0, t / 1e6,
+                timed > 0.0 ? 100.0 * t / timed : 0.0);
+    }
+
+    if (P->json)
+        write_json(P, order, n, cls, total, elapsed);
+    if (P->st) {
+        halmat_prof_stmt(H);            /* close the last interval */
+        stmt_report(H, P->st, 0, out);
+    }
+}
@@ -0,0 +1,73 @@
+/* Execution profiler (--profile, --profile-stmt, --profile-sample).
+ *
+ * Every operator halmat_step dispatches is counted by popcode; class
+ * totals are summed from those at report time.  Timing is sampled:
+ * one operator in every `rate` is timed with the monotonic clock and
+ * the samples are scaled up to the full count, so the cost of reading
+ * the clock can be traded against accuracy.  A fused chain counts as
+ * the operator it starts at.
+ *
+ * The statement profiler reads the clock whenever a SMRK executes or
+ * the call depth changes, and charges the time since the last reading
+ * to the statement and procedure that were running (exclusive) and to
+ * every statement and procedure on the call stack (inclusive).  The
+ * sampling profiler fills the same tables from SIGPROF samples and
+ * leaves the interpreter uninstrumented. */
+
+#ifndef HALMAT_PROF_H
+#define HALMAT_PROF_H
+
+#include "halmat.h"
+
+#define HALMAT_POPCODES 4096            /* 4-bit class, 8-bit opcode */
+#define HALMAT_STMT_MAX 65536           /* SMRK numbers are 16 bits */
+
+struct halmat_prof {
+    uint64_t count[HALMAT_POPCODES];
+    uint64_t samples[HALMAT_POPCODES];
+    uint64_t ns[HALMAT_POPCODES];       /* sampled time */
+    uint32_t rate;                      /* time one operator in this many */
+    uint32_t countdown;
+    uint64_t start_ns;
+    const char *json;                   /* JSON report file, NULL = none */
+
+    struct halmat_stmt_prof *st;        /* statement profile, NULL = off */
+    uint64_t last_stmts;                /* stmt_count at the last reading */
+    uint32_t last_depth;                /* frame_depth at the last reading */
+};
+
+int      halmat_prof_init(halmat_t *H, uint32_t rate, const char *json);
+void     halmat_prof_report(halmat_t *H, FILE *out);
+void     halmat_prof_free(halmat_t *H);
+uint64_t halmat_prof_now(void);
+int      halmat_prof_stmt_init(halmat_t *H, const char *listing,
+                               const char *stacks);
+void     halmat_prof_stmt(halmat_t *H);     /* statement or call depth changed */
+int      halmat_prof_sample_start(halmat_t *H, uint32_t hz, const char *listing,
+                                  const char *stacks);
+void     halmat_prof_sample_stop(halmat_t *H, FILE *out);  /* and report */
+
+/* Also used by the cost estimate (halmat_cost.c) */
+uint32_t   *halmat_stmt_map(const halmat_t *H);     /* address -> statement */
+uint32_t    halmat_callee(const halmat_t *H, uint32_t at);  /* call's SYT */
+const char *halmat_proc_name(const halmat_t *H, uint32_t syt, char *buf, size_t n);
+
+/* Around one dispatch: enter returns the start time of a sampled
+ * operator, 0 if this one is not timed */
+static inline uint64_t halmat_prof_enter(struct halmat_prof *P, uint32_t popcode)
+{
+    P->count[popcode]++;
+    if (--P->countdown)
+        return 0;
+    P->countdown = P->rate;
+    return halmat_prof_now();
+}
+
+static inline void halmat_prof_leave(struct halmat_prof *P, uint32_t popcode,
+                                     uint64_t t0)
+{
+    P->samples[popcode]++;
+    P->ns[popcode] += halmat_prof_now() - t0;
+}
+
+#endif /* HALMAT_PROF_H */
@@ -0,0 +1,240 @@
+#include <stddef.h>
+#include "halmat_replay.h"
+#include "halmat_sched.h"
+
+/* A copy is the state from code_len up to the backing stores, then
+ * syt_store and data_store.  code_store stays out: the program never
+ * writes it, and the breakpoint traps patched into it must survive. */
+#define HEAD_OFF   offsetof(halmat_t, code_len)
+#define HEAD_LEN   (offsetof(halmat_t, code_store) - HEAD_OFF)
+#define STORE_OFF  offsetof(halmat_t, syt_store)
+#define STORE_LEN  (offsetof(halmat_t, unit_store) - STORE_OFF)
+#define STATE_LEN  (HEAD_LEN + STORE_LEN)
+
+int halmat_replay_init(halmat_t *H, uint64_t interval, uint64_t mem_mb)
+{
+    struct halmat_replay *R = calloc(1, sizeof(*R));
+    if (!R)
+        return -1;
+    R->interval = interval ? interval : HALMAT_SNAP_INTERVAL;
+    R->mem_max = (mem_mb ? mem_mb : HALMAT_SNAP_MEM_MB) << 20;
+    H->replay = R;
+    halmat_replay_snap(H);
+    if (R->nsnap == 0) {
+        halmat_replay_free(H);
+        return -1;
+    }
+    return 0;
+}
+
+static void drop_snap(struct halmat_replay *R, halmat_snap_t *s)
+{
+    R->mem -= STATE_LEN + (s->sched ? sizeof(halmat_sched_t) : 0);
+    free(s->state);
+    free(s->sched);
+}
+
+void halmat_replay_free(halmat_t *H)
+{
+    struct halmat_replay *R = H->replay;
+    if (!R)
+        return;
+    for (uint32_t i = 0; i < R->nsnap; i++)
+        drop_snap(R, &R->snap[i]);
+    free(R->snap);
+    free(R->in);
+    free(R->vals);
+    free(R);
+    H->replay = NULL;
+}
+
+/* Over budget: keep the first copy and every other one after it */
+static void thin(struct halmat_replay *R)
+{
+    uint32_t n = 1;
+    for (uint32_t i = 1; i < R->nsnap; i++) {
+        if (i & 1)
+            drop_snap(R, &R->snap[i]);
+        else
+            R->snap[n++] = R->snap[i];
+    }
+    R->nsnap = n;
+    R->interval *= 2;
+}
+
+void halmat_replay_snap(halmat_t *H)
+{
+    struct halmat_replay *R = H->replay;
+    size_t bytes = STATE_LEN + (H->sched ? sizeof(halmat_sched_t) : 0);
+
+    if (R->nsnap > 1 && R->mem + bytes > R->mem_max)
+        thin(R);
+    if (R->nsnap == R->snapcap) {
+        uint32_t cap = R->snapcap ? R->snapcap * 2 : 16;
+        halmat_snap_t *p = realloc(R->snap, cap * sizeof(*p));
+        if (!p)
+            goto fail;
+        R->snap = p;
+        R->snapcap = cap;
+    }
+
+    halmat_snap_t *s = &R->snap[R->nsnap];
+    s->cycle = H->cycle_count;
+    s->state = malloc(STATE_LEN);
+    s->sched = NULL;
+    if (!s->state)
+        goto fail;
+    memcpy(s->state, (uint8_t *)H + HEAD_OFF, HEAD_LEN);
+    memcpy(s->state + HEAD_LEN, (uint8_t *)H + STORE_OFF, STORE_LEN);
+    if (H->sched) {
+        if (!(s->sched = malloc(sizeof(halmat_sched_t)))) {
+            free(s->state);
+            goto fail;
+        }
+        memcpy(s->sched, H->sched, sizeof(halmat_sched_t));
+    }
+    R->mem += bytes;
+    R->nsnap++;
+    R->next_snap = s->cycle + R->interval;
+    return;
+
+fail:
+    /* Go on with the copies there are; a later move costs more */
+    fprintf(stderr, "halmat_replay: out of memory for snapshot at cycle %llu\n",
+            (unsigned long long)H->cycle_count);
+    R->next_snap = H->cycle_count + R->interval;
+}
+
+/* Put back the last copy at or before cycle; returns its cycle.  The
+ * tools, the debugger's state, the code with its traps, open files
+ * (unit_store) and the tables built at load stay as they are. */
+uint64_t halmat_replay_restore(halmat_t *H, uint64_t cycle)
+{
+    struct halmat_replay *R = H->replay;
+    uint32_t lo = 0, hi = R->nsnap;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (R->snap[mid].cycle <= cycle)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const halmat_snap_t *s = &R->snap[lo];
+
+    struct halmat_fuse *fuse = H->fuse;
+    struct halmat_arrays *arrays = H->arrays;
+    struct halmat_structs *structs = H->structs;
+    struct halmat_chars *chars = H->chars;
+    struct halmat_prof *prof = H->prof;
+    struct halmat_trace *trace = H->trace;
+    struct halmat_perf *perf = H->perf;
+    struct halmat_cov *cov = H->cov;
+    struct halmat_watch *watch = H->watch;
+    struct halmat_sched *sched = H->sched;
+    int single_step = H->single_step;
+    uint32_t bp_count = H->bp_count, bp_resume = H->bp_resume;
+    breakpoint_t bp[64];
+    memcpy(bp, H->breakpoints, sizeof(bp));
+
+    memcpy((uint8_t *)H + HEAD_OFF, s->state, HEAD_LEN);
+    memcpy((uint8_t *)H + STORE_OFF, s->state + HEAD_LEN, STORE_LEN);
+
+    H->fuse = fuse;
+    H->arrays = arrays;
+    H->structs = structs;
+    H->chars = chars;
+    H->prof = prof;
+    H->trace = trace;
+    H->perf = perf;
+    H->cov = cov;
+    H->watch = watch;
+    H->replay = R;
+    H->debug_mode = 1;
+    H->single_step = single_step;
+    memcpy(H->breakpoints, bp, sizeof(bp));
+    H->bp_count = bp_count;
+    H->bp_resume = bp_resume;
+
+    H->sched = sched;
+    if (s->sched) {
+        if (!H->sched && !(H->sched = malloc(sizeof(halmat_sched_t)))) {
+            fprintf(stderr, "halmat_replay: out of memory restoring cycle %llu\n",
+                    (unsigned long long)s->cycle);
+            H->halted = -1;
+        } else {
+            memcpy(H->sched, s->sched, sizeof(halmat_sched_t));
+        }
+    } else if (H->sched) {
+        halmat_sched_free(H);
+    }
+
+    lo = 0;
+    hi = R->nin;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (R->in[mid].cycle < s->cycle)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    R->next_in = lo;
+    return s->cycle;
+}
+
+/* Below the frontier, the input this cycle took the first time */
+int halmat_replay_fetch(halmat_t *H, halmat_val_t *v, int n)
+{
+    struct halmat_replay *R = H->replay;
+    if (H->cycle_count >= R->frontier)
+        return 0;
+    if (n <= 0)
+        return 1;
+    while (R->next_in < R->nin && R->in[R->next_in].cycle < H->cycle_count)
+        R->next_in++;
+    const halmat_input_t *e = R->next_in < R->nin ? &R->in[R->next_in] : NULL;
+    if (!e || e->cycle != H->cycle_count || e->n != (uint32_t)n) {
+        fprintf(stderr, "halmat_replay: no input logged for cycle %llu\n",
+                (unsigned long long)H->cycle_count);
+        return 0;
+    }
+    memcpy(v, &R->vals[e->first], (size_t)n * sizeof(*v));
+    R->next_in++;
+    return 1;
+}
+
+void halmat_replay_keep(halmat_t *H, const halmat_val_t *v, int n)
+{
+    struct halmat_replay *R = H->replay;
+    if (H->cycle_count < R->frontier || n <= 0)
+        return;
+    if (R->nin == R->incap) {
+        uint32_t cap = R->incap ? R->incap * 2 : 64;
+        halmat_input_t *p = realloc(R->in, cap * sizeof(*p));
+        if (!p)
+            goto fail;
+        R->in = p;
+        R->incap = cap;
+    }
+    if (R->nvals + (uint32_t)n > R->valcap) {
+        uint32_t cap = R->valcap ? R->valcap : 64;
+        while (cap < R->nvals + (uint32_t)n)
+            cap *= 2;
+        halmat_val_t *p = realloc(R->vals, cap * sizeof(*p));
+        if (!p)
+            goto fail;
+        R->vals = p;
+        R->valcap = cap;
+    }
+    memcpy(&R->vals[R->nvals], v, (size_t)n * sizeof(*v));
+    R->in[R->nin].cycle = H->cycle_count;
+    R->in[R->nin].first = R->nvals;
+    R->in[R->nin].n = (uint32_t)n;
+    R->nin++;
+    R->nvals += (uint32_t)n;
+    R->next_in = R->nin;
+    return;
+
+fail:
+    fprintf(stderr, "halmat_replay: out of memory logging input at cycle %llu\n",
+            (unsigned long long)H->cycle_count);
+}
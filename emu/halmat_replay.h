@@ -0,0 +1,79 @@
+/* Record and replay for the debugger (reverse-step, reverse-continue,
+ * goto-cycle).
+ *
+ * Under --debug the interpreter's state is copied every `interval`
+ * operators: halmat_t after the code, up to the open files, and the
+ * scheduler's tables.  What comes from outside the program is logged against the
+ * cycle that took it: the values READ, READALL and FILE read, and DATE
+ * and CLOCKTIME.  The virtual clock and the scheduler's choices are
+ * part of the copied state and follow from it, since the debugger runs
+ * every process on one thread.
+ *
+ * To move to an earlier cycle the nearest copy at or before it is
+ * restored and the program run forward.  Up to the furthest cycle
+ * reached so far (the frontier) inputs come from the log and WRITE and
+ * FILE output is dropped, as it has already been done.  The copies are
+ * kept within a memory budget: when it is reached every other one is
+ * dropped and the interval doubled. */
+
+#ifndef HALMAT_REPLAY_H
+#define HALMAT_REPLAY_H
+
+#include "halmat.h"
+
+#define HALMAT_SNAP_INTERVAL 100000         /* operators, default */
+#define HALMAT_SNAP_MEM_MB   512            /* default budget */
+
+struct halmat_sched;
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t *state;                 /* halmat_t from code_len on, less code */
+    struct halmat_sched *sched;     /* copy, NULL if none yet */
+} halmat_snap_t;
+
+typedef struct {
+    uint64_t cycle;
+    uint32_t first, n;              /* values in vals */
+} halmat_input_t;
+
+struct halmat_replay {
+    uint64_t       interval;
+    uint64_t       next_snap;       /* cycle of the next copy */
+    uint64_t       mem, mem_max;    /* bytes in copies, budget */
+    halmat_snap_t *snap;
+    uint32_t       nsnap, snapcap;
+
+    halmat_input_t *in;
+    uint32_t       nin, incap;
+    uint32_t       next_in;         /* next entry to replay */
+    halmat_val_t  *vals;
+    uint32_t       nvals, valcap;
+
+    uint64_t       frontier;        /* furthest cycle executed */
+};
+
+int      halmat_replay_init(halmat_t *H, uint64_t interval, uint64_t mem_mb);
+void     halmat_replay_free(halmat_t *H);
+void     halmat_replay_snap(halmat_t *H);
+uint64_t halmat_replay_restore(halmat_t *H, uint64_t cycle);   /* nearest copy <= */
+int      halmat_replay_fetch(halmat_t *H, halmat_val_t *v, int n);  /* 1: logged */
+void     halmat_replay_keep(halmat_t *H, const halmat_val_t *v, int n);
+
+/* After every operator the debugger runs */
+static inline void halmat_replay_tick(halmat_t *H)
+{
+    struct halmat_replay *R = H->replay;
+    if (H->cycle_count > R->frontier)
+        R->frontier = H->cycle_count;
+    if (H->cycle_count >= R->next_snap)
+        halmat_replay_snap(H);
+}
+
+/* Output at this cycle was written the first time round */
+static inline int halmat_replay_muted(const halmat_t *H)
+{
+    return H->replay && H->cycle_count < H->replay->frontier;
+}
+
+#endif /* HALMAT_REPLAY_H */
@@ -0,0 +1,907 @@
+#include "halmat_sched.h"
+
+/*
+ * HAL/S real-time executive on a virtual clock.
+ *
+ * Every process (the main program is process 0) owns a saved interpreter
+ * context.  Only one runs at a time; a switch happens when the running
+ * process blocks (WAIT, end of cycle, TERMINATE) or when a SCHEDULE,
+ * SIGNAL or UPDATE PRIORITY readies something of higher priority.
+ *
+ *   run queue    256 FIFO levels + bitmap, highest level found with clz
+ *   timers       hashed wheel of 1 ms slots + occupancy bitmap
+ *   events       per-SYT waiter lists, plus one list for compound
+ *                event expressions that are re-evaluated on any change
+ *
+ * Execution takes no virtual time; the clock jumps to the next deadline
+ * when nothing is ready.
+ *
+ * The compiler's phrase encoding in the SCHD/WAIT/SGNL/PRIO tags is not
+ * documented; the layout in halmat_sched.h is a reconstruction.
+ */
+
+#define TICK_OF(us)   ((us) / HALMAT_WHEEL_TICK_US)
+#define SLOT_OF(tick) ((uint32_t)(tick) & (HALMAT_WHEEL_SLOTS - 1))
+#define MAP_WORDS(n)  ((n) / 64)
+
+static int val_true(halmat_val_t v)
+{
+    switch (v.type) {
+    case HTYPE_SCALAR:  return v.v.scalar != 0.0;
+    case HTYPE_INTEGER: return v.v.integer != 0;
+    default:            return v.v.bits != 0;
+    }
+}
+
+/* Seconds (SCALAR or INTEGER) to microseconds, negative clamps to 0 */
+static uint64_t val_us(halmat_val_t v)
+{
+    double s = (v.type == HTYPE_INTEGER) ? (double)v.v.integer : v.v.scalar;
+    if (!(s > 0.0))
+        return 0;
+    return (uint64_t)(s * 1e6 + 0.5);
+}
+
+static int map_highest(const uint64_t *map, int words)
+{
+    for (int i = words - 1; i >= 0; i--)
+        if (map[i])
+            return i * 64 + 63 - __builtin_clzll(map[i]);
+    return -1;
+}
+
+/* ---- run queue ---- */
+
+static void rq_push(halmat_sched_t *S, int32_t id, int front)
+{
+    halmat_task_t *t = &S->tasks[id];
+    uint32_t p = t->prio;
+    t->state = TASK_READY;
+    if (S->rq_head[p] < 0) {
+        t->rq_next = -1;
+        S->rq_head[p] = S->rq_tail[p] = id;
+        S->rq_map[p >> 6] |= 1ULL << (p & 63);
+    } else if (front) {
+        t->rq_next = S->rq_head[p];
+        S->rq_head[p] = id;
+    } else {
+        t->rq_next = -1;
+        S->tasks[S->rq_tail[p]].rq_next = id;
+        S->rq_tail[p] = id;
+    }
+}
+
+int32_t halmat_sched_pop_ready(halmat_sched_t *S)
+{
+    int p = map_highest(S->rq_map, MAP_WORDS(HALMAT_SCHED_PRIOS));
+    if (p < 0)
+        return -1;
+    int32_t id = S->rq_head[p];
+    S->rq_head[p] = S->tasks[id].rq_next;
+    if (S->rq_head[p] < 0) {
+        S->rq_tail[p] = -1;
+        S->rq_map[p >> 6] &= ~(1ULL << (p & 63));
+    }
+    return id;
+}
+
+static void rq_remove(halmat_sched_t *S, int32_t id)
+{
+    uint32_t p = S->tasks[id].prio;
+    int32_t prev = -1;
+    for (int32_t i = S->rq_head[p]; i >= 0; prev = i, i = S->tasks[i].rq_next) {
+        if (i != id)
+            continue;
+        if (prev < 0) S->rq_head[p] = S->tasks[i].rq_next;
+        else          S->tasks[prev].rq_next = S->tasks[i].rq_next;
+        if (S->rq_tail[p] == id) S->rq_tail[p] = prev;
+        if (S->rq_head[p] < 0)
+            S->rq_map[p >> 6] &= ~(1ULL << (p & 63));
+        return;
+    }
+}
+
+/* ---- timer wheel ---- */
+
+static void tw_insert(halmat_sched_t *S, int32_t id, uint64_t deadline)
+{
+    halmat_task_t *t = &S->tasks[id];
+    uint32_t slot = SLOT_OF(TICK_OF(deadline));
+    t->state = TASK_WAIT_TIME;
+    t->deadline_us = deadline;
+    t->tw_prev = -1;
+    t->tw_next = S->wheel[slot];
+    if (t->tw_next >= 0)
+        S->tasks[t->tw_next].tw_prev = id;
+    S->wheel[slot] = id;
+    S->wheel_map[slot >> 6] |= 1ULL << (slot & 63);
+    S->wheel_count++;
+}
+
+static void tw_remove(halmat_sched_t *S, int32_t id)
+{
+    halmat_task_t *t = &S->tasks[id];
+    uint32_t slot = SLOT_OF(TICK_OF(t->deadline_us));
+    if (t->tw_prev >= 0) S->tasks[t->tw_prev].tw_next = t->tw_next;
+    else                 S->wheel[slot] = t->tw_next;
+    if (t->tw_next >= 0) S->tasks[t->tw_next].tw_prev = t->tw_prev;
+    if (S->wheel[slot] < 0)
+        S->wheel_map[slot >> 6] &= ~(1ULL << (slot & 63));
+    S->wheel_count--;
+}
+
+/* Earliest pending deadline.  Walks occupied slots from the current tick
+ * for one revolution; only deadlines further out than that fall back to
+ * a scan of the whole wheel. */
+static uint64_t tw_next_deadline(halmat_sched_t *S)
+{
+    uint64_t now_tick = TICK_OF(S->now_us);
+    uint32_t start = SLOT_OF(now_tick);
+
+    for (uint32_t d = 0; d < HALMAT_WHEEL_SLOTS; ) {
+        uint32_t slot = (start + d) & (HALMAT_WHEEL_SLOTS - 1);
+        uint64_t bits = S->wheel_map[slot >> 6] >> (slot & 63);
+        if (!bits) {
+            d += 64 - (slot & 63);
+            continue;
+        }
+        uint32_t skip = (uint32_t)__builtin_ctzll(bits);
+        if (skip) {
+            d += skip;
+            continue;
+        }
+        uint64_t tick = now_tick + d;
+        uint64_t best = UINT64_MAX;
+        for (int32_t i = S->wheel[slot]; i >= 0; i = S->tasks[i].tw_next)
+            if (TICK_OF(S->tasks[i].deadline_us) == tick &&
+                S->tasks[i].deadline_us < best)
+                best = S->tasks[i].deadline_us;
+        if (best != UINT64_MAX)
+            return best;
+        d++;
+    }
+
+    uint64_t best = UINT64_MAX;
+    for (uint32_t slot = 0; slot < HALMAT_WHEEL_SLOTS; slot++)
+        for (int32_t i = S->wheel[slot]; i >= 0; i = S->tasks[i].tw_next)
+            if (S->tasks[i].deadline_us < best)
+                best = S->tasks[i].deadline_us;
+    return best;
+}
+
+/* ---- event waiters ---- */
+
+static void ev_wait(halmat_sched_t *S, int32_t id, uint32_t event)
+{
+    halmat_task_t *t = &S->tasks[id];
+    int32_t *head = event ? &S->ev_head[event] : &S->ev_any_head;
+    int32_t *tail = event ? &S->ev_tail[event] : &S->ev_any_tail;
+    t->state = TASK_WAIT_EVENT;
+    t->wait_event = event;
+    t->ev_next = -1;
+    if (*head < 0) *head = id;
+    else           S->tasks[*tail].ev_next = id;
+    *tail = id;
+}
+
+static void ev_remove(halmat_sched_t *S, int32_t id)
+{
+    uint32_t event = S->tasks[id].wait_event;
+    int32_t *head = event ? &S->ev_head[event] : &S->ev_any_head;
+    int32_t *tail = event ? &S->ev_tail[event] : &S->ev_any_tail;
+    int32_t prev = -1;
+    for (int32_t i = *head; i >= 0; prev = i, i = S->tasks[i].ev_next) {
+        if (i != id)
+            continue;
+        if (prev < 0) *head = S->tasks[i].ev_next;
+        else          S->tasks[prev].ev_next = S->tasks[i].ev_next;
+        if (*tail == id) *tail = prev;
+        return;
+    }
+}
+
+/* ---- process lifecycle ---- */
+
+static void detach(halmat_sched_t *S, int32_t id)
+{
+    switch (S->tasks[id].state) {
+    case TASK_READY:      rq_remove(S, id); break;
+    case TASK_WAIT_TIME:  tw_remove(S, id); break;
+    case TASK_WAIT_EVENT: ev_remove(S, id); break;
+    default: break;
+    }
+}
+
+static int event_set(halmat_t *H, uint32_t syt)
+{
+    if (syt >= HALMAT_MAX_SYT)
+        return 0;
+    if (H->syt[syt].val.type == HTYPE_EVENT)
+        return __atomic_load_n(&H->syt[syt].val.v.bits, __ATOMIC_ACQUIRE) != 0;
+    return val_true(H->syt[syt].val);
+}
+
+static void terminate(halmat_t *H, halmat_sched_t *S, int32_t id)
+{
+    halmat_task_t *t = &S->tasks[id];
+
+    if (t->state == TASK_RUNNING && H->task != id) {
+        /* Running on another worker thread, which finishes the job */
+        __atomic_store_n(&t->killed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (uint32_t j = 0; j < S->ntasks && t->ndependents > 0; j++)
+        if (S->tasks[j].state != TASK_FREE && S->tasks[j].parent == id)
+            terminate(H, S, (int32_t)j);
+
+    detach(S, id);
+    if (t->parent >= 0) {
+        halmat_task_t *p = &S->tasks[t->parent];
+        if (p->ndependents > 0 && --p->ndependents == 0 &&
+            p->state == TASK_WAIT_DEP)
+            rq_push(S, t->parent, 0);
+    }
+    if (t->syt < HALMAT_MAX_SYT && S->task_of[t->syt] == id)
+        S->task_of[t->syt] = -1;
+    if (H->task == id)
+        H->task = -1;
+
+    t->state = TASK_FREE;
+    t->gen++;
+    t->rq_next = S->free_list;
+    S->free_list = id;
+}
+
+/* Begin a new cycle, unless the SCHEDULE's cancel phrases say otherwise */
+static void release(halmat_t *H, halmat_sched_t *S, int32_t id)
+{
+    halmat_task_t *t = &S->tasks[id];
+    uint8_t cancel = t->sched_flags & SCHD_CANCEL_MASK;
+
+    if (t->cancelled ||
+        (cancel == SCHD_UNTIL_TIME && t->until_us && S->now_us > t->until_us) ||
+        (cancel == SCHD_WHILE_EVENT && !event_set(H, t->cancel_event)) ||
+        (cancel == SCHD_UNTIL_EVENT && event_set(H, t->cancel_event))) {
+        terminate(H, S, id);
+        return;
+    }
+
+    t->starting = 0;
+    t->release_us = t->deadline_us;
+    t->pc = t->entry;
+    t->frame_depth = 0;
+    t->loop_depth = 0;
+    t->nvac = 0;
+    t->activations++;
+    rq_push(S, id, 0);
+}
+
+static void wake(halmat_t *H, halmat_sched_t *S, int32_t id)
+{
+    if (S->tasks[id].starting)
+        release(H, S, id);
+    else
+        rq_push(S, id, 0);
+}
+
+static void wake_list(halmat_t *H, halmat_sched_t *S, int32_t *head, int32_t *tail)
+{
+    int32_t i = *head;
+    *head = *tail = -1;
+    while (i >= 0) {
+        int32_t next = S->tasks[i].ev_next;
+        S->tasks[i].deadline_us = S->now_us;
+        wake(H, S, i);
+        i = next;
+    }
+}
+
+/* ---- context save/restore ---- */
+
+/* First operator of the statement containing addr (SMRK ends a statement) */
+static uint32_t stmt_start(halmat_t *H, uint32_t addr)
+{
+    uint32_t a = addr;
+    while (a > 0) {
+        uint32_t w = H->code[--a];
+        if (HALMAT_IS_OP(w) &&
+            (HALMAT_POPCODE(w) == POP_SMRK || HALMAT_POPCODE(w) == POP_PXRC))
+            return a + HALMAT_NUMOP(w) + 1;
+    }
+    return 0;
+}
+
+static void keep_vac(halmat_sched_t *S, halmat_task_t *t, uint32_t addr)
+{
+    for (uint32_t i = 0; i < t->nvac; i++)
+        if (VAC_SLOT(t->vac_addr[i]) == VAC_SLOT(addr))
+            return;
+    if (t->nvac >= HALMAT_TASK_LIVE_VACS) {
+        if (!S->live_vac_warned) {
+            fprintf(stderr, "halmat_sched: more than %d live VACs at task "
+                    "switch, some may be clobbered\n", HALMAT_TASK_LIVE_VACS);
+            S->live_vac_warned = 1;
+        }
+        return;
+    }
+    t->vac_addr[t->nvac++] = addr;
+}
+
+/* Operators evaluated so far in the statement [start, end) */
+static void keep_stmt_vacs(halmat_t *H, halmat_sched_t *S, halmat_task_t *t,
+                           uint32_t end)
+{
+    uint32_t a = stmt_start(H, end);
+    while (a < end && a < H->code_len) {
+        uint32_t w = H->code[a];
+        if (!HALMAT_IS_OP(w)) { a++; continue; }
+        keep_vac(S, t, a);
+        a += HALMAT_NUMOP(w) + 1;
+    }
+}
+
+/* Values still needed when the process resumes: DO FOR operands held in
+ * VACs and partial expressions of every statement with a call in flight. */
+static void save_context(halmat_t *H, halmat_sched_t *S, int32_t id)
+{
+    halmat_task_t *t = &S->tasks[id];
+
+    t->pc = H->pc;
+    t->frame_depth = H->frame_depth;
+    t->loop_depth = H->loop_depth;
+    memcpy(t->frames, H->frames, H->frame_depth * sizeof(call_frame_t));
+    memcpy(t->loops, H->loops, H->loop_depth * sizeof(loop_info_t));
+
+    t->nvac = 0;
+    for (uint32_t i = 0; i < H->loop_depth; i++) {
+        uint32_t a = H->loops[i].cmp_addr;
+        uint32_t w = H->code[a];
+        if (!HALMAT_IS_OP(w) || HALMAT_POPCODE(w) != POP_DFOR)
+            continue;
+        for (uint32_t k = 1; k <= HALMAT_NUMOP(w); k++)
+            if (HALMAT_QUAL(H->code[a + k]) == QUAL_VAC)
+                keep_vac(S, t, HALMAT_DATA(H->code[a + k]));
+    }
+    for (uint32_t i = 0; i < H->frame_depth; i++)
+        keep_stmt_vacs(H, S, t, H->frames[i].call_addr);
+    keep_stmt_vacs(H, S, t, H->pc);
+
+    for (uint32_t i = 0; i < t->nvac; i++)
+        t->vac_val[i] = H->vac[VAC_SLOT(t->vac_addr[i])];
+}
+
+void halmat_sched_restore(halmat_t *H, halmat_sched_t *S, int32_t id)
+{
+    halmat_task_t *t = &S->tasks[id];
+
+    H->pc = t->pc;
+    H->frame_depth = t->frame_depth;
+    H->loop_depth = t->loop_depth;
+    memcpy(H->frames, t->frames, t->frame_depth * sizeof(call_frame_t));
+    memcpy(H->loops, t->loops, t->loop_depth * sizeof(loop_info_t));
+    for (uint32_t i = 0; i < t->nvac; i++)
+        H->vac[VAC_SLOT(t->vac_addr[i])] = t->vac_val[i];
+
+    t->state = TASK_RUNNING;
+    H->task = id;
+    S->dispatches++;
+}
+
+/* ---- dispatcher ---- */
+
+static int halt(halmat_t *H)
+{
+    H->halted = 1;
+    return HALMAT_HALT;
+}
+
+/* Move the clock to the next deadline and wake what is due.  Returns 0
+ * when nothing can ever become ready again (or the time limit is hit). */
+int halmat_sched_advance(halmat_t *H, halmat_sched_t *S)
+{
+    for (;;) {
+        if (S->wheel_count == 0) {
+            uint32_t blocked = 0;
+            for (uint32_t i = 0; i < S->ntasks; i++)
+                if (S->tasks[i].state == TASK_WAIT_EVENT ||
+                    S->tasks[i].state == TASK_WAIT_DEP)
+                    blocked++;
+            if (blocked)
+                fprintf(stderr, "halmat_sched: deadlock at t=%.6f s, "
+                        "%u process(es) blocked\n", S->now_us / 1e6, blocked);
+            return 0;
+        }
+
+        uint64_t next = tw_next_deadline(S);
+        if (H->sim_limit_us && next > H->sim_limit_us) {
+            S->now_us = H->sim_limit_us;
+            return 0;
+        }
+        S->now_us = next;
+
+        /* Expire everything due in this tick */
+        uint32_t slot = SLOT_OF(TICK_OF(next));
+        int32_t i = S->wheel[slot];
+        while (i >= 0) {
+            int32_t n = S->tasks[i].tw_next;
+            if (S->tasks[i].deadline_us <= S->now_us) {
+                tw_remove(S, i);
+                wake(H, S, i);
+            }
+            i = n;
+        }
+        return 1;
+    }
+}
+
+static int dispatch(halmat_t *H, halmat_sched_t *S)
+{
+    if (S->mt == SCHED_MT_PARALLEL)
+        return HALMAT_SWITCH;       /* worker threads pick the next one */
+
+    for (;;) {
+        int32_t id = halmat_sched_pop_ready(S);
+        if (id >= 0) {
+            if (S->mt == SCHED_MT_REPLAY)
+                return halmat_sched_mt_handoff(S, id);
+            halmat_sched_restore(H, S, id);
+            return HALMAT_OK;
+        }
+        if (!halmat_sched_advance(H, S))
+            return S->mt ? halmat_sched_mt_finish(S) : halt(H);
+    }
+}
+
+/* Park the running process in its new state and run something else */
+static int block_current(halmat_t *H, halmat_sched_t *S)
+{
+    H->task = -1;
+    return dispatch(H, S);
+}
+
+static int maybe_preempt(halmat_t *H, halmat_sched_t *S)
+{
+    int32_t cur = H->task;
+    int top = map_highest(S->rq_map, MAP_WORDS(HALMAT_SCHED_PRIOS));
+    if (S->mt == SCHED_MT_PARALLEL || cur < 0 ||
+        top <= (int)S->tasks[cur].prio)
+        return HALMAT_OK;
+    save_context(H, S, cur);
+    rq_push(S, cur, 1);
+    return block_current(H, S);
+}
+
+static void arm(halmat_t *H, halmat_sched_t *S, int32_t id, uint64_t when)
+{
+    S->tasks[id].starting = 1;
+    if (when <= S->now_us) {
+        S->tasks[id].deadline_us = S->now_us;
+        release(H, S, id);
+    } else {
+        tw_insert(S, id, when);
+    }
+}
+
+/* ---- public entry points ---- */
+
+int halmat_sched_init(halmat_t *H)
+{
+    halmat_sched_t *S = calloc(1, sizeof(*S));
+    if (!S) {
+        fprintf(stderr, "halmat_sched: out of memory\n");
+        return HALMAT_ERR_OVERFLOW;
+    }
+
+    S->free_list = -1;
+    S->ev_any_head = S->ev_any_tail = -1;
+    for (int i = 0; i < HALMAT_SCHED_PRIOS; i++)
+        S->rq_head[i] = S->rq_tail[i] = -1;
+    for (int i = 0; i < HALMAT_WHEEL_SLOTS; i++)
+        S->wheel[i] = -1;
+    for (int i = 0; i < HALMAT_MAX_SYT; i++) {
+        S->ev_head[i] = S->ev_tail[i] = -1;
+        S->task_of[i] = -1;
+    }
+
+    /* Locate every TASK body and the program's own name */
+    uint32_t main_syt = 0;
+    for (uint32_t blk = 0; blk < H->num_blocks; blk++) {
+        uint32_t base = blk * HALMAT_BLOCK_WORDS;
+        uint32_t af = (H->code[base + 1] >> 16) & 0xFFFF;
+        uint32_t scan = base + 2;
+        while (scan <= base + af) {
+            uint32_t w = H->code[scan];
+            if (!HALMAT_IS_OP(w)) { scan++; continue; }
+            uint32_t pop = HALMAT_POPCODE(w);
+            uint32_t n   = HALMAT_NUMOP(w);
+            if (n >= 1) {
+                uint32_t syt = HALMAT_DATA(H->code[scan + 1]);
+                if (pop == POP_TDEF && syt < HALMAT_MAX_SYT)
+                    S->task_entry[syt] = scan + n + 1;
+                else if (pop == POP_MDEF && !main_syt)
+                    main_syt = syt;
+            }
+            scan += n + 1;
+        }
+    }
+
+    halmat_task_t *t = &S->tasks[0];
+    t->state = TASK_RUNNING;
+    t->prio = HALMAT_SCHED_DEF_PRIO;
+    t->syt = main_syt;
+    t->parent = -1;
+    t->activations = 1;
+    t->rand_state = H->rand_state;      /* the program's stream goes on */
+    if (main_syt < HALMAT_MAX_SYT)
+        S->task_of[main_syt] = 0;
+    S->ntasks = 1;
+    H->task = 0;
+
+    H->sched = S;
+    return HALMAT_OK;
+}
+
+void halmat_sched_free(halmat_t *H)
+{
+    free(H->sched);
+    H->sched = NULL;
+}
+
+double halmat_sched_clock(halmat_t *H)
+{
+    return H->sched ? H->sched->now_us / 1e6 : 0.0;
+}
+
+static int32_t task_alloc(halmat_sched_t *S)
+{
+    int32_t id;
+    if (S->free_list >= 0) {
+        id = S->free_list;
+        S->free_list = S->tasks[id].rq_next;
+    } else if (S->ntasks < HALMAT_MAX_TASKS) {
+        id = (int32_t)S->ntasks++;
+    } else {
+        return -1;
+    }
+    uint32_t gen = S->tasks[id].gen;
+    memset(&S->tasks[id], 0, sizeof(S->tasks[id]));
+    S->tasks[id].gen = gen;
+    S->tasks[id].parent = -1;
+    return id;
+}
+
+static int exec_schd(halmat_t *H, halmat_sched_t *S, uint32_t numop, uint32_t tag)
+{
+    uint32_t pc = H->pc;
+    uint32_t k = 1;
+    halmat_val_t none;
+    memset(&none, 0, sizeof(none));
+#define NEXT_WORD() (k <= numop ? H->code[pc + k++] : 0)
+#define NEXT_VAL()  (k <= numop ? halmat_resolve_operand(H, H->code[pc + k++]) : none)
+
+    uint32_t name = HALMAT_DATA(NEXT_WORD());
+    if (name >= HALMAT_MAX_SYT || !S->task_entry[name]) {
+        fprintf(stderr, "halmat_sched: SCHEDULE of unknown process SYT(%u) "
+                "at PC=%u\n", name, pc);
+        return HALMAT_ERR_BAD_OP;
+    }
+    if (S->task_of[name] >= 0) {
+        fprintf(stderr, "halmat_sched: process SYT(%u) already scheduled "
+                "at PC=%u\n", name, pc);
+        H->pc = pc + numop + 1;
+        return HALMAT_OK;
+    }
+
+    int32_t id = task_alloc(S);
+    if (id < 0) {
+        fprintf(stderr, "halmat_sched: process table full at PC=%u\n", pc);
+        return HALMAT_ERR_STACK;
+    }
+    halmat_task_t *t = &S->tasks[id];
+    t->syt = name;
+    t->entry = S->task_entry[name];
+    t->sched_flags = (uint8_t)tag;
+    t->prio = H->task >= 0 ? S->tasks[H->task].prio : HALMAT_SCHED_DEF_PRIO;
+    S->task_of[name] = (int16_t)id;
+
+    uint64_t when = S->now_us;
+    uint32_t on_event = 0;
+    switch (tag & SCHD_TIME_MASK) {
+    case SCHD_AT: when = val_us(NEXT_VAL()); break;
+    case SCHD_IN: when = S->now_us + val_us(NEXT_VAL()); break;
+    case SCHD_ON: on_event = HALMAT_DATA(NEXT_WORD()); break;
+    }
+    if (tag & SCHD_PRIO) {
+        halmat_val_t p = NEXT_VAL();
+        int prio = (p.type == HTYPE_SCALAR) ? (int)p.v.scalar : p.v.integer;
+        t->prio = (uint8_t)(prio < 0 ? 0 : prio > 255 ? 255 : prio);
+    }
+    if ((tag & SCHD_REPEAT_MASK) == SCHD_EVERY ||
+        (tag & SCHD_REPEAT_MASK) == SCHD_AFTER)
+        t->period_us = val_us(NEXT_VAL());
+    switch (tag & SCHD_CANCEL_MASK) {
+    case SCHD_UNTIL_TIME:  t->until_us = val_us(NEXT_VAL()); break;
+    case SCHD_WHILE_EVENT:
+    case SCHD_UNTIL_EVENT: t->cancel_event = HALMAT_DATA(NEXT_WORD()); break;
+    }
+#undef NEXT_WORD
+#undef NEXT_VAL
+
+    if ((tag & SCHD_DEPENDENT) && H->task >= 0) {
+        t->parent = H->task;
+        S->tasks[H->task].ndependents++;
+    }
+
+    H->pc = pc + numop + 1;
+
+    if (on_event && on_event < HALMAT_MAX_SYT && !event_set(H, on_event)) {
+        t->starting = 1;
+        ev_wait(S, id, on_event);
+    } else {
+        arm(H, S, id, when);
+    }
+    return maybe_preempt(H, S);
+}
+
+static int exec_wait(halmat_t *H, halmat_sched_t *S, uint32_t numop, uint32_t tag)
+{
+    uint32_t pc = H->pc;
+    int32_t cur = H->task;
+    halmat_task_t *t = &S->tasks[cur];
+
+    H->pc = pc + numop + 1;
+
+    if (numop == 0) {
+        /* WAIT FOR DEPENDENT */
+        if (t->ndependents == 0)
+            return HALMAT_OK;
+        save_context(H, S, cur);
+        t->state = TASK_WAIT_DEP;
+        return block_current(H, S);
+    }
+
+    uint32_t ow = H->code[pc + 1];
+    switch (tag) {
+    case WAIT_INTERVAL:
+    case WAIT_UNTIL: {
+        uint64_t when = val_us(halmat_resolve_operand(H, ow));
+        if (tag == WAIT_INTERVAL)
+            when += S->now_us;
+        if (when <= S->now_us)
+            return HALMAT_OK;
+        save_context(H, S, cur);
+        tw_insert(S, cur, when);
+        return block_current(H, S);
+    }
+    case WAIT_FOR_EVENT:
+        if (HALMAT_QUAL(ow) == QUAL_SYT && HALMAT_DATA(ow) != 0) {
+            uint32_t ev = HALMAT_DATA(ow);
+            if (event_set(H, ev))
+                return HALMAT_OK;
+            save_context(H, S, cur);
+            ev_wait(S, cur, ev);
+            return block_current(H, S);
+        }
+        /* Compound expression: re-run the statement on any event change */
+        if (val_true(halmat_resolve_operand(H, ow)))
+            return HALMAT_OK;
+        H->pc = stmt_start(H, pc);
+        save_context(H, S, cur);
+        ev_wait(S, cur, 0);
+        return block_current(H, S);
+    default:
+        return HALMAT_OK;
+    }
+}
+
+static int exec_sgnl(halmat_t *H, halmat_sched_t *S, uint32_t numop, uint32_t tag)
+{
+    uint32_t pc = H->pc;
+    H->pc = pc + numop + 1;
+    if (numop < 1)
+        return HALMAT_OK;
+
+    uint32_t ev = HALMAT_DATA(H->code[pc + 1]);
+    if (HALMAT_QUAL(H->code[pc + 1]) != QUAL_SYT || ev >= HALMAT_MAX_SYT)
+        return HALMAT_OK;
+
+    halmat_val_t *v = &H->syt[ev].val;
+    v->type = HTYPE_EVENT;
+    H->syt[ev].allocated = 1;
+    if (tag == SGNL_SET)
+        __atomic_store_n(&v->v.bits, 1, __ATOMIC_RELEASE);
+    else if (tag == SGNL_RESET)
+        __atomic_store_n(&v->v.bits, 0, __ATOMIC_RELEASE);
+
+    /* SIGNAL is a pulse: waiters on this event run, the value is unchanged */
+    if (tag != SGNL_RESET)
+        wake_list(H, S, &S->ev_head[ev], &S->ev_tail[ev]);
+    wake_list(H, S, &S->ev_any_head, &S->ev_any_tail);
+    return maybe_preempt(H, S);
+}
+
+/* CANCEL lets the current cycle finish; TERMINATE stops at once.
+ * With no operands both apply to the running process. */
+static int exec_stop(halmat_t *H, halmat_sched_t *S, uint32_t numop, int term)
+{
+    uint32_t pc = H->pc;
+    H->pc = pc + numop + 1;
+
+    for (uint32_t k = 0; k <= numop; k++) {
+        int32_t id;
+        if (numop == 0) {
+            id = H->task;
+        } else if (k == 0) {
+            continue;
+        } else {
+            uint32_t syt = HALMAT_DATA(H->code[pc + k]);
+            id = syt < HALMAT_MAX_SYT ? S->task_of[syt] : -1;
+        }
+        if (id < 0 || S->tasks[id].state == TASK_FREE)
+            continue;
+
+        if (term) {
+            terminate(H, S, id);
+        } else {
+            S->tasks[id].cancelled = 1;
+            if (S->tasks[id].starting)
+                terminate(H, S, id);
+        }
+    }
+
+    if (H->task < 0)
+        return dispatch(H, S);
+    return HALMAT_OK;
+}
+
+static int exec_prio(halmat_t *H, halmat_sched_t *S, uint32_t numop, uint32_t tag)
+{
+    uint32_t pc = H->pc;
+    H->pc = pc + numop + 1;
+    if (numop < 1)
+        return HALMAT_OK;
+
+    int32_t id = H->task;
+    if (tag && numop >= 2) {
+        uint32_t syt = HALMAT_DATA(H->code[pc + 2]);
+        id = syt < HALMAT_MAX_SYT ? S->task_of[syt] : -1;
+    }
+    if (id < 0)
+        return HALMAT_OK;
+
+    halmat_val_t p = halmat_resolve_operand(H, H->code[pc + 1]);
+    int prio = (p.type == HTYPE_SCALAR) ? (int)p.v.scalar : p.v.integer;
+    prio = prio < 0 ? 0 : prio > 255 ? 255 : prio;
+
+    halmat_task_t *t = &S->tasks[id];
+    if (t->state == TASK_READY) {
+        rq_remove(S, id);
+        t->prio = (uint8_t)prio;
+        rq_push(S, id, 0);
+    } else {
+        t->prio = (uint8_t)prio;
+    }
+    return maybe_preempt(H, S);
+}
+
+int halmat_sched_exec(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag)
+{
+    if (!H->sched) {
+        int rc = halmat_sched_init(H);
+        if (rc != HALMAT_OK)
+            return rc;
+        if (H->sched_threads > 1)
+            return halmat_sched_mt_run(H);
+    }
+    halmat_sched_t *S = H->sched;
+    int rc;
+
+    if (S->mt) halmat_sched_mt_enter(H);
+    switch (popcode) {
+    case POP_WAIT: rc = exec_wait(H, S, numop, tag); break;
+    case POP_SGNL: rc = exec_sgnl(H, S, numop, tag); break;
+    case POP_CANC: rc = exec_stop(H, S, numop, 0);   break;
+    case POP_TERM: rc = exec_stop(H, S, numop, 1);   break;
+    case POP_PRIO: rc = exec_prio(H, S, numop, tag); break;
+    case POP_SCHD: rc = exec_schd(H, S, numop, tag); break;
+    default:
+        H->pc += numop + 1;
+        rc = HALMAT_OK;
+        break;
+    }
+    if (S->mt) halmat_sched_mt_leave(H);
+    return rc;
+}
+
+/* End of a process cycle: re-arm a repeating process or terminate it */
+static int close_current(halmat_t *H, halmat_sched_t *S)
+{
+    int32_t id = H->task;
+    halmat_task_t *t = &S->tasks[id];
+    uint8_t repeat = t->sched_flags & SCHD_REPEAT_MASK;
+
+    if (id == 0 || !repeat || t->cancelled) {
+        terminate(H, S, id);
+        return dispatch(H, S);
+    }
+
+    uint64_t next = S->now_us;
+    if (repeat == SCHD_EVERY) {
+        /* Keep the phase; skip whole periods that were overrun */
+        next = t->release_us + t->period_us;
+        while (t->period_us && next < S->now_us) {
+            next += t->period_us;
+            t->overruns++;
+        }
+    } else if (repeat == SCHD_AFTER) {
+        next = S->now_us + t->period_us;
+    }
+    /* A cycle takes no virtual time, so with no period the process would
+     * run again at the same instant forever: move on one wheel tick */
+    if (!t->period_us && next <= S->now_us)
+        next = S->now_us + HALMAT_WHEEL_TICK_US;
+
+    if (t->until_us && next > t->until_us &&
+        (t->sched_flags & SCHD_CANCEL_MASK) == SCHD_UNTIL_TIME) {
+        terminate(H, S, id);
+        return dispatch(H, S);
+    }
+
+    H->task = -1;
+    t->deadline_us = next;
+    arm(H, S, id, next);
+    return dispatch(H, S);
+}
+
+/* CLOS at call depth 0 */
+int halmat_sched_close(halmat_t *H)
+{
+    halmat_sched_t *S = H->sched;
+    if (S->mt) halmat_sched_mt_enter(H);
+    int rc = close_current(H, S);
+    if (S->mt) halmat_sched_mt_leave(H);
+    return rc;
+}
+
+/* Worker threads: the running process fell off the end or was killed */
+int halmat_sched_exit(halmat_t *H)
+{
+    halmat_sched_t *S = H->sched;
+    if (S->mt) halmat_sched_mt_enter(H);
+    if (H->task >= 0)
+        terminate(H, S, H->task);
+    int rc = dispatch(H, S);
+    if (S->mt) halmat_sched_mt_leave(H);
+    return rc;
+}
+
+void halmat_sched_print(halmat_t *H, FILE *out)
+{
+    static const char *state_names[] = {
+        "free", "ready", "running", "wait-time", "wait-event", "wait-dep"
+    };
+    halmat_sched_t *S = H->sched;
+    if (!S) {
+        fprintf(out, "  (no real-time activity)\n");
+        return;
+    }
+    fprintf(out, "  t=%.6f s  dispatches=%llu\n",
+            S->now_us / 1e6, (unsigned long long)S->dispatches);
+    for (uint32_t i = 0; i < S->ntasks; i++) {
+        halmat_task_t *t = &S->tasks[i];
+        if (t->state == TASK_FREE)
+            continue;
+        fprintf(out, "  [%3u] SYT(%u) prio=%-3u %-10s PC=%-6u cycles=%llu",
+                i, t->syt, t->prio, state_names[t->state],
+                (int32_t)i == H->task ? H->pc : t->pc,
+                (unsigned long long)t->activations);
+        if (t->state == TASK_WAIT_TIME)
+            fprintf(out, " due=%.6f", t->deadline_us / 1e6);
+        if (t->state == TASK_WAIT_EVENT && t->wait_event)
+            fprintf(out, " event=SYT(%u)", t->wait_event);
+        if (t->overruns)
+            fprintf(out, " overruns=%llu", (unsigned long long)t->overruns);
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,152 @@
+/* Cooperative real-time scheduler for the HAL/S process statements
+ * (SCHEDULE, WAIT, SIGNAL/SET/RESET, CANCEL, TERMINATE, UPDATE PRIORITY).
+ *
+ * Processes run on a virtual clock: time only moves when every process is
+ * blocked, so the clock jumps straight to the next timer deadline.  The
+ * state lives outside halmat_t and is only allocated once a program
+ * executes its first real-time operator. */
+
+#ifndef HALMAT_SCHED_H
+#define HALMAT_SCHED_H
+
+#include "halmat.h"
+
+#define HALMAT_MAX_TASKS      256
+#define HALMAT_SCHED_PRIOS    256
+#define HALMAT_SCHED_DEF_PRIO 128
+#define HALMAT_WHEEL_SLOTS    1024      /* power of 2 */
+#define HALMAT_WHEEL_TICK_US  1000      /* 1 ms per slot */
+#define HALMAT_TASK_LIVE_VACS 16
+
+/* SCHD TAG: SCHEDULE phrase flags */
+#define SCHD_TIME_MASK    0x03  /* 1=AT time, 2=IN interval, 3=ON event */
+#define SCHD_AT           0x01
+#define SCHD_IN           0x02
+#define SCHD_ON           0x03
+#define SCHD_PRIO         0x04
+#define SCHD_DEPENDENT    0x08
+#define SCHD_REPEAT_MASK  0x30  /* 0x10=REPEAT, 0x20=EVERY dt, 0x30=AFTER dt */
+#define SCHD_REPEAT       0x10
+#define SCHD_EVERY        0x20
+#define SCHD_AFTER        0x30
+#define SCHD_CANCEL_MASK  0xC0  /* 0x40=UNTIL time, 0x80=WHILE ev, 0xC0=UNTIL ev */
+#define SCHD_UNTIL_TIME   0x40
+#define SCHD_WHILE_EVENT  0x80
+#define SCHD_UNTIL_EVENT  0xC0
+
+/* WAIT TAG (NUMOP=0 is WAIT FOR DEPENDENT) */
+#define WAIT_INTERVAL     0
+#define WAIT_UNTIL        1
+#define WAIT_FOR_EVENT    2
+
+/* SGNL TAG */
+#define SGNL_SIGNAL       0
+#define SGNL_SET          1
+#define SGNL_RESET        2
+
+/* Threading modes */
+#define SCHED_MT_OFF      0
+#define SCHED_MT_PARALLEL 1     /* ready processes run concurrently */
+#define SCHED_MT_REPLAY   2     /* threads, but the sequential interleaving */
+
+enum {
+    TASK_FREE = 0,
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_WAIT_TIME,     /* on the timer wheel */
+    TASK_WAIT_EVENT,    /* on an event waiter list */
+    TASK_WAIT_DEP       /* WAIT FOR DEPENDENT */
+};
+
+typedef struct {
+    uint8_t      state;
+    uint8_t      prio;
+    uint8_t      sched_flags;   /* SCHD TAG this process was scheduled with */
+    uint8_t      cancelled;     /* CANCEL seen: finish current cycle only */
+    uint8_t      starting;      /* next wakeup begins a new cycle */
+    uint8_t      killed;        /* TERMINATEd while running on another worker */
+    uint8_t      _pad[2];
+    uint32_t     gen;           /* bumped on termination; stale deque entries */
+    uint32_t     syt;           /* process name */
+    uint32_t     entry;         /* first operator of the body */
+    int32_t      parent;        /* DEPENDENT owner, -1 if none */
+    uint32_t     ndependents;
+
+    uint64_t     deadline_us;   /* timer wheel key */
+    uint64_t     release_us;    /* start of the current cycle */
+    uint64_t     period_us;     /* REPEAT EVERY/AFTER interval */
+    uint64_t     until_us;      /* UNTIL time, 0 = none */
+    uint32_t     cancel_event;  /* WHILE/UNTIL event SYT */
+    uint32_t     wait_event;    /* event being waited on, 0 = compound */
+    uint32_t     restart_pc;    /* statement to re-run for compound waits */
+
+    int32_t      rq_next;
+    int32_t      tw_next, tw_prev;
+    int32_t      ev_next;
+
+    /* Saved interpreter context */
+    uint32_t     pc;
+    uint32_t     frame_depth;
+    uint32_t     loop_depth;
+    call_frame_t frames[HALMAT_MAX_FRAMES];
+    loop_info_t  loops[HALMAT_MAX_LOOPS];
+    uint32_t     nvac;
+    uint32_t     vac_addr[HALMAT_TASK_LIVE_VACS];
+    halmat_val_t vac_val[HALMAT_TASK_LIVE_VACS];
+
+    uint64_t     activations;
+    uint64_t     overruns;
+    uint64_t     rand_state;    /* this process's RANDOM stream, 0 = unseeded */
+} halmat_task_t;
+
+typedef struct halmat_sched {
+    halmat_task_t tasks[HALMAT_MAX_TASKS];
+    uint32_t      ntasks;           /* high-water mark of used slots */
+    int32_t       free_list;
+    int           mt;               /* SCHED_MT_* */
+    struct halmat_mt *pool;         /* worker threads, halmat_sched_mt.c */
+
+    /* Priority run queue: FIFO per level + occupancy bitmap */
+    int32_t       rq_head[HALMAT_SCHED_PRIOS];
+    int32_t       rq_tail[HALMAT_SCHED_PRIOS];
+    uint64_t      rq_map[HALMAT_SCHED_PRIOS / 64];
+
+    /* Hashed timer wheel keyed by deadline tick */
+    int32_t       wheel[HALMAT_WHEEL_SLOTS];
+    uint64_t      wheel_map[HALMAT_WHEEL_SLOTS / 64];
+    uint32_t      wheel_count;
+    uint64_t      now_us;
+
+    /* Event waiters: one list per event SYT, plus compound expressions */
+    int32_t       ev_head[HALMAT_MAX_SYT];
+    int32_t       ev_tail[HALMAT_MAX_SYT];
+    int32_t       ev_any_head, ev_any_tail;
+
+    uint32_t      task_entry[HALMAT_MAX_SYT];  /* process SYT -> body */
+    int16_t       task_of[HALMAT_MAX_SYT];     /* process SYT -> task, -1 */
+
+    uint64_t      dispatches;
+    int           live_vac_warned;
+} halmat_sched_t;
+
+int  halmat_sched_init(halmat_t *H);
+void halmat_sched_free(halmat_t *H);
+int  halmat_sched_exec(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag);
+int  halmat_sched_close(halmat_t *H);
+int  halmat_sched_exit(halmat_t *H);
+double halmat_sched_clock(halmat_t *H);
+void halmat_sched_print(halmat_t *H, FILE *out);
+
+/* Used by the worker pool; call with the pool lock held */
+int     halmat_sched_advance(halmat_t *H, halmat_sched_t *S);
+int32_t halmat_sched_pop_ready(halmat_sched_t *S);
+void    halmat_sched_restore(halmat_t *H, halmat_sched_t *S, int32_t id);
+
+/* halmat_sched_mt.c */
+int  halmat_sched_mt_run(halmat_t *H);
+void halmat_sched_mt_enter(halmat_t *H);
+void halmat_sched_mt_leave(halmat_t *H);
+int  halmat_sched_mt_handoff(halmat_sched_t *S, int32_t id);
+int  halmat_sched_mt_finish(halmat_sched_t *S);
+
+#endif /* HALMAT_SCHED_H */
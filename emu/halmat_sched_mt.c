@@ -0,0 +1,676 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <pthread.h>
+#include "halmat_sched.h"
+
+/*
+ * Multi-threaded process execution (--threads N).
+ *
+ * Each worker thread owns a private halmat_t clone: PC, frames, loops,
+ * VACs and the TINT cursor are per thread, while the code, SYT, data
+ * segment and I/O units are the master's stores, reached through the
+ * same pointers; the clone stops short of them (CLONE_SIZE).  The scheduler
+ * state in halmat_sched.c is guarded by one pool lock.
+ *
+ * Parallel mode: ready processes sit on per-worker Chase-Lev deques;
+ * idle workers steal.  The virtual clock only moves when no process is
+ * ready or running.
+ *
+ * Shared data: a SYT referenced by more than one process body (or from
+ * any procedure body, which every process may call) is "shared" and maps
+ * to one of 63 lock stripes; stripe 0 serialises I/O.  Each statement
+ * holds the stripes for the shared SYTs it and its callees touch, taken in
+ * ascending order at the statement boundary.  An UPDATE block holds the
+ * union of its statements' stripes from UDEF to CLOS.
+ *
+ * Replay mode (--deterministic): the sequential dispatcher picks every
+ * process switch and hands the process to the next worker in turn, so the
+ * interleaving and output match a single-threaded run exactly.
+ */
+
+#define MT_STRIPES    64
+#define MT_IO_STRIPE  0
+#define DQ_SIZE       HALMAT_MAX_TASKS      /* power of 2 */
+#define SHARED_BODY   UINT32_MAX
+#define CLONE_SIZE    offsetof(halmat_t, code_store)
+
+#define DQ_ENTRY(id, gen)  ((int32_t)(((gen) & 0x7FFFFF) << 8 | (uint32_t)(id)))
+#define DQ_ID(e)           ((e) & 0xFF)
+#define DQ_GEN(e)          ((uint32_t)(e) >> 8)
+
+typedef struct {
+    int64_t top;
+    int64_t bottom;
+    int32_t buf[DQ_SIZE];
+} ws_deque_t;
+
+typedef struct halmat_worker {
+    halmat_t         *H;            /* private interpreter clone */
+    struct halmat_mt *mt;
+    pthread_t         thread;
+    uint32_t          idx;
+    ws_deque_t        dq;
+    uint64_t          held;         /* stripes currently locked */
+    uint64_t          upd[HALMAT_MAX_UPDATE];
+} halmat_worker_t;
+
+typedef struct halmat_mt {
+    pthread_mutex_t  lock;          /* guards halmat_sched_t */
+    pthread_cond_t   cv;
+    pthread_mutex_t  stripe[MT_STRIPES];
+    halmat_worker_t *workers;
+    uint32_t         nworkers;
+    int              done;
+    int              error;
+    uint32_t         running;       /* atomic: processes on a worker */
+    uint32_t         ready;         /* atomic: entries on deques */
+    int32_t          turn;          /* replay: process handed off */
+    uint32_t         turn_worker;
+    uint64_t         handoffs;
+
+    uint32_t        *stmt_of;       /* code address -> statement */
+    uint64_t        *stmt_mask;     /* statement -> stripes */
+    uint64_t        *upd_mask;      /* statement holding UDEF -> block stripes */
+    uint32_t         nstmts;
+} halmat_mt_t;
+
+/* ---- Chase-Lev work-stealing deque (fixed size, no resize needed:
+ *      at most HALMAT_MAX_TASKS processes exist) ---- */
+
+static void dq_push(ws_deque_t *d, int32_t x)
+{
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->buf[b & (DQ_SIZE - 1)], x, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+static int32_t dq_pop(ws_deque_t *d)
+{
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    int32_t x = __atomic_load_n(&d->buf[b & (DQ_SIZE - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        /* Last entry: race the thieves for it */
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            x = -1;
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return x;
+}
+
+static int32_t dq_steal(ws_deque_t *d)
+{
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return -1;
+    int32_t x = __atomic_load_n(&d->buf[t & (DQ_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return -1;
+    return x;
+}
+
+static int32_t steal_any(halmat_mt_t *mt, halmat_worker_t *w)
+{
+    for (uint32_t k = 1; k < mt->nworkers; k++) {
+        halmat_worker_t *v = &mt->workers[(w->idx + k) % mt->nworkers];
+        int32_t x = dq_steal(&v->dq);
+        if (x >= 0)
+            return x;
+    }
+    return -1;
+}
+
+/* Move the scheduler's ready queue onto this worker's deque.  Lowest
+ * priority goes in first so the owner pops the highest next. */
+static void drain_ready(halmat_mt_t *mt, halmat_worker_t *w, halmat_sched_t *S)
+{
+    int32_t ids[HALMAT_MAX_TASKS];
+    int n = 0;
+    int32_t id;
+    while (n < HALMAT_MAX_TASKS && (id = halmat_sched_pop_ready(S)) >= 0)
+        ids[n++] = id;
+    if (!n)
+        return;
+    __atomic_add_fetch(&mt->ready, (uint32_t)n, __ATOMIC_SEQ_CST);
+    while (n-- > 0)
+        dq_push(&w->dq, DQ_ENTRY(ids[n], S->tasks[ids[n]].gen));
+    pthread_cond_broadcast(&mt->cv);
+}
+
+/* ---- static shared-SYT analysis ---- */
+
+static int syt_is_data(uint32_t pop, uint32_t k)
+{
+    switch (pop) {
+    case POP_MDEF: case POP_TDEF: case POP_PDEF: case POP_FDEF:
+    case POP_UDEF: case POP_CDEF: case POP_CLOS:
+    case POP_CANC: case POP_TERM:
+        return 0;
+    case POP_FCAL: case POP_PCAL: case POP_SCHD:
+        return k != 1;
+    case POP_PRIO:
+        return k != 2;
+    default:
+        return 1;
+    }
+}
+
+static int is_io(uint32_t pop)
+{
+    switch (pop) {
+    case POP_XXST: case POP_XXAR: case POP_XXND: case POP_WRIT:
+    case POP_READ: case POP_RDAL: case POP_FILE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+#define STRIPE_BIT(syt) (1ULL << (1 + (syt) % (MT_STRIPES - 1)))
+
+/* Runs body once per operator in every block, with addr, w (the operator
+ * word) and stmt (its statement number) in scope */
+#define FOR_EACH_OP(H, body) do {                                        \
+    uint32_t stmt_ = 0;                                                  \
+    for (uint32_t blk_ = 0; blk_ < (H)->num_blocks; blk_++) {             \
+        uint32_t base_ = blk_ * HALMAT_BLOCK_WORDS;                       \
+        uint32_t af_ = ((H)->code[base_ + 1] >> 16) & 0xFFFF;             \
+        uint32_t addr = base_ + 2;                                        \
+        stmt_++;                                                          \
+        while (addr <= base_ + af_) {                                     \
+            uint32_t w = (H)->code[addr];                                 \
+            uint32_t stmt = stmt_;                                        \
+            if (!HALMAT_IS_OP(w)) { addr++; continue; }                   \
+            body                                                          \
+            if (HALMAT_POPCODE(w) == POP_SMRK) stmt_++;                   \
+            addr += HALMAT_NUMOP(w) + 1;                                  \
+        }                                                                 \
+    }                                                                     \
+} while (0)
+
+static int analyse(halmat_t *H, halmat_mt_t *mt)
+{
+    uint32_t *owner = calloc(HALMAT_MAX_SYT, sizeof(uint32_t));
+    uint64_t *proc_mask = calloc(HALMAT_MAX_SYT, sizeof(uint64_t));
+    uint32_t nstmts = 1;
+
+    FOR_EACH_OP(H, { (void)w; nstmts = stmt + 1; });
+    mt->nstmts = nstmts;
+    mt->stmt_of = calloc(H->code_len ? H->code_len : 1, sizeof(uint32_t));
+    mt->stmt_mask = calloc(nstmts, sizeof(uint64_t));
+    mt->upd_mask = calloc(nstmts, sizeof(uint64_t));
+    uint32_t *stmt_proc = calloc(nstmts, sizeof(uint32_t));
+    uint32_t *call_stmt = calloc(H->code_len ? H->code_len : 1, sizeof(uint32_t));
+    uint32_t *call_proc = calloc(H->code_len ? H->code_len : 1, sizeof(uint32_t));
+    uint32_t ncalls = 0;
+
+    if (!owner || !proc_mask || !mt->stmt_of || !mt->stmt_mask ||
+        !mt->upd_mask || !stmt_proc || !call_stmt || !call_proc) {
+        free(owner); free(proc_mask); free(stmt_proc);
+        free(call_stmt); free(call_proc);
+        return -1;
+    }
+
+    /* Pass 1: which body touches each SYT.  Process bodies are MDEF and
+     * TDEF blocks; anything inside a PROCEDURE/FUNCTION counts as shared. */
+    {
+        uint32_t blk_pop[64], blk_addr[64];
+        int depth = 0;
+        FOR_EACH_OP(H, {
+            uint32_t pop = HALMAT_POPCODE(w);
+            uint32_t n = HALMAT_NUMOP(w);
+            for (uint32_t k = 0; k <= n && addr + k < H->code_len; k++)
+                mt->stmt_of[addr + k] = stmt;
+
+            uint32_t body = 0;
+            for (int i = depth - 1; i >= 0; i--) {
+                if (blk_pop[i] == POP_PDEF || blk_pop[i] == POP_FDEF) {
+                    body = SHARED_BODY;
+                    break;
+                }
+                if (blk_pop[i] == POP_TDEF || blk_pop[i] == POP_MDEF) {
+                    body = blk_addr[i] + 1;
+                    break;
+                }
+            }
+            if (body)
+                for (uint32_t k = 1; k <= n; k++) {
+                    uint32_t ow = H->code[addr + k];
+                    uint32_t syt = HALMAT_DATA(ow);
+                    if (HALMAT_QUAL(ow) != QUAL_SYT || syt >= HALMAT_MAX_SYT ||
+                        !syt_is_data(pop, k))
+                        continue;
+                    if (!owner[syt]) owner[syt] = body;
+                    else if (owner[syt] != body) owner[syt] = SHARED_BODY;
+                }
+
+            if (pop == POP_MDEF || pop == POP_TDEF || pop == POP_PDEF ||
+                pop == POP_FDEF || pop == POP_UDEF || pop == POP_CDEF) {
+                if (depth < 64) {
+                    blk_pop[depth] = pop;
+                    blk_addr[depth] = addr;
+                    depth++;
+                }
+            } else if (pop == POP_CLOS && depth > 0) {
+                depth--;
+            }
+        });
+    }
+
+    /* Pass 2: per-statement stripe masks, procedure membership, calls,
+     * DO FOR variables (EFOR writes them without naming them) */
+    {
+        uint32_t blk_pop[64], blk_syt[64];
+        uint32_t dfor[HALMAT_MAX_LOOPS];
+        int depth = 0, ndfor = 0;
+        FOR_EACH_OP(H, {
+            uint32_t pop = HALMAT_POPCODE(w);
+            uint32_t n = HALMAT_NUMOP(w);
+            uint64_t m = 0;
+
+            if (is_io(pop))
+                m |= 1ULL << MT_IO_STRIPE;
+            for (uint32_t k = 1; k <= n; k++) {
+                uint32_t ow = H->code[addr + k];
+                uint32_t syt = HALMAT_DATA(ow);
+                if (HALMAT_QUAL(ow) == QUAL_SYT && syt < HALMAT_MAX_SYT &&
+                    owner[syt] == SHARED_BODY && syt_is_data(pop, k))
+                    m |= STRIPE_BIT(syt);
+            }
+            if (pop == POP_DFOR && ndfor < HALMAT_MAX_LOOPS)
+                dfor[ndfor++] = addr;
+            if (pop == POP_EFOR && ndfor > 0) {
+                uint32_t d = dfor[--ndfor];
+                for (uint32_t k = 1; k <= HALMAT_NUMOP(H->code[d]); k++) {
+                    uint32_t syt = HALMAT_DATA(H->code[d + k]);
+                    if (HALMAT_QUAL(H->code[d + k]) == QUAL_SYT &&
+                        syt < HALMAT_MAX_SYT && owner[syt] == SHARED_BODY)
+                        m |= STRIPE_BIT(syt);
+                }
+            }
+            mt->stmt_mask[stmt] |= m;
+
+            for (int i = depth - 1; i >= 0; i--)
+                if (blk_pop[i] == POP_PDEF || blk_pop[i] == POP_FDEF) {
+                    stmt_proc[stmt] = blk_syt[i];
+                    break;
+                }
+            if ((pop == POP_FCAL || pop == POP_PCAL) && n >= 1 &&
+                ncalls < H->code_len) {
+                call_stmt[ncalls] = stmt;
+                call_proc[ncalls] = HALMAT_DATA(H->code[addr + 1]) %
+                                    HALMAT_MAX_SYT;
+                ncalls++;
+            }
+
+            if (pop == POP_MDEF || pop == POP_TDEF || pop == POP_PDEF ||
+                pop == POP_FDEF || pop == POP_UDEF || pop == POP_CDEF) {
+                if (depth < 64) {
+                    blk_pop[depth] = pop;
+                    blk_syt[depth] = n >= 1 ? HALMAT_DATA(H->code[addr + 1])
+                                            % HALMAT_MAX_SYT : 0;
+                    depth++;
+                }
+            } else if (pop == POP_CLOS && depth > 0) {
+                depth--;
+            }
+        });
+    }
+
+    /* A call statement holds everything its callees (transitively) need */
+    for (int changed = 1; changed; ) {
+        changed = 0;
+        for (uint32_t s = 0; s < nstmts; s++)
+            if (stmt_proc[s] && (proc_mask[stmt_proc[s]] | mt->stmt_mask[s]) !=
+                                proc_mask[stmt_proc[s]]) {
+                proc_mask[stmt_proc[s]] |= mt->stmt_mask[s];
+                changed = 1;
+            }
+        for (uint32_t c = 0; c < ncalls; c++) {
+            uint64_t m = mt->stmt_mask[call_stmt[c]] | proc_mask[call_proc[c]];
+            if (m != mt->stmt_mask[call_stmt[c]]) {
+                mt->stmt_mask[call_stmt[c]] = m;
+                changed = 1;
+            }
+        }
+    }
+
+    /* UPDATE blocks: union over UDEF..CLOS, keyed by the UDEF's statement */
+    {
+        uint32_t open_stmt[HALMAT_MAX_UPDATE], open_syt[HALMAT_MAX_UPDATE];
+        int nopen = 0;
+        FOR_EACH_OP(H, {
+            uint32_t pop = HALMAT_POPCODE(w);
+            uint32_t syt = HALMAT_NUMOP(w) >= 1 ? HALMAT_DATA(H->code[addr + 1]) : 0;
+            for (int i = 0; i < nopen; i++)
+                mt->upd_mask[open_stmt[i]] |= mt->stmt_mask[stmt];
+            if (pop == POP_UDEF && nopen < HALMAT_MAX_UPDATE) {
+                open_stmt[nopen] = stmt;
+                open_syt[nopen] = syt;
+                nopen++;
+            } else if (pop == POP_CLOS && nopen > 0 && open_syt[nopen - 1] == syt) {
+                nopen--;
+            }
+        });
+    }
+
+    free(owner);
+    free(proc_mask);
+    free(stmt_proc);
+    free(call_stmt);
+    free(call_proc);
+    return 0;
+}
+
+/* ---- stripe locking ---- */
+
+static void hold(halmat_mt_t *mt, halmat_worker_t *w, uint64_t need)
+{
+    uint64_t drop = w->held & ~need;
+    uint64_t add  = need & ~w->held;
+
+    /* Taking a stripe below one already held would break the ascending
+     * order, so start over from nothing */
+    if (add && w->held && __builtin_ctzll(add) < 63 - __builtin_clzll(w->held))
+        drop = w->held;
+
+    for (uint64_t b = drop; b; b &= b - 1)
+        pthread_mutex_unlock(&mt->stripe[__builtin_ctzll(b)]);
+    w->held &= ~drop;
+
+    for (uint64_t b = need & ~w->held; b; b &= b - 1)
+        pthread_mutex_lock(&mt->stripe[__builtin_ctzll(b)]);
+    w->held = need;
+}
+
+static uint64_t needed(halmat_mt_t *mt, halmat_worker_t *w, halmat_t *W)
+{
+    uint64_t need = W->pc < W->code_len ? mt->stmt_mask[mt->stmt_of[W->pc]] : 0;
+    for (uint32_t i = 0; i < W->frame_depth; i++)
+        need |= mt->stmt_mask[mt->stmt_of[W->frames[i].call_addr]];
+    for (uint32_t i = 0; i < W->update_depth && i < HALMAT_MAX_UPDATE; i++)
+        need |= w->upd[i];
+    return need;
+}
+
+/* ---- workers ---- */
+
+/* Run one process until it blocks, ends or is killed */
+static void run_process(halmat_worker_t *w, int32_t entry)
+{
+    halmat_mt_t *mt = w->mt;
+    halmat_t *W = w->H;
+    halmat_sched_t *S = W->sched;
+    int replay = (S->mt == SCHED_MT_REPLAY);
+    int32_t id = DQ_ID(entry);
+
+    pthread_mutex_lock(&mt->lock);
+    if (!replay && (S->tasks[id].state != TASK_READY ||
+                    (S->tasks[id].gen & 0x7FFFFF) != DQ_GEN(entry))) {
+        pthread_mutex_unlock(&mt->lock);     /* stale: terminated meanwhile */
+        return;
+    }
+    halmat_sched_restore(W, S, id);
+    pthread_mutex_unlock(&mt->lock);
+
+    uint32_t key_stmt = UINT32_MAX, key_fd = UINT32_MAX, key_ud = UINT32_MAX;
+    int rc;
+    for (;;) {
+        if (__atomic_load_n(&S->tasks[id].killed, __ATOMIC_RELAXED)) {
+            hold(mt, w, 0);
+            rc = halmat_sched_exit(W);
+            break;
+        }
+        if (__atomic_load_n(&mt->done, __ATOMIC_RELAXED)) {
+            rc = HALMAT_SWITCH;
+            break;
+        }
+
+        if (!replay) {
+            uint32_t st = W->pc < W->code_len ? mt->stmt_of[W->pc] : 0;
+            if (st != key_stmt || W->frame_depth != key_fd ||
+                W->update_depth != key_ud) {
+                key_stmt = st;
+                key_fd = W->frame_depth;
+                key_ud = W->update_depth;
+                hold(mt, w, needed(mt, w, W));
+            }
+        }
+
+        uint32_t pc = W->pc, ud = W->update_depth;
+        rc = halmat_step(W);
+        if (W->update_depth > ud && ud < HALMAT_MAX_UPDATE)
+            w->upd[ud] = mt->upd_mask[mt->stmt_of[pc]];
+        if (rc != HALMAT_OK)
+            break;
+    }
+    hold(mt, w, 0);
+
+    if (rc == HALMAT_HALT && W->halted == 1) {
+        /* Ran off the end of the program without a CLOS */
+        W->halted = 0;
+        rc = halmat_sched_exit(W);
+    }
+    if (rc < 0 || W->halted < 0) {
+        pthread_mutex_lock(&mt->lock);
+        mt->error = 1;
+        __atomic_store_n(&mt->done, 1, __ATOMIC_RELAXED);
+        pthread_cond_broadcast(&mt->cv);
+        pthread_mutex_unlock(&mt->lock);
+    }
+}
+
+static void *worker_parallel(void *arg)
+{
+    halmat_worker_t *w = arg;
+    halmat_mt_t *mt = w->mt;
+    halmat_sched_t *S = w->H->sched;
+
+    for (;;) {
+        int32_t e = dq_pop(&w->dq);
+        if (e < 0)
+            e = steal_any(mt, w);
+        if (e >= 0) {
+            /* running goes up before ready goes down: an idle worker that
+             * sees both at zero knows nothing is in flight */
+            __atomic_add_fetch(&mt->running, 1, __ATOMIC_SEQ_CST);
+            __atomic_sub_fetch(&mt->ready, 1, __ATOMIC_SEQ_CST);
+            run_process(w, e);
+            __atomic_sub_fetch(&mt->running, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        pthread_mutex_lock(&mt->lock);
+        if (mt->done) {
+            pthread_mutex_unlock(&mt->lock);
+            break;
+        }
+        if (__atomic_load_n(&mt->ready, __ATOMIC_SEQ_CST) == 0) {
+            if (__atomic_load_n(&mt->running, __ATOMIC_SEQ_CST) == 0) {
+                if (halmat_sched_advance(w->H, S)) {
+                    drain_ready(mt, w, S);
+                } else {
+                    __atomic_store_n(&mt->done, 1, __ATOMIC_RELAXED);
+                    pthread_cond_broadcast(&mt->cv);
+                }
+            } else {
+                pthread_cond_wait(&mt->cv, &mt->lock);
+            }
+        }
+        pthread_mutex_unlock(&mt->lock);
+    }
+    return NULL;
+}
+
+static void *worker_replay(void *arg)
+{
+    halmat_worker_t *w = arg;
+    halmat_mt_t *mt = w->mt;
+
+    for (;;) {
+        pthread_mutex_lock(&mt->lock);
+        while (!mt->done && !(mt->turn >= 0 && mt->turn_worker == w->idx))
+            pthread_cond_wait(&mt->cv, &mt->lock);
+        if (mt->done) {
+            pthread_mutex_unlock(&mt->lock);
+            break;
+        }
+        int32_t id = mt->turn;
+        mt->turn = -1;
+        pthread_mutex_unlock(&mt->lock);
+        run_process(w, id);
+    }
+    return NULL;
+}
+
+/* ---- hooks called from halmat_sched.c ---- */
+
+void halmat_sched_mt_enter(halmat_t *H)
+{
+    pthread_mutex_lock(&H->sched->pool->lock);
+}
+
+void halmat_sched_mt_leave(halmat_t *H)
+{
+    halmat_mt_t *mt = H->sched->pool;
+    if (H->sched->mt == SCHED_MT_PARALLEL && H->worker)
+        drain_ready(mt, H->worker, H->sched);
+    pthread_mutex_unlock(&mt->lock);
+}
+
+int halmat_sched_mt_handoff(halmat_sched_t *S, int32_t id)
+{
+    halmat_mt_t *mt = S->pool;
+    mt->turn = id;
+    mt->turn_worker = (uint32_t)(mt->handoffs++ % mt->nworkers);
+    pthread_cond_broadcast(&mt->cv);
+    return HALMAT_SWITCH;
+}
+
+int halmat_sched_mt_finish(halmat_sched_t *S)
+{
+    __atomic_store_n(&S->pool->done, 1, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&S->pool->cv);
+    return HALMAT_SWITCH;
+}
+
+/* Called on the first real-time operator: hand the rest of the run to the
+ * worker pool, starting with the main program at the current PC. */
+int halmat_sched_mt_run(halmat_t *H)
+{
+    halmat_sched_t *S = H->sched;
+    halmat_mt_t *mt = calloc(1, sizeof(*mt));
+    uint32_t n = H->sched_threads;
+
+    if (n > HALMAT_MAX_TASKS)
+        n = HALMAT_MAX_TASKS;
+    if (!mt || analyse(H, mt) != 0 ||
+        !(mt->workers = calloc(n, sizeof(halmat_worker_t)))) {
+        fprintf(stderr, "halmat_sched: out of memory for worker pool\n");
+        if (mt) {
+            free(mt->stmt_of);
+            free(mt->stmt_mask);
+            free(mt->upd_mask);
+        }
+        free(mt);
+        return HALMAT_ERR_OVERFLOW;
+    }
+    mt->nworkers = n;
+    mt->turn = -1;
+    pthread_mutex_init(&mt->lock, NULL);
+    pthread_cond_init(&mt->cv, NULL);
+    for (int i = 0; i < MT_STRIPES; i++)
+        pthread_mutex_init(&mt->stripe[i], NULL);
+
+    S->pool = mt;
+    S->mt = H->sched_replay ? SCHED_MT_REPLAY : SCHED_MT_PARALLEL;
+
+    /* Park the main program; it re-executes this operator on a worker */
+    {
+        halmat_task_t *t = &S->tasks[0];
+        t->pc = H->pc;
+        t->frame_depth = H->frame_depth;
+        t->loop_depth = H->loop_depth;
+        memcpy(t->frames, H->frames, H->frame_depth * sizeof(call_frame_t));
+        memcpy(t->loops, H->loops, H->loop_depth * sizeof(loop_info_t));
+        t->nvac = 0;
+        t->state = TASK_READY;
+    }
+
+    uint64_t cycles0 = H->cycle_count, stmts0 = H->stmt_count;
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        halmat_worker_t *w = &mt->workers[i];
+        w->H = malloc(CLONE_SIZE);
+        if (!w->H)
+            break;
+        memcpy(w->H, H, CLONE_SIZE);           /* shares code/syt/data/units */
+        w->H->worker = w;
+        w->H->task = -1;
+        w->mt = mt;
+        w->idx = i;
+    }
+    if (S->mt == SCHED_MT_PARALLEL) {
+        dq_push(&mt->workers[0].dq, DQ_ENTRY(0, S->tasks[0].gen));
+        mt->ready = 1;
+    } else {
+        mt->turn = 0;
+        mt->turn_worker = 0;
+        mt->handoffs = 1;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (!mt->workers[i].H ||
+            pthread_create(&mt->workers[i].thread, NULL,
+                           S->mt == SCHED_MT_REPLAY ? worker_replay
+                                                    : worker_parallel,
+                           &mt->workers[i]) != 0) {
+            fprintf(stderr, "halmat_sched: could not start worker %u\n", i);
+            pthread_mutex_lock(&mt->lock);
+            __atomic_store_n(&mt->done, 1, __ATOMIC_RELAXED);
+            mt->error = 1;
+            pthread_cond_broadcast(&mt->cv);
+            pthread_mutex_unlock(&mt->lock);
+            break;
+        }
+        started++;
+    }
+    for (uint32_t i = 0; i < started; i++)
+        pthread_join(mt->workers[i].thread, NULL);
+
+    for (uint32_t i = 0; i < n; i++) {
+        halmat_t *W = mt->workers[i].H;
+        if (!W)
+            continue;
+        H->cycle_count += W->cycle_count - cycles0;
+        H->stmt_count += W->stmt_count - stmts0;
+        free(W);
+    }
+    H->task = -1;
+    H->halted = mt->error ? -1 : 1;
+
+    free(mt->stmt_of);
+    free(mt->stmt_mask);
+    free(mt->upd_mask);
+    free(mt->workers);
+    pthread_mutex_destroy(&mt->lock);
+    pthread_cond_destroy(&mt->cv);
+    for (int i = 0; i < MT_STRIPES; i++)
+        pthread_mutex_destroy(&mt->stripe[i]);
+    free(mt);
+    S->pool = NULL;
+    S->mt = SCHED_MT_OFF;
+    return HALMAT_HALT;
+}
@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "halmat_shm.h"
+
+#define SPINS_BEFORE_YIELD 256
+#define YIELDS_PER_CHECK   1024     /* between looks for the peer's process */
+
+halmat_shm_t *halmat_shm_open(const char *name, int create)
+{
+    int fd = shm_open(name, create ? (O_RDWR | O_CREAT) : O_RDWR, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "halmat_shm: cannot open %s\n", name);
+        return NULL;
+    }
+    if (create && ftruncate(fd, (off_t)sizeof(halmat_shm_t)) != 0) {
+        fprintf(stderr, "halmat_shm: cannot size %s\n", name);
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(halmat_shm_t), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "halmat_shm: cannot map %s\n", name);
+        return NULL;
+    }
+
+    halmat_shm_t *shm = p;
+    if (create) {
+        memset(shm, 0, sizeof(*shm));
+        shm->version = HALMAT_SHM_VERSION;
+        shm->nunits = HALMAT_SHM_UNITS;
+        shm->ring_recs = HALMAT_SHM_RING_RECS;
+        __atomic_store_n(&shm->magic, HALMAT_SHM_MAGIC, __ATOMIC_RELEASE);
+    } else if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != HALMAT_SHM_MAGIC ||
+               shm->version != HALMAT_SHM_VERSION ||
+               shm->ring_recs != HALMAT_SHM_RING_RECS) {
+        fprintf(stderr, "halmat_shm: %s is not a version %d segment\n",
+                name, HALMAT_SHM_VERSION);
+        munmap(p, sizeof(halmat_shm_t));
+        return NULL;
+    }
+    return shm;
+}
+
+void halmat_shm_close(halmat_shm_t *shm, const char *name, int unlink)
+{
+    if (shm)
+        munmap(shm, sizeof(*shm));
+    if (unlink && name)
+        shm_unlink(name);
+}
+
+int halmat_shm_put(halmat_shm_ring_t *r, const halmat_shm_rec_t *rec)
+{
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    if (tail - head >= HALMAT_SHM_RING_RECS)
+        return 0;
+    halmat_shm_rec_t *slot = &r->rec[tail & (HALMAT_SHM_RING_RECS - 1)];
+    *slot = *rec;
+    slot->seq = (uint32_t)tail;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int halmat_shm_get(halmat_shm_ring_t *r, halmat_shm_rec_t *rec)
+{
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return 0;
+    *rec = r->rec[head & (HALMAT_SHM_RING_RECS - 1)];
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* While waiting: 1 if the peer is done, -1 if its process has gone,
+ * else 0.  The process is looked up only now and then while yielding. */
+static int peer_end(const halmat_shm_peer_t *peer, unsigned spin)
+{
+    if (halmat_shm_state(peer) == SHM_STATE_DONE)
+        return 1;
+    if (spin < SPINS_BEFORE_YIELD ||
+        (spin - SPINS_BEFORE_YIELD) % YIELDS_PER_CHECK != YIELDS_PER_CHECK - 1)
+        return 0;
+    int32_t pid = __atomic_load_n(&peer->pid, __ATOMIC_RELAXED);
+    return pid > 0 && kill((pid_t)pid, 0) != 0 && errno == ESRCH ? -1 : 0;
+}
+
+int halmat_shm_put_wait(halmat_shm_ring_t *r, const halmat_shm_rec_t *rec,
+                        const halmat_shm_peer_t *peer)
+{
+    for (unsigned spin = 0; !halmat_shm_put(r, rec); spin++) {
+        int end = peer_end(peer, spin);
+        if (end)
+            return end > 0 ? 0 : -1;
+        if (spin >= SPINS_BEFORE_YIELD)
+            sched_yield();
+    }
+    return 1;
+}
+
+int halmat_shm_get_wait(halmat_shm_ring_t *r, halmat_shm_rec_t *rec,
+                        const halmat_shm_peer_t *peer)
+{
+    for (unsigned spin = 0; !halmat_shm_get(r, rec); spin++) {
+        /* Re-check after the peer ends: it may have published its last
+         * record just before */
+        int end = peer_end(peer, spin);
+        if (end)
+            return halmat_shm_get(r, rec) ? 1 : end > 0 ? 0 : -1;
+        if (spin >= SPINS_BEFORE_YIELD)
+            sched_yield();
+    }
+    return 1;
+}
+
+void halmat_shm_set_state(halmat_shm_peer_t *peer, uint32_t value)
+{
+    if (value == SHM_STATE_RUNNING)
+        __atomic_store_n(&peer->pid, (int32_t)getpid(), __ATOMIC_RELAXED);
+    __atomic_store_n(&peer->state, value, __ATOMIC_RELEASE);
+}
+
+uint32_t halmat_shm_state(const halmat_shm_peer_t *peer)
+{
+    return __atomic_load_n(&peer->state, __ATOMIC_ACQUIRE);
+}
+
+/* The host's input ring for unit, or NULL (with a message) if out of range */
+static halmat_shm_ring_t *in_ring(halmat_shm_t *shm, int unit)
+{
+    if (unit < 0 || unit >= HALMAT_SHM_UNITS) {
+        fprintf(stderr, "halmat_shm: no unit %d\n", unit);
+        return NULL;
+    }
+    return &shm->in[unit];
+}
+
+int halmat_shm_send_int(halmat_shm_t *shm, int unit, int32_t v)
+{
+    halmat_shm_ring_t *r = in_ring(shm, unit);
+    halmat_shm_rec_t rec;
+    if (!r)
+        return -1;
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = SHM_REC_INT;
+    rec.v.integer = v;
+    return halmat_shm_put_wait(r, &rec, &shm->emu) == 1 ? 0 : -1;
+}
+
+int halmat_shm_send_scalar(halmat_shm_t *shm, int unit, double v)
+{
+    halmat_shm_ring_t *r = in_ring(shm, unit);
+    halmat_shm_rec_t rec;
+    if (!r)
+        return -1;
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = SHM_REC_SCALAR;
+    rec.v.scalar = v;
+    return halmat_shm_put_wait(r, &rec, &shm->emu) == 1 ? 0 : -1;
+}
+
+int halmat_shm_send_char(halmat_shm_t *shm, int unit, const char *s, int len)
+{
+    halmat_shm_ring_t *r = in_ring(shm, unit);
+    halmat_shm_rec_t rec;
+    if (!r)
+        return -1;
+    do {
+        int chunk = len > HALMAT_SHM_PAYLOAD ? HALMAT_SHM_PAYLOAD : len;
+        memset(&rec, 0, sizeof(rec));
+        rec.kind = SHM_REC_CHAR;
+        rec.len = (uint16_t)chunk;
+        rec.flags = (len > chunk) ? SHM_F_MORE : 0;
+        memcpy(rec.v.chars, s, (size_t)chunk);
+        if (halmat_shm_put_wait(r, &rec, &shm->emu) != 1)
+            return -1;
+        s += chunk;
+        len -= chunk;
+    } while (len > 0);
+    return 0;
+}
+
+int halmat_shm_send_eol(halmat_shm_t *shm, int unit)
+{
+    halmat_shm_ring_t *r = in_ring(shm, unit);
+    halmat_shm_rec_t rec;
+    if (!r)
+        return -1;
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = SHM_REC_EOL;
+    return halmat_shm_put_wait(r, &rec, &shm->emu) == 1 ? 0 : -1;
+}
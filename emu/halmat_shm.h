@@ -0,0 +1,109 @@
+/* Shared-memory I/O channels between yaHALMAT-shm and a host simulator.
+ *
+ * One POSIX shm segment holds a pair of single-producer/single-consumer
+ * rings per logical unit: "out" carries WRITE data to the host, "in"
+ * carries READ data to the emulator.  Records are fixed 64-byte binary
+ * values; nothing is formatted as text and the fast path makes no
+ * system calls.  This header is the whole host-side API (link
+ * libhalmathost.a); it does not depend on the rest of the emulator. */
+
+#ifndef HALMAT_SHM_H
+#define HALMAT_SHM_H
+
+#include <stdint.h>
+
+#define HALMAT_SHM_MAGIC      0x484C4D54u   /* "HLMT" */
+#define HALMAT_SHM_VERSION    2
+#define HALMAT_SHM_UNITS      16
+#define HALMAT_SHM_RING_RECS  1024          /* power of 2 */
+#define HALMAT_SHM_PAYLOAD    48
+#define HALMAT_SHM_DEFAULT    "/halmat"     /* overridden by $HALMAT_SHM */
+
+/* Record kinds */
+#define SHM_REC_INT     1
+#define SHM_REC_SCALAR  2
+#define SHM_REC_CHAR    3   /* up to 48 bytes; SHM_F_MORE chains the rest */
+#define SHM_REC_BIT     4
+#define SHM_REC_EOL     5   /* end of one WRITE statement / input record */
+
+#define SHM_F_MORE      0x01
+
+/* Peer states */
+#define SHM_STATE_NONE     0
+#define SHM_STATE_RUNNING  1
+#define SHM_STATE_DONE     2
+
+/* One side of the connection.  pid is published with RUNNING so that
+ * the other side can tell a crash from a peer that is merely slow. */
+typedef struct {
+    uint32_t state;                 /* SHM_STATE_* */
+    int32_t  pid;                   /* 0 = not published */
+} halmat_shm_peer_t;
+
+typedef struct {
+    uint8_t  kind;
+    uint8_t  flags;
+    uint16_t len;           /* CHAR bytes in this record */
+    uint32_t seq;           /* per-ring record number */
+    uint64_t stamp_us;      /* emulator virtual clock when produced */
+    union {
+        int32_t  integer;
+        double   scalar;
+        uint32_t bits;
+        char     chars[HALMAT_SHM_PAYLOAD];
+    } v;
+} halmat_shm_rec_t;
+
+typedef char halmat_shm_rec_size_check[sizeof(halmat_shm_rec_t) == 64 ? 1 : -1];
+
+/* head and tail live on their own cache lines so producer and consumer
+ * never write the same line */
+typedef struct {
+    uint64_t head;                  /* next record to consume */
+    uint8_t  _pad0[56];
+    uint64_t tail;                  /* next record to produce */
+    uint8_t  _pad1[56];
+    halmat_shm_rec_t rec[HALMAT_SHM_RING_RECS];
+} halmat_shm_ring_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nunits;
+    uint32_t ring_recs;
+    halmat_shm_peer_t emu;
+    halmat_shm_peer_t host;
+    uint8_t  _pad[32];
+    halmat_shm_ring_t out[HALMAT_SHM_UNITS];    /* emulator -> host */
+    halmat_shm_ring_t in[HALMAT_SHM_UNITS];     /* host -> emulator */
+} halmat_shm_t;
+
+/* Map the segment, creating and initialising it when create is set */
+halmat_shm_t *halmat_shm_open(const char *name, int create);
+void          halmat_shm_close(halmat_shm_t *shm, const char *name, int unlink);
+
+/* Non-blocking: 1 on success, 0 if the ring is full/empty */
+int halmat_shm_put(halmat_shm_ring_t *r, const halmat_shm_rec_t *rec);
+int halmat_shm_get(halmat_shm_ring_t *r, halmat_shm_rec_t *rec);
+
+/* Blocking variants: spin, then yield, checking on the peer at the
+ * other end.  1 once the record is through; 0 if the peer is done (for
+ * get, and the ring is empty); -1 if its process has gone without
+ * saying so.  A peer that has not started yet is waited for. */
+int halmat_shm_put_wait(halmat_shm_ring_t *r, const halmat_shm_rec_t *rec,
+                        const halmat_shm_peer_t *peer);
+int halmat_shm_get_wait(halmat_shm_ring_t *r, halmat_shm_rec_t *rec,
+                        const halmat_shm_peer_t *peer);
+
+/* RUNNING also publishes the calling process's pid */
+void     halmat_shm_set_state(halmat_shm_peer_t *peer, uint32_t value);
+uint32_t halmat_shm_state(const halmat_shm_peer_t *peer);
+
+/* Host convenience: queue input values for READ on a unit; -1 if the
+ * unit is out of range or the emulator has gone */
+int halmat_shm_send_int(halmat_shm_t *shm, int unit, int32_t v);
+int halmat_shm_send_scalar(halmat_shm_t *shm, int unit, double v);
+int halmat_shm_send_char(halmat_shm_t *shm, int unit, const char *s, int len);
+int halmat_shm_send_eol(halmat_shm_t *shm, int unit);
+
+#endif /* HALMAT_SHM_H */
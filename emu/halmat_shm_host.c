@@ -0,0 +1,222 @@
+/* halmat-host: plays the host-simulator side of the shared-memory I/O
+ * channels.  Creates the segment, runs yaHALMAT-shm as a child and
+ * prints what the program WRITEs, one line per WRITE statement, in the
+ * same format as the file-based I/O.  --selftest pushes N records
+ * through a ring between two processes and checks order and content. */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "halmat_shm.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] -- yaHALMAT-shm [args...]\n", prog);
+    fprintf(stderr, "       %s --selftest N\n", prog);
+    fprintf(stderr, "  --shm NAME     Segment name (default $HALMAT_SHM or %s)\n",
+            HALMAT_SHM_DEFAULT);
+    fprintf(stderr, "  --in U:V       Queue value V for READ on unit U (repeatable)\n");
+    fprintf(stderr, "  --stamps       Prefix each line with unit and virtual time\n");
+}
+
+static void queue_input(halmat_shm_t *shm, const char *spec)
+{
+    char *end;
+    long unit = strtol(spec, &end, 10);
+    if (*end != ':' || unit < 0 || unit >= HALMAT_SHM_UNITS) {
+        fprintf(stderr, "halmat-host: bad --in '%s'\n", spec);
+        exit(1);
+    }
+    const char *v = end + 1;
+    long iv = strtol(v, &end, 10);
+    if (*v && !*end) {
+        halmat_shm_send_int(shm, (int)unit, (int32_t)iv);
+        return;
+    }
+    double dv = strtod(v, &end);
+    if (*v && !*end)
+        halmat_shm_send_scalar(shm, (int)unit, dv);
+    else
+        halmat_shm_send_char(shm, (int)unit, v, (int)strlen(v));
+}
+
+/* Per-unit line state: a line is printed once its EOL arrives */
+typedef struct {
+    char buf[4096];
+    int  len;
+    uint64_t stamp_us;
+} line_t;
+
+static void append(line_t *l, const char *s, int n)
+{
+    if (n > (int)sizeof(l->buf) - l->len)
+        n = (int)sizeof(l->buf) - l->len;
+    memcpy(l->buf + l->len, s, (size_t)n);
+    l->len += n;
+}
+
+static void consume(line_t *l, int unit, const halmat_shm_rec_t *rec, int stamps)
+{
+    char tmp[64];
+    int n = 0;
+    if (l->len == 0)
+        l->stamp_us = rec->stamp_us;
+    switch (rec->kind) {
+    case SHM_REC_INT:
+        n = snprintf(tmp, sizeof(tmp), "%11d", rec->v.integer);
+        break;
+    case SHM_REC_SCALAR:
+        n = (rec->v.scalar == 0.0) ? snprintf(tmp, sizeof(tmp), " 0.0")
+                                   : snprintf(tmp, sizeof(tmp), "% .7E", rec->v.scalar);
+        break;
+    case SHM_REC_BIT:
+        n = snprintf(tmp, sizeof(tmp), "%u", rec->v.bits);
+        break;
+    case SHM_REC_CHAR:
+        append(l, rec->v.chars, rec->len);
+        return;
+    case SHM_REC_EOL:
+        if (stamps)
+            printf("[%2d %10.6f] ", unit, l->stamp_us / 1e6);
+        printf("%.*s\n", l->len, l->buf);
+        l->len = 0;
+        return;
+    }
+    append(l, tmp, n);
+}
+
+static int run_host(halmat_shm_t *shm, char **argv, int stamps)
+{
+    static line_t lines[HALMAT_SHM_UNITS];
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "halmat-host: fork failed\n");
+        return 1;
+    }
+    if (pid == 0) {
+        execv(argv[0], argv);
+        fprintf(stderr, "halmat-host: cannot run %s\n", argv[0]);
+        _exit(127);
+    }
+
+    halmat_shm_rec_t rec;
+    for (;;) {
+        /* Sample the state before draining so that records published
+         * just ahead of DONE are not lost */
+        uint32_t st = halmat_shm_state(&shm->emu);
+        int got = 0;
+        for (int u = 0; u < HALMAT_SHM_UNITS; u++)
+            while (halmat_shm_get(&shm->out[u], &rec)) {
+                consume(&lines[u], u, &rec, stamps);
+                got = 1;
+            }
+        if (got)
+            continue;
+        if (st == SHM_STATE_DONE)
+            break;
+        if (waitpid(pid, NULL, WNOHANG) == pid) {
+            pid = 0;                        /* died without DONE */
+            break;
+        }
+        nanosleep(&(struct timespec){0, 100000}, NULL);
+    }
+    fflush(stdout);
+
+    halmat_shm_set_state(&shm->host, SHM_STATE_DONE);
+    int status = 0;
+    if (pid > 0)
+        waitpid(pid, &status, 0);
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : 1;
+}
+
+static int selftest(halmat_shm_t *shm, long n)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        return 1;
+    if (pid == 0) {
+        halmat_shm_rec_t rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.kind = SHM_REC_INT;
+        halmat_shm_set_state(&shm->emu, SHM_STATE_RUNNING);
+        for (long i = 0; i < n; i++) {
+            rec.v.integer = (int32_t)(i * 7);
+            rec.stamp_us = (uint64_t)i;
+            if (halmat_shm_put_wait(&shm->out[0], &rec, &shm->host) != 1)
+                _exit(1);
+        }
+        halmat_shm_set_state(&shm->emu, SHM_STATE_DONE);
+        _exit(0);
+    }
+
+    halmat_shm_rec_t rec;
+    long i = 0, bad = 0;
+    while (halmat_shm_get_wait(&shm->out[0], &rec, &shm->emu) == 1) {
+        if (rec.seq != (uint32_t)i || rec.v.integer != (int32_t)(i * 7) ||
+            rec.stamp_us != (uint64_t)i)
+            bad++;
+        i++;
+    }
+    waitpid(pid, NULL, 0);
+    printf("selftest: %ld records, %ld bad\n", i, bad);
+    return (i == n && bad == 0) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = getenv("HALMAT_SHM");
+    long selftest_n = 0;
+    int stamps = 0;
+    int i;
+
+    if (!name || !name[0])
+        name = HALMAT_SHM_DEFAULT;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc)
+            name = argv[++i];
+        else if (strcmp(argv[i], "--selftest") == 0 && i + 1 < argc)
+            selftest_n = atol(argv[++i]);
+        else if (strcmp(argv[i], "--stamps") == 0)
+            stamps = 1;
+        else if (strcmp(argv[i], "--in") == 0 && i + 1 < argc)
+            i++;                            /* queued once the segment exists */
+        else if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!selftest_n && i >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    halmat_shm_t *shm = halmat_shm_open(name, 1);
+    if (!shm)
+        return 1;
+    halmat_shm_set_state(&shm->host, SHM_STATE_RUNNING);
+    setenv("HALMAT_SHM", name, 1);
+
+    int rc;
+    if (selftest_n) {
+        rc = selftest(shm, selftest_n);
+    } else {
+        for (int j = 1; j < i; j++)
+            if (strcmp(argv[j], "--in") == 0)
+                queue_input(shm, argv[++j]);
+            else if (strcmp(argv[j], "--shm") == 0)
+                j++;
+        rc = run_host(shm, argv + i, stamps);
+    }
+
+    halmat_shm_close(shm, name, 1);
+    return rc;
+}
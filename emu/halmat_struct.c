@@ -0,0 +1,602 @@
+/* Structures and NAME variables: EXTN/XPT, TASN, TEQU, TNEQ, NASN,
+ * NEQU, NNEQ, TINT, NINT, EINT.
+ *
+ * Templates come from the STRUCTURE statements in the HAL/S source;
+ * halmat_load_declares numbers a template and its fields like any
+ * other symbols.  At load time the fields of each template are packed
+ * in order of declaration at their natural alignment (SCALAR, VECTOR
+ * and MATRIX 8, INTEGER and BIT 4, CHARACTER 2), so a field costs its
+ * own size rather than a whole halmat_val_t.  A minor structure spans
+ * the fields under it, and each structure variable gets one block per
+ * copy in the data segment.  Structure assignment and comparison are
+ * then memmove/memcmp over the blocks.
+ *
+ * An EXTN lists the qualification of a structure reference, e.g.
+ * A.B.C: the variable first, the field referenced last.  Each EXTN is
+ * decoded once into the field's offset, and an XPT operand naming it
+ * resolves to a reference into the block, the same as a DSUB result.
+ *
+ * NAME variables and NAME fields hold real pointers (halmat_name_t)
+ * into that storage, or into a plain variable's value.  Reading or
+ * assigning a NAME variable reads or assigns what it points at; NASN
+ * and NINT change where it points. */
+
+#include <stddef.h>
+#include "halmat.h"
+
+#define ADVANCE() do { H->pc = pc + numop + 1; } while (0)
+#define NEXT_OP(H, a) halmat_op_at(H, (a) + HALMAT_NUMOP((H)->code[a]) + 1)
+
+typedef struct {
+    uint32_t off;           /* field offset into a copy */
+    uint16_t var;           /* structure variable, or a NAME of one */
+    uint16_t field;         /* field referenced, 0 = the whole structure */
+    uint8_t  hops;          /* NAME fields on the way: walk at run time */
+} xref_t;
+
+struct halmat_structs {
+    uint32_t *xref_at;      /* EXTN address -> xref + 1 */
+    xref_t   *xrefs;
+    uint32_t  nxrefs;
+};
+
+static int null_name(halmat_t *H)
+{
+    fprintf(stderr, "halmat_class0: NULL NAME dereferenced at PC=%u\n", H->pc);
+    return HALMAT_ERR_NULL_NAME;
+}
+
+static halmat_name_t *slot(uint8_t *p)
+{
+    return (halmat_name_t *)p;
+}
+
+/* ---- layout ---- */
+
+static uint32_t align_of(const syt_entry_t *e)
+{
+    if (e->st.name)
+        return 8;
+    switch (e->arr.etype) {
+    case HTYPE_SCALAR:
+    case HTYPE_VECTOR:
+    case HTYPE_MATRIX:
+    case HTYPE_STRUCT:  return 8;
+    case HTYPE_CHAR:    return 2;
+    default:            return 4;
+    }
+}
+
+static int is_field(const halmat_t *H, uint32_t f, uint32_t tp)
+{
+    return f < HALMAT_MAX_SYT && H->syt[f].st.owner == tp &&
+           (H->syt[f].st.kind == SK_FIELD || H->syt[f].st.kind == SK_MINOR);
+}
+
+/* Offsets of the fields of template tp and its size per copy */
+static void layout(halmat_t *H, uint32_t tp)
+{
+    uint32_t open[16];
+    int nopen = 0;
+    uint32_t at = 0;
+
+    for (uint32_t f = tp + 1; is_field(H, f, tp); f++) {
+        syt_entry_t *e = &H->syt[f];
+        while (nopen && H->syt[open[nopen - 1]].st.level >= e->st.level) {
+            syt_entry_t *m = &H->syt[open[--nopen]];
+            m->arr.esize = at - m->st.offset;
+        }
+        if (e->st.kind == SK_MINOR) {
+            at = (at + 7u) & ~7u;
+            e->st.offset = at;
+            if (nopen < 16)
+                open[nopen++] = f;
+            continue;
+        }
+        if (e->arr.etype == HTYPE_STRUCT)
+            e->arr.esize = e->st.templ ? H->syt[e->st.templ].arr.esize : 0;
+        uint32_t size = halmat_array_layout(&e->arr);
+        if (e->st.name)
+            size = sizeof(halmat_name_t);
+        uint32_t al = align_of(e);
+        at = (at + al - 1) & ~(al - 1);
+        e->st.offset = at;
+        at += size;
+    }
+    while (nopen) {
+        syt_entry_t *m = &H->syt[open[--nopen]];
+        m->arr.esize = at - m->st.offset;
+    }
+    H->syt[tp].arr.esize = (at + 7u) & ~7u;
+}
+
+/* Copies of structure variable s (1 if not multiple) */
+static uint32_t copies(const halmat_t *H, uint32_t s)
+{
+    const halmat_array_t *a = &H->syt[s].arr;
+    return a->ndim ? a->extent[0] : 1;
+}
+
+/* ---- EXTN ---- */
+
+/* Offset of the field an EXTN designates; hops if a NAME field on the
+ * way has to be followed at run time */
+static void decode(halmat_t *H, uint32_t addr, xref_t *x)
+{
+    uint32_t n = HALMAT_NUMOP(H->code[addr]);
+    memset(x, 0, sizeof(*x));
+    x->var = (uint16_t)HALMAT_DATA(H->code[addr + 1]);
+    for (uint32_t k = 2; k <= n; k++) {
+        uint32_t f = HALMAT_DATA(H->code[addr + k]);
+        if (HALMAT_QUAL(H->code[addr + k]) != QUAL_SYT || f >= HALMAT_MAX_SYT)
+            continue;
+        const syt_entry_t *e = &H->syt[f];
+        x->field = (uint16_t)f;
+        if (k == n)
+            x->off += e->st.offset;
+        else if (e->st.name)
+            x->hops++;
+        else if (e->arr.etype == HTYPE_STRUCT && e->st.templ)
+            x->off += e->st.offset;     /* into a nested template */
+    }
+}
+
+static const xref_t *xref(halmat_t *H, uint32_t addr)
+{
+    struct halmat_structs *S = H->structs;
+    uint32_t k = S && addr < H->code_len ? S->xref_at[addr] : 0;
+    return k ? &S->xrefs[k - 1] : NULL;
+}
+
+/* Start of copy 1 of structure variable s; NULL for a NULL NAME */
+static uint8_t *var_base(halmat_t *H, uint32_t s)
+{
+    const syt_entry_t *e = &H->syt[s];
+    if (e->st.name)
+        return slot(H->data + e->st.offset)->p;
+    return H->data + e->arr.base;
+}
+
+/* Address of the field an XPT designates, in copy 1; NULL if a NAME
+ * on the way is NULL.  A NAME field itself is not followed. */
+static uint8_t *field_addr(halmat_t *H, const xref_t *x, uint32_t addr)
+{
+    uint8_t *p = var_base(H, x->var);
+    if (!p)
+        return NULL;
+    if (!x->hops)
+        return p + x->off;
+
+    uint32_t n = HALMAT_NUMOP(H->code[addr]);
+    for (uint32_t k = 2; k <= n; k++) {
+        uint32_t f = HALMAT_DATA(H->code[addr + k]);
+        if (HALMAT_QUAL(H->code[addr + k]) != QUAL_SYT || f >= HALMAT_MAX_SYT)
+            continue;
+        const syt_entry_t *e = &H->syt[f];
+        if (k == n)
+            return p + e->st.offset;
+        if (e->st.name) {
+            p = slot(p + e->st.offset)->p;
+            if (!p)
+                return NULL;
+        } else if (e->arr.etype == HTYPE_STRUCT && e->st.templ) {
+            p += e->st.offset;
+        }
+    }
+    return p;
+}
+
+/* ---- what an operand designates ---- */
+
+/* Dimensions to subscript, for a DSUB on word: an XPT's field, with
+ * the copies of a multiple structure as the first dimension, or what
+ * a NAME variable points at.  1 if the address comes from
+ * halmat_struct_addr(), 0 for an ordinary variable. */
+int halmat_struct_desc(halmat_t *H, uint32_t word, halmat_array_t *a)
+{
+    uint32_t d = HALMAT_DATA(word);
+
+    if (HALMAT_QUAL(word) == QUAL_XPT) {
+        const xref_t *x = xref(H, d);
+        memset(a, 0, sizeof(*a));
+        if (!x)
+            return 1;
+        const syt_entry_t *f = &H->syt[x->field ? x->field : x->var];
+        *a = f->arr;
+        if (!x->field) {
+            a->ndim = 0;
+            a->count = 1;
+        }
+        if (f->st.name)                 /* points elsewhere */
+            return 1;
+        if (!a->count)
+            a->count = 1;
+        uint32_t n = copies(H, x->var);
+        if (n > 1 && !x->hops && a->ndim < HALMAT_MAX_DIMS) {
+            memmove(a->extent + 1, a->extent, a->ndim * sizeof(a->extent[0]));
+            memmove(a->stride + 1, a->stride, a->ndim * sizeof(a->stride[0]));
+            a->extent[0] = (uint16_t)n;
+            a->stride[0] = H->syt[x->var].arr.esize;
+            a->ndim++;
+            a->count *= n;
+        }
+        return 1;
+    }
+
+    if (HALMAT_QUAL(word) != QUAL_SYT || d >= HALMAT_MAX_SYT) {
+        memset(a, 0, sizeof(*a));
+        return 0;
+    }
+    const syt_entry_t *e = &H->syt[d];
+    *a = e->arr;
+    if (e->arr.etype == HTYPE_STRUCT && !e->st.name) {
+        a->count = copies(H, d);
+        return 1;
+    }
+    return e->st.name;
+}
+
+/* Where the data word designates starts (an XPT: in copy 1), following
+ * a NAME; plain is set to the variable + 1 if that is a plain
+ * variable's value.  NULL for a NULL NAME. */
+uint8_t *halmat_struct_addr(halmat_t *H, uint32_t word, uint32_t *plain)
+{
+    uint32_t d = HALMAT_DATA(word);
+    uint8_t *p = NULL;
+
+    *plain = 0;
+    if (HALMAT_QUAL(word) == QUAL_XPT) {
+        const xref_t *x = xref(H, d);
+        if (!x || !(p = field_addr(H, x, d))) {
+            null_name(H);
+            return NULL;
+        }
+        if (!x->field || !H->syt[x->field].st.name)
+            return p;
+    } else if (HALMAT_QUAL(word) == QUAL_SYT && d < HALMAT_MAX_SYT) {
+        if (!H->syt[d].st.name)
+            return H->data + H->syt[d].arr.base;
+        p = H->data + H->syt[d].st.offset;
+    } else {
+        return NULL;
+    }
+
+    const halmat_name_t *n = slot(p);       /* a NAME: follow it */
+    if (!n->p) {
+        null_name(H);
+        return NULL;
+    }
+    *plain = n->syt;
+    return n->p;
+}
+
+/* Reference to the data word designates: a structure field (XPT), a
+ * whole structure, or what a NAME variable points at.  In an array
+ * loop, the current element of an arrayed field or of the copies.
+ * 0, HALMAT_ERR_NULL_NAME, or 1 if word is none of these. */
+int halmat_struct_ref(halmat_t *H, uint32_t word, halmat_val_t *r)
+{
+    halmat_array_t a;
+    uint32_t plain;
+
+    if (!halmat_struct_desc(H, word, &a))
+        return 1;
+    uint8_t *p = halmat_struct_addr(H, word, &plain);
+    if (!p)
+        return HALMAT_ERR_NULL_NAME;
+
+    uint32_t all = a.count;
+    if (a.etype != HTYPE_STRUCT && H->adlp_n && a.count > 1) {
+        uint32_t i = H->adlp_i % a.count;   /* row-major digits */
+        for (int d = a.ndim - 1; d >= 0; d--) {
+            p += (i % a.extent[d]) * a.stride[d];
+            i /= a.extent[d];
+        }
+    }
+    halmat_ref_init(r, &a, p);
+    if (a.etype == HTYPE_STRUCT && HALMAT_QUAL(word) == QUAL_SYT && all > 1)
+        r->v.ref.bytes = a.esize * all;     /* all copies */
+    if (plain) {
+        r->v.ref.p = p;
+        r->v.ref.len = &H->syt[plain - 1].val.v.string.len;
+        r->v.ref.syt = (uint16_t)plain;
+    }
+    return 0;
+}
+
+/* What NAME(word) gives: where the operand's value lives, or the
+ * pointer a NAME variable or field already holds */
+static halmat_name_t name_of(halmat_t *H, uint32_t word)
+{
+    halmat_name_t n = {NULL, 0};
+    uint32_t d = HALMAT_DATA(word);
+
+    switch (HALMAT_QUAL(word)) {
+    case QUAL_SYT: {
+        if (d >= HALMAT_MAX_SYT)
+            break;
+        syt_entry_t *e = &H->syt[d];
+        if (e->st.name) {
+            n = *slot(H->data + e->st.offset);
+        } else if (e->arr.count || e->arr.etype == HTYPE_STRUCT) {
+            n.p = H->data + e->arr.base;
+        } else {
+            n.p = (uint8_t *)&e->val.v;
+            n.syt = d + 1;
+        }
+        break;
+    }
+    case QUAL_XPT: {
+        const xref_t *x = xref(H, d);
+        uint8_t *p = x ? field_addr(H, x, d) : NULL;
+        if (p && x->field && H->syt[x->field].st.name)
+            n = *slot(p);
+        else
+            n.p = p;
+        break;
+    }
+    case QUAL_VAC: {
+        const halmat_val_t *r = &H->vac[VAC_SLOT(d)];
+        if (r->type != HTYPE_REF)
+            break;
+        n.syt = r->v.ref.syt;
+        n.p = !n.syt && r->v.ref.store == HTYPE_CHAR ? (uint8_t *)r->v.ref.len
+                                                     : r->v.ref.p;
+        break;
+    }
+    }
+    return n;
+}
+
+/* The pointer a NAME variable or an XPT to a NAME field holds */
+static halmat_name_t *name_slot(halmat_t *H, uint32_t word)
+{
+    uint32_t d = HALMAT_DATA(word);
+
+    if (HALMAT_QUAL(word) == QUAL_SYT && d < HALMAT_MAX_SYT && H->syt[d].st.name)
+        return slot(H->data + H->syt[d].st.offset);
+    if (HALMAT_QUAL(word) == QUAL_XPT) {
+        const xref_t *x = xref(H, d);
+        if (x && x->field && H->syt[x->field].st.name) {
+            uint8_t *p = field_addr(H, x, d);
+            return p ? slot(p) : NULL;
+        }
+    }
+    return NULL;
+}
+
+/* Whole structure, or a copy or minor structure of one */
+static int struct_operand(halmat_t *H, uint32_t word, halmat_val_t *r)
+{
+    if (HALMAT_QUAL(word) == QUAL_VAC) {
+        *r = H->vac[VAC_SLOT(HALMAT_DATA(word))];
+        return r->type == HTYPE_REF && r->v.ref.type == HTYPE_STRUCT ? 0 : -1;
+    }
+    int rc = halmat_struct_ref(H, word, r);
+    if (rc)
+        return rc < 0 ? rc : -1;
+    return r->v.ref.type == HTYPE_STRUCT ? 0 : -1;
+}
+
+/* ---- initialisation ---- */
+
+/* Reference to terminal element k of structure variable s, counting
+ * through every field of every copy; -1 past the end */
+static int terminal(halmat_t *H, uint32_t s, uint32_t k, halmat_val_t *r)
+{
+    uint32_t tp = H->syt[s].st.templ;
+    uint32_t per = 0;
+
+    if (!tp)
+        return -1;
+    for (uint32_t f = tp + 1; is_field(H, f, tp); f++) {
+        const syt_entry_t *e = &H->syt[f];
+        if (e->st.kind == SK_FIELD && !e->st.name && e->arr.etype != HTYPE_STRUCT)
+            per += e->arr.count ? e->arr.count : 1;
+    }
+    if (!per || k >= per * copies(H, s))
+        return -1;
+
+    uint8_t *p = var_base(H, s);
+    if (!p)
+        return -1;
+    p += (k / per) * H->syt[s].arr.esize;
+    k %= per;
+    for (uint32_t f = tp + 1; is_field(H, f, tp); f++) {
+        const syt_entry_t *e = &H->syt[f];
+        if (e->st.kind != SK_FIELD || e->st.name || e->arr.etype == HTYPE_STRUCT)
+            continue;
+        uint32_t n = e->arr.count ? e->arr.count : 1;
+        if (k < n) {
+            halmat_ref_init(r, &e->arr, p + e->st.offset + k * e->arr.esize);
+            return 0;
+        }
+        k -= n;
+    }
+    return -1;
+}
+
+/* ---- operators ---- */
+
+int halmat_struct_exec(halmat_t *H, uint32_t popcode, uint32_t numop, uint32_t tag)
+{
+    struct halmat_structs *S = H->structs;
+    uint32_t pc = H->pc;
+    halmat_val_t a, b;
+    (void)tag;
+
+    switch (popcode) {
+
+    case POP_TASN: {
+        if (numop < 2) break;
+        int rc = struct_operand(H, H->code[pc + 1], &a);
+        if (rc == 0)
+            rc = struct_operand(H, H->code[pc + 2], &b);
+        if (rc == HALMAT_ERR_NULL_NAME)
+            return rc;
+        if (rc < 0 || !a.v.ref.bytes)
+            break;
+        /* one copy into every copy of the destination */
+        uint32_t n = a.v.ref.bytes < b.v.ref.bytes ? a.v.ref.bytes : b.v.ref.bytes;
+        for (uint32_t at = 0; at + n <= b.v.ref.bytes; at += n)
+            memmove(b.v.ref.p + at, a.v.ref.p, n);
+        if (H->watch)
+            halmat_watch_asn(H, pc);
+        break;
+    }
+
+    case POP_TEQU:
+    case POP_TNEQ: {
+        if (numop < 2) break;
+        int rc = struct_operand(H, H->code[pc + 1], &a);
+        if (rc == 0)
+            rc = struct_operand(H, H->code[pc + 2], &b);
+        if (rc == HALMAT_ERR_NULL_NAME)
+            return rc;
+        int eq = rc == 0 && a.v.ref.bytes == b.v.ref.bytes &&
+                 memcmp(a.v.ref.p, b.v.ref.p, a.v.ref.bytes) == 0;
+        halmat_val_t r = {0};
+        r.type = HTYPE_INTEGER;
+        r.v.integer = popcode == POP_TEQU ? eq : !eq;
+        halmat_store_vac(H, pc, r);
+        H->cond_true = r.v.integer;
+        break;
+    }
+
+    case POP_NEQU:
+    case POP_NNEQ: {
+        if (numop < 2) break;
+        halmat_name_t x = name_of(H, H->code[pc + 1]);
+        halmat_name_t y = name_of(H, H->code[pc + 2]);
+        int eq = x.p == y.p;
+        halmat_val_t r = {0};
+        r.type = HTYPE_INTEGER;
+        r.v.integer = popcode == POP_NEQU ? eq : !eq;
+        halmat_store_vac(H, pc, r);
+        H->cond_true = r.v.integer;
+        break;
+    }
+
+    case POP_NASN: {
+        /* NAME(dest) = NAME(src) */
+        if (numop < 2) break;
+        halmat_name_t *n = name_slot(H, H->code[pc + 2]);
+        if (n)
+            *n = name_of(H, H->code[pc + 1]);
+        break;
+    }
+
+    case POP_NINT: {
+        if (numop < 2) break;
+        halmat_name_t *n = name_slot(H, H->code[pc + 1]);
+        if (n)
+            *n = name_of(H, H->code[pc + 2]);
+        break;
+    }
+
+    case POP_TINT: {
+        /* successive values fill the terminals in order */
+        uint32_t s = HALMAT_DATA(H->code[pc + 1]);
+        if (numop < 2 || !S || HALMAT_QUAL(H->code[pc + 1]) != QUAL_SYT ||
+            s >= HALMAT_MAX_SYT)
+            break;
+        if (H->tint_syt != s) {
+            H->tint_syt = s;
+            H->tint_next = 0;
+        }
+        a = halmat_resolve_operand(H, H->code[pc + 2]);
+        if (terminal(H, s, H->tint_next++, &b) == 0)
+            halmat_ref_store(H, &b, &a);
+        break;
+    }
+
+    case POP_EINT:
+        H->tint_syt = 0;
+        break;
+    }
+
+    ADVANCE();
+    return HALMAT_OK;
+}
+
+/* ---- load-time pass ---- */
+
+void halmat_struct_build(halmat_t *H)
+{
+    uint32_t nextn = 0;
+
+    for (uint32_t s = 1; s < HALMAT_MAX_SYT; s++) {
+        syt_entry_t *e = &H->syt[s];
+        if (e->st.kind == SK_TEMPLATE) {
+            layout(H, s);
+            continue;
+        }
+        if (e->st.kind)
+            continue;
+        if (e->st.name) {
+            /* the pointer; arr describes what it points at */
+            if (e->arr.etype == HTYPE_STRUCT)
+                e->arr.esize = e->st.templ ? H->syt[e->st.templ].arr.esize : 0;
+            halmat_array_layout(&e->arr);
+            e->arr.count = 0;
+            uint32_t at = halmat_data_alloc(H, sizeof(halmat_name_t));
+            if (at == HALMAT_DATA_SIZE) {
+                fprintf(stderr, "halmat_struct_build: data segment full at SYT(%u)\n", s);
+                e->st.name = 0;
+                continue;
+            }
+            e->st.offset = at;
+        } else if (e->arr.etype == HTYPE_STRUCT) {
+            e->arr.esize = e->st.templ ? H->syt[e->st.templ].arr.esize : 0;
+            uint32_t at = halmat_data_alloc(H, halmat_array_layout(&e->arr));
+            e->arr.count = 0;               /* not an element array */
+            if (at == HALMAT_DATA_SIZE) {
+                fprintf(stderr, "halmat_struct_build: data segment full at SYT(%u)\n", s);
+                e->arr.ndim = 0;
+                e->arr.esize = 0;
+                continue;
+            }
+            e->arr.base = at;
+            e->allocated = 1;
+        }
+    }
+
+    for (uint32_t a = halmat_op_at(H, 0); a < H->code_len; a = NEXT_OP(H, a))
+        if (HALMAT_POPCODE(H->code[a]) == POP_EXTN && HALMAT_NUMOP(H->code[a]) >= 1)
+            nextn++;
+    if (!nextn)
+        return;
+
+    struct halmat_structs *S = calloc(1, sizeof(*S));
+    if (!S)
+        return;
+    S->xref_at = calloc(H->code_len, sizeof(uint32_t));
+    S->xrefs = calloc(nextn, sizeof(xref_t));
+    if (!S->xref_at || !S->xrefs) {
+        H->structs = S;
+        halmat_struct_free(H);
+        return;
+    }
+    for (uint32_t a = halmat_op_at(H, 0); a < H->code_len; a = NEXT_OP(H, a)) {
+        uint32_t w = H->code[a];
+        if (HALMAT_POPCODE(w) != POP_EXTN || HALMAT_NUMOP(w) < 1 ||
+            a + HALMAT_NUMOP(w) >= H->code_len ||
+            HALMAT_QUAL(H->code[a + 1]) != QUAL_SYT ||
+            HALMAT_DATA(H->code[a + 1]) >= HALMAT_MAX_SYT)
+            continue;
+        decode(H, a, &S->xrefs[S->nxrefs]);
+        S->xref_at[a] = ++S->nxrefs;
+    }
+    H->structs = S;
+}
+
+void halmat_struct_free(halmat_t *H)
+{
+    struct halmat_structs *S = H->structs;
+    if (!S)
+        return;
+    free(S->xref_at);
+    free(S->xrefs);
+    free(S);
+    H->structs = NULL;
+}
@@ -0,0 +1,779 @@
+/* Synthetic HALMAT programs.
+ *
+ * Globals and FUNCTIONs are declared in SOURCECO.txt, the FUNCTIONs
+ * are written first, then top-level statements until the requested
+ * number of blocks is full.  Whatever comes out has to load, get
+ * through every load-time analysis and run to the end, so the writer
+ * keeps to what the interpreter relies on:
+ *
+ *  - No statement and no FUNCTION crosses a block boundary: the scans
+ *    for EFOR, ETST, ECAS and CLOS do not step over block headers.  A
+ *    statement that crossed is written again in a fresh block, and one
+ *    too big for any block again with less nesting.
+ *  - No DO CASE inside a CASE arm, as DCAS counts every CLBL up to the
+ *    first ECAS.
+ *  - A FUNCTION calls only FUNCTIONs written before it, so there is no
+ *    recursion, and each has its own loop variables, as a callee that
+ *    stepped on its caller's could keep it looping for ever.
+ *  - INTEGERs are computed only from loop variables, parameters and
+ *    small constants, and SCALAR updates are contractions, so nothing
+ *    overflows however long the run.  Divisors are nonzero literals.
+ *  - IF labels get flow numbers of their own; DO and CASE use one per
+ *    nesting level, since those are registered as they run.
+ *
+ * Each statement's executed operators are estimated as it is written,
+ * loop bodies and calls multiplied out, and a statement over max_ops
+ * is written again with fewer trips or less nesting. */
+
+#include "halmat_synth.h"
+
+#define SYN_INTS     8
+#define SYN_SCALARS  8
+#define SYN_MATS     3
+#define SYN_VECS     3
+#define SYN_ARRAYS   3
+#define SYN_CHARS    2
+#define SYN_RESERVE  6          /* the program's CLOSE, SMRK and XREC */
+#define SYN_SOURCE   16000      /* the loader reads 16 KB of source */
+
+const char *const halmat_synth_kinds[SYN_KINDS] = {
+    "int", "scalar", "if", "for", "while", "case", "call",
+    "matrix", "array", "char", "write"
+};
+
+typedef struct {
+    uint32_t syt, param;
+    uint32_t loopv[SYN_MAX_DEPTH];
+    uint64_t cost;              /* operators one call runs */
+    int      loops;             /* deepest DO nesting, callees included */
+    int      frames;            /* deepest call chain from here */
+} syn_proc_t;
+
+typedef struct {
+    halmat_gen_t              *G;
+    const halmat_synth_opts_t *o;
+    halmat_synth_stats_t      *st;
+    uint64_t rng;
+    unsigned mixsum;
+
+    uint32_t ints[SYN_INTS], scalars[SYN_SCALARS];
+    uint32_t mats[SYN_MATS], vecs[SYN_VECS];
+    uint32_t arrays[SYN_ARRAYS], chars[SYN_CHARS];
+    uint32_t mainloop[SYN_MAX_DEPTH];
+    uint32_t extent;            /* of every array */
+    syn_proc_t procs[SYN_MAX_PROCS];
+    int      nprocs;
+
+    /* the statement being written */
+    const uint32_t *loopv;      /* loop variables by level */
+    uint32_t param;             /* 0 outside a FUNCTION */
+    int      callable;          /* FUNCTIONs [0, callable) */
+    int      level;             /* loops open */
+    uint32_t trip[SYN_MAX_DEPTH];
+    int      in_case;
+    uint64_t mult;              /* times it runs per top-level statement */
+    uint64_t cost;
+    int      loops, frames;
+} synth_t;
+
+/* splitmix64 */
+static uint64_t next(synth_t *S)
+{
+    uint64_t z = (S->rng += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint32_t below(synth_t *S, uint32_t n)
+{
+    return n ? (uint32_t)(next(S) % n) : 0;
+}
+
+static uint32_t pick(synth_t *S, const uint32_t *v, uint32_t n)
+{
+    return v[below(S, n)];
+}
+
+/* Literals are shared: a few dozen values cover every program */
+static uint32_t lit(synth_t *S, double v)
+{
+    halmat_gen_t *G = S->G;
+    int32_t w = (int32_t)double_to_ibm_float(v);
+    for (uint32_t i = 1; i < G->nlit; i++)
+        if (G->lit[i * 3] == 1 && G->lit[i * 3 + 1] == w)
+            return i;
+    return halmat_gen_lit(G, v);
+}
+
+static uint32_t char_lit(synth_t *S)
+{
+    static const char *const s[] = { "A", "HI", "GO", "ABC", "XYZ", "NAV" };
+    halmat_gen_t *G = S->G;
+    const char *c = s[below(S, 6)];
+    uint32_t w = (uint32_t)(strlen(c) - 1) << 24;
+    for (size_t k = 0; c[k]; k++)
+        w |= (uint32_t)(uint8_t)c[k] << (16 - 8 * k);
+    for (uint32_t i = 1; i < G->nlit; i++)
+        if (G->lit[i * 3] == 0 && (uint32_t)G->lit[i * 3 + 1] == w)
+            return i;
+    return halmat_gen_char(G, c);
+}
+
+/* Operators written since n0, run mult times */
+static void charge(synth_t *S, uint32_t n0)
+{
+    S->cost += S->mult * (S->G->nops - n0);
+}
+
+static void smrk(synth_t *S)
+{
+    uint32_t n0 = S->G->nops;
+    halmat_gen_smrk(S->G);
+    charge(S, n0);
+}
+
+/* ---- expressions ---- */
+
+/* A loop variable in scope, the parameter, or a small constant */
+static uint32_t int_leaf(synth_t *S)
+{
+    uint32_t r = below(S, (uint32_t)S->level + (S->param ? 2 : 1));
+    if (r < (uint32_t)S->level)
+        return HALMAT_SYT(S->loopv[r]);
+    if (S->param && r == (uint32_t)S->level)
+        return HALMAT_SYT(S->param);
+    return HALMAT_IMD(below(S, 10));
+}
+
+static uint32_t int_expr(synth_t *S, int n)
+{
+    if (n <= 0 || below(S, 3) == 0)
+        return int_leaf(S);
+    uint32_t a = int_expr(S, n - 1);
+    switch (below(S, 3)) {
+    case 0: {
+        uint32_t b = int_expr(S, n - 1);
+        return HALMAT_VAC(halmat_gen_op(S->G, POP_IADD, 0, 2, a, b));
+    }
+    case 1: {
+        uint32_t b = int_expr(S, n - 1);
+        return HALMAT_VAC(halmat_gen_op(S->G, POP_ISUB, 0, 2, a, b));
+    }
+    default:
+        return HALMAT_VAC(halmat_gen_op(S->G, POP_IIPR, 0, 2, a,
+                                        HALMAT_IMD(1 + below(S, 9))));
+    }
+}
+
+/* A subscript: a loop variable whose loop stays within the extent,
+ * else a constant */
+static uint32_t subscript(synth_t *S)
+{
+    int lv = S->level ? (int)below(S, (uint32_t)S->level) : -1;
+    if (lv >= 0 && S->trip[lv] <= S->extent && below(S, 4))
+        return HALMAT_OPERAND(QUAL_SYT, S->loopv[lv], 5);
+    return HALMAT_OPERAND(QUAL_IMD, 1 + below(S, S->extent), 5);
+}
+
+static uint32_t element(synth_t *S, uint32_t arr, uint32_t sub)
+{
+    return HALMAT_VAC(halmat_gen_op(S->G, POP_DSUB, 5, 2, HALMAT_SYT(arr), sub));
+}
+
+/* A bounded SCALAR term */
+static uint32_t scalar_term(synth_t *S)
+{
+    switch (below(S, 5)) {
+    case 0:
+        return HALMAT_LIT(lit(S, 0.25 * below(S, 20)));
+    case 1:
+        return int_leaf(S);
+    case 2: {
+        uint32_t a = int_leaf(S);
+        return HALMAT_VAC(halmat_gen_op(S->G, POP_SSPR, 0, 2, a,
+                                        HALMAT_LIT(lit(S, 0.125 * (1 + below(S, 8))))));
+    }
+    case 3: {
+        uint32_t x = pick(S, S->arrays, SYN_ARRAYS);
+        uint32_t a = element(S, x, subscript(S));
+        return HALMAT_VAC(halmat_gen_op(S->G, POP_SSDV, 0, 2, a,
+                                        HALMAT_LIT(lit(S, 2 + below(S, 3)))));
+    }
+    default:
+        return HALMAT_SYT(pick(S, S->ints, SYN_INTS));
+    }
+}
+
+/* ---- statements ---- */
+
+static void stmt(synth_t *S, int depth);
+
+/* One to three statements */
+static void body(synth_t *S, int depth)
+{
+    for (uint32_t n = 1 + below(S, 3); n > 0; n--)
+        stmt(S, depth);
+}
+
+static void s_int(synth_t *S)
+{
+    uint32_t n0 = S->G->nops;
+    uint32_t e = int_expr(S, 3);
+    halmat_gen_op(S->G, POP_IASN, 0, 2, e, HALMAT_SYT(pick(S, S->ints, SYN_INTS)));
+    charge(S, n0);
+    smrk(S);
+}
+
+/* X = X * 0.5 + Y / k +- term */
+static void s_scalar(synth_t *S)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t n0 = G->nops;
+    uint32_t x = pick(S, S->scalars, SYN_SCALARS);
+    uint32_t a = halmat_gen_op(G, POP_SSPR, 0, 2, HALMAT_SYT(x), HALMAT_LIT(lit(S, 0.5)));
+    if (below(S, 2)) {
+        uint32_t y = pick(S, S->scalars, SYN_SCALARS);
+        uint32_t b = halmat_gen_op(G, POP_SSDV, 0, 2, HALMAT_SYT(y),
+                                   HALMAT_LIT(lit(S, 2 + below(S, 3))));
+        a = halmat_gen_op(G, POP_SADD, 0, 2, HALMAT_VAC(a), HALMAT_VAC(b));
+    }
+    uint32_t t = scalar_term(S);
+    a = halmat_gen_op(G, below(S, 2) ? POP_SADD : POP_SSUB, 0, 2, HALMAT_VAC(a), t);
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(x));
+    charge(S, n0);
+    smrk(S);
+}
+
+static uint32_t condition(synth_t *S)
+{
+    static const uint32_t icmp[] = { POP_IGT, POP_ILT, POP_IEQU, POP_INEQ, POP_INGT, POP_INLT };
+    static const uint32_t scmp[] = { POP_SGT, POP_SLT, POP_SNGT, POP_SNLT };
+    if (below(S, 3)) {
+        uint32_t a = below(S, 2) ? HALMAT_SYT(pick(S, S->ints, SYN_INTS)) : int_leaf(S);
+        uint32_t b = int_leaf(S);
+        return halmat_gen_op(S->G, icmp[below(S, 6)], 0, 2, a, b);
+    }
+    uint32_t x = pick(S, S->scalars, SYN_SCALARS);
+    uint32_t b = lit(S, 0.5 * below(S, 8));
+    return halmat_gen_op(S->G, scmp[below(S, 4)], 0, 2, HALMAT_SYT(x), HALMAT_LIT(b));
+}
+
+static void s_if(synth_t *S, int depth)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t els = halmat_gen_flow(G), out = halmat_gen_flow(G);
+    uint32_t n0 = G->nops;
+    halmat_gen_op(G, POP_IFHD, 0, 0);
+    uint32_t c = condition(S);
+    halmat_gen_op(G, POP_FBRA, 0, 2, HALMAT_INL(els), HALMAT_VAC(c));
+    charge(S, n0);
+    smrk(S);
+    body(S, depth - 1);
+    n0 = G->nops;
+    halmat_gen_op(G, POP_BRA, 1, 1, HALMAT_INL(out));
+    halmat_gen_op(G, POP_LBL, 0, 1, HALMAT_INL(els));
+    charge(S, n0);
+    body(S, depth - 1);
+    n0 = G->nops;
+    halmat_gen_op(G, POP_LBL, 1, 1, HALMAT_INL(out));
+    charge(S, n0);
+    S->st->ifs++;
+}
+
+/* Trip count for a loop opened now: --trips, halved while the body
+ * would run more often than a quarter of the budget allows */
+static uint32_t trips(synth_t *S)
+{
+    uint32_t t = S->o->trips;
+    while (t > 1 && S->mult * t > S->o->max_ops / 4)
+        t /= 2;
+    return t;
+}
+
+static void open_loop(synth_t *S, uint32_t t)
+{
+    S->trip[S->level++] = t;
+    S->mult *= t;
+    if (S->level > S->loops)
+        S->loops = S->level;
+    S->st->loops++;
+}
+
+static void close_loop(synth_t *S)
+{
+    S->mult /= S->trip[--S->level];
+}
+
+static void s_for(synth_t *S, int depth)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t t = trips(S);
+    uint32_t f = 1 + (uint32_t)S->level;
+    uint32_t v = S->loopv[S->level];
+    uint32_t n0 = G->nops;
+    if (t <= 6 && below(S, 3) == 0) {
+        /* DO FOR V = 1, 2, ...: the values in a shuffled order */
+        uint32_t val[6];
+        for (uint32_t k = 0; k < t; k++)
+            val[k] = k + 1;
+        for (uint32_t k = t; k > 1; k--) {
+            uint32_t j = below(S, k), x = val[k - 1];
+            val[k - 1] = val[j];
+            val[j] = x;
+        }
+        halmat_gen_op(G, POP_DFOR, 0, 2, HALMAT_INL(f), HALMAT_SYT(v));
+        for (uint32_t k = 0; k < t; k++)
+            halmat_gen_op(G, POP_AFOR, k == t - 1, 1, HALMAT_LIT(lit(S, val[k])));
+    } else {
+        halmat_gen_op(G, POP_DFOR, 1, 4, HALMAT_INL(f), HALMAT_SYT(v),
+                      HALMAT_LIT(lit(S, 1)), HALMAT_LIT(lit(S, t)));
+    }
+    charge(S, n0);
+    open_loop(S, t);
+    smrk(S);
+    body(S, depth - 1);
+    n0 = G->nops;
+    halmat_gen_op(G, POP_EFOR, 0, 1, HALMAT_INL(f));
+    charge(S, n0);
+    close_loop(S);
+    smrk(S);
+}
+
+/* W = 1; DO WHILE W NOT > t; ...; W = W + 1; END; */
+static void s_while(synth_t *S, int depth)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t t = trips(S);
+    uint32_t f = 1 + (uint32_t)S->level;
+    uint32_t w = S->loopv[S->level];
+    uint32_t n0 = G->nops;
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_IMD(1), HALMAT_SYT(w));
+    charge(S, n0);
+    smrk(S);
+    n0 = G->nops;
+    halmat_gen_op(G, POP_DTST, 0, 1, HALMAT_INL(f));
+    uint32_t c = halmat_gen_op(G, POP_INGT, 0, 2, HALMAT_SYT(w), HALMAT_IMD(t));
+    halmat_gen_op(G, POP_CTST, 0, 1, HALMAT_VAC(c));
+    charge(S, n0);
+    open_loop(S, t);
+    smrk(S);
+    body(S, depth - 1);
+    n0 = G->nops;
+    uint32_t a = halmat_gen_op(G, POP_IADD, 0, 2, HALMAT_SYT(w), HALMAT_IMD(1));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(w));
+    charge(S, n0);
+    smrk(S);
+    n0 = G->nops;
+    halmat_gen_op(G, POP_ETST, 0, 1, HALMAT_INL(f));
+    charge(S, n0);
+    close_loop(S);
+    smrk(S);
+}
+
+/* Every arm is charged, though only one runs */
+static void s_case(synth_t *S, int depth)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t c = 1 + (uint32_t)S->level;
+    uint32_t sel = S->level ? S->loopv[below(S, (uint32_t)S->level)]
+                            : pick(S, S->ints, SYN_INTS);
+    uint32_t n0 = G->nops;
+    halmat_gen_op(G, POP_DCAS, 0, 2, HALMAT_INL(c), HALMAT_SYT(sel));
+    charge(S, n0);
+    smrk(S);
+    S->in_case++;
+    for (int k = 0; k < S->o->case_width; k++) {
+        n0 = G->nops;
+        halmat_gen_op(G, POP_CLBL, 0, 2, HALMAT_INL(c), HALMAT_INL(c));
+        charge(S, n0);
+        body(S, depth - 1);
+    }
+    S->in_case--;
+    n0 = G->nops;
+    halmat_gen_op(G, POP_CLBL, 1, 2, HALMAT_INL(c), HALMAT_INL(c));
+    halmat_gen_op(G, POP_ECAS, 0, 1, HALMAT_INL(c));
+    charge(S, n0);
+    smrk(S);
+    S->st->cases++;
+}
+
+/* A FUNCTION that fits in the loop stack, the call stack and what is
+ * left of the budget; -1 if none of a few tries does */
+static int callee(synth_t *S)
+{
+    for (int tries = 0; tries < 4 && S->callable > 0; tries++) {
+        const syn_proc_t *P = &S->procs[below(S, (uint32_t)S->callable)];
+        if (S->level + P->loops <= HALMAT_MAX_LOOPS &&
+            P->frames < HALMAT_MAX_FRAMES &&
+            S->cost + S->mult * P->cost <= S->o->max_ops)
+            return (int)(P - S->procs);
+    }
+    return -1;
+}
+
+/* I = P(n) */
+static void s_call(synth_t *S, int k)
+{
+    halmat_gen_t *G = S->G;
+    const syn_proc_t *P = &S->procs[k];
+    uint32_t n0 = G->nops;
+    uint32_t arg = int_leaf(S) | 6u << 8;
+    halmat_gen_op(G, POP_XXST, 1, 1, HALMAT_SYT(P->syt));
+    halmat_gen_op(G, POP_XXAR, 1, 1, arg);
+    uint32_t c = halmat_gen_op(G, POP_FCAL, 1, 1, HALMAT_SYT(P->syt));
+    halmat_gen_op(G, POP_XXND, 1, 0);
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(c), HALMAT_SYT(pick(S, S->ints, SYN_INTS)));
+    charge(S, n0);
+    S->cost += S->mult * P->cost;
+    if (S->level + P->loops > S->loops)
+        S->loops = S->level + P->loops;
+    if (P->frames > S->frames)
+        S->frames = P->frames;
+    smrk(S);
+    S->st->calls++;
+}
+
+/* Chains the fusion pass can take whole */
+static void s_matrix(synth_t *S)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t n0 = G->nops;
+    uint32_t m0 = pick(S, S->mats, SYN_MATS), m1 = pick(S, S->mats, SYN_MATS);
+    uint32_t m2 = pick(S, S->mats, SYN_MATS);
+    uint32_t v0 = pick(S, S->vecs, SYN_VECS), v1 = pick(S, S->vecs, SYN_VECS);
+    uint32_t a;
+    switch (below(S, 5)) {
+    case 0:                                     /* M = A B */
+        a = halmat_gen_op(G, POP_MMPR, 0, 2, HALMAT_SYT(m0), HALMAT_SYT(m1));
+        halmat_gen_op(G, POP_MASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(m2));
+        break;
+    case 1:                                     /* M = A + B - C */
+        a = halmat_gen_op(G, POP_MADD, 0, 2, HALMAT_SYT(m0), HALMAT_SYT(m1));
+        a = halmat_gen_op(G, POP_MSUB, 0, 2, HALMAT_VAC(a), HALMAT_SYT(m2));
+        halmat_gen_op(G, POP_MASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(m0));
+        break;
+    case 2:                                     /* M = TRANSPOSE(A) B */
+        a = halmat_gen_op(G, POP_MTRA, 0, 1, HALMAT_SYT(m0));
+        a = halmat_gen_op(G, POP_MMPR, 0, 2, HALMAT_VAC(a), HALMAT_SYT(m1));
+        halmat_gen_op(G, POP_MASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(m2));
+        break;
+    case 3:                                     /* V = A U + W */
+        a = halmat_gen_op(G, POP_MVPR, 0, 2, HALMAT_SYT(m0), HALMAT_SYT(v0));
+        a = halmat_gen_op(G, POP_VADD, 0, 2, HALMAT_VAC(a), HALMAT_SYT(v1));
+        halmat_gen_op(G, POP_VASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(v0));
+        break;
+    default:                                    /* V = U 0.5 - W */
+        a = halmat_gen_op(G, POP_VSPR, 0, 2, HALMAT_SYT(v0), HALMAT_LIT(lit(S, 0.5)));
+        a = halmat_gen_op(G, POP_VSUB, 0, 2, HALMAT_VAC(a), HALMAT_SYT(v1));
+        halmat_gen_op(G, POP_VASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(v1));
+        break;
+    }
+    charge(S, n0);
+    smrk(S);
+}
+
+static void s_array(synth_t *S)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t x = pick(S, S->arrays, SYN_ARRAYS);
+    uint32_t n0 = G->nops;
+    if (below(S, 3) == 0) {
+        /* A = A * 0.5 + B / 4, element by element */
+        uint32_t y = pick(S, S->arrays, SYN_ARRAYS);
+        halmat_gen_op(G, POP_ADLP, 0, 0);
+        uint32_t a = halmat_gen_op(G, POP_SSPR, 0, 2, HALMAT_SYT(x), HALMAT_LIT(lit(S, 0.5)));
+        uint32_t b = halmat_gen_op(G, POP_SSDV, 0, 2, HALMAT_SYT(y), HALMAT_LIT(lit(S, 4)));
+        a = halmat_gen_op(G, POP_SADD, 0, 2, HALMAT_VAC(a), HALMAT_VAC(b));
+        halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(x));
+        halmat_gen_op(G, POP_DLPE, 0, 0);
+        S->cost += S->mult * (G->nops - n0) * S->extent;
+    } else {
+        /* A(i) = A(i) * 0.5 + term */
+        uint32_t sub = subscript(S);
+        uint32_t a = element(S, x, sub);
+        a = halmat_gen_op(G, POP_SSPR, 0, 2, a, HALMAT_LIT(lit(S, 0.5)));
+        uint32_t t = scalar_term(S);
+        a = halmat_gen_op(G, POP_SADD, 0, 2, HALMAT_VAC(a), t);
+        uint32_t d = element(S, x, sub);
+        halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(a), d);
+        charge(S, n0);
+    }
+    smrk(S);
+}
+
+static void s_char(synth_t *S)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t s = S->chars[below(S, SYN_CHARS)];
+    uint32_t n0 = G->nops;
+    if (below(S, 4) == 0) {
+        halmat_gen_op(G, POP_CASN, 0, 2, HALMAT_LIT(char_lit(S)), HALMAT_SYT(s));
+    } else {
+        /* S = S || 'AB' || T, appended in place */
+        uint32_t t = S->chars[0] == s ? S->chars[1] : S->chars[0];
+        uint32_t a = halmat_gen_op(G, POP_CCAT, 0, 2, HALMAT_SYT(s), HALMAT_LIT(char_lit(S)));
+        a = halmat_gen_op(G, POP_CCAT, 0, 2, HALMAT_VAC(a), HALMAT_SYT(t));
+        halmat_gen_op(G, POP_CASN, 0, 2, HALMAT_VAC(a), HALMAT_SYT(s));
+    }
+    charge(S, n0);
+    smrk(S);
+}
+
+static void s_write(synth_t *S)
+{
+    halmat_gen_t *G = S->G;
+    uint32_t n0 = G->nops;
+    halmat_gen_op(G, POP_XXST, 0, 1, HALMAT_IMD(2));
+    halmat_gen_op(G, POP_XXAR, 0, 1,
+                  HALMAT_OPERAND(QUAL_SYT, pick(S, S->ints, SYN_INTS), 6));
+    halmat_gen_op(G, POP_XXAR, 0, 1,
+                  HALMAT_OPERAND(QUAL_SYT, pick(S, S->scalars, SYN_SCALARS), 6));
+    halmat_gen_op(G, POP_WRIT, 0, 1, HALMAT_IMD(6));
+    halmat_gen_op(G, POP_XXND, 0, 0);
+    charge(S, n0);
+    smrk(S);
+}
+
+/* A statement of a kind drawn from the mix; compound kinds that cannot
+ * be had here become integer assignments */
+static void stmt(synth_t *S, int depth)
+{
+    uint32_t r = below(S, S->mixsum);
+    int kind = 0;
+    while (r >= S->o->mix[kind])
+        r -= S->o->mix[kind++];
+
+    int compound = depth > 0 && S->level < SYN_MAX_DEPTH;
+    int k;
+    switch (kind) {
+    case SYN_SCALAR: s_scalar(S); return;
+    case SYN_MATRIX: s_matrix(S); return;
+    case SYN_ARRAY:  s_array(S);  return;
+    case SYN_CHAR:   s_char(S);   return;
+    case SYN_WRITE:  s_write(S);  return;
+    case SYN_IF:
+        if (depth > 0 && S->G->flow + 2 < HALMAT_MAX_FLOW) {
+            s_if(S, depth);
+            return;
+        }
+        break;
+    case SYN_FOR:
+        if (compound) {
+            s_for(S, depth);
+            return;
+        }
+        break;
+    case SYN_WHILE:
+        if (compound) {
+            s_while(S, depth);
+            return;
+        }
+        break;
+    case SYN_CASE:
+        if (depth > 0 && !S->in_case && S->level < SYN_MAX_DEPTH) {
+            s_case(S, depth);
+            return;
+        }
+        break;
+    case SYN_CALL:
+        if ((k = callee(S)) >= 0) {
+            s_call(S, k);
+            return;
+        }
+        break;
+    }
+    s_int(S);
+}
+
+/* ---- placement ---- */
+
+static void begin(synth_t *S, const uint32_t *loopv, uint32_t param, int callable)
+{
+    S->loopv = loopv;
+    S->param = param;
+    S->callable = callable;
+    S->level = 0;
+    S->in_case = 0;
+    S->mult = 1;
+    S->cost = 0;
+    S->loops = 0;
+    S->frames = 0;
+}
+
+/* FUNCTION k: FDEF ... RTRN N + k ... CLOS */
+static void w_proc(synth_t *S, int k, int depth)
+{
+    halmat_gen_t *G = S->G;
+    syn_proc_t *P = &S->procs[k];
+    begin(S, P->loopv, P->param, k);
+    halmat_gen_op(G, POP_FDEF, 0, 1, HALMAT_SYT(P->syt));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_EDCL, 1, 0);
+    body(S, depth);
+    uint32_t n0 = G->nops;
+    uint32_t a = halmat_gen_op(G, POP_IADD, 0, 2, HALMAT_SYT(P->param), HALMAT_IMD(k % 10));
+    halmat_gen_op(G, POP_RTRN, 0, 1, HALMAT_OPERAND(QUAL_VAC, a, 6));
+    charge(S, n0);
+    smrk(S);
+    halmat_gen_op(G, POP_CLOS, 0, 1, HALMAT_SYT(P->syt));
+    halmat_gen_smrk(G);
+}
+
+static void w_top(synth_t *S, int k, int depth)
+{
+    (void)k;
+    begin(S, S->mainloop, 0, S->nprocs);
+    stmt(S, depth);
+}
+
+/* Write one unit in the current block, else in a fresh one, else with
+ * less nesting.  -1 once the blocks are used up. */
+static int place(synth_t *S, void (*w)(synth_t *, int, int), int k)
+{
+    halmat_gen_t *G = S->G;
+    int depth = S->o->depth;
+    for (;;) {
+        halmat_gen_mark_t m = halmat_gen_mark(G);
+        uint64_t rng = S->rng;
+        halmat_synth_stats_t st = *S->st;
+        w(S, k, depth);
+        uint32_t end = G->nblocks * HALMAT_BLOCK_WORDS;
+        int crossed = G->nblocks != m.nblocks || G->at + SYN_RESERVE > end;
+        if (!G->err && !crossed && S->cost <= S->o->max_ops &&
+            S->loops <= HALMAT_MAX_LOOPS)
+            return 0;
+
+        halmat_gen_rewind(G, m);
+        S->rng = rng;
+        *S->st = st;
+        int fresh = m.at == (m.nblocks - 1) * HALMAT_BLOCK_WORDS + 2;
+        if (crossed && !fresh && S->cost <= S->o->max_ops) {
+            if (G->nblocks >= S->o->blocks || halmat_gen_block(G) != 0)
+                return -1;
+        } else if (depth > 0) {
+            depth--;
+        } else {
+            return -1;
+        }
+    }
+}
+
+/* ---- options ---- */
+
+void halmat_synth_defaults(halmat_synth_opts_t *o)
+{
+    static const unsigned mix[SYN_KINDS] = { 4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 0 };
+    memset(o, 0, sizeof(*o));
+    o->seed = 1;
+    o->blocks = 1;
+    o->depth = 3;
+    o->procs = 4;
+    o->case_width = 4;
+    o->trips = 8;
+    o->max_ops = 20000;
+    memcpy(o->mix, mix, sizeof(mix));
+}
+
+/* kind=weight,... over the defaults */
+int halmat_synth_mix(halmat_synth_opts_t *o, const char *spec)
+{
+    while (*spec) {
+        size_t n = strcspn(spec, "=");
+        int k;
+        for (k = 0; k < SYN_KINDS; k++)
+            if (strlen(halmat_synth_kinds[k]) == n &&
+                strncmp(spec, halmat_synth_kinds[k], n) == 0)
+                break;
+        if (k == SYN_KINDS || spec[n] != '=')
+            return -1;
+        char *end;
+        unsigned long w = strtoul(spec + n + 1, &end, 10);
+        if (end == spec + n + 1 || (*end && *end != ',') || w > 1000)
+            return -1;
+        o->mix[k] = (unsigned)w;
+        spec = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+/* ---- the program ---- */
+
+static void declare(synth_t *S, uint32_t *v, int n, const char *prefix, const char *attrs)
+{
+    char name[16];
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "%s%d", prefix, i + 1);
+        v[i] = halmat_gen_declare(S->G, name, attrs);
+    }
+}
+
+int halmat_synth(halmat_gen_t *G, const halmat_synth_opts_t *o, halmat_synth_stats_t *st)
+{
+    synth_t S;
+    memset(&S, 0, sizeof(S));
+    memset(st, 0, sizeof(*st));
+    S.G = G;
+    S.o = o;
+    S.st = st;
+    S.rng = o->seed;
+    for (int k = 0; k < SYN_KINDS; k++)
+        S.mixsum += o->mix[k];
+    if (!S.mixsum || o->blocks < 1 || o->blocks > HALMAT_MAX_BLOCKS ||
+        o->depth < 0 || o->depth > SYN_MAX_DEPTH || o->procs < 0 ||
+        o->procs > SYN_MAX_PROCS || o->case_width < 1 || o->trips < 1 ||
+        o->trips > 0xFFFF || !o->max_ops) {
+        fprintf(stderr, "halmat_synth: option out of range\n");
+        return -1;
+    }
+    S.extent = o->trips < 2 ? 2 : o->trips > 1000 ? 1000 : o->trips;
+
+    char attrs[32];
+    declare(&S, S.ints, SYN_INTS, "I", "INTEGER");
+    declare(&S, S.scalars, SYN_SCALARS, "X", "SCALAR");
+    declare(&S, S.mainloop, o->depth, "L", "INTEGER");
+    declare(&S, S.mats, SYN_MATS, "M", "MATRIX(3, 3)");
+    declare(&S, S.vecs, SYN_VECS, "V", "VECTOR(3)");
+    snprintf(attrs, sizeof(attrs), "ARRAY(%u) SCALAR", S.extent);
+    declare(&S, S.arrays, SYN_ARRAYS, "A", attrs);
+    declare(&S, S.chars, SYN_CHARS, "C", "CHARACTER(40)");
+
+    /* FUNCTION(N) INTEGER with its loop variables declared inside */
+    for (int k = 0; k < o->procs; k++) {
+        syn_proc_t *P = &S.procs[k];
+        char name[16];
+        snprintf(name, sizeof(name), "P%d", k + 1);
+        P->syt = halmat_gen_label(G, name);
+        halmat_gen_source(G, "    FUNCTION(N) INTEGER;\n    DECLARE INTEGER, N");
+        P->param = ++G->nsyt;
+        for (int d = 0; d < o->depth; d++) {
+            halmat_gen_source(G, ", P%dL%d", k + 1, d + 1);
+            P->loopv[d] = ++G->nsyt;
+        }
+        halmat_gen_source(G, ";\n    CLOSE %s;\n", name);
+    }
+    if (G->srclen > SYN_SOURCE || G->nsyt >= HALMAT_MAX_SYT) {
+        fprintf(stderr, "halmat_synth: too many FUNCTIONs for the loader's "
+                "16 KB of source; use fewer, or less depth\n");
+        return -1;
+    }
+
+    G->flow = SYN_MAX_DEPTH;        /* 1..16: DO and CASE, by level */
+    for (int k = 0; k < o->procs; k++) {
+        if (place(&S, w_proc, k) != 0)
+            break;
+        S.procs[k].cost = S.cost;
+        S.procs[k].loops = S.loops;
+        S.procs[k].frames = S.frames + 1;
+        S.nprocs++;
+    }
+    st->procs = (uint32_t)S.nprocs;
+
+    /* Statement numbers are 16 bits and the literal table is finite */
+    while (G->stmt < 0xFF00 && G->nlit < HALMAT_MAX_LIT - 64 &&
+           place(&S, w_top, 0) == 0) {
+        st->statements++;
+        st->ops += S.cost;
+    }
+    return G->err ? -1 : 0;
+}
@@ -0,0 +1,57 @@
+/* Synthetic HALMAT programs for scale testing (halmat-synth, and the
+ * synth_* benchmarks).
+ *
+ * A program is written through halmat_gen from a seed and a handful of
+ * knobs: how many blocks to fill, how deep DO/IF/CASE may nest, how
+ * many FUNCTIONs, how wide a DO CASE, how many times a loop goes round,
+ * and the relative weight of each kind of statement.  The same options
+ * and seed always give the same three files. */
+
+#ifndef HALMAT_SYNTH_H
+#define HALMAT_SYNTH_H
+
+#include "halmat_gen.h"
+
+enum {
+    SYN_INT,        /* I = integer expression */
+    SYN_SCALAR,     /* X = X * 0.5 + ... */
+    SYN_IF,         /* IF ... THEN ... ELSE ... */
+    SYN_FOR,        /* DO FOR, counted or discrete */
+    SYN_WHILE,      /* DO WHILE */
+    SYN_CASE,       /* DO CASE */
+    SYN_CALL,       /* I = P(n) */
+    SYN_MATRIX,     /* matrix and vector chains */
+    SYN_ARRAY,      /* subscripted and whole-array statements */
+    SYN_CHAR,       /* S = S || 'AB' || T */
+    SYN_WRITE,      /* WRITE(6) */
+    SYN_KINDS
+};
+
+#define SYN_MAX_DEPTH 16
+#define SYN_MAX_PROCS 100
+
+extern const char *const halmat_synth_kinds[SYN_KINDS];
+
+typedef struct {
+    uint64_t seed;
+    uint32_t blocks;            /* blocks to fill, 1..HALMAT_MAX_BLOCKS */
+    int      depth;             /* DO/IF/CASE nesting, 0..SYN_MAX_DEPTH */
+    int      procs;             /* FUNCTIONs, 0..SYN_MAX_PROCS */
+    int      case_width;        /* arms per DO CASE */
+    uint32_t trips;             /* times round each loop */
+    uint64_t max_ops;           /* operators one top-level statement may run */
+    unsigned mix[SYN_KINDS];    /* relative weights */
+} halmat_synth_opts_t;
+
+typedef struct {
+    uint32_t statements;        /* top level */
+    uint32_t procs;
+    uint32_t ifs, loops, cases, calls;
+    uint64_t ops;               /* operators the run should execute, roughly */
+} halmat_synth_stats_t;
+
+void halmat_synth_defaults(halmat_synth_opts_t *o);
+int  halmat_synth_mix(halmat_synth_opts_t *o, const char *spec);   /* "int=4,case=0" */
+int  halmat_synth(halmat_gen_t *G, const halmat_synth_opts_t *o, halmat_synth_stats_t *st);
+
+#endif /* HALMAT_SYNTH_H */
@@ -0,0 +1,86 @@
+/* halmat-synth: write a synthetic HALMAT program, halmat.bin,
+ * litfile.bin and SOURCECO.txt, into a directory, for yaHALMAT to run
+ * or halmat-bench to time.  See halmat_synth.c for what it writes. */
+
+#include <errno.h>
+#include <sys/stat.h>
+#include "halmat_synth.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "halmat-synth - synthetic HALMAT programs\n"
+        "Usage: %s [options] DIR\n"
+        "\n"
+        "Options:\n"
+        "  --seed N        Random seed (default 1)\n"
+        "  --blocks N      Blocks to fill, 1-%d (default 1)\n"
+        "  --depth N       DO/IF/CASE nesting, 0-%d (default 3)\n"
+        "  --procs N       FUNCTIONs, 0-%d (default 4)\n"
+        "  --case-width N  Arms per DO CASE (default 4)\n"
+        "  --trips N       Times round each loop (default 8)\n"
+        "  --max-ops N     Operators one top-level statement may run (default 20000)\n"
+        "  --mix SPEC      Statement weights, e.g. int=4,case=0,write=1\n"
+        "                  (int scalar if for while case call matrix array char write)\n"
+        "\n", prog, HALMAT_MAX_BLOCKS, SYN_MAX_DEPTH, SYN_MAX_PROCS);
+}
+
+int main(int argc, char *argv[])
+{
+    halmat_synth_opts_t o;
+    const char *dir = NULL;
+    halmat_synth_defaults(&o);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            o.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc) {
+            o.blocks = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            o.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--procs") == 0 && i + 1 < argc) {
+            o.procs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--case-width") == 0 && i + 1 < argc) {
+            o.case_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--trips") == 0 && i + 1 < argc) {
+            o.trips = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-ops") == 0 && i + 1 < argc) {
+            o.max_ops = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+            if (halmat_synth_mix(&o, argv[++i]) != 0) {
+                fprintf(stderr, "halmat-synth: bad --mix %s\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] != '-' && !dir) {
+            dir = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!dir) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "halmat-synth: cannot make %s\n", dir);
+        return 1;
+    }
+
+    halmat_gen_t G;
+    halmat_synth_stats_t st;
+    if (halmat_gen_init(&G, "SYNTH") != 0)
+        return 1;
+    int rc = halmat_synth(&G, &o, &st);
+    if (rc == 0)
+        rc = halmat_gen_write(&G, dir);
+    if (rc == 0)
+        printf("%s: %u blocks, %u operators, %u statements (%u top level), "
+               "%u FUNCTIONs, %u IFs, %u loops, %u CASEs, %u calls, "
+               "%u literals, %u symbols; at most about %llu operators to run\n",
+               dir, G.nblocks, G.nops, G.stmt, st.statements,
+               st.procs, st.ifs, st.loops, st.cases, st.calls, G.nlit - 1,
+               G.nsyt, (unsigned long long)st.ops);
+    halmat_gen_free(&G);
+    return rc ? 1 : 0;
+}
@@ -0,0 +1,308 @@
+/* halmat-testgen: write the regression programs that make test-gen
+ * runs, one directory each under DIR, with halmat.bin, litfile.bin,
+ * SOURCECO.txt, the input to READ on unit 5, and where the output is
+ * known, expect.txt.  Every program is run with and without --no-fuse
+ * and --sync-io, and the outputs must agree.
+ *
+ *   order    WRITE to units 6 and 7, which share stdout, interleaved
+ *   array    array loops with builtins and loop temporaries
+ *   far      the same loops beyond word 65535, where VAC operands
+ *            hold truncated addresses
+ *   builtin  INTEGER and SCALAR builtins, MAX of 16 arguments
+ *   read     READ into arrays and scalars
+ *   file     FILE write then read back through unit 1
+ *   struct   structure fields through EXTN, and TASN */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "halmat_gen.h"
+#include "halmat_builtin.h"
+
+#define ARR_N 6
+
+static void write_stmt(halmat_gen_t *G, int unit, int n, const uint32_t *args)
+{
+    halmat_gen_op(G, POP_XXST, 0, 1, HALMAT_IMD(2));
+    for (int i = 0; i < n; i++)
+        halmat_gen_op(G, POP_XXAR, 0, 1, args[i]);
+    halmat_gen_op(G, POP_WRIT, 0, 1, HALMAT_IMD(unit));
+    halmat_gen_op(G, POP_XXND, 0, 0);
+    halmat_gen_smrk(G);
+}
+
+static void read_stmt(halmat_gen_t *G, int n, const uint32_t *args)
+{
+    halmat_gen_op(G, POP_XXST, 0, 1, HALMAT_IMD(0));
+    for (int i = 0; i < n; i++)
+        halmat_gen_op(G, POP_XXAR, 0, 1, args[i]);
+    halmat_gen_op(G, POP_READ, 0, 1, HALMAT_IMD(5));
+    halmat_gen_op(G, POP_XXND, 0, 0);
+    halmat_gen_smrk(G);
+}
+
+static uint32_t scalar_arg(uint32_t syt) { return HALMAT_OPERAND(QUAL_SYT, syt, 5); }
+static uint32_t int_arg(uint32_t syt)    { return HALMAT_OPERAND(QUAL_SYT, syt, 6); }
+
+/* ---- programs ---- */
+
+static void gen_order(halmat_gen_t *G, FILE *expect)
+{
+    static const int units[] = { 6, 7, 7, 6, 7, 6 };
+    for (int i = 0; i < 6; i++) {
+        uint32_t v = HALMAT_OPERAND(QUAL_LIT, halmat_gen_lit(G, i + 1), 6);
+        write_stmt(G, units[i], 1, &v);
+        fprintf(expect, "%11d\n", i + 1);
+    }
+}
+
+/* A = SQRT(B) + SIN(B); C = MOD(B, 3); D = A * B - C, over ARR_N
+ * elements read from unit 5 */
+static void array_loops(halmat_gen_t *G, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    halmat_gen_op(G, POP_ADLP, 0, 0);
+    uint32_t s = halmat_gen_op(G, POP_BFNC, BI_SQRT, 1, HALMAT_SYT(b));
+    uint32_t t = halmat_gen_op(G, POP_BFNC, BI_SIN, 1, HALMAT_SYT(b));
+    uint32_t u = halmat_gen_op(G, POP_SADD, 0, 2, HALMAT_VAC(s), HALMAT_VAC(t));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(u), HALMAT_SYT(a));
+    halmat_gen_op(G, POP_DLPE, 0, 0);
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_ADLP, 0, 0);
+    s = halmat_gen_op(G, POP_BFNC, BI_MOD, 2, HALMAT_SYT(b),
+                      HALMAT_LIT(halmat_gen_lit(G, 3)));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(s), HALMAT_SYT(c));
+    halmat_gen_op(G, POP_DLPE, 0, 0);
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_ADLP, 0, 0);
+    s = halmat_gen_op(G, POP_SSPR, 0, 2, HALMAT_SYT(a), HALMAT_SYT(b));
+    t = halmat_gen_op(G, POP_SSUB, 0, 2, HALMAT_VAC(s), HALMAT_SYT(c));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(t), HALMAT_SYT(d));
+    halmat_gen_op(G, POP_DLPE, 0, 0);
+    halmat_gen_smrk(G);
+}
+
+static void gen_array(halmat_gen_t *G, FILE *input, int far)
+{
+    uint32_t a = halmat_gen_declare(G, "A", "ARRAY(6) SCALAR");
+    uint32_t b = halmat_gen_declare(G, "B", "ARRAY(6) SCALAR");
+    uint32_t c = halmat_gen_declare(G, "C", "ARRAY(6) SCALAR");
+    uint32_t d = halmat_gen_declare(G, "D", "ARRAY(6) SCALAR");
+    uint32_t x = scalar_arg(b);
+    read_stmt(G, 1, &x);
+    for (int i = 0; i < ARR_N; i++)
+        fprintf(input, "%s%d", i ? " " : "", 2 * i + 1);
+    fputc('\n', input);
+    if (far)
+        while (G->nblocks * HALMAT_BLOCK_WORDS < 0x10000 + HALMAT_BLOCK_WORDS)
+            halmat_gen_block(G);
+    array_loops(G, a, b, c, d);
+    uint32_t out[] = { scalar_arg(a), scalar_arg(c), scalar_arg(d) };
+    write_stmt(G, 6, 3, out);
+}
+
+static void gen_builtin(halmat_gen_t *G, FILE *input)
+{
+    uint32_t i = halmat_gen_declare(G, "I", "INTEGER");
+    uint32_t j = halmat_gen_declare(G, "J", "INTEGER");
+    uint32_t m = halmat_gen_declare(G, "M", "INTEGER");
+    uint32_t x = halmat_gen_declare(G, "X", "SCALAR");
+    uint32_t y = halmat_gen_declare(G, "Y", "SCALAR");
+    uint32_t k[6], r[3];
+    char name[8];
+    for (int n = 0; n < 6; n++) {
+        snprintf(name, sizeof(name), "K%d", n + 1);
+        k[n] = halmat_gen_declare(G, name, "INTEGER");
+    }
+    for (int n = 0; n < 3; n++) {
+        snprintf(name, sizeof(name), "R%d", n + 1);
+        r[n] = halmat_gen_declare(G, name, "SCALAR");
+    }
+    uint32_t in[] = { scalar_arg(x), scalar_arg(y), scalar_arg(i), scalar_arg(j) };
+    read_stmt(G, 4, in);
+    fprintf(input, "-7.25 2.5 -17 5\n");
+
+    /* READ gives SCALARs; an INTEGER assignment makes them INTEGER */
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_SYT(i), HALMAT_SYT(i));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_SYT(j), HALMAT_SYT(j));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_LIT(halmat_gen_lit(G, -1)), HALMAT_SYT(m));
+    halmat_gen_smrk(G);
+
+    uint32_t v[6];
+    v[0] = halmat_gen_op(G, POP_BFNC, BI_MOD, 2, HALMAT_SYT(i), HALMAT_SYT(j));
+    v[1] = halmat_gen_op(G, POP_BFNC, BI_MOD, 2, HALMAT_SYT(i), HALMAT_SYT(m));
+    v[2] = halmat_gen_op(G, POP_BFNC, BI_ABS, 1, HALMAT_SYT(i));
+    v[3] = halmat_gen_op(G, POP_BFNC, BI_ROUND, 1, HALMAT_SYT(x));
+    v[4] = halmat_gen_op(G, POP_BFNC, BI_MAX, 16,
+        HALMAT_SYT(i), HALMAT_SYT(j), HALMAT_SYT(m), HALMAT_SYT(i),
+        HALMAT_SYT(j), HALMAT_SYT(m), HALMAT_SYT(i), HALMAT_SYT(j),
+        HALMAT_SYT(m), HALMAT_SYT(i), HALMAT_SYT(j), HALMAT_SYT(m),
+        HALMAT_SYT(i), HALMAT_SYT(j), HALMAT_LIT(halmat_gen_lit(G, 11)),
+        HALMAT_SYT(m));
+    v[5] = halmat_gen_op(G, POP_BFNC, BI_MIN, 3, HALMAT_SYT(i), HALMAT_SYT(j),
+                         HALMAT_SYT(m));
+    for (int n = 0; n < 6; n++)
+        halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_VAC(v[n]), HALMAT_SYT(k[n]));
+    halmat_gen_smrk(G);
+    uint32_t s = halmat_gen_op(G, POP_BFNC, BI_SQRT, 1, HALMAT_SYT(y));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(s), HALMAT_SYT(r[0]));
+    s = halmat_gen_op(G, POP_BFNC, BI_ABS, 1, HALMAT_SYT(x));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(s), HALMAT_SYT(r[1]));
+    s = halmat_gen_op(G, POP_BFNC, BI_MOD, 2, HALMAT_SYT(x), HALMAT_SYT(y));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_VAC(s), HALMAT_SYT(r[2]));
+    halmat_gen_smrk(G);
+
+    uint32_t out[9];
+    for (int n = 0; n < 6; n++)
+        out[n] = int_arg(k[n]);
+    for (int n = 0; n < 3; n++)
+        out[6 + n] = scalar_arg(r[n]);
+    write_stmt(G, 6, 6, out);
+    write_stmt(G, 6, 3, out + 6);
+}
+
+static void gen_read(halmat_gen_t *G, FILE *input)
+{
+    uint32_t a = halmat_gen_declare(G, "A", "ARRAY(3) INTEGER");
+    uint32_t b = halmat_gen_declare(G, "B", "ARRAY(2) SCALAR");
+    uint32_t x = halmat_gen_declare(G, "X", "SCALAR");
+    uint32_t args[] = { int_arg(a), scalar_arg(b), scalar_arg(x) };
+    read_stmt(G, 3, args);
+    read_stmt(G, 1, args + 2);
+    fprintf(input, "4 -5 6 0.5 1.5E2 -3.75\n2.125\n");
+    write_stmt(G, 6, 3, args);
+}
+
+static void gen_file(halmat_gen_t *G)
+{
+    uint32_t x = halmat_gen_declare(G, "X", "SCALAR");
+    uint32_t y = halmat_gen_declare(G, "Y", "SCALAR");
+    uint32_t z = halmat_gen_declare(G, "Z", "SCALAR");
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_LIT(halmat_gen_lit(G, 42.5)), HALMAT_SYT(x));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_LIT(halmat_gen_lit(G, -0.125)), HALMAT_SYT(y));
+    halmat_gen_smrk(G);
+    /* FILE(1, 3) = X; FILE(1, 1) = Y; then Y, Z back from them */
+    halmat_gen_op(G, POP_FILE, 1, 2, HALMAT_LIT(halmat_gen_lit(G, 3)), HALMAT_SYT(x) | 2);
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_FILE, 1, 2, HALMAT_LIT(halmat_gen_lit(G, 1)), HALMAT_SYT(y) | 2);
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_FILE, 1, 2, HALMAT_SYT(z), HALMAT_LIT(halmat_gen_lit(G, 3)));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_FILE, 1, 2, HALMAT_SYT(x), HALMAT_LIT(halmat_gen_lit(G, 1)));
+    halmat_gen_smrk(G);
+    uint32_t out[] = { scalar_arg(x), scalar_arg(z) };
+    write_stmt(G, 6, 2, out);
+}
+
+/* STRUCTURE T: 1 A SCALAR, 1 B INTEGER; the template and its fields
+ * take the next symbol numbers, as halmat_load_declares counts them */
+static void gen_struct(halmat_gen_t *G, FILE *input)
+{
+    halmat_gen_source(G, "    STRUCTURE T: 1 A SCALAR, 1 B INTEGER;\n");
+    uint32_t fa = G->nsyt + 2, fb = G->nsyt + 3;
+    G->nsyt += 3;
+    uint32_t s = halmat_gen_declare(G, "S", "T-STRUCTURE");
+    uint32_t r = halmat_gen_declare(G, "R", "T-STRUCTURE");
+    uint32_t x = halmat_gen_declare(G, "X", "SCALAR");
+    uint32_t in = scalar_arg(x);
+    read_stmt(G, 1, &in);
+    fprintf(input, "6.5\n");
+
+    uint32_t e = halmat_gen_op(G, POP_EXTN, 0, 2, HALMAT_SYT(s), HALMAT_SYT(fa));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_SYT(x), HALMAT_OPERAND(QUAL_XPT, e, 0));
+    halmat_gen_smrk(G);
+    e = halmat_gen_op(G, POP_EXTN, 0, 2, HALMAT_SYT(s), HALMAT_SYT(fb));
+    halmat_gen_op(G, POP_IASN, 0, 2, HALMAT_LIT(halmat_gen_lit(G, 7)),
+                  HALMAT_OPERAND(QUAL_XPT, e, 0));
+    halmat_gen_smrk(G);
+    halmat_gen_op(G, POP_TASN, 0, 2, HALMAT_SYT(s), HALMAT_SYT(r));
+    halmat_gen_smrk(G);
+    e = halmat_gen_op(G, POP_EXTN, 0, 2, HALMAT_SYT(s), HALMAT_SYT(fa));
+    halmat_gen_op(G, POP_SASN, 0, 2, HALMAT_LIT(halmat_gen_lit(G, 0)),
+                  HALMAT_OPERAND(QUAL_XPT, e, 0));
+    halmat_gen_smrk(G);
+
+    uint32_t ra = halmat_gen_op(G, POP_EXTN, 0, 2, HALMAT_SYT(r), HALMAT_SYT(fa));
+    uint32_t rb = halmat_gen_op(G, POP_EXTN, 0, 2, HALMAT_SYT(r), HALMAT_SYT(fb));
+    uint32_t sa = halmat_gen_op(G, POP_EXTN, 0, 2, HALMAT_SYT(s), HALMAT_SYT(fa));
+    uint32_t out[] = { HALMAT_OPERAND(QUAL_XPT, ra, 5), HALMAT_OPERAND(QUAL_XPT, rb, 6),
+                       HALMAT_OPERAND(QUAL_XPT, sa, 5) };
+    write_stmt(G, 6, 3, out);
+}
+
+/* ---- driver ---- */
+
+enum { P_ORDER, P_ARRAY, P_FAR, P_BUILTIN, P_READ, P_FILE, P_STRUCT, NPROG };
+
+static const char *const prog_names[NPROG] = {
+    "order", "array", "far", "builtin", "read", "file", "struct"
+};
+
+static FILE *open_in(const char *dir, const char *prog, const char *file)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s/%s", dir, prog, file);
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        fprintf(stderr, "halmat-testgen: cannot write %s\n", path);
+    return fp;
+}
+
+static int gen_one(const char *dir, int p)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, prog_names[p]);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "halmat-testgen: cannot make %s\n", path);
+        return -1;
+    }
+    FILE *input = open_in(dir, prog_names[p], "input.txt");
+    FILE *expect = p == P_ORDER ? open_in(dir, prog_names[p], "expect.txt") : NULL;
+    if (!input || (p == P_ORDER && !expect)) {
+        if (input) fclose(input);
+        return -1;
+    }
+
+    halmat_gen_t G;
+    char name[16];
+    int i;
+    for (i = 0; prog_names[p][i] && i < 15; i++)
+        name[i] = (char)(prog_names[p][i] - 'a' + 'A');
+    name[i] = '\0';
+    int rc = halmat_gen_init(&G, name);
+    if (rc == 0) {
+        switch (p) {
+        case P_ORDER:   gen_order(&G, expect); break;
+        case P_ARRAY:   gen_array(&G, input, 0); break;
+        case P_FAR:     gen_array(&G, input, 1); break;
+        case P_BUILTIN: gen_builtin(&G, input); break;
+        case P_READ:    gen_read(&G, input); break;
+        case P_FILE:    gen_file(&G); break;
+        case P_STRUCT:  gen_struct(&G, input); break;
+        }
+        rc = halmat_gen_write(&G, path);
+    }
+    halmat_gen_free(&G);
+    fclose(input);
+    if (expect)
+        fclose(expect);
+    if (rc != 0)
+        fprintf(stderr, "halmat-testgen: cannot write %s\n", path);
+    return rc;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 || argv[1][0] == '-') {
+        fprintf(stderr, "Usage: %s DIR\n", argv[0]);
+        return 1;
+    }
+    if (mkdir(argv[1], 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "halmat-testgen: cannot make %s\n", argv[1]);
+        return 1;
+    }
+    for (int p = 0; p < NPROG; p++)
+        if (gen_one(argv[1], p) != 0)
+            return 1;
+    return 0;
+}
@@ -0,0 +1,264 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "halmat_trace.h"
+
+static const char magic[8] = { 'H', 'A', 'L', 'T', 'R', 'A', 'C', 'E' };
+
+/* ---- encoding ---- */
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t x = 0;
+    for (int s = 0; p < end && s < 64; s += 7) {
+        uint8_t b = *p++;
+        x |= (uint64_t)(b & 0x7F) << s;
+        if (!(b & 0x80)) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Worst case per record: pc delta 5, popcode 2, type 1, result 10 */
+#define REC_MAX 18
+static uint8_t chunk_buf[8 + HALMAT_TRACE_CHUNK * REC_MAX];
+
+static void write_chunk(struct halmat_trace *T, uint64_t from, uint32_t n)
+{
+    uint8_t *p = chunk_buf + 8;
+    uint32_t prev_pc = 0;
+    uint64_t prev_result = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const halmat_trace_rec_t *r = &T->ring[(from + i) & (HALMAT_TRACE_RING - 1)];
+        int32_t d = (int32_t)(r->pc - prev_pc);
+        p = put_varint(p, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+        p = put_varint(p, r->pop);
+        if (T->results) {
+            *p++ = r->rtype;
+            if (r->rtype) {
+                p = put_varint(p, r->result ^ prev_result);
+                prev_result = r->result;
+            }
+        }
+        prev_pc = r->pc;
+    }
+    uint32_t len = (uint32_t)(p - chunk_buf - 8);
+    put_u32(chunk_buf, n);
+    put_u32(chunk_buf + 4, len);
+    fwrite(chunk_buf, 1, 8 + (size_t)len, T->fp);
+    T->records += n;
+    T->bytes += 8 + len;
+}
+
+/* Take everything available, or only whole chunks unless stopping.
+ * Returns the number of records written. */
+static uint32_t drain(struct halmat_trace *T, int all)
+{
+    uint64_t head = T->head;
+    uint64_t tail = __atomic_load_n(&T->tail, __ATOMIC_ACQUIRE);
+    uint32_t done = 0;
+    while (tail - head >= HALMAT_TRACE_CHUNK || (all && tail > head)) {
+        uint32_t n = tail - head < HALMAT_TRACE_CHUNK ?
+                     (uint32_t)(tail - head) : HALMAT_TRACE_CHUNK;
+        write_chunk(T, head, n);
+        head += n;
+        done += n;
+        __atomic_store_n(&T->head, head, __ATOMIC_RELEASE);
+    }
+    return done;
+}
+
+static void nap(long ns)
+{
+    struct timespec ts = { 0, ns };
+    nanosleep(&ts, NULL);
+}
+
+static void *writer_main(void *arg)
+{
+    struct halmat_trace *T = arg;
+    while (!__atomic_load_n(&T->stop, __ATOMIC_ACQUIRE))
+        if (!drain(T, 0))
+            nap(1000000);               /* 1 ms */
+    drain(T, 1);
+    return NULL;
+}
+
+void halmat_trace_wait(struct halmat_trace *T)
+{
+    while (T->tail - __atomic_load_n(&T->head, __ATOMIC_ACQUIRE) == HALMAT_TRACE_RING) {
+        if (!T->threaded)
+            drain(T, 0);
+        else
+            nap(100000);
+    }
+}
+
+int halmat_trace_open(halmat_t *H, const char *path, int results)
+{
+    struct halmat_trace *T = calloc(1, sizeof(*T));
+    if (!T)
+        return -1;
+    T->fp = fopen(path, "wb");
+    if (!T->fp) {
+        fprintf(stderr, "halmat_trace: cannot create %s\n", path);
+        free(T);
+        return -1;
+    }
+    uint8_t hdr[16];
+    memcpy(hdr, magic, 8);
+    put_u32(hdr + 8, 1);
+    put_u32(hdr + 12, results ? HALMAT_TRACE_RESULTS : 0);
+    fwrite(hdr, 1, sizeof(hdr), T->fp);
+    T->results = results;
+    T->threaded = pthread_create(&T->thread, NULL, writer_main, T) == 0;
+    H->trace = T;
+    return 0;
+}
+
+void halmat_trace_close(halmat_t *H)
+{
+    struct halmat_trace *T = H->trace;
+    if (!T)
+        return;
+    if (T->threaded) {
+        __atomic_store_n(&T->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(T->thread, NULL);
+    } else {
+        drain(T, 1);
+    }
+    fclose(T->fp);
+    fprintf(stderr, "halmat_trace: %llu records, %llu bytes (%.1f per record)\n",
+            (unsigned long long)T->records, (unsigned long long)T->bytes + 16,
+            T->records ? (double)T->bytes / (double)T->records : 0.0);
+    free(T);
+    H->trace = NULL;
+}
+
+/* ---- decoding ---- */
+
+static void print_operand(const halmat_t *H, uint32_t w, FILE *out)
+{
+    uint32_t q = HALMAT_QUAL(w), d = HALMAT_DATA(w);
+    const char *name = q == QUAL_SYT ? halmat_syt_name(H, d) : NULL;
+    if (name)
+        fprintf(out, " %s", name);
+    else
+        fprintf(out, " %s(%u)", halmat_qual_name(q), d);
+}
+
+static void print_result(uint8_t type, uint64_t v, FILE *out)
+{
+    switch (type) {
+    case HTYPE_SCALAR: {
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        fprintf(out, "  = %.9g", d);
+        break;
+    }
+    case HTYPE_INTEGER:
+        fprintf(out, "  = %d", (int32_t)(uint32_t)v);
+        break;
+    case HTYPE_BIT:
+    case HTYPE_BOOLEAN:
+        fprintf(out, "  = 0x%X", (uint32_t)v);
+        break;
+    default:
+        break;
+    }
+}
+
+int halmat_trace_decode(halmat_t *H, const char *path, FILE *out)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t hdr[16];
+    if (!f || fread(hdr, 1, 16, f) != 16 || memcmp(hdr, magic, 8) != 0 ||
+        get_u32(hdr + 8) != 1) {
+        fprintf(stderr, "halmat_trace: %s is not a trace file\n", path);
+        if (f) fclose(f);
+        return -1;
+    }
+    int results = (get_u32(hdr + 12) & HALMAT_TRACE_RESULTS) != 0;
+    uint8_t *buf = NULL;
+    size_t cap = 0;
+    uint64_t seq = 0;
+    int rc = 0;
+
+    uint8_t ch[8];
+    while (fread(ch, 1, 8, f) == 8) {
+        uint32_t n = get_u32(ch), len = get_u32(ch + 4);
+        if (len > cap) {
+            uint8_t *b = realloc(buf, len);
+            if (!b) { rc = -1; break; }
+            buf = b;
+            cap = len;
+        }
+        if (fread(buf, 1, len, f) != len) {
+            fprintf(stderr, "halmat_trace: %s: truncated chunk\n", path);
+            rc = -1;
+            break;
+        }
+        const uint8_t *p = buf, *end = buf + len;
+        uint32_t pc = 0;
+        uint64_t result = 0;
+        for (uint32_t i = 0; i < n && p; i++) {
+            uint64_t zz, pop;
+            uint8_t type = 0;
+            if (!(p = get_varint(p, end, &zz)) || !(p = get_varint(p, end, &pop)))
+                break;
+            pc += (uint32_t)((zz >> 1) ^ (~(zz & 1) + 1));
+            if (results) {
+                if (p >= end) { p = NULL; break; }
+                type = *p++;
+                uint64_t x = 0;
+                if (type && !(p = get_varint(p, end, &x)))
+                    break;
+                result ^= x;
+            }
+            const char *name = halmat_popcode_name((uint32_t)pop);
+            fprintf(out, "%10llu  %5u  %-6s", (unsigned long long)seq++, pc,
+                    name ? name : "???");
+            if (pc < H->code_len && HALMAT_IS_OP(H->code[pc])) {
+                uint32_t numop = HALMAT_NUMOP(H->code[pc]);
+                for (uint32_t j = 1; j <= numop && pc + j < H->code_len; j++)
+                    print_operand(H, H->code[pc + j], out);
+            }
+            if (type)
+                print_result(type, result, out);
+            fputc('\n', out);
+        }
+        if (!p) {
+            fprintf(stderr, "halmat_trace: %s: corrupt chunk\n", path);
+            rc = -1;
+            break;
+        }
+    }
+    free(buf);
+    fclose(f);
+    return rc;
+}
@@ -0,0 +1,75 @@
+/* Binary execution trace (--trace-bin, --decode-trace).
+ *
+ * halmat_step appends one fixed-size record per operator (code address,
+ * popcode and, with --trace-results, the value it left in its VAC) to
+ * a single-producer/single-consumer ring.  A writer thread takes the
+ * records in chunks of HALMAT_TRACE_CHUNK and writes them compressed:
+ * each chunk is self-contained and holds the code address as a signed
+ * delta from the previous record's and the result as the XOR with the
+ * previous result, both as varints.  The interpreter never formats
+ * anything, and only waits if the writer falls a whole ring behind.
+ *
+ * File: "HALTRACE", version and flags (u32 little-endian each), then
+ * chunks of u32 record count, u32 byte count and the records. */
+
+#ifndef HALMAT_TRACE_H
+#define HALMAT_TRACE_H
+
+#include <pthread.h>
+#include "halmat.h"
+
+#define HALMAT_TRACE_RING   (1u << 18)      /* records, power of 2 */
+#define HALMAT_TRACE_CHUNK  8192
+#define HALMAT_TRACE_RESULTS 0x1            /* header flag */
+
+typedef struct {
+    uint32_t pc;
+    uint16_t pop;
+    uint8_t  rtype;     /* HTYPE of the result, 0 = none recorded */
+    uint8_t  _pad;
+    uint64_t result;    /* INTEGER, BIT, or the SCALAR's bits */
+} halmat_trace_rec_t;
+
+struct halmat_trace {
+    halmat_trace_rec_t ring[HALMAT_TRACE_RING];
+    uint64_t head;      /* next record the writer takes */
+    uint64_t tail;      /* next record halmat_step fills */
+    int      results;
+    int      stop;
+    FILE    *fp;
+    uint64_t records;
+    uint64_t bytes;
+    pthread_t thread;
+    int      threaded;
+};
+
+int  halmat_trace_open(halmat_t *H, const char *path, int results);
+void halmat_trace_close(halmat_t *H);           /* flush, report size */
+void halmat_trace_wait(struct halmat_trace *T); /* ring full */
+int  halmat_trace_decode(halmat_t *H, const char *path, FILE *out);
+
+static inline void halmat_trace_put(halmat_t *H, uint32_t pc, uint32_t pop)
+{
+    struct halmat_trace *T = H->trace;
+    uint64_t tail = T->tail;
+    if (tail - __atomic_load_n(&T->head, __ATOMIC_ACQUIRE) == HALMAT_TRACE_RING)
+        halmat_trace_wait(T);
+    halmat_trace_rec_t *r = &T->ring[tail & (HALMAT_TRACE_RING - 1)];
+    r->pc = pc;
+    r->pop = (uint16_t)pop;
+    r->rtype = 0;
+    r->result = 0;
+    if (T->results && (pop >> 8) >= 1 && (pop >> 8) <= 7 && (pop & 0xFF) != 0x01) {
+        const halmat_val_t *v = &H->vac[VAC_SLOT(pc)];
+        r->rtype = v->type;
+        if (v->type == HTYPE_SCALAR)
+            memcpy(&r->result, &v->v.scalar, sizeof(double));
+        else if (v->type == HTYPE_INTEGER)
+            r->result = (uint32_t)v->v.integer;
+        else if (v->type == HTYPE_BIT || v->type == HTYPE_BOOLEAN)
+            r->result = v->v.bits;
+    }
+    __atomic_store_n(&T->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* HALMAT_TRACE_H */
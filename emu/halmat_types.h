@@ -12,12 +12,15 @@ enum {
     HTYPE_INTEGER = 6,
     HTYPE_BOOLEAN = 7,
     HTYPE_EVENT   = 9,
-    HTYPE_STRUCT  = 10
+    HTYPE_STRUCT  = 10,
+    HTYPE_REF     = 11      /* DSUB result: where the element lives */
 };
 
+#define HALMAT_MAX_DIMS 3   /* ARRAY(n, m, k) */
+
 typedef struct {
     uint8_t  type;
-    uint8_t  rows;
+    uint8_t  rows;      /* VECTOR/MATRIX shape; BIT: length, 0 = 32 */
     uint8_t  cols;
     uint8_t  _pad;
     union {
@@ -30,13 +33,67 @@ typedef struct {
             uint16_t len;
         } string;
         uint32_t bits;
+        struct {
+            uint8_t  *p;        /* first element */
+            uint16_t *len;      /* CHARACTER: the string's current length */
+            uint16_t  stride;   /* elements between rows (vector: elements) */
+            uint16_t  first;    /* CHARACTER/BIT partition, 0-based */
+            uint16_t  count;
+            uint16_t  size;     /* CHARACTER capacity, BIT length */
+            uint16_t  syt;      /* plain variable + 1, 0 in the data segment */
+            uint8_t   type;     /* type of the value referenced */
+            uint8_t   store;    /* how the element is held: SCALAR is double,
+                                   INTEGER int32, BIT uint32, CHAR bytes */
+            uint32_t  bytes;    /* STRUCT: size of the storage referenced */
+        } ref;                  /* rows/cols give the shape */
     } v;
 } halmat_val_t;
 
+/* Arrayed variables: elements are contiguous and row-major in the data
+ * segment.  Element type and shape are also kept for unarrayed
+ * variables that were declared, for component subscripts. */
+typedef struct {
+    uint32_t base;                      /* data segment offset of element 1 */
+    uint32_t count;                     /* elements, 0 = not arrayed */
+    uint32_t esize;                     /* bytes per element */
+    uint32_t stride[HALMAT_MAX_DIMS];   /* bytes between successive indices */
+    uint16_t extent[HALMAT_MAX_DIMS];
+    uint16_t elen;                      /* CHARACTER/BIT length */
+    uint8_t  ndim;
+    uint8_t  etype;                     /* element type, 0 = not known */
+    uint8_t  erows, ecols;              /* VECTOR length, MATRIX shape */
+} halmat_array_t;
+
+/* Structures.  A template's fields are laid out packed, in order of
+ * declaration, when the program is loaded; a structure variable is
+ * one block in the data segment per copy (arr.extent[0] copies of
+ * arr.esize bytes) and arr.etype HTYPE_STRUCT. */
+enum { SK_NONE, SK_TEMPLATE, SK_FIELD, SK_MINOR };
+
+typedef struct {
+    uint32_t offset;    /* field: bytes into the structure;
+                           NAME variable: data segment offset of its pointer */
+    uint16_t templ;     /* the template a structure (NAME) variable or
+                           field is declared with */
+    uint16_t owner;     /* field: the template it belongs to */
+    uint8_t  level;     /* field level number */
+    uint8_t  kind;      /* SK_* */
+    uint8_t  name;      /* NAME variable or NAME field */
+} halmat_struct_t;
+
+/* What a NAME variable holds: where the target's value starts, as in
+ * a ref (a CHARACTER in the data segment: at its length word) */
+typedef struct {
+    uint8_t  *p;        /* NULL = the NULL name */
+    uint32_t  syt;      /* plain variable + 1, 0 in the data segment */
+} halmat_name_t;
+
 typedef struct {
-    halmat_val_t val;
-    uint8_t      allocated;
-    uint8_t      _pad[3];
+    halmat_val_t    val;
+    uint8_t         allocated;
+    uint8_t         _pad[3];
+    halmat_array_t  arr;
+    halmat_struct_t st;
 } syt_entry_t;
 
 typedef struct {
@@ -58,6 +115,7 @@ typedef struct {
     uint32_t addr;
     uint32_t stmt;
     int      enabled;
+    uint32_t saved;        /* the operator word the trap replaced */
 } breakpoint_t;
 
 typedef struct {
@@ -72,6 +130,8 @@ typedef struct {
 typedef struct {
     halmat_val_t args[HALMAT_MAX_IO_ARGS];
     uint8_t      arg_types[HALMAT_MAX_IO_ARGS];
+    uint32_t     arg_words[HALMAT_MAX_IO_ARGS]; /* XXAR operand, READ target */
+    uint16_t     arg_elem[HALMAT_MAX_IO_ARGS];  /* element of a whole array */
     int          nargs;
     int          active;
     int          is_call;
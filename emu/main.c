@@ -1,6 +1,13 @@
 #include "halmat.h"
 #include "halmat_io.h"
 #include "halmat_debug.h"
+#include "halmat_sched.h"
+#include "halmat_prof.h"
+#include "halmat_trace.h"
+#include "halmat_perf.h"
+#include "halmat_cov.h"
+#include "halmat_replay.h"
+#include "halmat_cost.h"
 
 static halmat_t H;
 
@@ -11,12 +18,53 @@ static void usage(const char *prog)
         "Usage: %s [options] halmat.bin\n"
         "\n"
         "Options:\n"
-        "  --disasm       Disassemble only (no execution)\n"
+        "  --disasm       Disassemble only (no execution); with coverage,\n"
+        "                 annotated with hit counts and a summary\n"
         "  --litfile F    Load literal table (resolves LIT references)\n"
         "  --unit N=PATH  Map logical unit N to file (stdin/stdout/stderr for std streams)\n"
-        "  --ebcdic       Translate character output from EBCDIC CP 037 to ASCII\n"
+        "  --ebcdic       Character literals are EBCDIC CP 037: transcode at load\n"
+        "  --ebcdic-unit N  Unit N's file holds EBCDIC text (READ and WRITE)\n"
         "  --debug        Enter debugger mode\n"
+        "  --snapshot-interval N  Debugger: copy the state every N operators\n"
+        "                 for reverse-step (default 100000, 0 = off)\n"
+        "  --snapshot-mem MB  Debugger: memory for the copies (default 512)\n"
         "  --trace        Print each instruction as it executes\n"
+        "  --trace-bin F  Record each operator executed to F (binary, compressed)\n"
+        "  --trace-results  With --trace-bin, also record each operator's result\n"
+        "  --decode-trace F  Print trace file F against halmat.bin, then exit\n"
+        "  --sim-time S   Stop real-time programs after S seconds of virtual time\n"
+        "  --threads N    Run ready processes on N worker threads\n"
+        "  --deterministic  With --threads, keep the single-threaded interleaving\n"
+        "  --sync-io      Format WRITE output before continuing (no writer thread)\n"
+        "  --reclen N     Record length in bytes for new FILE units (default 520)\n"
+        "  --no-fuse      Run matrix/vector expressions, array loops and string\n"
+        "                 appends one operator at a time\n"
+        "  --hfp          Builtin results rounded to IBM short hex float\n"
+        "  --profile      Count operators by popcode and class, report at exit\n"
+        "  --profile-rate N  Time one operator in N (default 16)\n"
+        "  --profile-json F  Also write the profile to F as JSON\n"
+        "  --profile-stmt Also time statements and procedures, with the\n"
+        "                 annotated source listing\n"
+        "  --profile-stacks F  Write collapsed call stacks to F (flame graphs)\n"
+        "  --profile-sample  Profile statements and procedures by sampling\n"
+        "                 (SIGPROF) instead of timing every statement\n"
+        "  --sample-hz N  Sampling rate for --profile-sample (default 1000)\n"
+        "  --perf-counters  Report hardware counters (cycles, instructions,\n"
+        "                 cache and branch misses) per run phase\n"
+        "  --perf-class   Also per operator class (reads counters at every\n"
+        "                 class change)\n"
+        "  --coverage F   Record which operators run, write the map to F\n"
+        "  --coverage-counts  Also count hits per operator (one thread)\n"
+        "  --coverage-in F  Merge coverage file F first (repeatable); with\n"
+        "                 --disasm --coverage F, writes the merged map\n"
+        "  --cost         Estimate AP-101S instructions and time per statement,\n"
+        "                 procedure and process (one operator at a time)\n"
+        "  --cost-model F  Cost table overrides for --cost (see halmat_cost.h)\n"
+        "  --frame-budget MS  With --cost, report frames of MS ms of virtual\n"
+        "                 time whose estimated work takes longer than MS\n"
+        "  --listing F    Source listing for --profile-stmt and --profile-sample\n"
+        "                 (default: LISTING2.txt\n"
+        "                 next to halmat.bin)\n"
         "\n", prog);
 }
 
@@ -27,6 +75,27 @@ int main(int argc, char *argv[])
     int disasm_only = 0;
     int debug = 0;
     int trace = 0;
+    int fuse = 1;
+    int profile = 0;
+    const char *trace_bin = NULL;
+    int trace_results = 0;
+    const char *decode_trace = NULL;
+    uint32_t profile_rate = 16;
+    const char *profile_json = NULL;
+    int profile_stmt = 0;
+    const char *profile_stacks = NULL;
+    int profile_sample = 0;
+    uint32_t sample_hz = 1000;
+    int perf = 0;
+    const char *coverage = NULL;
+    int coverage_counts = 0;
+    int coverage_in = 0;
+    const char *listing = NULL;
+    int cost = 0;
+    const char *cost_model = NULL;
+    double frame_ms = 0.0;
+    uint64_t snap_interval = HALMAT_SNAP_INTERVAL;
+    uint64_t snap_mem = HALMAT_SNAP_MEM_MB;
 
     halmat_init(&H);
 
@@ -64,10 +133,128 @@ int main(int argc, char *argv[])
                 snprintf(H.units[unit_num].path, sizeof(H.units[unit_num].path), "%s", path);
         } else if (strcmp(argv[i], "--ebcdic") == 0) {
             H.translate_ebcdic = 1;
+        } else if (strcmp(argv[i], "--ebcdic-unit") == 0 && i + 1 < argc) {
+            char *endptr;
+            long n = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr || n < 0 || n >= HALMAT_MAX_UNITS) {
+                fprintf(stderr, "Unit number must be 0-%d\n", HALMAT_MAX_UNITS - 1);
+                return 1;
+            }
+            H.units[n].ebcdic = 1;
         } else if (strcmp(argv[i], "--debug") == 0) {
             debug = 1;
+        } else if (strcmp(argv[i], "--snapshot-interval") == 0 && i + 1 < argc) {
+            char *endptr;
+            snap_interval = strtoull(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr) {
+                fprintf(stderr, "--snapshot-interval: invalid count '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--snapshot-mem") == 0 && i + 1 < argc) {
+            char *endptr;
+            long n = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr || n < 1 || n > (1L << 20)) {
+                fprintf(stderr, "--snapshot-mem: expected 1-1048576, got '%s'\n", argv[i]);
+                return 1;
+            }
+            snap_mem = (uint64_t)n;
         } else if (strcmp(argv[i], "--trace") == 0) {
             trace = 1;
+        } else if (strcmp(argv[i], "--trace-bin") == 0 && i + 1 < argc) {
+            trace_bin = argv[++i];
+        } else if (strcmp(argv[i], "--trace-results") == 0) {
+            trace_results = 1;
+        } else if (strcmp(argv[i], "--decode-trace") == 0 && i + 1 < argc) {
+            decode_trace = argv[++i];
+        } else if (strcmp(argv[i], "--sim-time") == 0 && i + 1 < argc) {
+            char *endptr;
+            double secs = strtod(argv[++i], &endptr);
+            if (endptr == argv[i] || *endptr || !(secs > 0.0)) {
+                fprintf(stderr, "--sim-time: invalid duration '%s'\n", argv[i]);
+                return 1;
+            }
+            H.sim_limit_us = (uint64_t)(secs * 1e6 + 0.5);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char *endptr;
+            long n = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr || n < 1 || n > 256) {
+                fprintf(stderr, "--threads: expected 1-256, got '%s'\n", argv[i]);
+                return 1;
+            }
+            H.sched_threads = (uint32_t)n;
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            H.sched_replay = 1;
+        } else if (strcmp(argv[i], "--reclen") == 0 && i + 1 < argc) {
+            char *endptr;
+            long n = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr || n < HALMAT_FILE_RECLEN_MIN ||
+                n > (long)HALMAT_FILE_RECLEN_MAX) {
+                fprintf(stderr, "--reclen: expected %u-%u, got '%s'\n",
+                        HALMAT_FILE_RECLEN_MIN, HALMAT_FILE_RECLEN_MAX, argv[i]);
+                return 1;
+            }
+            H.file_reclen = (uint32_t)n;
+        } else if (strcmp(argv[i], "--hfp") == 0) {
+            H.hfp = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = 1;
+        } else if (strcmp(argv[i], "--profile-rate") == 0 && i + 1 < argc) {
+            char *endptr;
+            long n = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr || n < 1 || n > 1000000) {
+                fprintf(stderr, "--profile-rate: expected 1-1000000, got '%s'\n", argv[i]);
+                return 1;
+            }
+            profile = 1;
+            profile_rate = (uint32_t)n;
+        } else if (strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc) {
+            profile = 1;
+            profile_json = argv[++i];
+        } else if (strcmp(argv[i], "--profile-stmt") == 0) {
+            profile = profile_stmt = 1;
+        } else if (strcmp(argv[i], "--profile-stacks") == 0 && i + 1 < argc) {
+            profile_stacks = argv[++i];
+        } else if (strcmp(argv[i], "--profile-sample") == 0) {
+            profile_sample = 1;
+        } else if (strcmp(argv[i], "--sample-hz") == 0 && i + 1 < argc) {
+            char *endptr;
+            long n = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr || n < 1 || n > 100000) {
+                fprintf(stderr, "--sample-hz: expected 1-100000, got '%s'\n", argv[i]);
+                return 1;
+            }
+            profile_sample = 1;
+            sample_hz = (uint32_t)n;
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            perf = perf ? perf : 1;
+        } else if (strcmp(argv[i], "--perf-class") == 0) {
+            perf = 2;
+        } else if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc) {
+            coverage = argv[++i];
+        } else if (strcmp(argv[i], "--coverage-counts") == 0) {
+            coverage_counts = 1;
+        } else if (strcmp(argv[i], "--coverage-in") == 0 && i + 1 < argc) {
+            coverage_in = 1;
+            i++;                /* merged once the program is loaded */
+        } else if (strcmp(argv[i], "--cost") == 0) {
+            cost = 1;
+        } else if (strcmp(argv[i], "--cost-model") == 0 && i + 1 < argc) {
+            cost = 1;
+            cost_model = argv[++i];
+        } else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+            char *endptr;
+            frame_ms = strtod(argv[++i], &endptr);
+            if (endptr == argv[i] || *endptr || !(frame_ms > 0.0)) {
+                fprintf(stderr, "--frame-budget: invalid duration '%s'\n", argv[i]);
+                return 1;
+            }
+            cost = 1;
+        } else if (strcmp(argv[i], "--listing") == 0 && i + 1 < argc) {
+            listing = argv[++i];
+        } else if (strcmp(argv[i], "--no-fuse") == 0) {
+            fuse = 0;
+        } else if (strcmp(argv[i], "--sync-io") == 0) {
+            H.sync_io = 1;
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             usage(argv[0]);
             return 0;
@@ -85,6 +272,12 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (perf) {
+        if (halmat_perf_open(&H, perf == 2) != 0)
+            fprintf(stderr, "yaHALMAT: cannot allocate counters, running without\n");
+        halmat_perf_phase(&H, HALMAT_PERF_LOAD);
+    }
+
     if (halmat_load(&H, halmat_file) != 0) {
         fprintf(stderr, "Failed to load %s\n", halmat_file);
         return 1;
@@ -120,7 +313,8 @@ int main(int argc, char *argv[])
         } else {
             snprintf(autosrc, sizeof(autosrc), "SOURCECO.txt");
         }
-        halmat_load_strings(&H, autosrc); /* silent failure OK */
+        if (halmat_load_strings(&H, autosrc) == 0) /* silent failure OK */
+            halmat_load_declares(&H, autosrc);
 
         /* Fallback: out_<name>/halmat.bin → test_<name>.hal in parent dir */
         if (H.lit_str_pool_used <= 1 && sep3) {
@@ -134,32 +328,113 @@ int main(int argc, char *argv[])
                 snprintf(autosrc, sizeof(autosrc), "%.*stest_%.*s.hal",
                          parent_len, halmat_file,
                          dir_name_len - 4, dir_start + 4);
-                halmat_load_strings(&H, autosrc);
+                if (halmat_load_strings(&H, autosrc) == 0)
+                    halmat_load_declares(&H, autosrc);
             }
         }
     }
 
+    if (H.translate_ebcdic)
+        halmat_transcode_literals(&H);
+
+    halmat_perf_phase(&H, HALMAT_PERF_ANALYSIS);
     halmat_build_flow_table(&H);
 
+    if (decode_trace)
+        return halmat_trace_decode(&H, decode_trace, stdout) == 0 ? 0 : 1;
+
+    if (coverage || coverage_counts || coverage_in) {
+        if (halmat_cov_init(&H, coverage_counts) != 0) {
+            fprintf(stderr, "yaHALMAT: cannot allocate coverage map\n");
+            return 1;
+        }
+        for (int i = 1; i < argc - 1; i++)
+            if (strcmp(argv[i], "--coverage-in") == 0 &&
+                halmat_cov_merge(&H, argv[++i]) != 0)
+                return 1;
+    }
+
     if (disasm_only) {
         printf("HALMAT DISASSEMBLY: %s\n", halmat_file);
         printf("%u bytes, %u block(s)\n\n",
                H.num_blocks * HALMAT_BLOCK_BYTES, H.num_blocks);
         halmat_disasm(&H, stdout);
-        return 0;
+        int rc = coverage ? halmat_cov_write(&H, coverage) : 0;
+        halmat_cov_free(&H);
+        return rc ? 1 : 0;
+    }
+
+    if (profile_stacks && !profile_sample)
+        profile = profile_stmt = 1;
+    if (profile)
+        fuse = 0;               /* every operator is counted */
+    if (trace_bin)
+        fuse = 0;               /* every operator is recorded */
+    if (debug || trace) {
+        H.sched_threads = 0;    /* stepping needs a single interpreter */
+        H.sync_io = 1;          /* keep output in step with the listing */
+        fuse = 0;               /* one operator per step */
+    }
+    if (cost) {
+        H.sched_threads = 0;    /* one set of per-process counts */
+        fuse = 0;               /* every operator is costed */
+        if (halmat_cost_init(&H, cost_model, frame_ms) != 0)
+            return 1;
+    }
+    halmat_struct_build(&H);
+    halmat_array_build(&H, fuse);
+    if (fuse) {
+        halmat_fuse_build(&H);
+        halmat_char_build(&H);
     }
 
     halmat_io_init(&H);
 
+    if (profile) {
+        H.sched_threads = 0;    /* the counters are not shared */
+        if (halmat_prof_init(&H, profile_rate, profile_json) != 0)
+            fprintf(stderr, "yaHALMAT: cannot allocate profile, running without\n");
+    }
+    if (trace_bin) {
+        H.sched_threads = 0;    /* one ring, one producer */
+        if (halmat_trace_open(&H, trace_bin, trace_results) != 0)
+            return 1;
+    }
+    char autolst[512];
+    if ((profile_stmt || profile_sample) && !listing) {
+        const char *sep = strrchr(halmat_file, '/');
+        const char *sep2 = strrchr(halmat_file, '\\');
+        if (sep2 && (!sep || sep2 > sep)) sep = sep2;
+        if (sep)
+            snprintf(autolst, sizeof(autolst), "%.*sLISTING2.txt",
+                     (int)(sep - halmat_file + 1), halmat_file);
+        else
+            snprintf(autolst, sizeof(autolst), "LISTING2.txt");
+        listing = autolst;
+    }
+    if (profile_stmt && H.prof) {
+        if (halmat_prof_stmt_init(&H, listing, profile_stacks) != 0)
+            fprintf(stderr, "yaHALMAT: cannot allocate statement profile\n");
+    }
+    if (profile_sample) {
+        H.sched_threads = 0;    /* one interpreter to sample */
+        if (halmat_prof_sample_start(&H, sample_hz, listing, profile_stacks) != 0)
+            fprintf(stderr, "yaHALMAT: cannot start the sampling profiler\n");
+    }
+
+    if (perf)
+        H.sched_threads = 0;    /* the counters follow one thread */
+    if (H.cov && H.cov->hits)
+        H.sched_threads = 0;    /* hit counters are not atomic */
+    halmat_perf_phase(&H, HALMAT_PERF_EXEC);
+
     if (debug) {
         halmat_debug_init(&H);
-        while (!H.halted) {
-            if (H.single_step || halmat_debug_check_breakpoint(&H)) {
-                halmat_debug_prompt(&H);
-                if (H.halted) break;
-            }
-            halmat_step(&H);
-        }
+        if (snap_interval && halmat_replay_init(&H, snap_interval, snap_mem) != 0)
+            fprintf(stderr, "yaHALMAT: cannot allocate snapshots, no reverse execution\n");
+        halmat_debug_run(&H);
+        halmat_replay_free(&H);
+        halmat_debug_free(&H);
     } else {
         if (trace) {
             while (!H.halted) {
@@ -177,12 +452,35 @@ int main(int argc, char *argv[])
         }
     }
 
+    halmat_perf_phase(&H, HALMAT_PERF_NONE);
+    halmat_trace_close(&H);
+    halmat_prof_sample_stop(&H, stderr);
+    halmat_prof_report(&H, stderr);
+    halmat_prof_free(&H);
+    halmat_perf_phase(&H, HALMAT_PERF_SHUTDOWN);
     halmat_io_shutdown(&H);
+    halmat_perf_phase(&H, HALMAT_PERF_NONE);
+    halmat_perf_report(&H, stderr);
+    halmat_perf_free(&H);
+    halmat_cost_report(&H, stderr);
+    halmat_cost_free(&H);
+    int cov_rc = 0;
+    if (H.cov) {
+        halmat_cov_summary(&H, stderr);
+        if (coverage)
+            cov_rc = halmat_cov_write(&H, coverage);
+        halmat_cov_free(&H);
+    }
+    halmat_sched_free(&H);
+    halmat_fuse_free(&H);
+    halmat_char_free(&H);
+    halmat_array_free(&H);
+    halmat_struct_free(&H);
 
     if (H.halted < 0) {
         fprintf(stderr, "yaHALMAT: execution error at PC=%u\n", H.pc);
         return 1;
     }
 
-    return 0;
+    return cov_rc ? 1 : 0;
 }